@@ -29,13 +29,11 @@
  */
 
 #include "libavutil/attributes.h"
-#include "libavutil/audio_fifo.h"
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/channel_layout.h"
 #include "libavutil/common.h"
 #include "libavutil/eval.h"
-#include "libavutil/float_dsp.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/samplefmt.h"
@@ -47,117 +45,15 @@
 #include "internal.h"
 
 #define INPUT_ON       1    /**< input is active */
-#define INPUT_EOF      2    /**< input has reached EOF (may still be active) */
 
 #define DURATION_LONGEST  0
 #define DURATION_SHORTEST 1
 #define DURATION_FIRST    2
 
-
-typedef struct FrameInfo {
-    int nb_samples;
-    int64_t pts;
-    struct FrameInfo *next;
-} FrameInfo;
-
-/**
- * Linked list used to store timestamps and frame sizes of all frames in the
- * FIFO for the first input.
- *
- * This is needed to keep timestamps synchronized for the case where multiple
- * input frames are pushed to the filter for processing before a frame is
- * requested by the output link.
- */
-typedef struct FrameList {
-    int nb_frames;
-    int nb_samples;
-    FrameInfo *list;
-    FrameInfo *end;
-} FrameList;
-
-static void frame_list_clear(FrameList *frame_list)
-{
-    if (frame_list) {
-        while (frame_list->list) {
-            FrameInfo *info = frame_list->list;
-            frame_list->list = info->next;
-            av_free(info);
-        }
-        frame_list->nb_frames  = 0;
-        frame_list->nb_samples = 0;
-        frame_list->end        = NULL;
-    }
-}
-
-static int frame_list_next_frame_size(FrameList *frame_list)
-{
-    if (!frame_list->list)
-        return 0;
-    return frame_list->list->nb_samples;
-}
-
-static int64_t frame_list_next_pts(FrameList *frame_list)
-{
-    if (!frame_list->list)
-        return AV_NOPTS_VALUE;
-    return frame_list->list->pts;
-}
-
-static void frame_list_remove_samples(FrameList *frame_list, int nb_samples)
-{
-    if (nb_samples >= frame_list->nb_samples) {
-        frame_list_clear(frame_list);
-    } else {
-        int samples = nb_samples;
-        while (samples > 0) {
-            FrameInfo *info = frame_list->list;
-            av_assert0(info);
-            if (info->nb_samples <= samples) {
-                samples -= info->nb_samples;
-                frame_list->list = info->next;
-                if (!frame_list->list)
-                    frame_list->end = NULL;
-                frame_list->nb_frames--;
-                frame_list->nb_samples -= info->nb_samples;
-                av_free(info);
-            } else {
-                info->nb_samples       -= samples;
-                info->pts              += samples;
-                frame_list->nb_samples -= samples;
-                samples = 0;
-            }
-        }
-    }
-}
-
-static int frame_list_add_frame(FrameList *frame_list, int nb_samples, int64_t pts)
-{
-    FrameInfo *info = av_malloc(sizeof(*info));
-    if (!info)
-        return AVERROR(ENOMEM);
-    info->nb_samples = nb_samples;
-    info->pts        = pts;
-    info->next       = NULL;
-
-    if (!frame_list->list) {
-        frame_list->list = info;
-        frame_list->end  = info;
-    } else {
-        av_assert0(frame_list->end);
-        frame_list->end->next = info;
-        frame_list->end       = info;
-    }
-    frame_list->nb_frames++;
-    frame_list->nb_samples += nb_samples;
-
-    return 0;
-}
-
-/* FIXME: use directly links fifo */
+#define MIX_BLOCK 256
 
 typedef struct MixContext {
     const AVClass *class;       /**< class for AVOptions */
-    AVFloatDSPContext *fdsp;
 
     int nb_inputs;              /**< number of inputs */
     int active_inputs;          /**< number of input currently active */
@@ -165,18 +61,27 @@ typedef struct MixContext {
     float dropout_transition;   /**< transition time when an input drops out */
     char *weights_str;          /**< string for custom weights for every input */
     int normalize;              /**< if inputs are scaled */
+    int integer;                /**< if integer inputs are mixed without conversion */
 
     int nb_channels;            /**< number of channels */
     int sample_rate;            /**< sample rate */
     int planar;
-    AVAudioFifo **fifos;        /**< audio fifo for each input */
     uint8_t *input_state;       /**< current state of each input */
     float *input_scale;         /**< mixing scale factor for each input */
     float *weights;             /**< custom weights for every input */
     float weight_sum;           /**< sum of custom weights for every input */
     float *scale_norm;          /**< normalization factor for every input */
     int64_t next_pts;           /**< calculated pts for next output frame */
-    FrameList *frame_list;      /**< list of frame info for the first input */
+    AVFrame **frames;           /**< input frames being mixed */
+    const uint8_t **src;        /**< plane pointers of the mixed inputs */
+    float *src_scale;           /**< scale factors of the mixed inputs */
+
+    /**
+     * Set dst[n] to the sum of src[i][n] * scale[i] over all i < nb_src,
+     * for n < len. dst may be one of the sources.
+     */
+    void (*mix)(uint8_t *dst, const uint8_t *const *src, const float *scale,
+                int nb_src, ptrdiff_t len);
 } MixContext;
 
 #define OFFSET(x) offsetof(MixContext, x)
@@ -198,6 +103,8 @@ static const AVOption amix_options[] = {
             OFFSET(weights_str), AV_OPT_TYPE_STRING, {.str="1 1"}, 0, 0, A|F|T },
     { "normalize", "Scale inputs",
             OFFSET(normalize), AV_OPT_TYPE_BOOL, {.i64=1}, 0, 1, A|F|T },
+    { "integer", "Mix integer inputs without conversion",
+            OFFSET(integer), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, A|F },
     { NULL }
 };
 
@@ -241,6 +148,41 @@ static void calculate_scales(MixContext *s, int nb_samples)
     }
 }
 
+#define MIX_FUNC(name, type, ftype, conv)                                       \
+static void mix_##name##_c(uint8_t *dst, const uint8_t *const *src,           \
+                           const float *scale, int nb_src, ptrdiff_t len)     \
+{                                                                             \
+    type *d = (type *)dst;                                                    \
+    ftype sum[MIX_BLOCK];                                                     \
+                                                                              \
+    for (ptrdiff_t n = 0; n < len; n += MIX_BLOCK) {                          \
+        const int block = FFMIN(len - n, MIX_BLOCK);                          \
+                                                                              \
+        for (int j = 0; j < block; j++)                                       \
+            sum[j] = 0;                                                       \
+                                                                              \
+        for (int i = 0; i < nb_src; i++) {                                    \
+            const type *s = (const type *)src[i] + n;                         \
+            const ftype g = scale[i];                                         \
+                                                                              \
+            for (int j = 0; j < block; j++)                                   \
+                sum[j] += s[j] * g;                                           \
+        }                                                                     \
+                                                                              \
+        for (int j = 0; j < block; j++)                                       \
+            d[n + j] = conv(sum[j]);                                          \
+    }                                                                         \
+}
+
+#define CONV_FLT(x) (x)
+#define CONV_S16(x) av_clip_int16(lrintf(x))
+#define CONV_S32(x) av_clipl_int32(llrint(x))
+
+MIX_FUNC(s16, int16_t, float,  CONV_S16)
+MIX_FUNC(s32, int32_t, double, CONV_S32)
+MIX_FUNC(flt, float,   float,  CONV_FLT)
+MIX_FUNC(dbl, double,  double, CONV_FLT)
+
 static int config_output(AVFilterLink *outlink)
 {
     AVFilterContext *ctx = outlink->src;
@@ -252,22 +194,14 @@ static int config_output(AVFilterLink *outlink)
     s->sample_rate     = outlink->sample_rate;
     outlink->time_base = (AVRational){ 1, outlink->sample_rate };
     s->next_pts        = AV_NOPTS_VALUE;
+    s->nb_channels     = outlink->channels;
 
-    s->frame_list = av_mallocz(sizeof(*s->frame_list));
-    if (!s->frame_list)
+    s->frames    = av_mallocz_array(s->nb_inputs, sizeof(*s->frames));
+    s->src       = av_malloc_array(s->nb_inputs, sizeof(*s->src));
+    s->src_scale = av_malloc_array(s->nb_inputs, sizeof(*s->src_scale));
+    if (!s->frames || !s->src || !s->src_scale)
         return AVERROR(ENOMEM);
 
-    s->fifos = av_mallocz_array(s->nb_inputs, sizeof(*s->fifos));
-    if (!s->fifos)
-        return AVERROR(ENOMEM);
-
-    s->nb_channels = outlink->channels;
-    for (i = 0; i < s->nb_inputs; i++) {
-        s->fifos[i] = av_audio_fifo_alloc(outlink->format, s->nb_channels, 1024);
-        if (!s->fifos[i])
-            return AVERROR(ENOMEM);
-    }
-
     s->input_state = av_malloc(s->nb_inputs);
     if (!s->input_state)
         return AVERROR(ENOMEM);
@@ -282,6 +216,13 @@ static int config_output(AVFilterLink *outlink)
         s->scale_norm[i] = s->weight_sum / FFABS(s->weights[i]);
     calculate_scales(s, 0);
 
+    switch (av_get_packed_sample_fmt(outlink->format)) {
+    case AV_SAMPLE_FMT_S16: s->mix = mix_s16_c; break;
+    case AV_SAMPLE_FMT_S32: s->mix = mix_s32_c; break;
+    case AV_SAMPLE_FMT_FLT: s->mix = mix_flt_c; break;
+    case AV_SAMPLE_FMT_DBL: s->mix = mix_dbl_c; break;
+    }
+
     av_get_channel_layout_string(buf, sizeof(buf), -1, outlink->channel_layout);
 
     av_log(ctx, AV_LOG_VERBOSE,
@@ -292,23 +233,46 @@ static int config_output(AVFilterLink *outlink)
 }
 
 /**
- * Read samples from the input FIFOs, mix, and write to the output link.
+ * Take exactly nb_samples samples from an input.
+ */
+static int consume_input(AVFilterContext *ctx, int i, int nb_samples,
+                         AVFrame **rframe)
+{
+    int ret = ff_inlink_consume_samples(ctx->inputs[i], nb_samples, nb_samples, rframe);
+    if (ret < 0)
+        return ret;
+    av_assert0(ret > 0 && (*rframe)->nb_samples == nb_samples);
+
+    return 0;
+}
+
+/**
+ * Mix the queued samples of all active inputs and write them to the
+ * output link.
+ *
+ * @return 1 if a frame was output, 0 if more input is needed
  */
 static int output_frame(AVFilterLink *outlink)
 {
     AVFilterContext *ctx = outlink->src;
     MixContext      *s = ctx->priv;
-    AVFrame *out_buf, *in_buf;
-    int nb_samples, ns, i;
+    AVFrame *out_buf = NULL;
+    int nb_samples, ns, i, p, planes, plane_size, nb_src = 0, ret = 0;
 
     if (s->input_state[0] & INPUT_ON) {
+        AVFilterLink *inlink = ctx->inputs[0];
+        AVFrame *frame;
+
         /* first input live: use the corresponding frame size */
-        nb_samples = frame_list_next_frame_size(s->frame_list);
+        if (!ff_inlink_queued_frames(inlink))
+            return 0;
+        frame = ff_inlink_peek_frame(inlink, 0);
+        nb_samples = frame->nb_samples;
         for (i = 1; i < s->nb_inputs; i++) {
             if (s->input_state[i] & INPUT_ON) {
-                ns = av_audio_fifo_size(s->fifos[i]);
+                ns = ff_inlink_queued_samples(ctx->inputs[i]);
                 if (ns < nb_samples) {
-                    if (!(s->input_state[i] & INPUT_EOF))
+                    if (!ff_outlink_get_status(ctx->inputs[i]))
                         /* unclosed input with not enough samples */
                         return 0;
                     /* closed input to drain */
@@ -317,13 +281,14 @@ static int output_frame(AVFilterLink *outlink)
             }
         }
 
-        s->next_pts = frame_list_next_pts(s->frame_list);
+        s->next_pts = frame->pts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE :
+                      av_rescale_q(frame->pts, inlink->time_base, outlink->time_base);
     } else {
         /* first input closed: use the available samples */
         nb_samples = INT_MAX;
         for (i = 1; i < s->nb_inputs; i++) {
             if (s->input_state[i] & INPUT_ON) {
-                ns = av_audio_fifo_size(s->fifos[i]);
+                ns = ff_inlink_queued_samples(ctx->inputs[i]);
                 nb_samples = FFMIN(nb_samples, ns);
             }
         }
@@ -333,78 +298,66 @@ static int output_frame(AVFilterLink *outlink)
         }
     }
 
-    frame_list_remove_samples(s->frame_list, nb_samples);
-
     calculate_scales(s, nb_samples);
 
     if (nb_samples == 0)
         return 0;
 
-    out_buf = ff_get_audio_buffer(outlink, nb_samples);
-    if (!out_buf)
-        return AVERROR(ENOMEM);
-
-    in_buf = ff_get_audio_buffer(outlink, nb_samples);
-    if (!in_buf) {
-        av_frame_free(&out_buf);
-        return AVERROR(ENOMEM);
-    }
+    planes     = s->planar ? s->nb_channels : 1;
+    plane_size = nb_samples * (s->planar ? 1 : s->nb_channels);
 
     for (i = 0; i < s->nb_inputs; i++) {
-        if (s->input_state[i] & INPUT_ON) {
-            int planes, plane_size, p;
-
-            av_audio_fifo_read(s->fifos[i], (void **)in_buf->extended_data,
-                               nb_samples);
+        if (!(s->input_state[i] & INPUT_ON))
+            continue;
 
-            planes     = s->planar ? s->nb_channels : 1;
-            plane_size = nb_samples * (s->planar ? 1 : s->nb_channels);
-            plane_size = FFALIGN(plane_size, 16);
+        ret = consume_input(ctx, i, nb_samples, &s->frames[nb_src]);
+        if (ret < 0)
+            goto end;
+        s->src_scale[nb_src] = s->input_scale[i];
+        nb_src++;
+    }
 
-            if (out_buf->format == AV_SAMPLE_FMT_FLT ||
-                out_buf->format == AV_SAMPLE_FMT_FLTP) {
-                for (p = 0; p < planes; p++) {
-                    s->fdsp->vector_fmac_scalar((float *)out_buf->extended_data[p],
-                                                (float *) in_buf->extended_data[p],
-                                                s->input_scale[i], plane_size);
-                }
-            } else {
-                for (p = 0; p < planes; p++) {
-                    s->fdsp->vector_dmac_scalar((double *)out_buf->extended_data[p],
-                                                (double *) in_buf->extended_data[p],
-                                                s->input_scale[i], plane_size);
-                }
-            }
+    /* mix in place into the first input if possible, so that the output
+     * always carries the properties of the first input */
+    if (av_frame_is_writable(s->frames[0])) {
+        out_buf = av_frame_clone(s->frames[0]);
+        if (!out_buf) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+    } else {
+        out_buf = ff_get_audio_buffer(outlink, nb_samples);
+        if (!out_buf) {
+            ret = AVERROR(ENOMEM);
+            goto end;
         }
+        ret = av_frame_copy_props(out_buf, s->frames[0]);
+        if (ret < 0)
+            goto end;
     }
-    av_frame_free(&in_buf);
+
+    for (p = 0; p < planes; p++) {
+        for (i = 0; i < nb_src; i++)
+            s->src[i] = s->frames[i]->extended_data[p];
+        s->mix(out_buf->extended_data[p], s->src, s->src_scale,
+               nb_src, plane_size);
+    }
+    emms_c();
 
     out_buf->pts = s->next_pts;
     if (s->next_pts != AV_NOPTS_VALUE)
         s->next_pts += nb_samples;
 
-    return ff_filter_frame(outlink, out_buf);
-}
-
-/**
- * Requests a frame, if needed, from each input link other than the first.
- */
-static int request_samples(AVFilterContext *ctx, int min_samples)
-{
-    MixContext *s = ctx->priv;
-    int i;
-
-    av_assert0(s->nb_inputs > 1);
-
-    for (i = 1; i < s->nb_inputs; i++) {
-        if (!(s->input_state[i] & INPUT_ON) ||
-             (s->input_state[i] & INPUT_EOF))
-            continue;
-        if (av_audio_fifo_size(s->fifos[i]) >= min_samples)
-            continue;
-        ff_inlink_request_frame(ctx->inputs[i]);
+end:
+    for (i = 0; i < nb_src; i++)
+        av_frame_free(&s->frames[i]);
+    if (ret < 0) {
+        av_frame_free(&out_buf);
+        return ret;
     }
-    return output_frame(ctx->outputs[0]);
+
+    ret = ff_filter_frame(outlink, out_buf);
+    return ret < 0 ? ret : 1;
 }
 
 /**
@@ -432,57 +385,20 @@ static int activate(AVFilterContext *ctx)
 {
     AVFilterLink *outlink = ctx->outputs[0];
     MixContext *s = ctx->priv;
-    AVFrame *buf = NULL;
     int i, ret;
 
     FF_FILTER_FORWARD_STATUS_BACK_ALL(outlink, ctx);
 
-    for (i = 0; i < s->nb_inputs; i++) {
-        AVFilterLink *inlink = ctx->inputs[i];
-
-        if ((ret = ff_inlink_consume_frame(ctx->inputs[i], &buf)) > 0) {
-            if (i == 0) {
-                int64_t pts = av_rescale_q(buf->pts, inlink->time_base,
-                                           outlink->time_base);
-                ret = frame_list_add_frame(s->frame_list, buf->nb_samples, pts);
-                if (ret < 0) {
-                    av_frame_free(&buf);
-                    return ret;
-                }
-            }
-
-            ret = av_audio_fifo_write(s->fifos[i], (void **)buf->extended_data,
-                                      buf->nb_samples);
-            if (ret < 0) {
-                av_frame_free(&buf);
-                return ret;
-            }
-
-            av_frame_free(&buf);
-
-            ret = output_frame(outlink);
-            if (ret < 0)
-                return ret;
-        }
-    }
-
     for (i = 0; i < s->nb_inputs; i++) {
         int64_t pts;
         int status;
 
         if (ff_inlink_acknowledge_status(ctx->inputs[i], &status, &pts)) {
             if (status == AVERROR_EOF) {
-                if (i == 0) {
-                    s->input_state[i] = 0;
-                    if (s->nb_inputs == 1) {
-                        ff_outlink_set_status(outlink, status, pts);
-                        return 0;
-                    }
-                } else {
-                    s->input_state[i] |= INPUT_EOF;
-                    if (av_audio_fifo_size(s->fifos[i]) == 0) {
-                        s->input_state[i] = 0;
-                    }
+                s->input_state[i] = 0;
+                if (i == 0 && s->nb_inputs == 1) {
+                    ff_outlink_set_status(outlink, status, pts);
+                    return 0;
                 }
             }
         }
@@ -493,24 +409,39 @@ static int activate(AVFilterContext *ctx)
         return 0;
     }
 
-    if (ff_outlink_frame_wanted(outlink)) {
-        int wanted_samples;
+    ret = output_frame(outlink);
+    if (ret < 0)
+        return ret;
+    if (ret > 0) {
+        /* more input may already be queued */
+        ff_filter_set_ready(ctx, 10);
+        return 0;
+    }
 
-        if (!(s->input_state[0] & INPUT_ON))
-            return request_samples(ctx, 1);
+    if (ff_outlink_frame_wanted(outlink)) {
+        int wanted_samples = 1;
 
-        if (s->frame_list->nb_frames == 0) {
-            ff_inlink_request_frame(ctx->inputs[0]);
-            return 0;
+        if (s->input_state[0] & INPUT_ON) {
+            if (!ff_inlink_queued_frames(ctx->inputs[0])) {
+                ff_inlink_request_frame(ctx->inputs[0]);
+                return 0;
+            }
+            wanted_samples = ff_inlink_peek_frame(ctx->inputs[0], 0)->nb_samples;
         }
-        av_assert0(s->frame_list->nb_frames > 0);
 
-        wanted_samples = frame_list_next_frame_size(s->frame_list);
-
-        return request_samples(ctx, wanted_samples);
+        /* requests a frame, if needed, from each input link other than the first */
+        for (i = 1; i < s->nb_inputs; i++) {
+            if (!(s->input_state[i] & INPUT_ON) ||
+                ff_outlink_get_status(ctx->inputs[i]))
+                continue;
+            if (ff_inlink_queued_samples(ctx->inputs[i]) >= wanted_samples)
+                continue;
+            ff_inlink_request_frame(ctx->inputs[i]);
+        }
+        return 0;
     }
 
-    return 0;
+    return FFERROR_NOT_READY;
 }
 
 static void parse_weights(AVFilterContext *ctx)
@@ -559,10 +490,6 @@ static av_cold int init(AVFilterContext *ctx)
         }
     }
 
-    s->fdsp = avpriv_float_dsp_alloc(0);
-    if (!s->fdsp)
-        return AVERROR(ENOMEM);
-
     s->weights = av_mallocz_array(s->nb_inputs, sizeof(*s->weights));
     if (!s->weights)
         return AVERROR(ENOMEM);
@@ -577,18 +504,17 @@ static av_cold void uninit(AVFilterContext *ctx)
     int i;
     MixContext *s = ctx->priv;
 
-    if (s->fifos) {
+    if (s->frames) {
         for (i = 0; i < s->nb_inputs; i++)
-            av_audio_fifo_free(s->fifos[i]);
-        av_freep(&s->fifos);
+            av_frame_free(&s->frames[i]);
+        av_freep(&s->frames);
     }
-    frame_list_clear(s->frame_list);
-    av_freep(&s->frame_list);
+    av_freep(&s->src);
+    av_freep(&s->src_scale);
     av_freep(&s->input_state);
     av_freep(&s->input_scale);
     av_freep(&s->scale_norm);
     av_freep(&s->weights);
-    av_freep(&s->fdsp);
 
     for (i = 0; i < ctx->nb_inputs; i++)
         av_freep(&ctx->input_pads[i].name);
@@ -601,9 +527,18 @@ static int query_formats(AVFilterContext *ctx)
         AV_SAMPLE_FMT_DBL, AV_SAMPLE_FMT_DBLP,
         AV_SAMPLE_FMT_NONE
     };
+    static const enum AVSampleFormat integer_sample_fmts[] = {
+        AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_FLTP,
+        AV_SAMPLE_FMT_DBL, AV_SAMPLE_FMT_DBLP,
+        AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S16P,
+        AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_S32P,
+        AV_SAMPLE_FMT_NONE
+    };
+    MixContext *s = ctx->priv;
     int ret;
 
-    if ((ret = ff_set_common_formats(ctx, ff_make_format_list(sample_fmts))) < 0 ||
+    if ((ret = ff_set_common_formats(ctx, ff_make_format_list(s->integer ? integer_sample_fmts
+                                                                          : sample_fmts))) < 0 ||
         (ret = ff_set_common_samplerates(ctx, ff_all_samplerates())) < 0)
         return ret;
 
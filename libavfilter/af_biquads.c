@@ -766,8 +766,8 @@ static int filter_channel(AVFilterContext *ctx, void *arg, int jobnr, int nb_job
     AVFrame *buf = td->in;
     AVFrame *out_buf = td->out;
     BiquadsContext *s = ctx->priv;
-    const int start = (buf->channels * jobnr) / nb_jobs;
-    const int end = (buf->channels * (jobnr+1)) / nb_jobs;
+    const int start = ff_audio_channels_start(buf->channels, jobnr, nb_jobs);
+    const int end = ff_audio_channels_start(buf->channels, jobnr + 1, nb_jobs);
     int ch;
 
     for (ch = start; ch < end; ch++) {
@@ -811,7 +811,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
 
     td.in = buf;
     td.out = out_buf;
-    ctx->internal->execute(ctx, filter_channel, &td, NULL, FFMIN(outlink->channels, ff_filter_get_nb_threads(ctx)));
+    ff_filter_execute_channels(ctx, filter_channel, &td, outlink->channels);
 
     for (ch = 0; ch < outlink->channels; ch++) {
         if (s->cache[ch].clippings > 0)
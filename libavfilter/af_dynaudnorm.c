@@ -86,6 +86,15 @@ typedef struct DynamicAudioNormalizerContext {
     cqueue *is_enabled;
 } DynamicAudioNormalizerContext;
 
+typedef struct ThreadData {
+    AVFrame *frame;
+    int is_first_frame;
+    int enabled;
+    local_gain gain;
+    double prev_actual_thresh;
+    double curr_actual_thresh;
+} ThreadData;
+
 #define OFFSET(x) offsetof(DynamicAudioNormalizerContext, x)
 #define FLAGS AV_OPT_FLAG_AUDIO_PARAM|AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_RUNTIME_PARAM
 
@@ -540,13 +549,18 @@ static inline double update_value(double new, double old, double aggressiveness)
     return aggressiveness * new + (1.0 - aggressiveness) * old;
 }
 
-static void perform_dc_correction(DynamicAudioNormalizerContext *s, AVFrame *frame)
+static int dc_correction_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    DynamicAudioNormalizerContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *frame = td->frame;
+    const int is_first_frame = td->is_first_frame;
     const double diff = 1.0 / frame->nb_samples;
-    int is_first_frame = cqueue_empty(s->gain_history_original[0]);
+    const int start = ff_audio_channels_start(s->channels, jobnr, nb_jobs);
+    const int end = ff_audio_channels_start(s->channels, jobnr + 1, nb_jobs);
     int c, i;
 
-    for (c = 0; c < s->channels; c++) {
+    for (c = start; c < end; c++) {
         double *dst_ptr = (double *)frame->extended_data[c];
         double current_average_value = 0.0;
         double prev_value;
@@ -561,6 +575,8 @@ static void perform_dc_correction(DynamicAudioNormalizerContext *s, AVFrame *fra
             dst_ptr[i] -= fade(prev_value, s->dc_correction_value[c], i, frame->nb_samples);
         }
     }
+
+    return 0;
 }
 
 static double setup_compress_thresh(double threshold)
@@ -612,23 +628,21 @@ static double compute_frame_std_dev(DynamicAudioNormalizerContext *s,
     return FFMAX(sqrt(variance), DBL_EPSILON);
 }
 
-static void perform_compression(DynamicAudioNormalizerContext *s, AVFrame *frame)
+static int compress_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    int is_first_frame = cqueue_empty(s->gain_history_original[0]);
+    DynamicAudioNormalizerContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *frame = td->frame;
+    const int is_first_frame = td->is_first_frame;
+    const int start = ff_audio_channels_start(s->channels, jobnr, nb_jobs);
+    const int end = ff_audio_channels_start(s->channels, jobnr + 1, nb_jobs);
     int c, i;
 
     if (s->channels_coupled) {
-        const double standard_deviation = compute_frame_std_dev(s, frame, -1);
-        const double current_threshold  = FFMIN(1.0, s->compress_factor * standard_deviation);
-
-        const double prev_value = is_first_frame ? current_threshold : s->compress_threshold[0];
-        double prev_actual_thresh, curr_actual_thresh;
-        s->compress_threshold[0] = is_first_frame ? current_threshold : update_value(current_threshold, s->compress_threshold[0], (1.0/3.0));
-
-        prev_actual_thresh = setup_compress_thresh(prev_value);
-        curr_actual_thresh = setup_compress_thresh(s->compress_threshold[0]);
+        const double prev_actual_thresh = td->prev_actual_thresh;
+        const double curr_actual_thresh = td->curr_actual_thresh;
 
-        for (c = 0; c < s->channels; c++) {
+        for (c = start; c < end; c++) {
             double *const dst_ptr = (double *)frame->extended_data[c];
             for (i = 0; i < frame->nb_samples; i++) {
                 const double localThresh = fade(prev_actual_thresh, curr_actual_thresh, i, frame->nb_samples);
@@ -636,7 +650,7 @@ static void perform_compression(DynamicAudioNormalizerContext *s, AVFrame *frame
             }
         }
     } else {
-        for (c = 0; c < s->channels; c++) {
+        for (c = start; c < end; c++) {
             const double standard_deviation = compute_frame_std_dev(s, frame, c);
             const double current_threshold  = setup_compress_thresh(FFMIN(1.0, s->compress_factor * standard_deviation));
 
@@ -655,37 +669,67 @@ static void perform_compression(DynamicAudioNormalizerContext *s, AVFrame *frame
             }
         }
     }
+
+    return 0;
+}
+
+static int update_gain_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    DynamicAudioNormalizerContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int start = ff_audio_channels_start(s->channels, jobnr, nb_jobs);
+    const int end = ff_audio_channels_start(s->channels, jobnr + 1, nb_jobs);
+    int c;
+
+    for (c = start; c < end; c++)
+        update_gain_history(s, c, s->channels_coupled ? td->gain :
+                                  get_max_local_gain(s, td->frame, c));
+
+    return 0;
 }
 
-static void analyze_frame(DynamicAudioNormalizerContext *s, AVFrame *frame)
+static void analyze_frame(AVFilterContext *ctx, AVFrame *frame)
 {
+    DynamicAudioNormalizerContext *s = ctx->priv;
+    ThreadData td;
+
+    td.frame = frame;
+    td.is_first_frame = cqueue_empty(s->gain_history_original[0]);
+
     if (s->dc_correction) {
-        perform_dc_correction(s, frame);
+        ff_filter_execute_channels(ctx, dc_correction_channels, &td, s->channels);
     }
 
     if (s->compress_factor > DBL_EPSILON) {
-        perform_compression(s, frame);
-    }
+        if (s->channels_coupled) {
+            const double standard_deviation = compute_frame_std_dev(s, frame, -1);
+            const double current_threshold  = FFMIN(1.0, s->compress_factor * standard_deviation);
+            const double prev_value = td.is_first_frame ? current_threshold : s->compress_threshold[0];
 
-    if (s->channels_coupled) {
-        const local_gain gain = get_max_local_gain(s, frame, -1);
-        int c;
+            s->compress_threshold[0] = td.is_first_frame ? current_threshold : update_value(current_threshold, s->compress_threshold[0], (1.0/3.0));
 
-        for (c = 0; c < s->channels; c++)
-            update_gain_history(s, c, gain);
-    } else {
-        int c;
-
-        for (c = 0; c < s->channels; c++)
-            update_gain_history(s, c, get_max_local_gain(s, frame, c));
+            td.prev_actual_thresh = setup_compress_thresh(prev_value);
+            td.curr_actual_thresh = setup_compress_thresh(s->compress_threshold[0]);
+        }
+        ff_filter_execute_channels(ctx, compress_channels, &td, s->channels);
     }
+
+    if (s->channels_coupled)
+        td.gain = get_max_local_gain(s, frame, -1);
+    ff_filter_execute_channels(ctx, update_gain_channels, &td, s->channels);
 }
 
-static void amplify_frame(DynamicAudioNormalizerContext *s, AVFrame *frame, int enabled)
+static int amplify_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    DynamicAudioNormalizerContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *frame = td->frame;
+    const int enabled = td->enabled;
+    const int start = ff_audio_channels_start(s->channels, jobnr, nb_jobs);
+    const int end = ff_audio_channels_start(s->channels, jobnr + 1, nb_jobs);
     int c, i;
 
-    for (c = 0; c < s->channels; c++) {
+    for (c = start; c < end; c++) {
         double *dst_ptr = (double *)frame->extended_data[c];
         double current_amplification_factor;
 
@@ -701,6 +745,8 @@ static void amplify_frame(DynamicAudioNormalizerContext *s, AVFrame *frame, int
 
         s->prev_amplification_factor[c] = current_amplification_factor;
     }
+
+    return 0;
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
@@ -715,16 +761,19 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
            !cqueue_empty(s->gain_history_smoothed[0])) {
         AVFrame *out = ff_bufqueue_get(&s->queue);
         double is_enabled;
+        ThreadData td;
 
         cqueue_dequeue(s->is_enabled, &is_enabled);
 
-        amplify_frame(s, out, is_enabled > 0.);
+        td.frame = out;
+        td.enabled = is_enabled > 0.;
+        ff_filter_execute_channels(ctx, amplify_channels, &td, s->channels);
         s->pts = out->pts + out->nb_samples;
         ret = ff_filter_frame(outlink, out);
     }
 
     av_frame_make_writable(in);
-    analyze_frame(s, in);
+    analyze_frame(ctx, in);
     if (!s->eof) {
         ff_bufqueue_add(ctx, &s->queue, in);
         cqueue_enqueue(s->is_enabled, !ctx->is_disabled);
@@ -879,6 +928,7 @@ AVFilter ff_af_dynaudnorm = {
     .inputs        = avfilter_af_dynaudnorm_inputs,
     .outputs       = avfilter_af_dynaudnorm_outputs,
     .priv_class    = &dynaudnorm_class,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL |
+                     AVFILTER_FLAG_SLICE_THREADS,
     .process_command = process_command,
 };
@@ -61,6 +61,8 @@ typedef struct LoudNormContext {
     double offset;
     int linear;
     int dual_mono;
+    int lookahead;
+    int upsample;
     enum PrintFormat print_format;
 
     double *buf;
@@ -84,12 +86,17 @@ typedef struct LoudNormContext {
     int env_cnt;
     int attack_length;
     int release_length;
+    int peak_lookahead;
+    int peak_window;
+    int gain_offset;
 
     int64_t pts;
     enum FrameType frame_type;
     int above_threshold;
     int prev_nb_samples;
     int channels;
+    int64_t nb_in_samples;
+    int64_t nb_out_samples;
 
     FFEBUR128State *r128_in;
     FFEBUR128State *r128_out;
@@ -115,6 +122,8 @@ static const AVOption loudnorm_options[] = {
     { "offset",           "set offset gain",                   OFFSET(offset),           AV_OPT_TYPE_DOUBLE,  {.dbl =  0.},    -99.,       99.,  FLAGS },
     { "linear",           "normalize linearly if possible",    OFFSET(linear),           AV_OPT_TYPE_BOOL,    {.i64 =  1},        0,         1,  FLAGS },
     { "dual_mono",        "treat mono input as dual-mono",     OFFSET(dual_mono),        AV_OPT_TYPE_BOOL,    {.i64 =  0},        0,         1,  FLAGS },
+    { "lookahead",        "set lookahead in milliseconds",     OFFSET(lookahead),        AV_OPT_TYPE_INT,     {.i64 =  3000},   300,      3000,  FLAGS },
+    { "upsample",         "upsample to 192 kHz for true peaks", OFFSET(upsample),        AV_OPT_TYPE_BOOL,    {.i64 =  1},        0,         1,  FLAGS },
     { "print_format",     "set print format for stats",        OFFSET(print_format),     AV_OPT_TYPE_INT,     {.i64 =  NONE},  NONE,  PF_NB -1,  FLAGS, "print_format" },
     {     "none",         0,                                   0,                        AV_OPT_TYPE_CONST,   {.i64 =  NONE},     0,         0,  FLAGS, "print_format" },
     {     "json",         0,                                   0,                        AV_OPT_TYPE_CONST,   {.i64 =  JSON},     0,         0,  FLAGS, "print_format" },
@@ -164,38 +173,101 @@ static double gaussian_filter(LoudNormContext *s, int index)
     return result;
 }
 
+/**
+ * Peak magnitude of the limiter buffer around index. Without upsampling,
+ * the inter-sample peaks are estimated with the ITU-R BS.1770-4 4x
+ * interpolation filter.
+ */
+static double limiter_peak(LoudNormContext *s, int index)
+{
+    const double *buf = s->limiter_buf;
+    const int size = s->limiter_buf_size;
+    double x[FF_EBUR128_TP_TAPS], max;
+    int i;
+
+    if (index < 0)
+        index += size;
+    else if (index >= size)
+        index -= size;
+    max = fabs(buf[index]);
+    if (s->upsample)
+        return max;
+
+    index -= 5 * s->channels;
+    if (index < 0)
+        index += size;
+    for (i = 0; i < FF_EBUR128_TP_TAPS; i++) {
+        x[i] = buf[index];
+        index += s->channels;
+        if (index >= size)
+            index -= size;
+    }
+
+    return FFMAX(max, ff_ebur128_interp_peak(x));
+}
+
+static double get_peak(LoudNormContext *s, FFEBUR128State *st)
+{
+    double peak = 0.;
+
+    for (int c = 0; c < s->channels; c++) {
+        double tmp;
+        if (s->upsample)
+            ff_ebur128_sample_peak(st, c, &tmp);
+        else
+            ff_ebur128_true_peak(st, c, &tmp);
+        if (c == 0 || tmp > peak)
+            peak = tmp;
+    }
+
+    return peak;
+}
+
+/**
+ * Short-term loudness. With a short lookahead, the first measurements are
+ * done on the audio available so far instead of a zero padded 3s window.
+ */
+static void get_shortterm(LoudNormContext *s, FFEBUR128State *st,
+                          int64_t nb_samples, int sample_rate, double *out)
+{
+    const int64_t elapsed = nb_samples * 1000 / sample_rate;
+
+    if (s->lookahead < 3000 && elapsed < 3000)
+        ff_ebur128_loudness_window(st, FFMAX(elapsed, 1), out);
+    else
+        ff_ebur128_loudness_shortterm(st, out);
+}
+
 static void detect_peak(LoudNormContext *s, int offset, int nb_samples, int channels, int *peak_delta, double *peak_value)
 {
     int n, c, i, index;
     double ceiling;
-    double *buf;
 
     *peak_delta = -1;
-    buf = s->limiter_buf;
     ceiling = s->target_tp;
 
-    index = s->limiter_buf_index + (offset * channels) + (1920 * channels);
+    index = s->limiter_buf_index + (offset * channels) + (s->peak_lookahead * channels);
     if (index >= s->limiter_buf_size)
         index -= s->limiter_buf_size;
 
     if (s->frame_type == FIRST_FRAME) {
         for (c = 0; c < channels; c++)
-            s->prev_smp[c] = fabs(buf[index + c - channels]);
+            s->prev_smp[c] = limiter_peak(s, index + c - channels);
     }
 
     for (n = 0; n < nb_samples; n++) {
         for (c = 0; c < channels; c++) {
             double this, next, max_peak;
 
-            this = fabs(buf[(index + c) < s->limiter_buf_size ? (index + c) : (index + c - s->limiter_buf_size)]);
-            next = fabs(buf[(index + c + channels) < s->limiter_buf_size ? (index + c + channels) : (index + c + channels - s->limiter_buf_size)]);
+            this = limiter_peak(s, index + c);
+            next = limiter_peak(s, index + c + channels);
 
             if ((s->prev_smp[c] <= this) && (next <= this) && (this > ceiling) && (n > 0)) {
                 int detected;
 
                 detected = 1;
-                for (i = 2; i < 12; i++) {
-                    next = fabs(buf[(index + c + (i * channels)) < s->limiter_buf_size ? (index + c + (i * channels)) : (index + c + (i * channels) - s->limiter_buf_size)]);
+                for (i = 2; i < s->peak_window; i++) {
+                    next = limiter_peak(s, index + c + (i * channels));
                     if (next > this) {
                         detected = 0;
                         break;
@@ -206,10 +278,12 @@ static void detect_peak(LoudNormContext *s, int offset, int nb_samples, int chan
                     continue;
 
                 for (c = 0; c < channels; c++) {
-                    if (c == 0 || fabs(buf[index + c]) > max_peak)
-                        max_peak = fabs(buf[index + c]);
+                    const double peak = limiter_peak(s, index + c);
+
+                    if (c == 0 || peak > max_peak)
+                        max_peak = peak;
 
-                    s->prev_smp[c] = fabs(buf[(index + c) < s->limiter_buf_size ? (index + c) : (index + c - s->limiter_buf_size)]);
+                    s->prev_smp[c] = peak;
                 }
 
                 *peak_delta = n;
@@ -242,26 +316,21 @@ static void true_peak_limiter(LoudNormContext *s, double *out, int nb_samples, i
         double max;
 
         max = 0.;
-        for (n = 0; n < 1920; n++) {
+        for (n = 0; n < s->peak_lookahead; n++) {
             for (c = 0; c < channels; c++) {
-              max = fabs(buf[c]) > max ? fabs(buf[c]) : max;
+                const double peak = limiter_peak(s, n * channels + c);
+                max = peak > max ? peak : max;
             }
-            buf += channels;
         }
 
         if (max > ceiling) {
-            s->gain_reduction[1] = ceiling / max;
+            const double env = ceiling / max;
+
+            s->gain_reduction[1] = env;
             s->limiter_state = SUSTAIN;
-            buf = s->limiter_buf;
 
-            for (n = 0; n < 1920; n++) {
-                for (c = 0; c < channels; c++) {
-                    double env;
-                    env = s->gain_reduction[1];
-                    buf[c] *= env;
-                }
-                buf += channels;
-            }
+            for (n = 0; n < s->peak_lookahead * channels; n++)
+                buf[n] *= env;
         }
 
         buf = s->limiter_buf;
@@ -294,11 +363,10 @@ static void true_peak_limiter(LoudNormContext *s, double *out, int nb_samples, i
 
         case ATTACK:
             for (; s->env_cnt < s->attack_length; s->env_cnt++) {
-                for (c = 0; c < channels; c++) {
-                    double env;
-                    env = s->gain_reduction[0] - ((double) s->env_cnt / (s->attack_length - 1) * (s->gain_reduction[0] - s->gain_reduction[1]));
+                const double env = s->gain_reduction[0] - ((double) s->env_cnt / (s->attack_length - 1) * (s->gain_reduction[0] - s->gain_reduction[1]));
+
+                for (c = 0; c < channels; c++)
                     buf[s->env_index + c] *= env;
-                }
 
                 s->env_index += channels;
                 if (s->env_index >= s->limiter_buf_size)
@@ -313,7 +381,7 @@ static void true_peak_limiter(LoudNormContext *s, double *out, int nb_samples, i
 
             if (smp_cnt < nb_samples) {
                 s->env_cnt = 0;
-                s->attack_length = 1920;
+                s->attack_length = s->peak_lookahead;
                 s->limiter_state = SUSTAIN;
             }
             break;
@@ -344,11 +412,10 @@ static void true_peak_limiter(LoudNormContext *s, double *out, int nb_samples, i
                 }
 
                 for (s->env_cnt = 0; s->env_cnt < peak_delta; s->env_cnt++) {
-                    for (c = 0; c < channels; c++) {
-                        double env;
-                        env = s->gain_reduction[1];
+                    const double env = s->gain_reduction[1];
+
+                    for (c = 0; c < channels; c++)
                         buf[s->env_index + c] *= env;
-                    }
 
                     s->env_index += channels;
                     if (s->env_index >= s->limiter_buf_size)
@@ -365,11 +432,10 @@ static void true_peak_limiter(LoudNormContext *s, double *out, int nb_samples, i
 
         case RELEASE:
             for (; s->env_cnt < s->release_length; s->env_cnt++) {
-                for (c = 0; c < channels; c++) {
-                    double env;
-                    env = s->gain_reduction[0] + (((double) s->env_cnt / (s->release_length - 1)) * (s->gain_reduction[1] - s->gain_reduction[0]));
+                const double env = s->gain_reduction[0] + (((double) s->env_cnt / (s->release_length - 1)) * (s->gain_reduction[1] - s->gain_reduction[0]));
+
+                for (c = 0; c < channels; c++)
                     buf[s->env_index + c] *= env;
-                }
 
                 s->env_index += channels;
                 if (s->env_index >= s->limiter_buf_size)
@@ -392,15 +458,15 @@ static void true_peak_limiter(LoudNormContext *s, double *out, int nb_samples, i
 
     } while (smp_cnt < nb_samples);
 
-    for (n = 0; n < nb_samples; n++) {
-        for (c = 0; c < channels; c++) {
-            out[c] = buf[index + c];
-            if (fabs(out[c]) > ceiling) {
-                out[c] = ceiling * (out[c] < 0 ? -1 : 1);
-            }
-        }
-        out += channels;
-        index += channels;
+    /* copy out the contiguous runs of the ring buffer, clipped to the ceiling */
+    while (nb_samples > 0) {
+        const int len = FFMIN(nb_samples * channels, s->limiter_buf_size - index);
+
+        for (n = 0; n < len; n++)
+            out[n] = av_clipd(buf[index + n], -ceiling, ceiling);
+        out += len;
+        nb_samples -= len / channels;
+        index += len;
         if (index >= s->limiter_buf_size)
             index -= s->limiter_buf_size;
     }
@@ -441,17 +507,13 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     limiter_buf = s->limiter_buf;
 
     ff_ebur128_add_frames_double(s->r128_in, src, in->nb_samples);
+    s->nb_in_samples += in->nb_samples;
 
-    if (s->frame_type == FIRST_FRAME && in->nb_samples < frame_size(inlink->sample_rate, 3000)) {
+    if (s->frame_type == FIRST_FRAME && in->nb_samples < frame_size(inlink->sample_rate, s->lookahead)) {
         double offset, offset_tp, true_peak;
 
         ff_ebur128_loudness_global(s->r128_in, &global);
-        for (c = 0; c < inlink->channels; c++) {
-            double tmp;
-            ff_ebur128_sample_peak(s->r128_in, c, &tmp);
-            if (c == 0 || tmp > true_peak)
-                true_peak = tmp;
-        }
+        true_peak = get_peak(s, s->r128_in);
 
         offset    = pow(10., (s->target_i - global) / 20.);
         offset_tp = true_peak * offset;
@@ -469,7 +531,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
             s->buf_index += inlink->channels;
         }
 
-        ff_ebur128_loudness_shortterm(s->r128_in, &shortterm);
+        get_shortterm(s, s->r128_in, s->nb_in_samples, inlink->sample_rate, &shortterm);
 
         if (shortterm < s->measured_thresh) {
             s->above_threshold = 0;
@@ -500,6 +562,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         subframe_length = frame_size(inlink->sample_rate, 100);
         true_peak_limiter(s, dst, subframe_length, inlink->channels);
         ff_ebur128_add_frames_double(s->r128_out, dst, subframe_length);
+        s->nb_out_samples += subframe_length;
 
         s->pts +=
         out->nb_samples =
@@ -511,13 +574,15 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         break;
 
     case INNER_FRAME:
-        gain      = gaussian_filter(s, s->index + 10 < 30 ? s->index + 10 : s->index + 10 - 30);
-        gain_next = gaussian_filter(s, s->index + 11 < 30 ? s->index + 11 : s->index + 11 - 30);
+        gain      = gaussian_filter(s, (s->index + s->gain_offset    ) % 30);
+        gain_next = gaussian_filter(s, (s->index + s->gain_offset + 1) % 30);
 
         for (n = 0; n < in->nb_samples; n++) {
+            const double env = gain + (((double) n / in->nb_samples) * (gain_next - gain));
+
             for (c = 0; c < inlink->channels; c++) {
                 buf[s->prev_buf_index + c] = src[c];
-                limiter_buf[s->limiter_buf_index + c] = buf[s->buf_index + c] * (gain + (((double) n / in->nb_samples) * (gain_next - gain))) * s->offset;
+                limiter_buf[s->limiter_buf_index + c] = buf[s->buf_index + c] * env * s->offset;
             }
             src += inlink->channels;
 
@@ -539,10 +604,11 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 
         true_peak_limiter(s, dst, in->nb_samples, inlink->channels);
         ff_ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
+        s->nb_out_samples += in->nb_samples;
 
         ff_ebur128_loudness_range(s->r128_in, &lra);
         ff_ebur128_loudness_global(s->r128_in, &global);
-        ff_ebur128_loudness_shortterm(s->r128_in, &shortterm);
+        get_shortterm(s, s->r128_in, s->nb_in_samples, inlink->sample_rate, &shortterm);
         ff_ebur128_relative_threshold(s->r128_in, &relative_threshold);
 
         if (s->above_threshold == 0) {
@@ -551,7 +617,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
             if (shortterm > s->measured_thresh)
                 s->prev_delta *= 1.0058;
 
-            ff_ebur128_loudness_shortterm(s->r128_out, &shortterm_out);
+            get_shortterm(s, s->r128_out, s->nb_out_samples, inlink->sample_rate, &shortterm_out);
             if (shortterm_out >= s->target_i)
                 s->above_threshold = 1;
         }
@@ -573,7 +639,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         break;
 
     case FINAL_FRAME:
-        gain = gaussian_filter(s, s->index + 10 < 30 ? s->index + 10 : s->index + 10 - 30);
+        gain = gaussian_filter(s, (s->index + s->gain_offset) % 30);
         s->limiter_buf_index = 0;
         src_index = 0;
 
@@ -710,7 +776,7 @@ static int query_formats(AVFilterContext *ctx)
     if (ret < 0)
         return ret;
 
-    if (s->frame_type != LINEAR_MODE) {
+    if (s->frame_type != LINEAR_MODE && s->upsample) {
         formats = ff_make_format_list(input_srate);
         if (!formats)
             return AVERROR(ENOMEM);
@@ -729,12 +795,13 @@ static int config_input(AVFilterLink *inlink)
 {
     AVFilterContext *ctx = inlink->dst;
     LoudNormContext *s = ctx->priv;
+    const int peak_mode = s->upsample ? FF_EBUR128_MODE_SAMPLE_PEAK : FF_EBUR128_MODE_TRUE_PEAK;
 
-    s->r128_in = ff_ebur128_init(inlink->channels, inlink->sample_rate, 0, FF_EBUR128_MODE_I | FF_EBUR128_MODE_S | FF_EBUR128_MODE_LRA | FF_EBUR128_MODE_SAMPLE_PEAK);
+    s->r128_in = ff_ebur128_init(inlink->channels, inlink->sample_rate, 0, FF_EBUR128_MODE_I | FF_EBUR128_MODE_S | FF_EBUR128_MODE_LRA | peak_mode);
     if (!s->r128_in)
         return AVERROR(ENOMEM);
 
-    s->r128_out = ff_ebur128_init(inlink->channels, inlink->sample_rate, 0, FF_EBUR128_MODE_I | FF_EBUR128_MODE_S | FF_EBUR128_MODE_LRA | FF_EBUR128_MODE_SAMPLE_PEAK);
+    s->r128_out = ff_ebur128_init(inlink->channels, inlink->sample_rate, 0, FF_EBUR128_MODE_I | FF_EBUR128_MODE_S | FF_EBUR128_MODE_LRA | peak_mode);
     if (!s->r128_out)
         return AVERROR(ENOMEM);
 
@@ -743,7 +810,7 @@ static int config_input(AVFilterLink *inlink)
         ff_ebur128_set_channel(s->r128_out, 0, FF_EBUR128_DUAL_MONO);
     }
 
-    s->buf_size = frame_size(inlink->sample_rate, 3000) * inlink->channels;
+    s->buf_size = frame_size(inlink->sample_rate, s->lookahead) * inlink->channels;
     s->buf = av_malloc_array(s->buf_size, sizeof(*s->buf));
     if (!s->buf)
         return AVERROR(ENOMEM);
@@ -762,7 +829,7 @@ static int config_input(AVFilterLink *inlink)
     if (s->frame_type != LINEAR_MODE) {
         inlink->min_samples =
         inlink->max_samples =
-        inlink->partial_buf_size = frame_size(inlink->sample_rate, 3000);
+        inlink->partial_buf_size = frame_size(inlink->sample_rate, s->lookahead);
     }
 
     s->pts = AV_NOPTS_VALUE;
@@ -776,6 +843,13 @@ static int config_input(AVFilterLink *inlink)
     s->target_tp = pow(10., s->target_tp / 20.);
     s->attack_length = frame_size(inlink->sample_rate, 10);
     s->release_length = frame_size(inlink->sample_rate, 100);
+    s->peak_lookahead = frame_size(inlink->sample_rate, 10);
+    s->peak_window = FFMAX(12 * inlink->sample_rate / 192000, 3);
+    /* The gain is smoothed over 21 of the last 30 100ms deltas. With the
+     * full 3s lookahead the window ends 1s before the newest delta, with a
+     * shorter lookahead it is moved closer to it. */
+    s->gain_offset = 20 - FFMAX(s->lookahead / 100 - 20, 2);
+    s->nb_in_samples = s->nb_out_samples = 0;
 
     return 0;
 }
@@ -805,7 +879,6 @@ static av_cold void uninit(AVFilterContext *ctx)
 {
     LoudNormContext *s = ctx->priv;
     double i_in, i_out, lra_in, lra_out, thresh_in, thresh_out, tp_in, tp_out;
-    int c;
 
     if (!s->r128_in || !s->r128_out)
         goto end;
@@ -813,22 +886,12 @@ static av_cold void uninit(AVFilterContext *ctx)
     ff_ebur128_loudness_range(s->r128_in, &lra_in);
     ff_ebur128_loudness_global(s->r128_in, &i_in);
     ff_ebur128_relative_threshold(s->r128_in, &thresh_in);
-    for (c = 0; c < s->channels; c++) {
-        double tmp;
-        ff_ebur128_sample_peak(s->r128_in, c, &tmp);
-        if ((c == 0) || (tmp > tp_in))
-            tp_in = tmp;
-    }
+    tp_in = get_peak(s, s->r128_in);
 
     ff_ebur128_loudness_range(s->r128_out, &lra_out);
     ff_ebur128_loudness_global(s->r128_out, &i_out);
     ff_ebur128_relative_threshold(s->r128_out, &thresh_out);
-    for (c = 0; c < s->channels; c++) {
-        double tmp;
-        ff_ebur128_sample_peak(s->r128_out, c, &tmp);
-        if ((c == 0) || (tmp > tp_out))
-            tp_out = tmp;
-    }
+    tp_out = get_peak(s, s->r128_out);
 
     switch(s->print_format) {
     case NONE:
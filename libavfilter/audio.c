@@ -95,3 +95,11 @@ AVFrame *ff_get_audio_buffer(AVFilterLink *link, int nb_samples)
 
     return ret;
 }
+
+int ff_filter_execute_channels(AVFilterContext *ctx, avfilter_action_func *func,
+                               void *arg, int nb_channels)
+{
+    const int nb_jobs = FFMAX(FFMIN(nb_channels, ff_filter_get_nb_threads(ctx)), 1);
+
+    return ctx->internal->execute(ctx, func, arg, NULL, nb_jobs);
+}
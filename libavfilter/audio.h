@@ -42,4 +42,26 @@ AVFrame *ff_null_get_audio_buffer(AVFilterLink *link, int nb_samples);
  */
 AVFrame *ff_get_audio_buffer(AVFilterLink *link, int nb_samples);
 
+/**
+ * Run a job on all channels of an audio filter, in parallel when the filter
+ * has AVFILTER_FLAG_SLICE_THREADS set.
+ *
+ * The channels are split into one contiguous range per job, func must only
+ * touch the channels from ff_audio_channels_start(nb_channels, jobnr, nb_jobs)
+ * to ff_audio_channels_start(nb_channels, jobnr + 1, nb_jobs).
+ *
+ * @param nb_channels    the number of independent channels to process
+ * @return               the return value of the execute callback
+ */
+int ff_filter_execute_channels(AVFilterContext *ctx, avfilter_action_func *func,
+                               void *arg, int nb_channels);
+
+/**
+ * @return the first channel processed by job jobnr of ff_filter_execute_channels()
+ */
+static inline int ff_audio_channels_start(int nb_channels, int jobnr, int nb_jobs)
+{
+    return (nb_channels * jobnr) / nb_jobs;
+}
+
 #endif /* AVFILTER_AUDIO_H */
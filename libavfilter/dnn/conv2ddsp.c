@@ -0,0 +1,85 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "conv2ddsp.h"
+
+void ff_dnn_conv2d_gemm4(float *dst, const float *src, const float *weights,
+                         const float *bias, int k, ptrdiff_t out_stride)
+{
+    for (int p = 0; p < 4; p++) {
+        if (out_stride < 8) {
+            /* few outputs: keep the sums in registers */
+            for (int o = 0; o < out_stride; o++) {
+                float sum = bias[o];
+
+                for (int i = 0; i < k; i++)
+                    sum += src[i] * weights[i * out_stride + o];
+                dst[o] = sum;
+            }
+        } else {
+            /* many outputs: walk the weights in memory order */
+            for (int o = 0; o < out_stride; o++)
+                dst[o] = bias[o];
+
+            for (int i = 0; i < k; i++) {
+                const float *w = weights + i * out_stride;
+                const float s = src[i];
+
+                for (int o = 0; o < out_stride; o++)
+                    dst[o] += s * w[o];
+            }
+        }
+
+        src += k;
+        dst += out_stride;
+    }
+}
+
+void ff_dnn_conv2d_gemm4_int8(int32_t *dst, const uint8_t *src, const int8_t *weights,
+                              int k, ptrdiff_t out_stride)
+{
+    for (int p = 0; p < 4; p++) {
+        if (out_stride < 8) {
+            for (int o = 0; o < out_stride; o++) {
+                const int8_t *w = weights + o * 4;
+                int32_t sum = 0;
+
+                for (int i = 0; i < k; i += 4) {
+                    sum += src[i + 0] * w[0] + src[i + 1] * w[1] +
+                           src[i + 2] * w[2] + src[i + 3] * w[3];
+                    w += out_stride * 4;
+                }
+                dst[o] = sum;
+            }
+        } else {
+            for (int o = 0; o < out_stride; o++)
+                dst[o] = 0;
+
+            for (int i = 0; i < k; i += 4) {
+                const int8_t *w = weights + i * out_stride;
+
+                for (int o = 0; o < out_stride; o++)
+                    dst[o] += src[i + 0] * w[4 * o + 0] + src[i + 1] * w[4 * o + 1] +
+                              src[i + 2] * w[4 * o + 2] + src[i + 3] * w[4 * o + 3];
+            }
+        }
+
+        src += k;
+        dst += out_stride;
+    }
+}
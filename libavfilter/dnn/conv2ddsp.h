@@ -0,0 +1,52 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_DNN_CONV2DDSP_H
+#define AVFILTER_DNN_CONV2DDSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Largest magnitude of the quantized weights passed to
+ * ff_dnn_conv2d_gemm4_int8().
+ */
+#define DNN_CONV2D_INT8_WEIGHT_MAX 127
+
+/**
+ * Compute 4 output pixels of a convolution lowered to a matrix product:
+ * dst[p * out_stride + o] = bias[o] + sum(src[p * k + i] * weights[i * out_stride + o])
+ * for p < 4, o < out_stride and i < k.
+ *
+ * @param k number of inputs of each output pixel, positive
+ */
+void ff_dnn_conv2d_gemm4(float *dst, const float *src, const float *weights,
+                         const float *bias, int k, ptrdiff_t out_stride);
+
+/**
+ * Integer version of ff_dnn_conv2d_gemm4() for quantized layers:
+ * dst[p * out_stride + o] = sum(src[p * k + i] * weights[(i / 4 * out_stride + o) * 4 + i % 4])
+ * for p < 4, o < out_stride and i < k.
+ *
+ * @param k number of inputs of each output pixel, positive multiple of 4
+ * The weights lie in [-DNN_CONV2D_INT8_WEIGHT_MAX, DNN_CONV2D_INT8_WEIGHT_MAX].
+ */
+void ff_dnn_conv2d_gemm4_int8(int32_t *dst, const uint8_t *src, const int8_t *weights,
+                              int k, ptrdiff_t out_stride);
+
+#endif /* AVFILTER_DNN_CONV2DDSP_H */
@@ -23,16 +23,35 @@
  * DNN native backend implementation.
  */
 
+#include <stdatomic.h>
+
+#include "config.h"
 #include "dnn_backend_native.h"
 #include "libavutil/avassert.h"
+#include "libavutil/cpu.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/time.h"
 #include "dnn_backend_native_layer_conv2d.h"
+#include "dnn_backend_native_layer_dense.h"
 #include "dnn_backend_native_layers.h"
+#include "dnn_backend_native_tile.h"
 #include "dnn_io_proc.h"
 
 #define OFFSET(x) offsetof(NativeContext, x)
 #define FLAGS AV_OPT_FLAG_FILTERING_PARAM
 static const AVOption dnn_native_options[] = {
-    { "conv2d_threads", "threads num for conv2d layer", OFFSET(options.conv2d_threads), AV_OPT_TYPE_INT,  { .i64 = 0 }, INT_MIN, INT_MAX, FLAGS },
+    { "threads",        "threads num for the layers",   OFFSET(options.threads),        AV_OPT_TYPE_INT,  { .i64 = 0 }, 0, INT_MAX, FLAGS },
+    { "conv2d_threads", "deprecated, use threads",      OFFSET(options.threads),        AV_OPT_TYPE_INT,  { .i64 = 0 }, 0, INT_MAX, FLAGS },
+    { "timing",         "report the time spent in each layer", OFFSET(options.timing),  AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1,       FLAGS },
+    { "int8",           "run the conv2d and dense layers in int8",
+                                                        OFFSET(options.int8),           AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1,       FLAGS },
+    { "calibrate",      "measure the input ranges of the layers for int8 inference",
+                                                        OFFSET(options.calibrate),      AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1,       FLAGS },
+    { "nireq",          "number of requests run at once in async mode",
+                                                        OFFSET(options.nireq),          AV_OPT_TYPE_INT,  { .i64 = 2 }, 1, INT_MAX, FLAGS },
+    { "batch_size",     "frames per request in async mode", OFFSET(options.batch_size), AV_OPT_TYPE_INT,  { .i64 = 1 }, 1, 1000,    FLAGS },
+    { "tile_size",      "run the model in tiles of this many input pixels, 0 to disable",
+                                                        OFFSET(options.tile_size),      AV_OPT_TYPE_INT,  { .i64 = 0 }, 0, INT_MAX, FLAGS },
     { NULL },
 };
 
@@ -44,9 +63,88 @@ static const AVClass dnn_native_class = {
     .category   = AV_CLASS_CATEGORY_FILTER,
 };
 
-static DNNReturnType execute_model_native(const DNNModel *model, const char *input_name, AVFrame *in_frame,
-                                          const char **output_names, uint32_t nb_output, AVFrame *out_frame,
-                                          int do_ioproc);
+static const char *const layer_names[DLT_COUNT] = {
+    [DLT_INPUT]          = "input",
+    [DLT_CONV2D]         = "conv2d",
+    [DLT_DEPTH_TO_SPACE] = "depth2space",
+    [DLT_MIRROR_PAD]     = "mirror_pad",
+    [DLT_MAXIMUM]        = "maximum",
+    [DLT_MATH_BINARY]    = "math_binary",
+    [DLT_MATH_UNARY]     = "math_unary",
+    [DLT_AVG_POOL]       = "avg_pool",
+    [DLT_DENSE]          = "dense",
+};
+
+typedef struct NativeTask {
+    const char *input_name;
+    AVFrame *in_frame;
+    const char *output_name;
+    AVFrame *out_frame;
+    int do_ioproc;
+    DNNReturnType result;
+    atomic_int done;            ///< set once result and out_frame are written
+} NativeTask;
+
+typedef struct NativeRequest {
+    /**
+     * context of the request, with its own thread pool, as a pool cannot
+     * run the jobs of two requests at once
+     */
+    NativeContext ctx;
+    DnnOperand **operands;      ///< one copy of the operands for each task of a batch
+    NativeTask **tasks;
+    int nb_tasks;
+    int64_t *layer_time;
+    int64_t nb_executions;
+} NativeRequest;
+
+static DNNReturnType execute_model_native(NativeModel *native_model, NativeTask *task);
+
+#if HAVE_THREADS
+static void worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    NativeContext *ctx = priv;
+
+    ctx->job_func(ctx->job_arg, jobnr, nb_jobs);
+}
+#endif
+
+/**
+ * Create the slice threads of ctx if they do not exist yet.
+ * nb_threads is 0 for one thread per cpu core.
+ */
+static int init_slicethread(NativeContext *ctx, int nb_threads)
+{
+#if HAVE_THREADS
+    if (nb_threads != 1 && !ctx->slicethread) {
+        int ret = avpriv_slicethread_create(&ctx->slicethread, ctx, worker_func, NULL, nb_threads);
+        if (ret < 0)
+            return ret;
+        ctx->nb_threads = ret;
+    }
+#endif
+    return 0;
+}
+
+int ff_dnn_native_get_nb_jobs(const NativeContext *ctx, int nb_units)
+{
+    int nb_threads = ctx && ctx->slicethread ? ctx->nb_threads : 1;
+
+    return av_clip(nb_units, 1, nb_threads);
+}
+
+void ff_dnn_native_execute(NativeContext *ctx, NativeJobFunc func, void *arg, int nb_jobs)
+{
+    if (!ctx || !ctx->slicethread || nb_jobs == 1) {
+        for (int i = 0; i < nb_jobs; i++)
+            func(arg, i, nb_jobs);
+        return;
+    }
+
+    ctx->job_func = func;
+    ctx->job_arg  = arg;
+    avpriv_slicethread_execute(ctx->slicethread, nb_jobs, 0);
+}
 
 static DNNReturnType get_input_native(void *model, DNNData *input, const char *input_name)
 {
@@ -80,6 +178,7 @@ static DNNReturnType get_output_native(void *model, const char *input_name, int
     DNNReturnType ret;
     NativeModel *native_model = model;
     NativeContext *ctx = &native_model->ctx;
+    NativeTask task;
     AVFrame *in_frame = av_frame_alloc();
     AVFrame *out_frame = NULL;
 
@@ -99,7 +198,12 @@ static DNNReturnType get_output_native(void *model, const char *input_name, int
     in_frame->width = input_width;
     in_frame->height = input_height;
 
-    ret = execute_model_native(native_model->model, input_name, in_frame, &output_name, 1, out_frame, 0);
+    task.input_name  = input_name;
+    task.in_frame    = in_frame;
+    task.output_name = output_name;
+    task.out_frame   = out_frame;
+    task.do_ioproc   = 0;
+    ret = execute_model_native(native_model, &task);
     *output_width = out_frame->width;
     *output_height = out_frame->height;
 
@@ -108,6 +212,40 @@ static DNNReturnType get_output_native(void *model, const char *input_name, int
     return ret;
 }
 
+/**
+ * @return number of quantized layers without a calibrated input range,
+ *         or a negative AVERROR code on failure
+ */
+static int quantize_layers(NativeModel *native_model)
+{
+    int nb_quantized = 0, nb_dynamic = 0;
+
+    for (int32_t layer = 0; layer < native_model->layers_num; ++layer) {
+        float range = native_model->input_range ? native_model->input_range[layer] : 0.f;
+        void *params = native_model->layers[layer].params;
+        int ret;
+
+        switch (native_model->layers[layer].type) {
+        case DLT_CONV2D:
+            ret = ff_dnn_quantize_layer_conv2d(params, range);
+            break;
+        case DLT_DENSE:
+            ret = ff_dnn_quantize_layer_dense(params, range);
+            break;
+        default:
+            continue;
+        }
+        if (ret < 0)
+            return ret;
+        nb_quantized++;
+        nb_dynamic += range <= 0.f;
+    }
+
+    av_log(&native_model->ctx, AV_LOG_VERBOSE, "%d layers run in int8, %d with dynamic input ranges\n",
+           nb_quantized, nb_dynamic);
+    return nb_dynamic;
+}
+
 // Loads model and its parameters that are stored in a binary file with following structure:
 // layers_num,layer_type,layer_parameterss,layer_type,layer_parameters...
 // For CONV layer: activation_function, input_num, output_num, kernel_size, kernel, biases
@@ -121,7 +259,7 @@ DNNModel *ff_dnn_load_model_native(const char *model_filename, DNNFunctionType f
     int version, header_size, major_version_expected = 1;
     NativeModel *native_model = NULL;
     AVIOContext *model_file_context;
-    int file_size, dnn_size, parsed_size;
+    int file_size, dnn_size, parsed_size, nb_dynamic = 0;
     int32_t layer;
     DNNLayerType layer_type;
 
@@ -161,15 +299,18 @@ DNNModel *ff_dnn_load_model_native(const char *model_filename, DNNFunctionType f
     model->model = native_model;
 
     native_model->ctx.class = &dnn_native_class;
+    av_opt_set_defaults(&native_model->ctx);
     model->options = options;
     if (av_opt_set_from_string(&native_model->ctx, model->options, NULL, "=", "&") < 0)
         goto fail;
     native_model->model = model;
 
-#if !HAVE_PTHREAD_CANCEL
-    if (native_model->ctx.options.conv2d_threads > 1){
-        av_log(&native_model->ctx, AV_LOG_WARNING, "'conv2d_threads' option was set but it is not supported "
-                       "on this build (pthread support is required)\n");
+    // the slice threads are created on the first sync execution, async
+    // requests have their own
+#if !HAVE_THREADS
+    if (native_model->ctx.options.threads > 1){
+        av_log(&native_model->ctx, AV_LOG_WARNING, "'threads' option was set but it is not supported "
+                       "on this build (thread support is required)\n");
     }
 #endif
 
@@ -189,6 +330,12 @@ DNNModel *ff_dnn_load_model_native(const char *model_filename, DNNFunctionType f
         goto fail;
     }
 
+    if (native_model->ctx.options.timing) {
+        native_model->layer_time = av_calloc(native_model->layers_num, sizeof(*native_model->layer_time));
+        if (!native_model->layer_time)
+            goto fail;
+    }
+
     for (layer = 0; layer < native_model->layers_num; ++layer){
         layer_type = (int32_t)avio_rl32(model_file_context);
         dnn_size += 4;
@@ -238,6 +385,19 @@ DNNModel *ff_dnn_load_model_native(const char *model_filename, DNNFunctionType f
         oprd->isNHWC = 1;
     }
 
+    if (file_size - dnn_size >= 4 &&
+        avio_rl32(model_file_context) == DNN_NATIVE_CALIBRATION_TAG) {
+        dnn_size += 4;
+        native_model->input_range = av_malloc_array(native_model->layers_num,
+                                                    sizeof(*native_model->input_range));
+        if (!native_model->input_range)
+            goto fail;
+        for (layer = 0; layer < native_model->layers_num; ++layer)
+            native_model->input_range[layer] = av_int2float(avio_rl32(model_file_context));
+        dnn_size += 4 * native_model->layers_num;
+        native_model->has_calibration_table = 1;
+    }
+
     avio_closep(&model_file_context);
 
     if (dnn_size != file_size){
@@ -245,6 +405,27 @@ DNNModel *ff_dnn_load_model_native(const char *model_filename, DNNFunctionType f
         return NULL;
     }
 
+    if (native_model->ctx.options.calibrate) {
+        av_freep(&native_model->input_range);
+        native_model->input_range = av_calloc(native_model->layers_num,
+                                              sizeof(*native_model->input_range));
+        if (!native_model->input_range)
+            goto fail;
+    } else if (native_model->ctx.options.int8) {
+        nb_dynamic = quantize_layers(native_model);
+        if (nb_dynamic < 0)
+            goto fail;
+    }
+
+    if (native_model->ctx.options.tile_size) {
+        // dynamic input ranges would be measured on each tile separately
+        if (nb_dynamic)
+            av_log(&native_model->ctx, AV_LOG_WARNING, "int8 layers without calibrated input ranges "
+                   "cannot be run in tiles, tile_size is ignored\n");
+        else if (ff_dnn_tile_init(native_model) < 0)
+            goto fail;
+    }
+
     model->get_input = &get_input_native;
     model->get_output = &get_output_native;
     model->filter_ctx = filter_ctx;
@@ -258,26 +439,17 @@ fail:
     return NULL;
 }
 
-static DNNReturnType execute_model_native(const DNNModel *model, const char *input_name, AVFrame *in_frame,
-                                          const char **output_names, uint32_t nb_output, AVFrame *out_frame,
-                                          int do_ioproc)
+static DNNReturnType fill_model_input(NativeModel *native_model, NativeContext *ctx,
+                                      DnnOperand *operands, NativeTask *task)
 {
-    NativeModel *native_model = model->model;
-    NativeContext *ctx = &native_model->ctx;
-    int32_t layer;
-    DNNData input, output;
+    DNNData input;
     DnnOperand *oprd = NULL;
 
-    if (native_model->layers_num <= 0 || native_model->operands_num <= 0) {
-        av_log(ctx, AV_LOG_ERROR, "No operands or layers in model\n");
-        return DNN_ERROR;
-    }
-
     for (int i = 0; i < native_model->operands_num; ++i) {
-        oprd = &native_model->operands[i];
-        if (strcmp(oprd->name, input_name) == 0) {
+        oprd = &operands[i];
+        if (strcmp(oprd->name, task->input_name) == 0) {
             if (oprd->type != DOT_INPUT) {
-                av_log(ctx, AV_LOG_ERROR, "Found \"%s\" in model, but it is not input node\n", input_name);
+                av_log(ctx, AV_LOG_ERROR, "Found \"%s\" in model, but it is not input node\n", task->input_name);
                 return DNN_ERROR;
             }
             break;
@@ -285,12 +457,12 @@ static DNNReturnType execute_model_native(const DNNModel *model, const char *inp
         oprd = NULL;
     }
     if (!oprd) {
-        av_log(ctx, AV_LOG_ERROR, "Could not find \"%s\" in model\n", input_name);
+        av_log(ctx, AV_LOG_ERROR, "Could not find \"%s\" in model\n", task->input_name);
         return DNN_ERROR;
     }
 
-    oprd->dims[1] = in_frame->height;
-    oprd->dims[2] = in_frame->width;
+    oprd->dims[1] = task->in_frame->height;
+    oprd->dims[2] = task->in_frame->width;
 
     av_freep(&oprd->data);
     oprd->length = ff_calculate_operand_data_length(oprd);
@@ -309,74 +481,288 @@ static DNNReturnType execute_model_native(const DNNModel *model, const char *inp
     input.channels = oprd->dims[3];
     input.data = oprd->data;
     input.dt = oprd->data_type;
-    if (do_ioproc) {
+    if (task->do_ioproc) {
         if (native_model->model->pre_proc != NULL) {
-            native_model->model->pre_proc(in_frame, &input, native_model->model->filter_ctx);
+            native_model->model->pre_proc(task->in_frame, &input, native_model->model->filter_ctx);
         } else {
-            ff_proc_from_frame_to_dnn(in_frame, &input, native_model->model->func_type, ctx);
+            ff_proc_from_frame_to_dnn(task->in_frame, &input, native_model->model->func_type, ctx);
         }
     }
 
-    if (nb_output != 1) {
-        // currently, the filter does not need multiple outputs,
-        // so we just pending the support until we really need it.
-        avpriv_report_missing_feature(ctx, "multiple outputs");
+    return DNN_SUCCESS;
+}
+
+static DNNReturnType fill_model_output(NativeModel *native_model, NativeContext *ctx,
+                                       DnnOperand *operands, NativeTask *task)
+{
+    DNNData output;
+    DnnOperand *oprd = NULL;
+
+    for (int j = 0; j < native_model->operands_num; ++j) {
+        if (strcmp(operands[j].name, task->output_name) == 0) {
+            oprd = &operands[j];
+            break;
+        }
+    }
+
+    if (oprd == NULL) {
+        av_log(ctx, AV_LOG_ERROR, "Could not find output in model\n");
         return DNN_ERROR;
     }
 
-    for (layer = 0; layer < native_model->layers_num; ++layer){
-        DNNLayerType layer_type = native_model->layers[layer].type;
-        if (ff_layer_funcs[layer_type].pf_exec(native_model->operands,
-                                            native_model->layers[layer].input_operand_indexes,
-                                            native_model->layers[layer].output_operand_index,
-                                            native_model->layers[layer].params,
-                                            &native_model->ctx) == DNN_ERROR) {
-            av_log(ctx, AV_LOG_ERROR, "Failed to execute model\n");
-            return DNN_ERROR;
+    output.data = oprd->data;
+    output.height = oprd->dims[1];
+    output.width = oprd->dims[2];
+    output.channels = oprd->dims[3];
+    output.dt = oprd->data_type;
+
+    if (task->do_ioproc) {
+        if (native_model->model->post_proc != NULL) {
+            native_model->model->post_proc(task->out_frame, &output, native_model->model->filter_ctx);
+        } else {
+            ff_proc_from_dnn_to_frame(task->out_frame, &output, ctx);
         }
+    } else {
+        task->out_frame->width = output.width;
+        task->out_frame->height = output.height;
+    }
+
+    return DNN_SUCCESS;
+}
+
+static int32_t find_operand(const NativeModel *native_model, const char *name)
+{
+    for (int32_t i = 0; i < native_model->operands_num; ++i) {
+        if (strcmp(native_model->operands[i].name, name) == 0)
+            return i;
     }
+    return -1;
+}
 
-    for (uint32_t i = 0; i < nb_output; ++i) {
-        DnnOperand *oprd = NULL;
-        const char *output_name = output_names[i];
-        for (int j = 0; j < native_model->operands_num; ++j) {
-            if (strcmp(native_model->operands[j].name, output_name) == 0) {
-                oprd = &native_model->operands[j];
-                break;
+/**
+ * Run the layers for nb_tasks tasks as one batch, task i on the operands
+ * operands[i]. Each layer is executed for all the tasks before the next
+ * one, while its weights are still in cache.
+ */
+static DNNReturnType execute_layers(NativeModel *native_model, NativeContext *ctx, DnnOperand **operands,
+                                    NativeTask **tasks, int nb_tasks, int64_t *layer_time)
+{
+    for (int32_t layer = 0; layer < native_model->layers_num; ++layer){
+        DNNLayerType layer_type = native_model->layers[layer].type;
+        int64_t start = layer_time ? av_gettime_relative() : 0;
+
+        for (int i = 0; i < nb_tasks; i++) {
+            if (native_model->ctx.options.calibrate && tasks[i]->do_ioproc &&
+                (layer_type == DLT_CONV2D || layer_type == DLT_DENSE)) {
+                const DnnOperand *input_oprd = &operands[i][native_model->layers[layer].input_operand_indexes[0]];
+                float range = ff_dnn_int8_measure_range(ctx, input_oprd->data,
+                                                        ff_calculate_operand_dims_count(input_oprd));
+                native_model->input_range[layer] = FFMAX(native_model->input_range[layer], range);
             }
-        }
 
-        if (oprd == NULL) {
-            av_log(ctx, AV_LOG_ERROR, "Could not find output in model\n");
-            return DNN_ERROR;
+            if (ff_layer_funcs[layer_type].pf_exec(operands[i],
+                                                native_model->layers[layer].input_operand_indexes,
+                                                native_model->layers[layer].output_operand_index,
+                                                native_model->layers[layer].params,
+                                                ctx) == DNN_ERROR) {
+                av_log(ctx, AV_LOG_ERROR, "Failed to execute model\n");
+                return DNN_ERROR;
+            }
+        }
+        if (layer_time && tasks[0]->do_ioproc) {
+            int64_t elapsed = av_gettime_relative() - start;
+            layer_time[layer] += elapsed;
+            av_log(ctx, AV_LOG_DEBUG, "layer %d (%s): %"PRId64" us for %d frames\n",
+                   layer, layer_names[layer_type], elapsed, nb_tasks);
         }
+    }
+
+    return DNN_SUCCESS;
+}
+
+/**
+ * Same as execute_layers(), on tiles of the input operand of at most
+ * tile_size x tile_size pixels plus their halo. The whole input is kept
+ * aside, and the output of each tile is copied into the whole output,
+ * which replaces the output operand at the end.
+ */
+static DNNReturnType execute_tiles(NativeModel *native_model, NativeContext *ctx, DnnOperand **operands,
+                                   NativeTask **tasks, int nb_tasks, int64_t *layer_time,
+                                   int32_t input_oprd, int32_t output_oprd)
+{
+    const int height   = operands[0][input_oprd].dims[1];
+    const int width    = operands[0][input_oprd].dims[2];
+    const int channels = operands[0][input_oprd].dims[3];
+    const int scale    = native_model->tile_scale[output_oprd];
+    const int64_t tile_size = (int64_t)ctx->options.tile_size * scale;
+    int32_t (*size)[2] = av_malloc_array(native_model->operands_num, sizeof(*size));
+    int (*range)[2][2] = av_malloc_array(native_model->operands_num, sizeof(*range));
+    uint8_t **frame_in  = av_calloc(nb_tasks, sizeof(*frame_in));
+    uint8_t **frame_out = av_calloc(nb_tasks, sizeof(*frame_out));
+    int out_height, out_width, out_channels = 0;
+    DNNReturnType ret = DNN_ERROR;
+
+    if (!size || !range || !frame_in || !frame_out) {
+        av_log(ctx, AV_LOG_ERROR, "Failed to allocate memory for tiles\n");
+        goto end;
+    }
 
-        output.data = oprd->data;
-        output.height = oprd->dims[1];
-        output.width = oprd->dims[2];
-        output.channels = oprd->dims[3];
-        output.dt = oprd->data_type;
-
-        if (do_ioproc) {
-            if (native_model->model->post_proc != NULL) {
-                native_model->model->post_proc(out_frame, &output, native_model->model->filter_ctx);
-            } else {
-                ff_proc_from_dnn_to_frame(out_frame, &output, ctx);
+    ff_dnn_tile_get_sizes(native_model, input_oprd, height, width, size);
+    out_height = size[output_oprd][0];
+    out_width  = size[output_oprd][1];
+
+    for (int i = 0; i < nb_tasks; i++) {
+        frame_in[i] = operands[i][input_oprd].data;
+        operands[i][input_oprd].data = NULL;
+    }
+
+    for (int y = 0; y < out_height; y += FFMIN(tile_size, out_height)) {
+        for (int x = 0; x < out_width; x += FFMIN(tile_size, out_width)) {
+            const int out[2][2] = { { y, FFMIN(y + tile_size, out_height) },
+                                    { x, FFMIN(x + tile_size, out_width)  } };
+            int in[2][2];
+
+            ff_dnn_tile_get_input_region(native_model, input_oprd, output_oprd,
+                                         (const int32_t (*)[2])size, range, out, in);
+
+            for (int i = 0; i < nb_tasks; i++) {
+                DnnOperand *oprd = &operands[i][input_oprd];
+                void *data;
+
+                oprd->dims[1] = in[0][1] - in[0][0];
+                oprd->dims[2] = in[1][1] - in[1][0];
+                oprd->length = ff_calculate_operand_data_length(oprd);
+                data = av_realloc(oprd->data, oprd->length);
+                if (!data) {
+                    av_log(ctx, AV_LOG_ERROR, "Failed to reallocate memory for tile input\n");
+                    goto end;
+                }
+                oprd->data = data;
+                av_image_copy_plane(oprd->data, oprd->dims[2] * channels * sizeof(float),
+                                    frame_in[i] + ((size_t)in[0][0] * width + in[1][0]) * channels * sizeof(float),
+                                    width * channels * sizeof(float),
+                                    oprd->dims[2] * channels * sizeof(float), oprd->dims[1]);
+            }
+
+            if (execute_layers(native_model, ctx, operands, tasks, nb_tasks, layer_time) != DNN_SUCCESS)
+                goto end;
+
+            for (int i = 0; i < nb_tasks; i++) {
+                const DnnOperand *oprd = &operands[i][output_oprd];
+                // position of the tile in the output of the layers
+                int tile_y = out[0][0] - in[0][0] * scale;
+                int tile_x = out[1][0] - in[1][0] * scale;
+
+                if (tile_y < 0 || tile_y + out[0][1] - out[0][0] > oprd->dims[1] ||
+                    tile_x < 0 || tile_x + out[1][1] - out[1][0] > oprd->dims[2] ||
+                    (out_channels && oprd->dims[3] != out_channels)) {
+                    av_log(ctx, AV_LOG_ERROR, "Unexpected output size of tile\n");
+                    goto end;
+                }
+                if (!frame_out[i]) {
+                    out_channels = oprd->dims[3];
+                    frame_out[i] = av_malloc_array((size_t)out_height * out_width, out_channels * sizeof(float));
+                    if (!frame_out[i]) {
+                        av_log(ctx, AV_LOG_ERROR, "Failed to allocate memory for output\n");
+                        goto end;
+                    }
+                }
+                av_image_copy_plane(frame_out[i] + ((size_t)out[0][0] * out_width + out[1][0]) * out_channels * sizeof(float),
+                                    out_width * out_channels * sizeof(float),
+                                    (const uint8_t *)oprd->data + ((size_t)tile_y * oprd->dims[2] + tile_x) * out_channels * sizeof(float),
+                                    oprd->dims[2] * out_channels * sizeof(float),
+                                    (out[1][1] - out[1][0]) * out_channels * sizeof(float), out[0][1] - out[0][0]);
             }
-        } else {
-            out_frame->width = output.width;
-            out_frame->height = output.height;
         }
     }
 
+    for (int i = 0; i < nb_tasks; i++) {
+        DnnOperand *oprd = &operands[i][output_oprd];
+        av_freep(&oprd->data);
+        oprd->data = frame_out[i];
+        frame_out[i] = NULL;
+        oprd->dims[1] = out_height;
+        oprd->dims[2] = out_width;
+        oprd->length = ff_calculate_operand_data_length(oprd);
+    }
+    ret = DNN_SUCCESS;
+
+end:
+    for (int i = 0; i < nb_tasks && frame_in; i++) {
+        av_freep(&frame_in[i]);
+        av_freep(&frame_out[i]);
+    }
+    av_freep(&frame_in);
+    av_freep(&frame_out);
+    av_freep(&size);
+    av_freep(&range);
+    return ret;
+}
+
+/**
+ * Run nb_tasks tasks as one batch, task i on the operands operands[i].
+ */
+static DNNReturnType execute_tasks(NativeModel *native_model, NativeContext *ctx, DnnOperand **operands,
+                                   NativeTask **tasks, int nb_tasks, int64_t *layer_time)
+{
+    int32_t input_oprd, output_oprd;
+    int tiled;
+    DNNReturnType ret;
+
+    if (native_model->layers_num <= 0 || native_model->operands_num <= 0) {
+        av_log(ctx, AV_LOG_ERROR, "No operands or layers in model\n");
+        return DNN_ERROR;
+    }
+
+    for (int i = 0; i < nb_tasks; i++) {
+        if (fill_model_input(native_model, ctx, operands[i], tasks[i]) != DNN_SUCCESS)
+            return DNN_ERROR;
+    }
+
+    // the tasks of a batch are run in tiles together, so they must have the same size
+    input_oprd  = find_operand(native_model, tasks[0]->input_name);
+    output_oprd = find_operand(native_model, tasks[0]->output_name);
+    tiled = native_model->tile_scale && output_oprd >= 0 &&
+            native_model->tile_scale[output_oprd] &&
+            (tasks[0]->in_frame->width  > ctx->options.tile_size ||
+             tasks[0]->in_frame->height > ctx->options.tile_size);
+    for (int i = 1; i < nb_tasks; i++) {
+        if (tasks[i]->in_frame->width  != tasks[0]->in_frame->width ||
+            tasks[i]->in_frame->height != tasks[0]->in_frame->height)
+            tiled = 0;
+    }
+
+    if (tiled)
+        ret = execute_tiles(native_model, ctx, operands, tasks, nb_tasks, layer_time, input_oprd, output_oprd);
+    else
+        ret = execute_layers(native_model, ctx, operands, tasks, nb_tasks, layer_time);
+    if (ret != DNN_SUCCESS)
+        return ret;
+
+    for (int i = 0; i < nb_tasks; i++) {
+        if (fill_model_output(native_model, ctx, operands[i], tasks[i]) != DNN_SUCCESS)
+            return DNN_ERROR;
+    }
+
     return DNN_SUCCESS;
 }
 
+static DNNReturnType execute_model_native(NativeModel *native_model, NativeTask *task)
+{
+    DNNReturnType ret = execute_tasks(native_model, &native_model->ctx, &native_model->operands,
+                                      &task, 1, native_model->layer_time);
+
+    if (ret == DNN_SUCCESS && task->do_ioproc)
+        native_model->nb_executions++;
+    return ret;
+}
+
 DNNReturnType ff_dnn_execute_model_native(const DNNModel *model, const char *input_name, AVFrame *in_frame,
                                           const char **output_names, uint32_t nb_output, AVFrame *out_frame)
 {
     NativeModel *native_model = model->model;
     NativeContext *ctx = &native_model->ctx;
+    NativeTask task;
 
     if (!in_frame) {
         av_log(ctx, AV_LOG_ERROR, "in frame is NULL when execute model.\n");
@@ -388,7 +774,291 @@ DNNReturnType ff_dnn_execute_model_native(const DNNModel *model, const char *inp
         return DNN_ERROR;
     }
 
-    return execute_model_native(model, input_name, in_frame, output_names, nb_output, out_frame, 1);
+    if (nb_output != 1) {
+        // currently, the filter does not need multiple outputs,
+        // so we just pending the support until we really need it.
+        avpriv_report_missing_feature(ctx, "multiple outputs");
+        return DNN_ERROR;
+    }
+
+    if (init_slicethread(ctx, ctx->options.threads) < 0) {
+        av_log(ctx, AV_LOG_ERROR, "Failed to create the slice threads\n");
+        return DNN_ERROR;
+    }
+
+    task.input_name  = input_name;
+    task.in_frame    = in_frame;
+    task.output_name = output_names[0];
+    task.out_frame   = out_frame;
+    task.do_ioproc   = 1;
+    return execute_model_native(native_model, &task);
+}
+
+#if HAVE_PTHREAD_CANCEL
+static void *request_thread(void *arg)
+{
+    NativeModel *native_model = arg;
+    NativeRequest *request;
+
+    while ((request = ff_safe_queue_pop_front(native_model->work_queue))) {
+        DNNReturnType ret = execute_tasks(native_model, &request->ctx, request->operands,
+                                          request->tasks, request->nb_tasks, request->layer_time);
+
+        if (ret == DNN_SUCCESS)
+            request->nb_executions += request->nb_tasks;
+        for (int i = 0; i < request->nb_tasks; i++) {
+            request->tasks[i]->result = ret;
+            atomic_store(&request->tasks[i]->done, 1);
+        }
+        request->nb_tasks = 0;
+
+        if (ff_safe_queue_push_back(native_model->request_queue, request) < 0)
+            av_log(&native_model->ctx, AV_LOG_ERROR, "Failed to push back request_queue.\n");
+    }
+
+    return NULL;
+}
+#endif
+
+static void free_request(NativeModel *native_model, NativeRequest *request)
+{
+    if (request->operands) {
+        for (int i = 0; i < native_model->ctx.options.batch_size; i++) {
+            if (!request->operands[i])
+                continue;
+            for (int32_t operand = 0; operand < native_model->operands_num; ++operand)
+                av_freep(&request->operands[i][operand].data);
+            av_freep(&request->operands[i]);
+        }
+        av_freep(&request->operands);
+    }
+    if (request->layer_time) {
+        for (int32_t layer = 0; layer < native_model->layers_num; ++layer)
+            native_model->layer_time[layer] += request->layer_time[layer];
+        native_model->nb_executions += request->nb_executions;
+        av_freep(&request->layer_time);
+    }
+    av_freep(&request->tasks);
+    avpriv_slicethread_free(&request->ctx.slicethread);
+    av_freep(&request);
+}
+
+static void uninit_async(NativeModel *native_model)
+{
+    // wait for the running requests, the workers are then all idle
+    for (int i = 0; i < native_model->nb_requests; i++)
+        free_request(native_model, ff_safe_queue_pop_front(native_model->request_queue));
+    native_model->nb_requests = 0;
+
+#if HAVE_PTHREAD_CANCEL
+    for (int i = 0; i < native_model->nb_workers; i++)
+        ff_safe_queue_push_back(native_model->work_queue, NULL);
+    for (int i = 0; i < native_model->nb_workers; i++)
+        pthread_join(native_model->workers[i], NULL);
+    native_model->nb_workers = 0;
+    av_freep(&native_model->workers);
+#endif
+
+    while (ff_queue_size(native_model->task_queue) != 0) {
+        NativeTask *task = ff_queue_pop_front(native_model->task_queue);
+        av_frame_free(&task->in_frame);
+        av_frame_free(&task->out_frame);
+        av_freep(&task);
+    }
+    ff_queue_destroy(native_model->task_queue);
+    native_model->task_queue = NULL;
+    ff_safe_queue_destroy(native_model->request_queue);
+    native_model->request_queue = NULL;
+    ff_safe_queue_destroy(native_model->work_queue);
+    native_model->work_queue = NULL;
+}
+
+static DNNReturnType init_async(NativeModel *native_model)
+{
+#if HAVE_PTHREAD_CANCEL
+    NativeContext *ctx = &native_model->ctx;
+    int total_threads = ctx->options.threads ? ctx->options.threads : av_cpu_count();
+    // the measured ranges are not shared between requests
+    int nb_requests = ctx->options.calibrate ? 1 : FFMIN(ctx->options.nireq, total_threads);
+    // each request thread also runs slices of its own layers
+    int nb_threads = total_threads / nb_requests;
+
+    native_model->request_queue = ff_safe_queue_create();
+    native_model->work_queue    = ff_safe_queue_create();
+    native_model->task_queue    = ff_queue_create();
+    native_model->workers       = av_calloc(nb_requests, sizeof(*native_model->workers));
+    if (!native_model->request_queue || !native_model->work_queue ||
+        !native_model->task_queue || !native_model->workers)
+        return DNN_ERROR;
+
+    for (int i = 0; i < nb_requests; i++) {
+        NativeRequest *request = av_mallocz(sizeof(*request));
+        if (!request)
+            return DNN_ERROR;
+        if (ff_safe_queue_push_back(native_model->request_queue, request) < 0) {
+            av_freep(&request);
+            return DNN_ERROR;
+        }
+        native_model->nb_requests++;
+
+        request->ctx.class   = &dnn_native_class;
+        request->ctx.options = ctx->options;
+        request->operands = av_calloc(ctx->options.batch_size, sizeof(*request->operands));
+        request->tasks    = av_calloc(ctx->options.batch_size, sizeof(*request->tasks));
+        if (!request->operands || !request->tasks)
+            return DNN_ERROR;
+
+        for (int j = 0; j < ctx->options.batch_size; j++) {
+            request->operands[j] = av_memdup(native_model->operands,
+                                             native_model->operands_num * sizeof(*native_model->operands));
+            if (!request->operands[j])
+                return DNN_ERROR;
+            for (int32_t operand = 0; operand < native_model->operands_num; ++operand)
+                request->operands[j][operand].data = NULL;
+        }
+
+        if (native_model->layer_time) {
+            request->layer_time = av_calloc(native_model->layers_num, sizeof(*request->layer_time));
+            if (!request->layer_time)
+                return DNN_ERROR;
+        }
+
+        if (init_slicethread(&request->ctx, nb_threads) < 0)
+            return DNN_ERROR;
+    }
+
+    for (int i = 0; i < nb_requests; i++) {
+        if (pthread_create(&native_model->workers[i], NULL, request_thread, native_model))
+            return DNN_ERROR;
+        native_model->nb_workers++;
+    }
+
+    return DNN_SUCCESS;
+#else
+    return DNN_ERROR;
+#endif
+}
+
+DNNReturnType ff_dnn_execute_model_async_native(const DNNModel *model, const char *input_name, AVFrame *in_frame,
+                                                const char **output_names, uint32_t nb_output, AVFrame *out_frame)
+{
+    NativeModel *native_model = model->model;
+    NativeContext *ctx = &native_model->ctx;
+    NativeRequest *request;
+    NativeTask *task;
+
+    if (!in_frame) {
+        av_log(ctx, AV_LOG_ERROR, "in frame is NULL when async execute model.\n");
+        return DNN_ERROR;
+    }
+
+    if (!out_frame) {
+        av_log(ctx, AV_LOG_ERROR, "out frame is NULL when async execute model.\n");
+        return DNN_ERROR;
+    }
+
+    if (nb_output != 1) {
+        avpriv_report_missing_feature(ctx, "multiple outputs");
+        return DNN_ERROR;
+    }
+
+    if (!native_model->task_queue && init_async(native_model) != DNN_SUCCESS) {
+        av_log(ctx, AV_LOG_ERROR, "Failed to create the requests for async execution\n");
+        uninit_async(native_model);
+        return DNN_ERROR;
+    }
+
+    task = av_malloc(sizeof(*task));
+    if (!task) {
+        av_log(ctx, AV_LOG_ERROR, "unable to alloc memory for task item.\n");
+        return DNN_ERROR;
+    }
+
+    task->input_name  = input_name;
+    task->in_frame    = in_frame;
+    task->output_name = output_names[0];
+    task->out_frame   = out_frame;
+    task->do_ioproc   = 1;
+    task->result      = DNN_ERROR;
+    atomic_init(&task->done, 0);
+    if (ff_queue_push_back(native_model->task_queue, task) < 0) {
+        av_freep(&task);
+        av_log(ctx, AV_LOG_ERROR, "unable to push back task_queue.\n");
+        return DNN_ERROR;
+    }
+
+    // blocks while all the requests are running
+    request = ff_safe_queue_pop_front(native_model->request_queue);
+    request->tasks[request->nb_tasks++] = task;
+
+    // keep filling the batch, it stays at the front of the idle requests
+    if (request->nb_tasks < ctx->options.batch_size) {
+        if (ff_safe_queue_push_front(native_model->request_queue, request) < 0) {
+            av_log(ctx, AV_LOG_ERROR, "Failed to push back request_queue.\n");
+            return DNN_ERROR;
+        }
+        return DNN_SUCCESS;
+    }
+
+    if (ff_safe_queue_push_back(native_model->work_queue, request) < 0) {
+        av_log(ctx, AV_LOG_ERROR, "Failed to push back work_queue.\n");
+        return DNN_ERROR;
+    }
+    return DNN_SUCCESS;
+}
+
+DNNAsyncStatusType ff_dnn_get_async_result_native(const DNNModel *model, AVFrame **in, AVFrame **out)
+{
+    NativeModel *native_model = model->model;
+    NativeTask *task = native_model->task_queue ? ff_queue_peek_front(native_model->task_queue) : NULL;
+    DNNReturnType result;
+
+    if (!task) {
+        return DAST_EMPTY_QUEUE;
+    }
+
+    if (!atomic_load(&task->done)) {
+        return DAST_NOT_READY;
+    }
+
+    ff_queue_pop_front(native_model->task_queue);
+    result = task->result;
+    if (result != DNN_SUCCESS) {
+        av_frame_free(&task->in_frame);
+        av_frame_free(&task->out_frame);
+    } else {
+        *in = task->in_frame;
+        *out = task->out_frame;
+    }
+    av_freep(&task);
+
+    return result == DNN_SUCCESS ? DAST_SUCCESS : DAST_FAIL;
+}
+
+DNNReturnType ff_dnn_flush_native(const DNNModel *model)
+{
+    NativeModel *native_model = model->model;
+    NativeContext *ctx = &native_model->ctx;
+    NativeRequest *request;
+
+    if (!native_model->request_queue)
+        return DNN_SUCCESS;
+
+    request = ff_safe_queue_pop_front(native_model->request_queue);
+    if (request->nb_tasks == 0) {
+        // no pending task need to flush
+        if (ff_safe_queue_push_front(native_model->request_queue, request) < 0) {
+            av_log(ctx, AV_LOG_ERROR, "Failed to push back request_queue.\n");
+            return DNN_ERROR;
+        }
+        return DNN_SUCCESS;
+    }
+
+    if (ff_safe_queue_push_back(native_model->work_queue, request) < 0) {
+        av_log(ctx, AV_LOG_ERROR, "Failed to push back work_queue.\n");
+        return DNN_ERROR;
+    }
+    return DNN_SUCCESS;
 }
 
 int32_t ff_calculate_operand_dims_count(const DnnOperand *oprd)
@@ -412,22 +1082,63 @@ int32_t ff_calculate_operand_data_length(const DnnOperand* oprd)
     return len;
 }
 
+static void report_layer_time(NativeModel *native_model)
+{
+    int64_t total = 0;
+
+    for (int32_t layer = 0; layer < native_model->layers_num; ++layer)
+        total += native_model->layer_time[layer];
+
+    for (int32_t layer = 0; layer < native_model->layers_num; ++layer) {
+        int64_t time = native_model->layer_time[layer];
+        av_log(&native_model->ctx, AV_LOG_INFO, "layer %d (%s): %.3f ms per execution, %.1f%%\n",
+               layer, layer_names[native_model->layers[layer].type],
+               time / 1000.0 / native_model->nb_executions,
+               total ? 100.0 * time / total : 0.0);
+    }
+    av_log(&native_model->ctx, AV_LOG_INFO, "%"PRId64" executions, %.3f ms per execution with %d threads\n",
+           native_model->nb_executions, total / 1000.0 / native_model->nb_executions,
+           native_model->ctx.slicethread ? native_model->ctx.nb_threads : 1);
+}
+
 void ff_dnn_free_model_native(DNNModel **model)
 {
     NativeModel *native_model;
     ConvolutionalParams *conv_params;
+    DenseParams *dense_params;
     int32_t layer;
 
     if (*model)
     {
         if ((*model)->model) {
             native_model = (*model)->model;
+            uninit_async(native_model);
+            if (native_model->layer_time && native_model->nb_executions)
+                report_layer_time(native_model);
+            avpriv_slicethread_free(&native_model->ctx.slicethread);
+            av_freep(&native_model->layer_time);
+            av_freep(&native_model->input_range);
+            av_freep(&native_model->tile_scale);
             if (native_model->layers) {
                 for (layer = 0; layer < native_model->layers_num; ++layer){
+                    if (!native_model->layers[layer].params)
+                        continue;
                     if (native_model->layers[layer].type == DLT_CONV2D){
                         conv_params = (ConvolutionalParams *)native_model->layers[layer].params;
                         av_freep(&conv_params->kernel);
                         av_freep(&conv_params->biases);
+                        av_freep(&conv_params->packed_kernel);
+                        av_freep(&conv_params->packed_biases);
+                        if (conv_params->int8)
+                            ff_dnn_int8_uninit_params(conv_params->int8);
+                        av_freep(&conv_params->int8);
+                    } else if (native_model->layers[layer].type == DLT_DENSE){
+                        dense_params = (DenseParams *)native_model->layers[layer].params;
+                        av_freep(&dense_params->kernel);
+                        av_freep(&dense_params->biases);
+                        if (dense_params->int8)
+                            ff_dnn_int8_uninit_params(dense_params->int8);
+                        av_freep(&dense_params->int8);
                     }
                     av_freep(&native_model->layers[layer].params);
                 }
@@ -30,6 +30,10 @@
 #include "../dnn_interface.h"
 #include "libavformat/avio.h"
 #include "libavutil/opt.h"
+#include "libavutil/slicethread.h"
+#include "libavutil/thread.h"
+#include "queue.h"
+#include "safe_queue.h"
 
 /**
  * the enum value of DNNLayerType should not be changed,
@@ -110,12 +114,32 @@ typedef struct InputParams{
 } InputParams;
 
 typedef struct NativeOptions{
-    uint32_t conv2d_threads;
+    uint32_t threads;
+    int timing;
+    int int8;
+    int calibrate;
+    int nireq;
+    int batch_size;
+    int tile_size;
 } NativeOptions;
 
+/**
+ * Job callback of the layers, run for jobnr in [0, nb_jobs).
+ */
+typedef void (*NativeJobFunc)(void *arg, int jobnr, int nb_jobs);
+
 typedef struct NativeContext {
     const AVClass *class;
     NativeOptions options;
+
+    /**
+     * thread pool shared by all the layers, created once when the model is
+     * loaded; NULL when the layers run on the calling thread only.
+     */
+    AVSliceThread *slicethread;
+    int nb_threads;
+    NativeJobFunc job_func;
+    void *job_arg;
 } NativeContext;
 
 // Represents simple feed-forward convolutional network.
@@ -126,17 +150,95 @@ typedef struct NativeModel{
     int32_t layers_num;
     DnnOperand *operands;
     int32_t operands_num;
+    int64_t *layer_time;    ///< accumulated execution time of each layer, in microseconds
+    int64_t nb_executions;
+
+    /**
+     * largest magnitude of the input of each layer, read from the
+     * calibration table of the model file or measured in calibration mode;
+     * NULL if neither. 0 for the layers which are not calibrated.
+     */
+    float *input_range;
+    int has_calibration_table;  ///< set if the model file has a calibration table
+
+    /**
+     * size of each operand relative to the model input, for tiled
+     * execution; NULL if the model is not run in tiles
+     */
+    int *tile_scale;
+
+    /* for async execution */
+    SafeQueue *request_queue;   ///< idle requests, holds NativeRequest
+    SafeQueue *work_queue;      ///< requests to run, a NULL entry stops a worker
+    Queue *task_queue;          ///< tasks in submission order, holds NativeTask
+    int nb_requests;
+#if HAVE_PTHREAD_CANCEL
+    pthread_t *workers;
+#endif
+    int nb_workers;
 } NativeModel;
 
+/**
+ * Tag of the optional calibration table, stored between the operands and
+ * the layer and operand counts of the model file. It is followed by one
+ * float per layer, see NativeModel.input_range.
+ */
+#define DNN_NATIVE_CALIBRATION_TAG MKTAG('I', 'N', 'T', '8')
+
 DNNModel *ff_dnn_load_model_native(const char *model_filename, DNNFunctionType func_type, const char *options, AVFilterContext *filter_ctx);
 
 DNNReturnType ff_dnn_execute_model_native(const DNNModel *model, const char *input_name, AVFrame *in_frame,
                                           const char **output_names, uint32_t nb_output, AVFrame *out_frame);
 
+DNNReturnType ff_dnn_execute_model_async_native(const DNNModel *model, const char *input_name, AVFrame *in_frame,
+                                                const char **output_names, uint32_t nb_output, AVFrame *out_frame);
+
+DNNAsyncStatusType ff_dnn_get_async_result_native(const DNNModel *model, AVFrame **in, AVFrame **out);
+
+DNNReturnType ff_dnn_flush_native(const DNNModel *model);
+
 void ff_dnn_free_model_native(DNNModel **model);
 
 // NOTE: User must check for error (return value <= 0) to handle
 // case like integer overflow.
 int32_t ff_calculate_operand_data_length(const DnnOperand *oprd);
 int32_t ff_calculate_operand_dims_count(const DnnOperand *oprd);
+
+/**
+ * Return the number of jobs to split nb_units independent units of work into,
+ * at most one per thread of the pool of ctx. ctx may be NULL.
+ */
+int ff_dnn_native_get_nb_jobs(const NativeContext *ctx, int nb_units);
+
+/**
+ * Run func for every job in [0, nb_jobs) on the thread pool of ctx and
+ * return when all of them are done. ctx may be NULL or have no thread pool,
+ * the jobs are then run by the calling thread.
+ */
+void ff_dnn_native_execute(NativeContext *ctx, NativeJobFunc func, void *arg, int nb_jobs);
+
+static av_always_inline float ff_dnn_native_activate(float value, DNNActivationFunc activation)
+{
+    switch (activation){
+    case RELU:
+        return FFMAX(value, 0.0);
+    case TANH:
+        return 2.0f  / (1.0f + exp(-2.0f * value)) - 1.0f;
+    case SIGMOID:
+        return 1.0f / (1.0f + exp(-value));
+    case LEAKY_RELU:
+        return FFMAX(value, 0.0) + 0.2 * FFMIN(value, 0.0);
+    case NONE:
+    default:
+        return value;
+    }
+}
+
+/**
+ * First unit of job jobnr when nb_units units are split into nb_jobs jobs.
+ */
+static inline int ff_dnn_native_job_start(int nb_units, int jobnr, int nb_jobs)
+{
+    return (int64_t)nb_units * jobnr / nb_jobs;
+}
 #endif
@@ -0,0 +1,153 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+#include "dnn_backend_native_int8.h"
+
+/* values handled by one job when quantizing an operand */
+#define QUANTIZE_UNITS_SHIFT 12
+
+typedef struct ThreadData {
+    const float *src;
+    uint8_t *dst;
+    int n;
+    float inv_scale;
+    float *range;
+} ThreadData;
+
+int ff_dnn_int8_init_params(NativeInt8Params *q, const float *kernel,
+                            int nb_outputs, int nb_inputs, float input_range)
+{
+    const int weight_max = DNN_CONV2D_INT8_WEIGHT_MAX;
+
+    q->k           = FFALIGN(nb_inputs, 4);
+    q->stride      = nb_outputs;
+    q->input_range = input_range;
+    q->kernel = av_calloc(q->k, q->stride * sizeof(*q->kernel));
+    q->scales = av_calloc(q->stride, sizeof(*q->scales));
+    q->sums   = av_calloc(q->stride, sizeof(*q->sums));
+    if (!q->kernel || !q->scales || !q->sums) {
+        ff_dnn_int8_uninit_params(q);
+        return AVERROR(ENOMEM);
+    }
+
+    for (int o = 0; o < nb_outputs; o++) {
+        const float *w = kernel + o * nb_inputs;
+        float max = 0.f, inv_scale;
+
+        for (int i = 0; i < nb_inputs; i++)
+            max = FFMAX(max, fabsf(w[i]));
+        q->scales[o] = max > 0.f ? max / weight_max : 1.f;
+        inv_scale = 1.f / q->scales[o];
+
+        for (int i = 0; i < nb_inputs; i++) {
+            int v = av_clip(lrintf(w[i] * inv_scale), -weight_max, weight_max);
+
+            q->kernel[(i / 4 * q->stride + o) * 4 + i % 4] = v;
+            q->sums[o] += v;
+        }
+    }
+
+    return 0;
+}
+
+void ff_dnn_int8_uninit_params(NativeInt8Params *q)
+{
+    av_freep(&q->kernel);
+    av_freep(&q->scales);
+    av_freep(&q->sums);
+}
+
+static void measure_range_job(void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    const int start = ff_dnn_native_job_start(td->n, jobnr, nb_jobs);
+    const int end = ff_dnn_native_job_start(td->n, jobnr + 1, nb_jobs);
+    float max = 0.f;
+
+    for (int i = start; i < end; i++)
+        max = FFMAX(max, fabsf(td->src[i]));
+    td->range[jobnr] = max;
+}
+
+float ff_dnn_int8_measure_range(NativeContext *ctx, const float *src, int n)
+{
+    float range[64] = { 0 };
+    ThreadData td = { .src = src, .n = n, .range = range };
+    int nb_jobs = FFMIN(ff_dnn_native_get_nb_jobs(ctx, n >> QUANTIZE_UNITS_SHIFT),
+                        FF_ARRAY_ELEMS(range));
+    float max = 0.f;
+
+    ff_dnn_native_execute(ctx, measure_range_job, &td, nb_jobs);
+    for (int i = 0; i < nb_jobs; i++)
+        max = FFMAX(max, range[i]);
+
+    return max;
+}
+
+static void quantize_job(void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    const int start = ff_dnn_native_job_start(td->n, jobnr, nb_jobs);
+    const int end = ff_dnn_native_job_start(td->n, jobnr + 1, nb_jobs);
+
+    for (int i = start; i < end; i++)
+        td->dst[i] = av_clip_uint8(lrintf(td->src[i] * td->inv_scale) + DNN_INT8_ZERO_POINT);
+}
+
+int ff_dnn_int8_quantize_input(NativeContext *ctx, const NativeInt8Params *q,
+                               uint8_t **dst, float *scale, const float *src, int n)
+{
+    ThreadData td = { .src = src, .n = n };
+    float range = q->input_range;
+
+    if (range <= 0.f)
+        range = ff_dnn_int8_measure_range(ctx, src, n);
+    if (range <= 0.f)
+        range = 1.f;
+
+    td.dst = av_malloc(n);
+    if (!td.dst)
+        return AVERROR(ENOMEM);
+
+    /* the inputs above a calibrated range saturate */
+    *scale = range / (DNN_INT8_ZERO_POINT - 1);
+    td.inv_scale = 1.f / *scale;
+    ff_dnn_native_execute(ctx, quantize_job, &td,
+                          ff_dnn_native_get_nb_jobs(ctx, n >> QUANTIZE_UNITS_SHIFT));
+    *dst = td.dst;
+
+    return 0;
+}
+
+void ff_dnn_int8_dequantize(float *dst, const int32_t *acc, const NativeInt8Params *q,
+                            const float *biases, float input_scale, int nb_outputs,
+                            DNNActivationFunc activation)
+{
+    for (int o = 0; o < nb_outputs; o++) {
+        float value = (acc[o] - DNN_INT8_ZERO_POINT * q->sums[o]) * (input_scale * q->scales[o]);
+
+        if (biases)
+            value += biases[o];
+        dst[o] = ff_dnn_native_activate(value, activation);
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * int8 quantized inference for the native backend
+ *
+ * The weights of a layer are quantized symmetrically per output channel
+ * when the model is loaded. The inputs are quantized to unsigned 8 bits
+ * around DNN_INT8_ZERO_POINT with one scale per layer, derived from the
+ * calibration table of the model file, or from the largest magnitude of
+ * the input when the layer was not calibrated. The products are summed in
+ * 32 bits by ff_dnn_conv2d_gemm4_int8() and scaled back to float.
+ */
+
+#ifndef AVFILTER_DNN_DNN_BACKEND_NATIVE_INT8_H
+#define AVFILTER_DNN_DNN_BACKEND_NATIVE_INT8_H
+
+#include <stdint.h>
+
+#include "dnn_backend_native.h"
+#include "conv2ddsp.h"
+
+#define DNN_INT8_ZERO_POINT 128
+
+typedef struct NativeInt8Params {
+    int8_t *kernel;         ///< weights packed for ff_dnn_conv2d_gemm4_int8()
+    float *scales;          ///< scale of the quantized weights of each output channel
+    int32_t *sums;          ///< sum of the quantized weights of each output channel
+    int k;                  ///< inputs of each output, padded to a multiple of 4
+    int stride;             ///< output channels
+    float input_range;      ///< calibrated magnitude bound of the input, 0 if unknown
+} NativeInt8Params;
+
+/**
+ * Quantize kernel, which holds nb_inputs weights for each of the nb_outputs
+ * output channels.
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_dnn_int8_init_params(NativeInt8Params *q, const float *kernel,
+                            int nb_outputs, int nb_inputs, float input_range);
+void ff_dnn_int8_uninit_params(NativeInt8Params *q);
+
+/**
+ * Return the largest magnitude of the n values of src.
+ */
+float ff_dnn_int8_measure_range(NativeContext *ctx, const float *src, int n);
+
+/**
+ * Quantize the n values of src into *dst, allocated by this function.
+ *
+ * @param q     parameters of the layer reading the values
+ * @param scale set to the size of one quantization step
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_dnn_int8_quantize_input(NativeContext *ctx, const NativeInt8Params *q,
+                               uint8_t **dst, float *scale, const float *src, int n);
+
+/**
+ * Scale the sums of one output pixel computed by gemm4_int8 back to float,
+ * add the biases, which may be NULL, and apply the activation.
+ */
+void ff_dnn_int8_dequantize(float *dst, const int32_t *acc, const NativeInt8Params *q,
+                            const float *biases, float input_scale, int nb_outputs,
+                            DNNActivationFunc activation);
+
+#endif
@@ -55,21 +55,73 @@ int ff_dnn_load_layer_avg_pool(Layer *layer, AVIOContext *model_file_context, in
     return dnn_size;
 }
 
+typedef struct ThreadData {
+    const float *input;
+    float *output;
+    const AvgPoolParams *params;
+    int height, width, channel;
+    int width_end;
+    int height_radius, width_radius;
+    int output_height, output_width;
+} ThreadData;
+
+static void dnn_execute_layer_avg_pool_job(void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    const AvgPoolParams *avgpool_params = td->params;
+    const float *input = td->input;
+    int height = td->height;
+    int width = td->width;
+    int channel = td->channel;
+    int width_end = td->width_end;
+    int height_radius = td->height_radius;
+    int width_radius = td->width_radius;
+    int kernel_strides = avgpool_params->strides;
+    int src_linesize = width * channel;
+    int start = ff_dnn_native_job_start(td->output_height, jobnr, nb_jobs);
+    int end = ff_dnn_native_job_start(td->output_height, jobnr + 1, nb_jobs);
+    float *output = td->output + start * td->output_width * channel;
+    int kernel_area;
+
+    for (int y = start * kernel_strides; y < end * kernel_strides; y += kernel_strides) {
+        for (int x = 0; x < width_end; x += kernel_strides) {
+            for (int n_channel = 0; n_channel < channel; ++n_channel) {
+                output[n_channel] = 0.0;
+                kernel_area = 0;
+                for (int kernel_y = 0; kernel_y < avgpool_params->kernel_size; ++kernel_y) {
+                    for (int kernel_x = 0; kernel_x < avgpool_params->kernel_size; ++kernel_x) {
+                        float input_pel;
+                        int y_pos = y + (kernel_y - height_radius);
+                        int x_pos = x + (kernel_x - width_radius);
+                        if (x_pos < 0 || x_pos >= width || y_pos < 0 || y_pos >= height) {
+                            input_pel = 0.0;
+                        } else {
+                            kernel_area++;
+                            input_pel = input[y_pos * src_linesize + x_pos * channel + n_channel];
+                        }
+                        output[n_channel] += input_pel;
+                    }
+                }
+                output[n_channel] /= kernel_area;
+            }
+            output += channel;
+        }
+    }
+}
+
 int ff_dnn_execute_layer_avg_pool(DnnOperand *operands, const int32_t *input_operand_indexes,
                                   int32_t output_operand_index, const void *parameters, NativeContext *ctx)
 {
-    float *output;
-    int height_end, width_end, height_radius, width_radius, output_height, output_width, kernel_area;
+    ThreadData td;
+    int width_end, height_radius, width_radius, output_height, output_width;
     int32_t input_operand_index = input_operand_indexes[0];
     int number = operands[input_operand_index].dims[0];
     int height = operands[input_operand_index].dims[1];
     int width = operands[input_operand_index].dims[2];
     int channel = operands[input_operand_index].dims[3];
-    const float *input = operands[input_operand_index].data;
     const AvgPoolParams *avgpool_params = parameters;
 
     int kernel_strides = avgpool_params->strides;
-    int src_linesize = width * channel;
     DnnOperand *output_operand = &operands[output_operand_index];
 
     /**
@@ -82,7 +134,6 @@ int ff_dnn_execute_layer_avg_pool(DnnOperand *operands, const int32_t *input_ope
      *                       and 7 - 2 - 2 = 3 lines after the last line of input image.
      */
     if (avgpool_params->padding_method == SAME) {
-        height_end = height;
         width_end = width;
         height_radius = avgpool_params->kernel_size - ((height - 1) % kernel_strides + 1);
         width_radius = avgpool_params->kernel_size - ((width - 1) % kernel_strides + 1);
@@ -92,7 +143,6 @@ int ff_dnn_execute_layer_avg_pool(DnnOperand *operands, const int32_t *input_ope
         output_width = ceil(width / (kernel_strides * 1.0));
     } else {
         av_assert0(avgpool_params->padding_method == VALID);
-        height_end = height - avgpool_params->kernel_size + 1;
         width_end = width - avgpool_params->kernel_size + 1;
         height_radius = 0;
         width_radius = 0;
@@ -116,32 +166,19 @@ int ff_dnn_execute_layer_avg_pool(DnnOperand *operands, const int32_t *input_ope
         av_log(ctx, AV_LOG_ERROR, "Failed to reallocate memory for output\n");
         return DNN_ERROR;
     }
-    output = output_operand->data;
-
-    for (int y = 0; y < height_end; y += kernel_strides) {
-        for (int x = 0; x < width_end; x += kernel_strides) {
-            for (int n_channel = 0; n_channel < channel; ++n_channel) {
-                output[n_channel] = 0.0;
-                kernel_area = 0;
-                for (int kernel_y = 0; kernel_y < avgpool_params->kernel_size; ++kernel_y) {
-                    for (int kernel_x = 0; kernel_x < avgpool_params->kernel_size; ++kernel_x) {
-                        float input_pel;
-                        int y_pos = y + (kernel_y - height_radius);
-                        int x_pos = x + (kernel_x - width_radius);
-                        if (x_pos < 0 || x_pos >= width || y_pos < 0 || y_pos >= height) {
-                            input_pel = 0.0;
-                        } else {
-                            kernel_area++;
-                            input_pel = input[y_pos * src_linesize + x_pos * channel + n_channel];
-                        }
-                        output[n_channel] += input_pel;
-                    }
-                }
-                output[n_channel] /= kernel_area;
-            }
-            output += channel;
-        }
-    }
+    td.input = operands[input_operand_index].data;
+    td.output = output_operand->data;
+    td.params = avgpool_params;
+    td.height = height;
+    td.width = width;
+    td.channel = channel;
+    td.width_end = width_end;
+    td.height_radius = height_radius;
+    td.width_radius = width_radius;
+    td.output_height = output_height;
+    td.output_width = output_width;
+    ff_dnn_native_execute(ctx, dnn_execute_layer_avg_pool_job, &td,
+                          ff_dnn_native_get_nb_jobs(ctx, output_height));
 
     return 0;
 }
@@ -18,13 +18,16 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <string.h>
+
 #include "libavutil/avassert.h"
-#include "libavutil/thread.h"
-#include "libavutil/cpu.h"
 #include "dnn_backend_native_layer_conv2d.h"
 
 #define CLAMP_TO_EDGE(x, w) ((x) < 0 ? 0 : ((x) >= (w) ? (w - 1) : (x)))
 
+/* number of output pixels lowered to a matrix at once */
+#define TILE_PIXELS 64
+
 //struct to pass parameters
 typedef struct ThreadCommonParam{
     DnnOperand *operands;
@@ -33,16 +36,12 @@ typedef struct ThreadCommonParam{
     const void *parameters;
     NativeContext *ctx;
     float *output_data;
+    float *scratch;
+    size_t scratch_size;
+    const uint8_t *quantized_input;
+    float input_scale;
 } ThreadCommonParam;
 
-typedef struct ThreadParam{
-    ThreadCommonParam *thread_common_param;
-    int thread_start, thread_end;
-#if HAVE_PTHREAD_CANCEL
-    pthread_t thread;
-#endif
-} ThreadParam;
-
 int ff_dnn_load_layer_conv2d(Layer *layer, AVIOContext *model_file_context, int file_size, int operands_num)
 {
     ConvolutionalParams *conv_params;
@@ -95,7 +94,12 @@ int ff_dnn_load_layer_conv2d(Layer *layer, AVIOContext *model_file_context, int
         }
     }
 
+    conv_params->packed_kernel = NULL;
+    conv_params->packed_biases = NULL;
+    conv_params->int8 = NULL;
     layer->params = conv_params;
+    if (ff_dnn_pack_layer_conv2d(conv_params) < 0)
+        return 0;
 
     layer->input_operand_indexes[0] = (int32_t)avio_rl32(model_file_context);
     layer->output_operand_index = (int32_t)avio_rl32(model_file_context);
@@ -108,11 +112,106 @@ int ff_dnn_load_layer_conv2d(Layer *layer, AVIOContext *model_file_context, int
     return dnn_size;
 }
 
-static void * dnn_execute_layer_conv2d_thread(void *threadarg)
+int ff_dnn_pack_layer_conv2d(ConvolutionalParams *conv_params)
+{
+    int filter_size = conv_params->kernel_size * conv_params->kernel_size * conv_params->input_num;
+    int stride = conv_params->output_num;
+
+    av_freep(&conv_params->packed_kernel);
+    av_freep(&conv_params->packed_biases);
+    conv_params->packed_kernel = av_calloc(filter_size, stride * sizeof(*conv_params->packed_kernel));
+    conv_params->packed_biases = av_calloc(stride, sizeof(*conv_params->packed_biases));
+    if (!conv_params->packed_kernel || !conv_params->packed_biases) {
+        av_freep(&conv_params->packed_kernel);
+        av_freep(&conv_params->packed_biases);
+        return AVERROR(ENOMEM);
+    }
+    conv_params->packed_stride = stride;
+
+    for (int n_filter = 0; n_filter < conv_params->output_num; ++n_filter) {
+        for (int i = 0; i < filter_size; ++i)
+            conv_params->packed_kernel[i * stride + n_filter] = conv_params->kernel[n_filter * filter_size + i];
+        if (conv_params->has_bias)
+            conv_params->packed_biases[n_filter] = conv_params->biases[n_filter];
+    }
+
+    return 0;
+}
+
+int ff_dnn_quantize_layer_conv2d(ConvolutionalParams *conv_params, float input_range)
+{
+    int filter_size = conv_params->kernel_size * conv_params->kernel_size * conv_params->input_num;
+    int ret;
+
+    if (!conv_params->int8) {
+        conv_params->int8 = av_mallocz(sizeof(*conv_params->int8));
+        if (!conv_params->int8)
+            return AVERROR(ENOMEM);
+    }
+    ff_dnn_int8_uninit_params(conv_params->int8);
+
+    ret = ff_dnn_int8_init_params(conv_params->int8, conv_params->kernel,
+                                  conv_params->output_num, filter_size, input_range);
+    if (ret < 0)
+        av_freep(&conv_params->int8);
+    return ret;
+}
+
+/* gather the input taps of the output pixel (x, y), in kernel layout order */
+static void im2col_pixel(float *col, const float *input, const ConvolutionalParams *conv_params,
+                         int x, int y, int width, int height)
+{
+    int radius = conv_params->kernel_size >> 1;
+    int src_linesize = width * conv_params->input_num;
+    size_t tap_size = conv_params->input_num * sizeof(*col);
+
+    for (int kernel_y = 0; kernel_y < conv_params->kernel_size; ++kernel_y) {
+        int y_pos = y + (kernel_y - radius) * conv_params->dilation;
+        for (int kernel_x = 0; kernel_x < conv_params->kernel_size; ++kernel_x) {
+            int x_pos = x + (kernel_x - radius) * conv_params->dilation;
+            if (conv_params->padding_method == SAME_CLAMP_TO_EDGE) {
+                memcpy(col, input + CLAMP_TO_EDGE(y_pos, height) * src_linesize +
+                                    CLAMP_TO_EDGE(x_pos, width) * conv_params->input_num, tap_size);
+            } else if (x_pos < 0 || x_pos >= width || y_pos < 0 || y_pos >= height) {
+                memset(col, 0, tap_size);
+            } else {
+                memcpy(col, input + y_pos * src_linesize + x_pos * conv_params->input_num, tap_size);
+            }
+            col += conv_params->input_num;
+        }
+    }
+}
+
+/* same as im2col_pixel() on the quantized input, padded to the int8 kernel size */
+static void im2col_pixel_int8(uint8_t *col, const uint8_t *input, const ConvolutionalParams *conv_params,
+                              int x, int y, int width, int height)
+{
+    int radius = conv_params->kernel_size >> 1;
+    int src_linesize = width * conv_params->input_num;
+    uint8_t *end = col + conv_params->int8->k;
+
+    for (int kernel_y = 0; kernel_y < conv_params->kernel_size; ++kernel_y) {
+        int y_pos = y + (kernel_y - radius) * conv_params->dilation;
+        for (int kernel_x = 0; kernel_x < conv_params->kernel_size; ++kernel_x) {
+            int x_pos = x + (kernel_x - radius) * conv_params->dilation;
+            if (conv_params->padding_method == SAME_CLAMP_TO_EDGE) {
+                memcpy(col, input + CLAMP_TO_EDGE(y_pos, height) * src_linesize +
+                                    CLAMP_TO_EDGE(x_pos, width) * conv_params->input_num, conv_params->input_num);
+            } else if (x_pos < 0 || x_pos >= width || y_pos < 0 || y_pos >= height) {
+                memset(col, DNN_INT8_ZERO_POINT, conv_params->input_num);
+            } else {
+                memcpy(col, input + y_pos * src_linesize + x_pos * conv_params->input_num, conv_params->input_num);
+            }
+            col += conv_params->input_num;
+        }
+    }
+    memset(col, 0, end - col);
+}
+
+static void dnn_execute_layer_conv2d_job(void *arg, int jobnr, int nb_jobs)
 {
     //pass parameters
-    ThreadParam *thread_param = threadarg;
-    ThreadCommonParam *thread_common_param = thread_param->thread_common_param;
+    ThreadCommonParam *thread_common_param = arg;
     DnnOperand *operands = thread_common_param->operands;
     int32_t input_operand_index = thread_common_param->input_operand_indexes[0];
     int height = operands[input_operand_index].dims[1];
@@ -121,87 +220,82 @@ static void * dnn_execute_layer_conv2d_thread(void *threadarg)
     const float *input = operands[input_operand_index].data;
     const ConvolutionalParams *conv_params = thread_common_param->parameters;
 
-    int radius = conv_params->kernel_size >> 1;
-    int src_linesize = width * conv_params->input_num;
-    int filter_linesize = conv_params->kernel_size * conv_params->input_num;
-    int filter_size = conv_params->kernel_size * filter_linesize;
+    int filter_size = conv_params->kernel_size * conv_params->kernel_size * conv_params->input_num;
     int pad_size = (conv_params->padding_method == VALID) ? (conv_params->kernel_size - 1) / 2 * conv_params->dilation : 0;
+    int thread_start = ff_dnn_native_job_start(height - 2 * pad_size, jobnr, nb_jobs) + pad_size;
+    int thread_end = ff_dnn_native_job_start(height - 2 * pad_size, jobnr + 1, nb_jobs) + pad_size;
+    int output_width = width - 2 * pad_size;
+    int nb_pixels = (thread_end - thread_start) * output_width;
+    ptrdiff_t stride = conv_params->packed_stride;
 
+    float *col = thread_common_param->scratch + jobnr * thread_common_param->scratch_size;
+    float *tile = col + TILE_PIXELS * filter_size;
+    const NativeInt8Params *q = conv_params->int8;
+    int32_t *qtile = (int32_t *)col;
     float *output = thread_common_param->output_data;
-    output += (conv_params->output_num) * (width - 2 * pad_size) * (thread_param->thread_start - pad_size);
+    output += (conv_params->output_num) * output_width * (thread_start - pad_size);
 
     av_assert0(channel == conv_params->input_num);
 
-    for (int y = thread_param->thread_start; y < thread_param->thread_end; ++y) {
-        for (int x = pad_size; x < width - pad_size; ++x) {
-            for (int n_filter = 0; n_filter < conv_params->output_num; ++n_filter) {
-                if (conv_params->has_bias)
-                    output[n_filter] = conv_params->biases[n_filter];
-                else
-                    output[n_filter] = 0.f;
-
-                for (int ch = 0; ch < conv_params->input_num; ++ch) {
-                    for (int kernel_y = 0; kernel_y < conv_params->kernel_size; ++kernel_y) {
-                        for (int kernel_x = 0; kernel_x < conv_params->kernel_size; ++kernel_x) {
-                            float input_pel;
-                            if (conv_params->padding_method == SAME_CLAMP_TO_EDGE) {
-                                int y_pos = CLAMP_TO_EDGE(y + (kernel_y - radius) * conv_params->dilation, height);
-                                int x_pos = CLAMP_TO_EDGE(x + (kernel_x - radius) * conv_params->dilation, width);
-                                input_pel = input[y_pos * src_linesize + x_pos * conv_params->input_num + ch];
-                            } else {
-                                int y_pos = y + (kernel_y - radius) * conv_params->dilation;
-                                int x_pos = x + (kernel_x - radius) * conv_params->dilation;
-                                input_pel = (x_pos < 0 || x_pos >= width || y_pos < 0 || y_pos >= height) ? 0.0 :
-                                                   input[y_pos * src_linesize + x_pos * conv_params->input_num + ch];
-                            }
-
-
-                            output[n_filter] += input_pel * conv_params->kernel[n_filter * filter_size + kernel_y * filter_linesize +
-                                                                                kernel_x * conv_params->input_num + ch];
-                        }
-                    }
-                }
-                switch (conv_params->activation){
-                case RELU:
-                    output[n_filter] = FFMAX(output[n_filter], 0.0);
-                    break;
-                case TANH:
-                    output[n_filter] = 2.0f  / (1.0f + exp(-2.0f * output[n_filter])) - 1.0f;
-                    break;
-                case SIGMOID:
-                    output[n_filter] = 1.0f / (1.0f + exp(-output[n_filter]));
-                    break;
-                case NONE:
-                    break;
-                case LEAKY_RELU:
-                    output[n_filter] = FFMAX(output[n_filter], 0.0) + 0.2 * FFMIN(output[n_filter], 0.0);
-                }
+    for (int pixel = 0; pixel < nb_pixels; pixel += TILE_PIXELS) {
+        int tile_pixels = FFMIN(TILE_PIXELS, nb_pixels - pixel);
+
+        if (q) {
+            uint8_t *qcol = (uint8_t *)(qtile + TILE_PIXELS * q->stride);
+
+            for (int p = 0; p < tile_pixels; ++p) {
+                int y = thread_start + (pixel + p) / output_width;
+                int x = pad_size + (pixel + p) % output_width;
+                im2col_pixel_int8(qcol + p * q->k, thread_common_param->quantized_input,
+                                  conv_params, x, y, width, height);
+            }
+            memset(qcol + tile_pixels * q->k, 0, (FFALIGN(tile_pixels, 4) - tile_pixels) * q->k);
+
+            for (int p = 0; p < tile_pixels; p += 4)
+                ff_dnn_conv2d_gemm4_int8(qtile + p * q->stride, qcol + p * q->k, q->kernel, q->k, q->stride);
+
+            for (int p = 0; p < tile_pixels; ++p) {
+                ff_dnn_int8_dequantize(output, qtile + p * q->stride, q, conv_params->biases,
+                                       thread_common_param->input_scale, conv_params->output_num,
+                                       conv_params->activation);
+                output += conv_params->output_num;
             }
+            continue;
+        }
+
+        for (int p = 0; p < tile_pixels; ++p) {
+            int y = thread_start + (pixel + p) / output_width;
+            int x = pad_size + (pixel + p) % output_width;
+            im2col_pixel(col + p * filter_size, input, conv_params, x, y, width, height);
+        }
+        memset(col + tile_pixels * filter_size, 0,
+               (FFALIGN(tile_pixels, 4) - tile_pixels) * filter_size * sizeof(*col));
+
+        for (int p = 0; p < tile_pixels; p += 4)
+            ff_dnn_conv2d_gemm4(tile + p * stride, col + p * filter_size,
+                                conv_params->packed_kernel, conv_params->packed_biases,
+                                filter_size, stride);
+
+        for (int p = 0; p < tile_pixels; ++p) {
+            for (int n_filter = 0; n_filter < conv_params->output_num; ++n_filter)
+                output[n_filter] = ff_dnn_native_activate(tile[p * stride + n_filter], conv_params->activation);
             output += conv_params->output_num;
         }
     }
-    return NULL;
 }
 
-
 int ff_dnn_execute_layer_conv2d(DnnOperand *operands, const int32_t *input_operand_indexes,
                                 int32_t output_operand_index, const void *parameters, NativeContext *ctx)
 {
-#if HAVE_PTHREAD_CANCEL
-    int thread_num = (ctx->options.conv2d_threads <= 0 || ctx->options.conv2d_threads > av_cpu_count())
-        ? (av_cpu_count() + 1) : (ctx->options.conv2d_threads);
-    int ret = DNN_SUCCESS, thread_stride;
-    ThreadParam *thread_param;
-#else
-    ThreadParam thread_param = { 0 };
-#endif
     ThreadCommonParam thread_common_param;
     const ConvolutionalParams *conv_params = parameters;
     int height = operands[input_operand_indexes[0]].dims[1];
     int width = operands[input_operand_indexes[0]].dims[2];
     int pad_size = (conv_params->padding_method == VALID) ? (conv_params->kernel_size - 1) / 2 * conv_params->dilation : 0;
+    int filter_size = conv_params->kernel_size * conv_params->kernel_size * conv_params->input_num;
     DnnOperand *output_operand = &operands[output_operand_index];
     void *tmp;
+    int nb_jobs;
 
     output_operand->dims[0] = operands[input_operand_indexes[0]].dims[0];
     output_operand->dims[1] = height - pad_size * 2;
@@ -226,38 +320,36 @@ int ff_dnn_execute_layer_conv2d(DnnOperand *operands, const int32_t *input_opera
     thread_common_param.parameters = parameters;
     thread_common_param.ctx = ctx;
 
-#if HAVE_PTHREAD_CANCEL
-    thread_param = av_malloc_array(thread_num, sizeof(*thread_param));
-    if (!thread_param)
-        return DNN_ERROR;
-    thread_stride = (height - pad_size * 2) / thread_num;
-    //create threads
-    for (int i = 0; i < thread_num; i++){
-        thread_param[i].thread_common_param = &thread_common_param;
-        thread_param[i].thread_start = thread_stride * i + pad_size;
-        thread_param[i].thread_end = (i == thread_num - 1) ? (height - pad_size) : (thread_param[i].thread_start + thread_stride);
-        if (pthread_create(&thread_param[i].thread, NULL,
-                           dnn_execute_layer_conv2d_thread, &thread_param[i])) {
-            thread_num = i;
-            ret = DNN_ERROR;
-            break;
+    thread_common_param.quantized_input = NULL;
+
+    if (conv_params->int8) {
+        const NativeInt8Params *q = conv_params->int8;
+        uint8_t *quantized_input;
+
+        if (ff_dnn_int8_quantize_input(ctx, q, &quantized_input, &thread_common_param.input_scale,
+                                       operands[input_operand_indexes[0]].data,
+                                       ff_calculate_operand_dims_count(&operands[input_operand_indexes[0]])) < 0) {
+            av_log(ctx, AV_LOG_ERROR, "Failed to allocate memory for the quantized input\n");
+            return DNN_ERROR;
         }
+        thread_common_param.quantized_input = quantized_input;
+        /* the int32 sums followed by the lowered input, in units of floats */
+        thread_common_param.scratch_size = TILE_PIXELS * (q->stride + q->k / 4);
+    } else {
+        thread_common_param.scratch_size = TILE_PIXELS * (filter_size + conv_params->packed_stride);
     }
 
-    for (int i = 0; i < thread_num; i++){
-        pthread_join(thread_param[i].thread, NULL);
+    nb_jobs = ff_dnn_native_get_nb_jobs(ctx, height - pad_size * 2);
+    thread_common_param.scratch = av_malloc_array(nb_jobs, thread_common_param.scratch_size * sizeof(float));
+    if (!thread_common_param.scratch) {
+        av_log(ctx, AV_LOG_ERROR, "Failed to allocate memory for the lowered input\n");
+        av_freep(&thread_common_param.quantized_input);
+        return DNN_ERROR;
     }
 
-    //release memory
-    av_freep(&thread_param);
-
-    return ret;
-#else
-    thread_param.thread_common_param = &thread_common_param;
-    thread_param.thread_start = pad_size;
-    thread_param.thread_end = height - pad_size;
-    dnn_execute_layer_conv2d_thread(&thread_param);
+    ff_dnn_native_execute(ctx, dnn_execute_layer_conv2d_job, &thread_common_param, nb_jobs);
 
+    av_freep(&thread_common_param.scratch);
+    av_freep(&thread_common_param.quantized_input);
     return DNN_SUCCESS;
-#endif
 }
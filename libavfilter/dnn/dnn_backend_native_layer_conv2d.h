@@ -22,7 +22,8 @@
 #define AVFILTER_DNN_DNN_BACKEND_NATIVE_LAYER_CONV2D_H
 
 #include "dnn_backend_native.h"
-
+#include "dnn_backend_native_int8.h"
+#include "conv2ddsp.h"
 
 typedef struct ConvolutionalParams{
     int32_t input_num, output_num, kernel_size;
@@ -32,9 +33,36 @@ typedef struct ConvolutionalParams{
     int32_t has_bias;
     float *kernel;
     float *biases;
+
+    /**
+     * kernel and biases repacked by ff_dnn_pack_layer_conv2d() for
+     * ff_dnn_conv2d_gemm4(), the kernel holds one row of packed_stride
+     * output channels per (kernel_y, kernel_x, input channel) tap.
+     */
+    float *packed_kernel;
+    float *packed_biases;
+    int packed_stride;
+
+    /**
+     * quantized kernel set by ff_dnn_quantize_layer_conv2d(), the layer
+     * runs in int8 when it is not NULL.
+     */
+    NativeInt8Params *int8;
 } ConvolutionalParams;
 
 int ff_dnn_load_layer_conv2d(Layer *layer, AVIOContext *model_file_context, int file_size, int operands_num);
+/**
+ * Build the packed kernel used by ff_dnn_execute_layer_conv2d() from kernel
+ * and biases; must be called once before the layer is executed.
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_dnn_pack_layer_conv2d(ConvolutionalParams *conv_params);
+/**
+ * Switch the layer to int8 inference.
+ * @param input_range calibrated magnitude bound of the input, 0 if unknown
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_dnn_quantize_layer_conv2d(ConvolutionalParams *conv_params, float input_range);
 int ff_dnn_execute_layer_conv2d(DnnOperand *operands, const int32_t *input_operand_indexes,
                                 int32_t output_operand_index, const void *parameters, NativeContext *ctx);
 #endif
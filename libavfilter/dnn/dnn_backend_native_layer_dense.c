@@ -18,9 +18,14 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <string.h>
+
 #include "libavutil/avassert.h"
 #include "dnn_backend_native_layer_dense.h"
 
+/* number of output pixels computed at once by the int8 path */
+#define TILE_PIXELS 64
+
 int ff_dnn_load_layer_dense(Layer *layer, AVIOContext *model_file_context, int file_size, int operands_num)
 {
     DenseParams *dense_params;
@@ -69,6 +74,7 @@ int ff_dnn_load_layer_dense(Layer *layer, AVIOContext *model_file_context, int f
         }
     }
 
+    dense_params->int8 = NULL;
     layer->params = dense_params;
 
     layer->input_operand_indexes[0] = (int32_t)avio_rl32(model_file_context);
@@ -82,19 +88,120 @@ int ff_dnn_load_layer_dense(Layer *layer, AVIOContext *model_file_context, int f
     return dnn_size;
 }
 
+int ff_dnn_quantize_layer_dense(DenseParams *dense_params, float input_range)
+{
+    int ret;
+
+    if (!dense_params->int8) {
+        dense_params->int8 = av_mallocz(sizeof(*dense_params->int8));
+        if (!dense_params->int8)
+            return AVERROR(ENOMEM);
+    }
+    ff_dnn_int8_uninit_params(dense_params->int8);
+
+    ret = ff_dnn_int8_init_params(dense_params->int8, dense_params->kernel,
+                                  dense_params->output_num, dense_params->input_num, input_range);
+    if (ret < 0)
+        av_freep(&dense_params->int8);
+    return ret;
+}
+
+typedef struct ThreadData {
+    const float *input;
+    float *output;
+    const DenseParams *params;
+    int nb_pixels;
+    const uint8_t *quantized_input;
+    float input_scale;
+    uint8_t *scratch;
+    size_t scratch_size;
+} ThreadData;
+
+static void dnn_execute_layer_dense_int8_job(void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    const DenseParams *dense_params = td->params;
+    const NativeInt8Params *q = dense_params->int8;
+    const int start = ff_dnn_native_job_start(td->nb_pixels, jobnr, nb_jobs);
+    const int end = ff_dnn_native_job_start(td->nb_pixels, jobnr + 1, nb_jobs);
+    const int input_num = dense_params->input_num;
+    int32_t *tile = (int32_t *)(td->scratch + jobnr * td->scratch_size);
+    uint8_t *col = (uint8_t *)(tile + TILE_PIXELS * q->stride);
+    float *output = td->output + start * dense_params->output_num;
+
+    for (int pixel = start; pixel < end; pixel += TILE_PIXELS) {
+        int tile_pixels = FFMIN(TILE_PIXELS, end - pixel);
+
+        /* pad the inputs of each pixel to the quantized kernel size */
+        memset(col, 0, FFALIGN(tile_pixels, 4) * q->k);
+        for (int p = 0; p < tile_pixels; ++p)
+            memcpy(col + p * q->k, td->quantized_input + (pixel + p) * input_num, input_num);
+
+        for (int p = 0; p < tile_pixels; p += 4)
+            ff_dnn_conv2d_gemm4_int8(tile + p * q->stride, col + p * q->k, q->kernel, q->k, q->stride);
+
+        for (int p = 0; p < tile_pixels; ++p) {
+            ff_dnn_int8_dequantize(output, tile + p * q->stride, q, dense_params->biases,
+                                   td->input_scale, dense_params->output_num,
+                                   dense_params->activation);
+            output += dense_params->output_num;
+        }
+    }
+}
+
+static void dnn_execute_layer_dense_job(void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    const DenseParams *dense_params = td->params;
+    const int start = ff_dnn_native_job_start(td->nb_pixels, jobnr, nb_jobs);
+    const int end = ff_dnn_native_job_start(td->nb_pixels, jobnr + 1, nb_jobs);
+    const float *input = td->input + start * dense_params->input_num;
+    float *output = td->output + start * dense_params->output_num;
+
+    for (int i = start; i < end; ++i) {
+        for (int n_filter = 0; n_filter < dense_params->output_num; ++n_filter) {
+            if (dense_params->has_bias)
+                output[n_filter] = dense_params->biases[n_filter];
+            else
+                output[n_filter] = 0.f;
+
+            for (int ch = 0; ch < dense_params->input_num; ++ch) {
+                float input_pel;
+                input_pel = input[ch];
+                output[n_filter] += input_pel * dense_params->kernel[n_filter*dense_params->input_num + ch];
+            }
+            switch (dense_params->activation){
+            case RELU:
+                output[n_filter] = FFMAX(output[n_filter], 0.0);
+                break;
+            case TANH:
+                output[n_filter] = 2.0f  / (1.0f + exp(-2.0f * output[n_filter])) - 1.0f;
+                break;
+            case SIGMOID:
+                output[n_filter] = 1.0f / (1.0f + exp(-output[n_filter]));
+                break;
+            case NONE:
+                break;
+            case LEAKY_RELU:
+                output[n_filter] = FFMAX(output[n_filter], 0.0) + 0.2 * FFMIN(output[n_filter], 0.0);
+            }
+        }
+        input += dense_params->input_num;
+        output += dense_params->output_num;
+    }
+}
+
 int ff_dnn_execute_layer_dense(DnnOperand *operands, const int32_t *input_operand_indexes,
                                int32_t output_operand_index, const void *parameters, NativeContext *ctx)
 {
-    float *output;
+    ThreadData td;
     int32_t input_operand_index = input_operand_indexes[0];
     int number = operands[input_operand_index].dims[0];
     int height = operands[input_operand_index].dims[1];
     int width = operands[input_operand_index].dims[2];
     int channel = operands[input_operand_index].dims[3];
-    const float *input = operands[input_operand_index].data;
     const DenseParams *dense_params = parameters;
 
-    int src_linesize = width * channel;
     DnnOperand *output_operand = &operands[output_operand_index];
     output_operand->dims[0] = number;
     output_operand->dims[1] = height;
@@ -111,41 +218,42 @@ int ff_dnn_execute_layer_dense(DnnOperand *operands, const int32_t *input_operan
         av_log(ctx, AV_LOG_ERROR, "Failed to reallocate memory for output\n");
         return DNN_ERROR;
     }
-    output = output_operand->data;
 
     av_assert0(channel == dense_params->input_num);
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            for (int n_filter = 0; n_filter < dense_params->output_num; ++n_filter) {
-                if (dense_params->has_bias)
-                    output[n_filter] = dense_params->biases[n_filter];
-                else
-                    output[n_filter] = 0.f;
-
-                for (int ch = 0; ch < dense_params->input_num; ++ch) {
-                    float input_pel;
-                    input_pel = input[y * src_linesize + x * dense_params->input_num + ch];
-                    output[n_filter] += input_pel * dense_params->kernel[n_filter*dense_params->input_num + ch];
-                }
-                switch (dense_params->activation){
-                case RELU:
-                    output[n_filter] = FFMAX(output[n_filter], 0.0);
-                    break;
-                case TANH:
-                    output[n_filter] = 2.0f  / (1.0f + exp(-2.0f * output[n_filter])) - 1.0f;
-                    break;
-                case SIGMOID:
-                    output[n_filter] = 1.0f / (1.0f + exp(-output[n_filter]));
-                    break;
-                case NONE:
-                    break;
-                case LEAKY_RELU:
-                    output[n_filter] = FFMAX(output[n_filter], 0.0) + 0.2 * FFMIN(output[n_filter], 0.0);
-                }
-            }
-            output += dense_params->output_num;
+    td.input     = operands[input_operand_index].data;
+    td.output    = output_operand->data;
+    td.params    = dense_params;
+    td.nb_pixels = height * width;
+
+    if (dense_params->int8) {
+        const NativeInt8Params *q = dense_params->int8;
+        int nb_jobs = ff_dnn_native_get_nb_jobs(ctx, td.nb_pixels);
+        uint8_t *quantized_input;
+
+        if (ff_dnn_int8_quantize_input(ctx, q, &quantized_input, &td.input_scale, td.input,
+                                       ff_calculate_operand_dims_count(&operands[input_operand_index])) < 0) {
+            av_log(ctx, AV_LOG_ERROR, "Failed to allocate memory for the quantized input\n");
+            return DNN_ERROR;
+        }
+        td.quantized_input = quantized_input;
+        td.scratch_size = TILE_PIXELS * (q->stride * sizeof(int32_t) + q->k);
+        td.scratch = av_malloc_array(nb_jobs, td.scratch_size);
+        if (!td.scratch) {
+            av_log(ctx, AV_LOG_ERROR, "Failed to allocate memory for the quantized tiles\n");
+            av_freep(&quantized_input);
+            return DNN_ERROR;
         }
+
+        ff_dnn_native_execute(ctx, dnn_execute_layer_dense_int8_job, &td, nb_jobs);
+
+        av_freep(&td.scratch);
+        av_freep(&quantized_input);
+        return 0;
     }
+
+    ff_dnn_native_execute(ctx, dnn_execute_layer_dense_job, &td,
+                          ff_dnn_native_get_nb_jobs(ctx, td.nb_pixels));
+
     return 0;
 }
@@ -22,6 +22,7 @@
 #define AVFILTER_DNN_DNN_BACKEND_NATIVE_LAYER_DENSE_H
 
 #include "dnn_backend_native.h"
+#include "dnn_backend_native_int8.h"
 
 typedef struct DenseParams{
     int32_t input_num, output_num;
@@ -29,9 +30,21 @@ typedef struct DenseParams{
     int32_t has_bias;
     float *kernel;
     float *biases;
+
+    /**
+     * quantized kernel set by ff_dnn_quantize_layer_dense(), the layer
+     * runs in int8 when it is not NULL.
+     */
+    NativeInt8Params *int8;
 } DenseParams;
 
 int ff_dnn_load_layer_dense(Layer *layer, AVIOContext *model_file_context, int file_size, int operands_num);
+/**
+ * Switch the layer to int8 inference.
+ * @param input_range calibrated magnitude bound of the input, 0 if unknown
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_dnn_quantize_layer_dense(DenseParams *dense_params, float input_range);
 int ff_dnn_execute_layer_dense(DnnOperand *operands, const int32_t *input_operand_indexes,
                                int32_t output_operand_index, const void *parameters, NativeContext *ctx);
 #endif
@@ -49,10 +49,49 @@ int ff_dnn_load_layer_depth2space(Layer *layer, AVIOContext *model_file_context,
     return dnn_size;
 }
 
+typedef struct ThreadData {
+    const float *input;
+    float *output;
+    int height, width, channels;
+    int block_size;
+} ThreadData;
+
+static void dnn_execute_layer_depth2space_job(void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    int block_size = td->block_size;
+    int width = td->width;
+    int channels = td->channels;
+    int start = ff_dnn_native_job_start(td->height, jobnr, nb_jobs);
+    int end = ff_dnn_native_job_start(td->height, jobnr + 1, nb_jobs);
+
+    int y, x, by, bx, ch;
+    int new_channels = channels / (block_size * block_size);
+    int output_linesize = width * channels;
+    int by_linesize = output_linesize / block_size;
+    int x_linesize = new_channels * block_size;
+    const float *input = td->input + start * width * channels;
+    float *output = td->output + start * output_linesize;
+
+    for (y = start; y < end; ++y){
+        for (x = 0; x < width; ++x){
+            for (by = 0; by < block_size; ++by){
+                for (bx = 0; bx < block_size; ++bx){
+                    for (ch = 0; ch < new_channels; ++ch){
+                        output[by * by_linesize + x * x_linesize + bx * new_channels + ch] = input[ch];
+                    }
+                    input += new_channels;
+                }
+            }
+        }
+        output += output_linesize;
+    }
+}
+
 int ff_dnn_execute_layer_depth2space(DnnOperand *operands, const int32_t *input_operand_indexes,
                                      int32_t output_operand_index, const void *parameters, NativeContext *ctx)
 {
-    float *output;
+    ThreadData td;
     const DepthToSpaceParams *params = parameters;
     int block_size = params->block_size;
     int32_t input_operand_index = input_operand_indexes[0];
@@ -60,13 +99,7 @@ int ff_dnn_execute_layer_depth2space(DnnOperand *operands, const int32_t *input_
     int height = operands[input_operand_index].dims[1];
     int width = operands[input_operand_index].dims[2];
     int channels = operands[input_operand_index].dims[3];
-    const float *input = operands[input_operand_index].data;
-
-    int y, x, by, bx, ch;
     int new_channels = channels / (block_size * block_size);
-    int output_linesize = width * channels;
-    int by_linesize = output_linesize / block_size;
-    int x_linesize = new_channels * block_size;
 
     DnnOperand *output_operand = &operands[output_operand_index];
     output_operand->dims[0] = number;
@@ -84,20 +117,15 @@ int ff_dnn_execute_layer_depth2space(DnnOperand *operands, const int32_t *input_
         av_log(ctx, AV_LOG_ERROR, "Failed to reallocate memory for output\n");
         return DNN_ERROR;
     }
-    output = output_operand->data;
 
-    for (y = 0; y < height; ++y){
-        for (x = 0; x < width; ++x){
-            for (by = 0; by < block_size; ++by){
-                for (bx = 0; bx < block_size; ++bx){
-                    for (ch = 0; ch < new_channels; ++ch){
-                        output[by * by_linesize + x * x_linesize + bx * new_channels + ch] = input[ch];
-                    }
-                    input += new_channels;
-                }
-            }
-        }
-        output += output_linesize;
-    }
+    td.input      = operands[input_operand_index].data;
+    td.output     = output_operand->data;
+    td.height     = height;
+    td.width      = width;
+    td.channels   = channels;
+    td.block_size = block_size;
+    ff_dnn_native_execute(ctx, dnn_execute_layer_depth2space_job, &td,
+                          ff_dnn_native_get_nb_jobs(ctx, height));
+
     return 0;
 }
@@ -54,50 +54,54 @@ static float floormod(float src0, float src1)
     return (float)((int)(src0) % (int)(src1));
 }
 
-static void math_binary_commutative(FunType pfun, const DnnLayerMathBinaryParams *params, const DnnOperand *input, DnnOperand *output, DnnOperand *operands, const int32_t *input_operand_indexes)
-{
-    int dims_count;
-    const float *src;
+typedef struct ThreadData {
+    FunType pfun;
+    int commutative;
+    const DnnLayerMathBinaryParams *params;
+    const float *src, *src1;
     float *dst;
-    dims_count = ff_calculate_operand_dims_count(output);
-    src = input->data;
-    dst = output->data;
+    int dims_count;
+} ThreadData;
+
+static void math_binary_commutative(FunType pfun, const DnnLayerMathBinaryParams *params, const float *src, const float *src1, float *dst, int start, int end)
+{
     if (params->input0_broadcast || params->input1_broadcast) {
-        for (int i = 0; i < dims_count; ++i) {
+        for (int i = start; i < end; ++i) {
             dst[i] = pfun(params->v, src[i]);
         }
     } else {
-        const DnnOperand *input1 = &operands[input_operand_indexes[1]];
-        const float *src1 = input1->data;
-        for (int i = 0; i < dims_count; ++i) {
+        for (int i = start; i < end; ++i) {
             dst[i] = pfun(src[i], src1[i]);
         }
     }
 }
-static void math_binary_not_commutative(FunType pfun, const DnnLayerMathBinaryParams *params, const DnnOperand *input, DnnOperand *output, DnnOperand *operands, const int32_t *input_operand_indexes)
+static void math_binary_not_commutative(FunType pfun, const DnnLayerMathBinaryParams *params, const float *src, const float *src1, float *dst, int start, int end)
 {
-    int dims_count;
-    const float *src;
-    float *dst;
-    dims_count = ff_calculate_operand_dims_count(output);
-    src = input->data;
-    dst = output->data;
     if (params->input0_broadcast) {
-        for (int i = 0; i < dims_count; ++i) {
+        for (int i = start; i < end; ++i) {
             dst[i] = pfun(params->v, src[i]);
         }
     } else if (params->input1_broadcast) {
-        for (int i = 0; i < dims_count; ++i) {
+        for (int i = start; i < end; ++i) {
             dst[i] = pfun(src[i], params->v);
         }
     } else {
-        const DnnOperand *input1 = &operands[input_operand_indexes[1]];
-        const float *src1 = input1->data;
-        for (int i = 0; i < dims_count; ++i) {
+        for (int i = start; i < end; ++i) {
             dst[i] = pfun(src[i], src1[i]);
         }
     }
 }
+static void math_binary_job(void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    int start = ff_dnn_native_job_start(td->dims_count, jobnr, nb_jobs);
+    int end = ff_dnn_native_job_start(td->dims_count, jobnr + 1, nb_jobs);
+
+    if (td->commutative)
+        math_binary_commutative(td->pfun, td->params, td->src, td->src1, td->dst, start, end);
+    else
+        math_binary_not_commutative(td->pfun, td->params, td->src, td->src1, td->dst, start, end);
+}
 int ff_dnn_load_layer_math_binary(Layer *layer, AVIOContext *model_file_context, int file_size, int operands_num)
 {
     DnnLayerMathBinaryParams params = { 0 };
@@ -152,6 +156,7 @@ int ff_dnn_execute_layer_math_binary(DnnOperand *operands, const int32_t *input_
     const DnnOperand *input = &operands[input_operand_indexes[0]];
     DnnOperand *output = &operands[output_operand_index];
     const DnnLayerMathBinaryParams *params = parameters;
+    ThreadData td;
 
     for (int i = 0; i < 4; ++i)
         output->dims[i] = input->dims[i];
@@ -170,25 +175,42 @@ int ff_dnn_execute_layer_math_binary(DnnOperand *operands, const int32_t *input_
 
     switch (params->bin_op) {
     case DMBO_SUB:
-        math_binary_not_commutative(sub, params, input, output, operands, input_operand_indexes);
-        return 0;
+        td.pfun = sub;
+        td.commutative = 0;
+        break;
     case DMBO_ADD:
-        math_binary_commutative(add, params, input, output, operands, input_operand_indexes);
-        return 0;
+        td.pfun = add;
+        td.commutative = 1;
+        break;
     case DMBO_MUL:
-        math_binary_commutative(mul, params, input, output, operands, input_operand_indexes);
-        return 0;
+        td.pfun = mul;
+        td.commutative = 1;
+        break;
     case DMBO_REALDIV:
-        math_binary_not_commutative(realdiv, params, input, output, operands, input_operand_indexes);
-        return 0;
+        td.pfun = realdiv;
+        td.commutative = 0;
+        break;
     case DMBO_MINIMUM:
-        math_binary_commutative(minimum, params, input, output, operands, input_operand_indexes);
-        return 0;
+        td.pfun = minimum;
+        td.commutative = 1;
+        break;
     case DMBO_FLOORMOD:
-        math_binary_not_commutative(floormod, params, input, output, operands, input_operand_indexes);
-        return 0;
+        td.pfun = floormod;
+        td.commutative = 0;
+        break;
     default:
         av_log(ctx, AV_LOG_ERROR, "Unmatch math binary operator\n");
         return DNN_ERROR;
     }
+
+    td.params = params;
+    td.src = input->data;
+    td.src1 = params->input0_broadcast || params->input1_broadcast ? NULL :
+              operands[input_operand_indexes[1]].data;
+    td.dst = output->data;
+    td.dims_count = ff_calculate_operand_dims_count(output);
+    // elementwise work is cheap, do not wake up threads for small operands
+    ff_dnn_native_execute(ctx, math_binary_job, &td,
+                          ff_dnn_native_get_nb_jobs(ctx, td.dims_count >> 12));
+    return 0;
 }
@@ -52,106 +52,129 @@ int ff_dnn_load_layer_math_unary(Layer *layer, AVIOContext *model_file_context,
 
 }
 
-int ff_dnn_execute_layer_math_unary(DnnOperand *operands, const int32_t *input_operand_indexes,
-                                    int32_t output_operand_index, const void *parameters, NativeContext *ctx)
-{
-    const DnnOperand *input = &operands[input_operand_indexes[0]];
-    DnnOperand *output = &operands[output_operand_index];
-    const DnnLayerMathUnaryParams *params = parameters;
-    int dims_count;
+typedef struct ThreadData {
     const float *src;
     float *dst;
+    int dims_count;
+    DNNMathUnaryOperation un_op;
+} ThreadData;
 
-    for (int i = 0; i < 4; ++i)
-        output->dims[i] = input->dims[i];
-
-    output->data_type = input->data_type;
-    output->length = ff_calculate_operand_data_length(output);
-    if (output->length <= 0) {
-        av_log(ctx, AV_LOG_ERROR, "The output data length overflow\n");
-        return DNN_ERROR;
-    }
-    output->data = av_realloc(output->data, output->length);
-    if (!output->data) {
-        av_log(ctx, AV_LOG_ERROR, "Failed to reallocate memory for output\n");
-        return DNN_ERROR;
-    }
-
-    dims_count = ff_calculate_operand_dims_count(output);
-    src = input->data;
-    dst = output->data;
+static void math_unary_job(void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    int start = ff_dnn_native_job_start(td->dims_count, jobnr, nb_jobs);
+    int end = ff_dnn_native_job_start(td->dims_count, jobnr + 1, nb_jobs);
+    const float *src = td->src;
+    float *dst = td->dst;
 
-    switch (params->un_op) {
+    switch (td->un_op) {
     case DMUO_ABS:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = FFABS(src[i]);
-        return 0;
+        break;
     case DMUO_SIN:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = sin(src[i]);
-        return 0;
+        break;
     case DMUO_COS:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = cos(src[i]);
-        return 0;
+        break;
     case DMUO_TAN:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = tan(src[i]);
-        return 0;
+        break;
     case DMUO_ASIN:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = asin(src[i]);
-        return 0;
+        break;
     case DMUO_ACOS:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = acos(src[i]);
-        return 0;
+        break;
     case DMUO_ATAN:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = atan(src[i]);
-        return 0;
+        break;
     case DMUO_SINH:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = sinh(src[i]);
-        return 0;
+        break;
     case DMUO_COSH:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = cosh(src[i]);
-        return 0;
+        break;
     case DMUO_TANH:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = tanh(src[i]);
-        return 0;
+        break;
     case DMUO_ASINH:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = asinh(src[i]);
-        return 0;
+        break;
     case DMUO_ACOSH:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = acosh(src[i]);
-        return 0;
+        break;
     case DMUO_ATANH:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = atanh(src[i]);
-        return 0;
+        break;
     case DMUO_CEIL:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = ceil(src[i]);
-        return 0;
+        break;
     case DMUO_FLOOR:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = floor(src[i]);
-        return 0;
+        break;
     case DMUO_ROUND:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = round(src[i]);
-        return 0;
+        break;
     case DMUO_EXP:
-        for (int i = 0; i < dims_count; ++i)
+        for (int i = start; i < end; ++i)
             dst[i] = exp(src[i]);
-        return 0;
+        break;
     default:
+        break;
+    }
+}
+
+int ff_dnn_execute_layer_math_unary(DnnOperand *operands, const int32_t *input_operand_indexes,
+                                    int32_t output_operand_index, const void *parameters, NativeContext *ctx)
+{
+    const DnnOperand *input = &operands[input_operand_indexes[0]];
+    DnnOperand *output = &operands[output_operand_index];
+    const DnnLayerMathUnaryParams *params = parameters;
+    ThreadData td;
+
+    for (int i = 0; i < 4; ++i)
+        output->dims[i] = input->dims[i];
+
+    output->data_type = input->data_type;
+    output->length = ff_calculate_operand_data_length(output);
+    if (output->length <= 0) {
+        av_log(ctx, AV_LOG_ERROR, "The output data length overflow\n");
+        return DNN_ERROR;
+    }
+    output->data = av_realloc(output->data, output->length);
+    if (!output->data) {
+        av_log(ctx, AV_LOG_ERROR, "Failed to reallocate memory for output\n");
+        return DNN_ERROR;
+    }
+
+    if (params->un_op < 0 || params->un_op >= DMUO_COUNT) {
         av_log(ctx, AV_LOG_ERROR, "Unmatch math unary operator\n");
         return DNN_ERROR;
     }
+
+    td.src = input->data;
+    td.dst = output->data;
+    td.dims_count = ff_calculate_operand_dims_count(output);
+    td.un_op = params->un_op;
+    // elementwise work is cheap, do not wake up threads for small operands
+    ff_dnn_native_execute(ctx, math_unary_job, &td,
+                          ff_dnn_native_get_nb_jobs(ctx, td.dims_count >> 12));
+    return 0;
 }
@@ -0,0 +1,208 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+#include "dnn_backend_native_tile.h"
+#include "dnn_backend_native_layer_avgpool.h"
+#include "dnn_backend_native_layer_conv2d.h"
+#include "dnn_backend_native_layer_depth2space.h"
+#include "dnn_backend_native_layer_mathbinary.h"
+#include "dnn_backend_native_layer_pad.h"
+
+static int get_nb_tensor_inputs(const Layer *layer)
+{
+    if (layer->type == DLT_MATH_BINARY) {
+        const DnnLayerMathBinaryParams *params = layer->params;
+        return 2 - !!params->input0_broadcast - !!params->input1_broadcast;
+    }
+    return 1;
+}
+
+/* size of the output of the layer along axis, for an input of size n */
+static int get_output_size(const Layer *layer, int axis, int n)
+{
+    switch (layer->type) {
+    case DLT_CONV2D: {
+        const ConvolutionalParams *params = layer->params;
+        if (params->padding_method == VALID)
+            return n - (params->kernel_size - 1) / 2 * params->dilation * 2;
+        return n;
+    }
+    case DLT_AVG_POOL: {
+        const AvgPoolParams *params = layer->params;
+        if (params->padding_method == VALID)
+            return n - params->kernel_size + 1;
+        return n;
+    }
+    case DLT_DEPTH_TO_SPACE: {
+        const DepthToSpaceParams *params = layer->params;
+        return n * params->block_size;
+    }
+    case DLT_MIRROR_PAD: {
+        const LayerPadParams *params = layer->params;
+        return n + params->paddings[axis + 1][0] + params->paddings[axis + 1][1];
+    }
+    default:
+        return n;
+    }
+}
+
+/* region of the input of size n the region out of the output depends on */
+static void get_input_range(const Layer *layer, int axis, const int out[2], int n, int in[2])
+{
+    switch (layer->type) {
+    case DLT_CONV2D: {
+        const ConvolutionalParams *params = layer->params;
+        int offset = params->padding_method == VALID ? (params->kernel_size - 1) / 2 * params->dilation : 0;
+        int radius = params->kernel_size >> 1;
+        in[0] = out[0] + offset - radius * params->dilation;
+        in[1] = out[1] + offset + (params->kernel_size - 1 - radius) * params->dilation;
+        break;
+    }
+    case DLT_AVG_POOL: {
+        const AvgPoolParams *params = layer->params;
+        int radius = params->padding_method == VALID ? 0 : (params->kernel_size - 1) >> 1;
+        in[0] = out[0] - radius;
+        in[1] = out[1] - radius + params->kernel_size - 1;
+        break;
+    }
+    case DLT_DEPTH_TO_SPACE: {
+        const DepthToSpaceParams *params = layer->params;
+        in[0] = out[0] / params->block_size;
+        in[1] = (out[1] + params->block_size - 1) / params->block_size;
+        break;
+    }
+    case DLT_MIRROR_PAD: {
+        const LayerPadParams *params = layer->params;
+        int before = params->paddings[axis + 1][0];
+        in[0] = out[0] - before;
+        in[1] = out[1] - before;
+        // the mirrored border reads the input up to its width away from the edge
+        if (out[0] < before)
+            in[1] = FFMAX(in[1], before - out[0] + 1);
+        if (out[1] > n + before)
+            in[0] = FFMIN(in[0], 2 * n - out[1] + before - 1);
+        break;
+    }
+    default:
+        in[0] = out[0];
+        in[1] = out[1];
+        break;
+    }
+
+    in[0] = av_clip(in[0], 0, n);
+    in[1] = av_clip(in[1], in[0], n);
+}
+
+int ff_dnn_tile_init(NativeModel *native_model)
+{
+    int *scale = av_calloc(native_model->operands_num, sizeof(*scale));
+
+    if (!scale)
+        return AVERROR(ENOMEM);
+
+    for (int32_t i = 0; i < native_model->operands_num; i++) {
+        if (native_model->operands[i].type == DOT_INPUT)
+            scale[i] = 1;
+    }
+
+    for (int32_t i = 0; i < native_model->layers_num; i++) {
+        const Layer *layer = &native_model->layers[i];
+        int nb_inputs = get_nb_tensor_inputs(layer);
+        int s = scale[layer->input_operand_indexes[0]];
+
+        if (layer->type == DLT_AVG_POOL) {
+            const AvgPoolParams *params = layer->params;
+            if (params->strides != 1)
+                s = 0;
+        }
+        for (int j = 1; j < nb_inputs; j++) {
+            if (scale[layer->input_operand_indexes[j]] != s)
+                s = 0;
+        }
+        if (!s) {
+            av_log(&native_model->ctx, AV_LOG_VERBOSE, "layer %d cannot be run in tiles\n", i);
+            av_freep(&scale);
+            return 0;
+        }
+
+        if (layer->type == DLT_DEPTH_TO_SPACE) {
+            const DepthToSpaceParams *params = layer->params;
+            s *= params->block_size;
+        }
+        scale[layer->output_operand_index] = s;
+    }
+
+    native_model->tile_scale = scale;
+    return 0;
+}
+
+void ff_dnn_tile_get_sizes(const NativeModel *native_model, int input_oprd,
+                           int height, int width, int32_t (*size)[2])
+{
+    memset(size, 0, native_model->operands_num * sizeof(*size));
+    size[input_oprd][0] = height;
+    size[input_oprd][1] = width;
+
+    for (int32_t i = 0; i < native_model->layers_num; i++) {
+        const Layer *layer = &native_model->layers[i];
+        const int32_t *in = size[layer->input_operand_indexes[0]];
+
+        if (!in[0])
+            continue;
+        for (int axis = 0; axis < 2; axis++)
+            size[layer->output_operand_index][axis] = get_output_size(layer, axis, in[axis]);
+    }
+}
+
+void ff_dnn_tile_get_input_region(const NativeModel *native_model, int input_oprd, int output_oprd,
+                                  const int32_t (*size)[2], int (*range)[2][2],
+                                  const int out[2][2], int in[2][2])
+{
+    for (int32_t i = 0; i < native_model->operands_num; i++) {
+        for (int axis = 0; axis < 2; axis++) {
+            range[i][axis][0] = INT_MAX;
+            range[i][axis][1] = INT_MIN;
+        }
+    }
+    memcpy(range[output_oprd], out, sizeof(range[output_oprd]));
+
+    for (int32_t i = native_model->layers_num - 1; i >= 0; i--) {
+        const Layer *layer = &native_model->layers[i];
+        int (*out_range)[2] = range[layer->output_operand_index];
+
+        if (out_range[0][0] >= out_range[0][1])
+            continue;
+
+        for (int j = 0; j < get_nb_tensor_inputs(layer); j++) {
+            int32_t input = layer->input_operand_indexes[j];
+            for (int axis = 0; axis < 2; axis++) {
+                int in_range[2];
+                get_input_range(layer, axis, out_range[axis], size[input][axis], in_range);
+                range[input][axis][0] = FFMIN(range[input][axis][0], in_range[0]);
+                range[input][axis][1] = FFMAX(range[input][axis][1], in_range[1]);
+            }
+        }
+    }
+
+    for (int axis = 0; axis < 2; axis++) {
+        in[axis][0] = FFMIN(range[input_oprd][axis][0], size[input_oprd][axis]);
+        in[axis][1] = FFMAX(range[input_oprd][axis][1], in[axis][0]);
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * tiled execution geometry for the native backend
+ *
+ * A large frame can be run through the model in tiles, so that the
+ * intermediate operands only hold one tile. The output is split into a
+ * grid, and each cell is computed from the region of the input that it
+ * depends on, the cell plus a halo as wide as the receptive field of the
+ * model. The halo is clipped at the frame borders, where the layers then
+ * pad exactly as on the whole frame, so the tiled output matches the
+ * output of the whole frame.
+ *
+ * Rows and columns are handled separately, axis 0 is the height and axis
+ * 1 the width. All the regions are half-open, [start, end).
+ */
+
+#ifndef AVFILTER_DNN_DNN_BACKEND_NATIVE_TILE_H
+#define AVFILTER_DNN_DNN_BACKEND_NATIVE_TILE_H
+
+#include <stdint.h>
+
+#include "dnn_backend_native.h"
+
+/**
+ * Check whether the model can be run in tiles, and if so set
+ * native_model->tile_scale. Models with strided pooling or with
+ * element-wise layers mixing operands of different scales are not tiled.
+ *
+ * @return 0 on success, even if the model cannot be tiled,
+ *         a negative AVERROR code on failure
+ */
+int ff_dnn_tile_init(NativeModel *native_model);
+
+/**
+ * Compute the height and width of every operand for an input of the given
+ * size, without running the model.
+ *
+ * @param size set to the size of each operand, 0 for operands the
+ *             input does not reach
+ */
+void ff_dnn_tile_get_sizes(const NativeModel *native_model, int input_oprd,
+                           int height, int width, int32_t (*size)[2]);
+
+/**
+ * Compute the region of the input operand needed to compute the region
+ * out of the output operand.
+ *
+ * @param size  operand sizes from ff_dnn_tile_get_sizes()
+ * @param range scratch space of operands_num entries
+ * @param in    set to the input region, clipped to the input size
+ */
+void ff_dnn_tile_get_input_region(const NativeModel *native_model, int input_oprd, int output_oprd,
+                                  const int32_t (*size)[2], int (*range)[2][2],
+                                  const int out[2][2], int in[2][2]);
+
+#endif
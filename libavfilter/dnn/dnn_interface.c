@@ -42,6 +42,11 @@ DNNModule *ff_get_dnn_module(DNNBackendType backend_type)
     case DNN_NATIVE:
         dnn_module->load_model = &ff_dnn_load_model_native;
         dnn_module->execute_model = &ff_dnn_execute_model_native;
+    #if HAVE_PTHREAD_CANCEL
+        dnn_module->execute_model_async = &ff_dnn_execute_model_async_native;
+        dnn_module->get_async_result = &ff_dnn_get_async_result_native;
+        dnn_module->flush = &ff_dnn_flush_native;
+    #endif
         dnn_module->free_model = &ff_dnn_free_model_native;
         break;
     case DNN_TF:
@@ -49,6 +49,10 @@ int ff_dnn_init(DnnContext *ctx, DNNFunctionType func_type, AVFilterContext *fil
         return AVERROR(EINVAL);
     }
 
+    // the native backend keeps running sync unless async is asked for
+    if (ctx->async < 0)
+        ctx->async = ctx->backend_type != DNN_NATIVE;
+
     if (!ctx->dnn_module->execute_model_async && ctx->async) {
         ctx->async = 0;
         av_log(filter_ctx, AV_LOG_WARNING, "this backend does not support async execution, roll back to sync.\n");
@@ -525,6 +525,20 @@ static void blend_line_hv(uint8_t *dst, int dst_delta,
                     right, hband, hsub + vsub, xm);
 }
 
+/* 8-bit mask on a plane without subsampling: same as blend_line_hv(), in a
+ * form simple enough to be vectorized by the compiler */
+static void blend_line_mask8(uint8_t *dst, int dst_delta,
+                             unsigned src, unsigned alpha,
+                             const uint8_t *mask, int w)
+{
+    int x;
+
+    for (x = 0; x < w; x++) {
+        const unsigned a = mask[x] * alpha;
+        dst[x * dst_delta] = ((0x1010101 - a) * dst[x * dst_delta] + a * src) >> 24;
+    }
+}
+
 void ff_blend_mask(FFDrawContext *draw, FFDrawColor *color,
                    uint8_t *dst[], int dst_linesize[], int dst_w, int dst_h,
                    const uint8_t *mask,  int mask_linesize, int mask_w, int mask_h,
@@ -582,7 +596,16 @@ void ff_blend_mask(FFDrawContext *draw, FFDrawColor *color,
                 p += dst_linesize[plane];
                 m += top * mask_linesize;
             }
-            if (depth <= 8) {
+            if (depth <= 8 && l2depth == 3 &&
+                !draw->hsub[plane] && !draw->vsub[plane]) {
+                for (y = 0; y < h_sub; y++) {
+                    blend_line_mask8(p, draw->pixelstep[plane],
+                                     color->comp[plane].u8[comp], alpha,
+                                     m + xm0, w_sub);
+                    p += dst_linesize[plane];
+                    m += mask_linesize;
+                }
+            } else if (depth <= 8) {
                 for (y = 0; y < h_sub; y++) {
                     blend_line_hv(p, draw->pixelstep[plane],
                                   color->comp[plane].u8[comp], alpha,
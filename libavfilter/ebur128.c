@@ -46,6 +46,7 @@
 #include <float.h>
 #include <limits.h>
 #include <math.h>               /* You may have to define _USE_MATH_DEFINES if you use MSVC */
+#include <string.h>
 
 #include "libavutil/common.h"
 #include "libavutil/mem.h"
@@ -64,6 +65,23 @@
 #define RELATIVE_GATE_FACTOR  pow(10.0, RELATIVE_GATE / 10.0)
 #define MINUS_20DB            pow(10.0, -20.0 / 10.0)
 
+#define TP_HIST  (FF_EBUR128_TP_TAPS - 1)
+
+const double ff_ebur128_tp_coeffs[FF_EBUR128_TP_PHASES][FF_EBUR128_TP_TAPS] = {
+    {  0.0017089843750,  0.0109863281250, -0.0196533203125,  0.0332031250000,
+      -0.0594482421875,  0.1373291015625,  0.9721679687500, -0.1022949218750,
+       0.0476074218750, -0.0266113281250,  0.0148925781250, -0.0083007812500 },
+    { -0.0291748046875,  0.0292968750000, -0.0517578125000,  0.0891113281250,
+      -0.1665039062500,  0.4650878906250,  0.7797851562500, -0.2003173828125,
+       0.1015625000000, -0.0582275390625,  0.0330810546875, -0.0189208984375 },
+    { -0.0189208984375,  0.0330810546875, -0.0582275390625,  0.1015625000000,
+      -0.2003173828125,  0.7797851562500,  0.4650878906250, -0.1665039062500,
+       0.0891113281250, -0.0517578125000,  0.0292968750000, -0.0291748046875 },
+    { -0.0083007812500,  0.0148925781250, -0.0266113281250,  0.0476074218750,
+      -0.1022949218750,  0.9721679687500,  0.1373291015625, -0.0594482421875,
+       0.0332031250000, -0.0196533203125,  0.0109863281250,  0.0017089843750 },
+};
+
 struct FFEBUR128StateInternal {
     /** Filtered audio data (used as ring buffer). */
     double *audio_data;
@@ -92,6 +110,12 @@ struct FFEBUR128StateInternal {
     size_t short_term_frame_counter;
     /** Maximum sample peak, one per channel */
     double *sample_peak;
+    /** Maximum true peak, one per channel */
+    double *true_peak;
+    /** Last TP_HIST samples of each channel, for true peak interpolation */
+    double *tp_history;
+    /** History followed by the samples being interpolated */
+    double *tp_buf;
     /** The maximum window duration in ms. */
     unsigned long window;
     /** Data pointer array for interleaved data */
@@ -238,6 +262,19 @@ FFEBUR128State *ff_ebur128_init(unsigned int channels,
     st->samplerate = samplerate;
     st->d->samples_in_100ms = (st->samplerate + 5) / 10;
     st->mode = mode;
+
+    st->d->true_peak  = NULL;
+    st->d->tp_history = NULL;
+    st->d->tp_buf     = NULL;
+    if ((mode & FF_EBUR128_MODE_TRUE_PEAK) == FF_EBUR128_MODE_TRUE_PEAK) {
+        st->d->true_peak  = av_mallocz_array(channels, sizeof(*st->d->true_peak));
+        st->d->tp_history = av_mallocz_array(channels, TP_HIST * sizeof(*st->d->tp_history));
+        /* at most 400ms of audio are filtered at once */
+        st->d->tp_buf     = av_malloc_array(st->d->samples_in_100ms * 4 + TP_HIST,
+                                            sizeof(*st->d->tp_buf));
+        CHECK_ERROR(!st->d->true_peak || !st->d->tp_history || !st->d->tp_buf,
+                    0, free_sample_peak)
+    }
     if ((mode & FF_EBUR128_MODE_S) == FF_EBUR128_MODE_S) {
         st->d->window = FFMAX(window, 3000);
     } else if ((mode & FF_EBUR128_MODE_M) == FF_EBUR128_MODE_M) {
@@ -289,6 +326,9 @@ free_block_energy_histogram:
 free_audio_data:
     av_free(st->d->audio_data);
 free_sample_peak:
+    av_free(st->d->true_peak);
+    av_free(st->d->tp_history);
+    av_free(st->d->tp_buf);
     av_free(st->d->sample_peak);
 free_channel_map:
     av_free(st->d->channel_map);
@@ -307,6 +347,9 @@ void ff_ebur128_destroy(FFEBUR128State ** st)
     av_free((*st)->d->audio_data);
     av_free((*st)->d->channel_map);
     av_free((*st)->d->sample_peak);
+    av_free((*st)->d->true_peak);
+    av_free((*st)->d->tp_history);
+    av_free((*st)->d->tp_buf);
     av_free((*st)->d->data_ptrs);
     av_free((*st)->d);
     av_free(*st);
@@ -335,6 +378,20 @@ static void ebur128_filter_##type(FFEBUR128State* st, const type** srcs,
             if (max > st->d->sample_peak[c]) st->d->sample_peak[c] = max;          \
         }                                                                          \
     }                                                                              \
+    if ((st->mode & FF_EBUR128_MODE_TRUE_PEAK) == FF_EBUR128_MODE_TRUE_PEAK) {     \
+        double *tp_buf = st->d->tp_buf;                                            \
+        for (c = 0; c < st->channels; ++c) {                                       \
+            double *history = st->d->tp_history + c * TP_HIST;                    \
+            double max = st->d->true_peak[c];                                      \
+            memcpy(tp_buf, history, TP_HIST * sizeof(*tp_buf));                    \
+            for (i = 0; i < frames; ++i)                                           \
+                tp_buf[TP_HIST + i] = (double) (srcs[c][src_index + i * stride] / scaling_factor); \
+            for (i = 0; i < frames; ++i)                                           \
+                max = FFMAX(max, ff_ebur128_interp_peak(tp_buf + i));              \
+            memcpy(history, tp_buf + frames, TP_HIST * sizeof(*history));          \
+            st->d->true_peak[c] = max;                                             \
+        }                                                                          \
+    }                                                                              \
     for (c = 0; c < st->channels; ++c) {                                           \
         int ci = st->d->channel_map[c] - 1;                                        \
         if (ci < 0) continue;                                                      \
@@ -613,6 +670,22 @@ static int ebur128_energy_shortterm(FFEBUR128State * st, double *out)
                                       out);
 }
 
+int ff_ebur128_loudness_window(FFEBUR128State * st,
+                               unsigned long window, double *out)
+{
+    double energy;
+    size_t interval_frames = st->samplerate * window / 1000;
+    int error = ebur128_energy_in_interval(st, interval_frames, &energy);
+    if (error) {
+        return error;
+    } else if (energy <= 0.0) {
+        *out = -HUGE_VAL;
+        return 0;
+    }
+    *out = ebur128_energy_to_loudness(energy);
+    return 0;
+}
+
 int ff_ebur128_loudness_shortterm(FFEBUR128State * st, double *out)
 {
     double energy;
@@ -722,3 +795,17 @@ int ff_ebur128_sample_peak(FFEBUR128State * st,
     *out = st->d->sample_peak[channel_number];
     return 0;
 }
+
+int ff_ebur128_true_peak(FFEBUR128State * st,
+                         unsigned int channel_number, double *out)
+{
+    if ((st->mode & FF_EBUR128_MODE_TRUE_PEAK) !=
+        FF_EBUR128_MODE_TRUE_PEAK) {
+        return AVERROR(EINVAL);
+    } else if (channel_number >= st->channels) {
+        return AVERROR(EINVAL);
+    }
+    *out = FFMAX(st->d->true_peak[channel_number],
+                 st->d->sample_peak[channel_number]);
+    return 0;
+}
@@ -32,6 +32,8 @@
 
 #include <stddef.h>             /* for size_t */
 
+#include "libavutil/common.h"
+
 /** \enum channel
  *  Use these values when setting the channel map with ebur128_set_channel().
  *  See definitions in ITU R-REC-BS 1770-4
@@ -91,8 +93,40 @@ enum mode {
     FF_EBUR128_MODE_LRA = (1 << 3) | FF_EBUR128_MODE_S,
   /** can call ff_ebur128_sample_peak */
     FF_EBUR128_MODE_SAMPLE_PEAK = (1 << 4) | FF_EBUR128_MODE_M,
+  /** can call ff_ebur128_true_peak */
+    FF_EBUR128_MODE_TRUE_PEAK = (1 << 5) | FF_EBUR128_MODE_SAMPLE_PEAK,
 };
 
+/** Number of phases of the ITU-R BS.1770-4 true-peak 4x over-sampling filter */
+#define FF_EBUR128_TP_PHASES 4
+/** Number of taps of each phase of the true-peak filter */
+#define FF_EBUR128_TP_TAPS  12
+
+/** Coefficients of the true-peak filter from ITU-R BS.1770-4 Annex 2 */
+extern const double ff_ebur128_tp_coeffs[FF_EBUR128_TP_PHASES][FF_EBUR128_TP_TAPS];
+
+/** \brief Peak of the 4x over-sampled signal around a sample.
+ *
+ *  The phases are mirror images of each other, so the set of interpolated
+ *  values does not depend on the direction the taps are applied in.
+ *
+ *  @param x FF_EBUR128_TP_TAPS consecutive samples of one channel
+ *  @return the maximum magnitude of the FF_EBUR128_TP_PHASES interpolated
+ *          values between x[5] and x[6].
+ */
+static inline double ff_ebur128_interp_peak(const double *x)
+{
+    double max = 0.0;
+
+    for (int p = 0; p < FF_EBUR128_TP_PHASES; p++) {
+        double v = 0.0;
+        for (int j = 0; j < FF_EBUR128_TP_TAPS; j++)
+            v += ff_ebur128_tp_coeffs[p][j] * x[j];
+        max = FFMAX(max, fabs(v));
+    }
+    return max;
+}
+
 /** forward declaration of FFEBUR128StateInternal */
 struct FFEBUR128StateInternal;
 
@@ -176,6 +210,20 @@ int ff_ebur128_loudness_global(FFEBUR128State * st, double *out);
  */
 int ff_ebur128_loudness_shortterm(FFEBUR128State * st, double *out);
 
+/** \brief Get loudness of the specified window in LUFS.
+ *
+ *  window must not be larger than the current window set in st.
+ *
+ *  @param st library state.
+ *  @param window window in ms to calculate loudness.
+ *  @param out loudness in LUFS. -HUGE_VAL if result is negative infinity.
+ *  @return
+ *    - 0 on success.
+ *    - AVERROR(EINVAL) if window larger than current window in st.
+ */
+int ff_ebur128_loudness_window(FFEBUR128State * st,
+                               unsigned long window, double *out);
+
 /** \brief Get loudness range (LRA) of programme in LU.
  *
  *  Calculates loudness range according to EBU 3342.
@@ -216,6 +264,22 @@ int ff_ebur128_loudness_range_multiple(FFEBUR128State ** sts,
 int ff_ebur128_sample_peak(FFEBUR128State * st,
                            unsigned int channel_number, double *out);
 
+/** \brief Get maximum true peak of selected channel in float format.
+ *
+ *  The signal is over-sampled by 4 with the interpolation filter from
+ *  ITU-R BS.1770-4 Annex 2. The result is never lower than the sample peak.
+ *
+ *  @param st library state
+ *  @param channel_number channel to analyse
+ *  @param out maximum true peak in float format (1.0 is 0 dBFS)
+ *  @return
+ *    - 0 on success.
+ *    - AVERROR(EINVAL) if mode "FF_EBUR128_MODE_TRUE_PEAK" has not been set.
+ *    - AVERROR(EINVAL) if invalid channel index.
+ */
+int ff_ebur128_true_peak(FFEBUR128State * st,
+                         unsigned int channel_number, double *out);
+
 /** \brief Get relative threshold in LUFS.
  *
  *  @param st library state
@@ -40,6 +40,7 @@
 #include "libswresample/swresample.h"
 #include "audio.h"
 #include "avfilter.h"
+#include "ebur128.h"
 #include "formats.h"
 #include "internal.h"
 
@@ -59,6 +60,8 @@
 #define RLB_A1 -1.99004745483398
 #define RLB_A2  0.99007225036621
 
+#define TP_HIST (FF_EBUR128_TP_TAPS - 1)
+
 #define ABS_THRES    -70            ///< silence gate: we discard anything below this absolute (LUFS) threshold
 #define ABS_UP_THRES  10            ///< upper loud limit to consider (ABS_THRES being the minimum)
 #define HIST_GRAIN   100            ///< defines histogram precision
@@ -98,6 +101,10 @@ typedef struct EBUR128Context {
     double *true_peaks;             ///< true peaks per channel
     double *sample_peaks;           ///< sample peaks per channel
     double *true_peaks_per_frame;   ///< true peaks in a frame per channel
+    int tp_filter;                  ///< true peak over-sampling method
+    double *tp_hist;                ///< last TP_HIST input samples per channel
+    double *tp_buf;                 ///< per channel history + frame samples
+    unsigned tp_buf_size;
 #if CONFIG_SWRESAMPLE
     SwrContext *swr_ctx;            ///< over-sampling context for true peak metering
     double *swr_buf;                ///< resampled audio data for true peak metering
@@ -122,6 +129,7 @@ typedef struct EBUR128Context {
     int nb_channels;                ///< number of channels in the input
     double *ch_weighting;           ///< channel weighting mapping
     int sample_count;               ///< sample count used for refresh frequency, reset at refresh
+    int nb_threads;
 
     /* Filter caches.
      * The mult by 3 in the following is for X[i], X[i-1] and X[i-2] */
@@ -155,6 +163,11 @@ enum {
     PEAK_MODE_TRUE_PEAKS    = 1<<2,
 };
 
+enum {
+    TP_FILTER_FIR,
+    TP_FILTER_SWR,
+};
+
 enum {
     GAUGE_TYPE_MOMENTARY = 0,
     GAUGE_TYPE_SHORTTERM = 1,
@@ -181,6 +194,9 @@ static const AVOption ebur128_options[] = {
         { "none",   "disable any peak mode",   0, AV_OPT_TYPE_CONST, {.i64 = PEAK_MODE_NONE},          INT_MIN, INT_MAX, A|F, "mode" },
         { "sample", "enable peak-sample mode", 0, AV_OPT_TYPE_CONST, {.i64 = PEAK_MODE_SAMPLES_PEAKS}, INT_MIN, INT_MAX, A|F, "mode" },
         { "true",   "enable true-peak mode",   0, AV_OPT_TYPE_CONST, {.i64 = PEAK_MODE_TRUE_PEAKS},    INT_MIN, INT_MAX, A|F, "mode" },
+    { "tpfilter", "set true-peak over-sampling method", OFFSET(tp_filter), AV_OPT_TYPE_INT, {.i64 = TP_FILTER_SWR}, TP_FILTER_FIR, TP_FILTER_SWR, A|F, "tpfilter" },
+        { "fir", "BS.1770 polyphase interpolator", 0, AV_OPT_TYPE_CONST, {.i64 = TP_FILTER_FIR}, INT_MIN, INT_MAX, A|F, "tpfilter" },
+        { "swr", "libswresample",                  0, AV_OPT_TYPE_CONST, {.i64 = TP_FILTER_SWR}, INT_MIN, INT_MAX, A|F, "tpfilter" },
     { "dualmono", "treat mono input files as dual-mono", OFFSET(dual_mono), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, A|F },
     { "panlaw", "set a specific pan law for dual-mono files", OFFSET(pan_law), AV_OPT_TYPE_DOUBLE, {.dbl = -3.01029995663978}, -10.0, 0.0, A|F },
     { "target", "set a specific target level in LUFS (-23 to 0)", OFFSET(target), AV_OPT_TYPE_INT, {.i64 = -23}, -23, 0, V|F },
@@ -393,7 +409,8 @@ static int config_audio_input(AVFilterLink *inlink)
      * As for the true peaks mode, it just simplifies the resampling buffer
      * allocation and the lookup in it (since sample buffers differ in size, it
      * can be more complex to integrate in the one-sample loop of
-     * filter_frame()). */
+     * filter_frame()), and the per frame true peaks (FTPK) of both
+     * over-sampling methods are then taken over the same 100ms windows. */
     if (ebur128->metadata || (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS))
         inlink->min_samples =
         inlink->max_samples =
@@ -439,16 +456,23 @@ static int config_audio_output(AVFilterLink *outlink)
             return AVERROR(ENOMEM);
     }
 
-#if CONFIG_SWRESAMPLE
+    ebur128->nb_threads = ff_filter_get_nb_threads(ctx);
+
     if (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS) {
+        ebur128->true_peaks = av_calloc(nb_channels, sizeof(*ebur128->true_peaks));
+        ebur128->true_peaks_per_frame = av_calloc(nb_channels, sizeof(*ebur128->true_peaks_per_frame));
+        ebur128->tp_hist    = av_calloc(nb_channels, TP_HIST * sizeof(*ebur128->tp_hist));
+        if (!ebur128->true_peaks || !ebur128->true_peaks_per_frame || !ebur128->tp_hist)
+            return AVERROR(ENOMEM);
+    }
+
+#if CONFIG_SWRESAMPLE
+    if ((ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS) && ebur128->tp_filter == TP_FILTER_SWR) {
         int ret;
 
         ebur128->swr_buf    = av_malloc_array(nb_channels, 19200 * sizeof(double));
-        ebur128->true_peaks = av_calloc(nb_channels, sizeof(*ebur128->true_peaks));
-        ebur128->true_peaks_per_frame = av_calloc(nb_channels, sizeof(*ebur128->true_peaks_per_frame));
         ebur128->swr_ctx    = swr_alloc();
-        if (!ebur128->swr_buf || !ebur128->true_peaks ||
-            !ebur128->true_peaks_per_frame || !ebur128->swr_ctx)
+        if (!ebur128->swr_buf || !ebur128->swr_ctx)
             return AVERROR(ENOMEM);
 
         av_opt_set_int(ebur128->swr_ctx, "in_channel_layout",    outlink->channel_layout, 0);
@@ -506,7 +530,8 @@ static av_cold int init(AVFilterContext *ctx)
             ebur128->loglevel = AV_LOG_INFO;
     }
 
-    if (!CONFIG_SWRESAMPLE && (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS)) {
+    if (!CONFIG_SWRESAMPLE && (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS) &&
+        ebur128->tp_filter == TP_FILTER_SWR) {
         av_log(ctx, AV_LOG_ERROR,
                "True-peak mode requires libswresample to be performed\n");
         return AVERROR(EINVAL);
@@ -577,6 +602,127 @@ static int gate_update(struct integrator *integ, double power,
     return gate_hist_pos;
 }
 
+typedef struct ThreadData {
+    const double *samples;          ///< interleaved input samples
+    int nb_samples;
+    int bin_id_400, bin_id_3000;    ///< cache positions of the first sample
+} ThreadData;
+
+/**
+ * Over-sample each channel of the frame by 4 with the BS.1770 polyphase
+ * filter and update the true peaks.
+ */
+static int true_peaks_fir(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    EBUR128Context *ebur128 = ctx->priv;
+    ThreadData *td = arg;
+    const int nb_channels = ebur128->nb_channels;
+    const int nb_samples  = td->nb_samples;
+    const int start = (nb_channels *  jobnr     ) / nb_jobs;
+    const int end   = (nb_channels * (jobnr + 1)) / nb_jobs;
+
+    for (int ch = start; ch < end; ch++) {
+        double *hist = ebur128->tp_hist + ch * TP_HIST;
+        double *buf  = ebur128->tp_buf  + ch * (nb_samples + TP_HIST);
+        const double *src = td->samples + ch;
+        double peak = 0.0;
+
+        memcpy(buf, hist, TP_HIST * sizeof(*buf));
+        for (int i = 0; i < nb_samples; i++)
+            buf[TP_HIST + i] = src[i * nb_channels];
+
+        for (int i = 0; i < nb_samples; i++)
+            peak = FFMAX(peak, ff_ebur128_interp_peak(buf + i));
+
+        memcpy(hist, buf + nb_samples, TP_HIST * sizeof(*hist));
+        ebur128->true_peaks_per_frame[ch] = peak;
+        ebur128->true_peaks[ch] = FFMAX(ebur128->true_peaks[ch], peak);
+    }
+
+    return 0;
+}
+
+/**
+ * Apply the K-weighting filters to a run of samples of each channel and
+ * feed the 400ms and 3s integrators.
+ */
+static int filter_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    EBUR128Context *ebur128 = ctx->priv;
+    ThreadData *td = arg;
+    const int nb_channels = ebur128->nb_channels;
+    const int nb_samples  = td->nb_samples;
+    const int start = (nb_channels *  jobnr     ) / nb_jobs;
+    const int end   = (nb_channels * (jobnr + 1)) / nb_jobs;
+
+    for (int ch = start; ch < end; ch++) {
+        const double *src = td->samples + ch;
+        double *cache_400  = ebur128->i400.cache[ch];
+        double *cache_3000 = ebur128->i3000.cache[ch];
+        double sum_400, sum_3000;
+        double x0, x1, x2, y0, y1, y2, z0, z1, z2;
+        int bin_id_400  = td->bin_id_400;
+        int bin_id_3000 = td->bin_id_3000;
+
+        if (ebur128->peak_mode & PEAK_MODE_SAMPLES_PEAKS) {
+            double peak = ebur128->sample_peaks[ch];
+
+            for (int i = 0; i < nb_samples; i++)
+                peak = FFMAX(peak, fabs(src[i * nb_channels]));
+            ebur128->sample_peaks[ch] = peak;
+        }
+
+        if (!ebur128->ch_weighting[ch])
+            continue;
+
+        x0 = ebur128->x[ch * 3]; x1 = ebur128->x[ch * 3 + 1]; x2 = ebur128->x[ch * 3 + 2];
+        y0 = ebur128->y[ch * 3]; y1 = ebur128->y[ch * 3 + 1]; y2 = ebur128->y[ch * 3 + 2];
+        z0 = ebur128->z[ch * 3]; z1 = ebur128->z[ch * 3 + 1]; z2 = ebur128->z[ch * 3 + 2];
+        sum_400  = ebur128->i400.sum [ch];
+        sum_3000 = ebur128->i3000.sum[ch];
+
+        for (int i = 0; i < nb_samples; i++) {
+            double bin;
+
+            x0 = src[i * nb_channels];
+
+            /* Y[i] = X[i]*b0 + X[i-1]*b1 + X[i-2]*b2 - Y[i-1]*a1 - Y[i-2]*a2 */
+            y2 = y1;
+            y1 = y0;
+            y0 = x0*PRE_B0 + x1*PRE_B1 + x2*PRE_B2 - y1*PRE_A1 - y2*PRE_A2;
+            x2 = x1;
+            x1 = x0;
+            z2 = z1;
+            z1 = z0;
+            z0 = y0*RLB_B0 + y1*RLB_B1 + y2*RLB_B2 - z1*RLB_A1 - z2*RLB_A2;
+
+            bin = z0 * z0;
+
+            /* add the new value, and limit the sum to the cache size (400ms or 3s)
+             * by removing the oldest one */
+            sum_400  = sum_400  + bin - cache_400 [bin_id_400];
+            sum_3000 = sum_3000 + bin - cache_3000[bin_id_3000];
+
+            /* override old cache entry with the new value */
+            cache_400 [bin_id_400 ] = bin;
+            cache_3000[bin_id_3000] = bin;
+
+            if (++bin_id_400  == I400_BINS)
+                bin_id_400  = 0;
+            if (++bin_id_3000 == I3000_BINS)
+                bin_id_3000 = 0;
+        }
+
+        ebur128->x[ch * 3] = x0; ebur128->x[ch * 3 + 1] = x1; ebur128->x[ch * 3 + 2] = x2;
+        ebur128->y[ch * 3] = y0; ebur128->y[ch * 3 + 1] = y1; ebur128->y[ch * 3 + 2] = y2;
+        ebur128->z[ch * 3] = z0; ebur128->z[ch * 3 + 1] = z1; ebur128->z[ch * 3 + 2] = z2;
+        ebur128->i400.sum [ch] = sum_400;
+        ebur128->i3000.sum[ch] = sum_3000;
+    }
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
 {
     int i, ch, idx_insample;
@@ -585,10 +731,21 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
     const int nb_channels = ebur128->nb_channels;
     const int nb_samples  = insamples->nb_samples;
     const double *samples = (double *)insamples->data[0];
+    const int nb_jobs = FFMIN(nb_channels, ebur128->nb_threads);
     AVFrame *pic = ebur128->outpicref;
 
+    if ((ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS) && ebur128->tp_filter == TP_FILTER_FIR) {
+        ThreadData td = { .samples = samples, .nb_samples = nb_samples };
+
+        av_fast_malloc(&ebur128->tp_buf, &ebur128->tp_buf_size,
+                       nb_channels * (nb_samples + TP_HIST) * sizeof(*ebur128->tp_buf));
+        if (!ebur128->tp_buf)
+            return AVERROR(ENOMEM);
+        ctx->internal->execute(ctx, true_peaks_fir, &td, NULL, nb_jobs);
+    }
+
 #if CONFIG_SWRESAMPLE
-    if (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS) {
+    if ((ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS) && ebur128->tp_filter == TP_FILTER_SWR) {
         const double *swr_samples = ebur128->swr_buf;
         int ret = swr_convert(ebur128->swr_ctx, (uint8_t**)&ebur128->swr_buf, 19200,
                               (const uint8_t **)insamples->data, nb_samples);
@@ -608,63 +765,35 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
 #endif
 
     for (idx_insample = 0; idx_insample < nb_samples; idx_insample++) {
-        const int bin_id_400  = ebur128->i400.cache_pos;
-        const int bin_id_3000 = ebur128->i3000.cache_pos;
-
-#define MOVE_TO_NEXT_CACHED_ENTRY(time) do {                \
-    ebur128->i##time.cache_pos++;                           \
-    if (ebur128->i##time.cache_pos == I##time##_BINS) {     \
-        ebur128->i##time.filled    = 1;                     \
-        ebur128->i##time.cache_pos = 0;                     \
-    }                                                       \
-} while (0)
-
-        MOVE_TO_NEXT_CACHED_ENTRY(400);
-        MOVE_TO_NEXT_CACHED_ENTRY(3000);
-
-        for (ch = 0; ch < nb_channels; ch++) {
-            double bin;
-
-            if (ebur128->peak_mode & PEAK_MODE_SAMPLES_PEAKS)
-                ebur128->sample_peaks[ch] = FFMAX(ebur128->sample_peaks[ch], fabs(*samples));
-
-            ebur128->x[ch * 3] = *samples++; // set X[i]
+        /* process the samples up to the next gating block boundary at once */
+        const int n = FFMIN(nb_samples - idx_insample, 4800 - ebur128->sample_count);
+        ThreadData td = {
+            .samples     = samples + idx_insample * nb_channels,
+            .nb_samples  = n,
+            .bin_id_400  = ebur128->i400.cache_pos,
+            .bin_id_3000 = ebur128->i3000.cache_pos,
+        };
 
-            if (!ebur128->ch_weighting[ch])
-                continue;
+        ctx->internal->execute(ctx, filter_channels, &td, NULL, nb_jobs);
 
-            /* Y[i] = X[i]*b0 + X[i-1]*b1 + X[i-2]*b2 - Y[i-1]*a1 - Y[i-2]*a2 */
-#define FILTER(Y, X, name) do {                                                 \
-            double *dst = ebur128->Y + ch*3;                                    \
-            double *src = ebur128->X + ch*3;                                    \
-            dst[2] = dst[1];                                                    \
-            dst[1] = dst[0];                                                    \
-            dst[0] = src[0]*name##_B0 + src[1]*name##_B1 + src[2]*name##_B2     \
-                                      - dst[1]*name##_A1 - dst[2]*name##_A2;    \
+#define MOVE_TO_NEXT_CACHED_ENTRIES(time, n) do {           \
+    ebur128->i##time.cache_pos += n;                        \
+    if (ebur128->i##time.cache_pos >= I##time##_BINS) {     \
+        ebur128->i##time.filled     = 1;                    \
+        ebur128->i##time.cache_pos -= I##time##_BINS;       \
+    }                                                       \
 } while (0)
 
-            // TODO: merge both filters in one?
-            FILTER(y, x, PRE);  // apply pre-filter
-            ebur128->x[ch * 3 + 2] = ebur128->x[ch * 3 + 1];
-            ebur128->x[ch * 3 + 1] = ebur128->x[ch * 3    ];
-            FILTER(z, y, RLB);  // apply RLB-filter
+        MOVE_TO_NEXT_CACHED_ENTRIES(400,  n);
+        MOVE_TO_NEXT_CACHED_ENTRIES(3000, n);
 
-            bin = ebur128->z[ch * 3] * ebur128->z[ch * 3];
-
-            /* add the new value, and limit the sum to the cache size (400ms or 3s)
-             * by removing the oldest one */
-            ebur128->i400.sum [ch] = ebur128->i400.sum [ch] + bin - ebur128->i400.cache [ch][bin_id_400];
-            ebur128->i3000.sum[ch] = ebur128->i3000.sum[ch] + bin - ebur128->i3000.cache[ch][bin_id_3000];
-
-            /* override old cache entry with the new value */
-            ebur128->i400.cache [ch][bin_id_400 ] = bin;
-            ebur128->i3000.cache[ch][bin_id_3000] = bin;
-        }
+        idx_insample += n - 1;
+        ebur128->sample_count += n;
 
         /* For integrated loudness, gating blocks are 400ms long with 75%
          * overlap (see BS.1770-2 p5), so a re-computation is needed each 100ms
          * (4800 samples at 48kHz). */
-        if (++ebur128->sample_count == 4800) {
+        if (ebur128->sample_count == 4800) {
             double loudness_400, loudness_3000;
             double power_400 = 1e-12, power_3000 = 1e-12;
             AVFilterLink *outlink = ctx->outputs[0];
@@ -976,6 +1105,8 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&ebur128->true_peaks);
     av_freep(&ebur128->sample_peaks);
     av_freep(&ebur128->true_peaks_per_frame);
+    av_freep(&ebur128->tp_hist);
+    av_freep(&ebur128->tp_buf);
     av_freep(&ebur128->i400.histogram);
     av_freep(&ebur128->i3000.histogram);
     for (i = 0; i < ebur128->nb_channels; i++) {
@@ -1009,5 +1140,5 @@ AVFilter ff_af_ebur128 = {
     .inputs        = ebur128_inputs,
     .outputs       = NULL,
     .priv_class    = &ebur128_class,
-    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS,
+    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -154,19 +154,23 @@ typedef struct SelectContext {
     ff_scene_sad_fn sad;            ///< Sum of the absolute difference function (scene detect only)
     double prev_mafd;               ///< previous MAFD                           (scene detect only)
     AVFrame *prev_picref;           ///< previous frame                          (scene detect only)
+    int scene_step;                 ///< line step of the SAD                    (scene detect only)
     double select;
     int select_out;                 ///< mark the selected output pad index
     int nb_outputs;
 } SelectContext;
 
 #define OFFSET(x) offsetof(SelectContext, x)
-#define DEFINE_OPTIONS(filt_name, FLAGS)                            \
-static const AVOption filt_name##_options[] = {                     \
+#define COMMON_OPTIONS(FLAGS)                                       \
     { "expr", "set an expression to use for selecting frames", OFFSET(expr_str), AV_OPT_TYPE_STRING, { .str = "1" }, .flags=FLAGS }, \
     { "e",    "set an expression to use for selecting frames", OFFSET(expr_str), AV_OPT_TYPE_STRING, { .str = "1" }, .flags=FLAGS }, \
     { "outputs", "set the number of outputs", OFFSET(nb_outputs), AV_OPT_TYPE_INT, {.i64 = 1}, 1, INT_MAX, .flags=FLAGS }, \
-    { "n",       "set the number of outputs", OFFSET(nb_outputs), AV_OPT_TYPE_INT, {.i64 = 1}, 1, INT_MAX, .flags=FLAGS }, \
-    { NULL }                                                            \
+    { "n",       "set the number of outputs", OFFSET(nb_outputs), AV_OPT_TYPE_INT, {.i64 = 1}, 1, INT_MAX, .flags=FLAGS },
+
+#define DEFINE_OPTIONS(filt_name, FLAGS)                            \
+static const AVOption filt_name##_options[] = {                     \
+    COMMON_OPTIONS(FLAGS)                                           \
+    { NULL }                                                        \
 }
 
 static int request_frame(AVFilterLink *outlink);
@@ -279,18 +283,11 @@ static double get_scene_score(AVFilterContext *ctx, AVFrame *frame)
     if (prev_picref &&
         frame->height == prev_picref->height &&
         frame->width  == prev_picref->width) {
-        uint64_t sad = 0;
+        uint64_t sad, count;
         double mafd, diff;
-        uint64_t count = 0;
-
-        for (int plane = 0; plane < select->nb_planes; plane++) {
-            uint64_t plane_sad;
-            select->sad(prev_picref->data[plane], prev_picref->linesize[plane],
-                    frame->data[plane], frame->linesize[plane],
-                    select->width[plane], select->height[plane], &plane_sad);
-            sad += plane_sad;
-            count += select->width[plane] * select->height[plane];
-        }
+
+        sad = ff_scene_sad_frames(ctx, select->sad, prev_picref, frame, select->nb_planes,
+                                  select->width, select->height, select->scene_step, &count);
 
         emms_c();
         mafd = (double)sad / count / (1ULL << (select->bitdepth - 8));
@@ -517,7 +514,11 @@ static int query_formats(AVFilterContext *ctx)
     return 0;
 }
 
-DEFINE_OPTIONS(select, AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM);
+static const AVOption select_options[] = {
+    COMMON_OPTIONS(AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM)
+    { "scene_step", "set the line step used for scene detection", OFFSET(scene_step), AV_OPT_TYPE_INT, {.i64 = 1}, 1, 64, .flags=AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM },
+    { NULL }
+};
 AVFILTER_DEFINE_CLASS(select);
 
 static av_cold int select_init(AVFilterContext *ctx)
@@ -549,6 +550,6 @@ AVFilter ff_vf_select = {
     .priv_size     = sizeof(SelectContext),
     .priv_class    = &select_class,
     .inputs        = avfilter_vf_select_inputs,
-    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS,
+    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_SLICE_THREADS,
 };
 #endif /* CONFIG_SELECT_FILTER */
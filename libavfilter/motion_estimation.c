@@ -45,6 +45,8 @@ if (x >= x_min && x <= x_max && y >= y_min && y <= y_max)\
 void ff_me_init_context(AVMotionEstContext *me_ctx, int mb_size, int search_param,
                         int width, int height, int x_min, int x_max, int y_min, int y_max)
 {
+    int n;
+
     me_ctx->width = width;
     me_ctx->height = height;
     me_ctx->mb_size = mb_size;
@@ -54,11 +56,15 @@ void ff_me_init_context(AVMotionEstContext *me_ctx, int mb_size, int search_para
     me_ctx->x_max = x_max;
     me_ctx->y_min = y_min;
     me_ctx->y_max = y_max;
+
+    for (n = 1; n < FF_ARRAY_ELEMS(me_ctx->sad); n++)
+        me_ctx->sad[n] = av_pixelutils_get_sad_fn(n, n, 0, NULL);
 }
 
 uint64_t ff_me_cmp_sad(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int x_mv, int y_mv)
 {
     const int linesize = me_ctx->linesize;
+    av_pixelutils_sad_fn sad_fn = ff_me_get_sad_fn(me_ctx, me_ctx->mb_size);
     uint8_t *data_ref = me_ctx->data_ref;
     uint8_t *data_cur = me_ctx->data_cur;
     uint64_t sad = 0;
@@ -67,6 +73,9 @@ uint64_t ff_me_cmp_sad(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int x_mv,
     data_ref += y_mv * linesize;
     data_cur += y_mb * linesize;
 
+    if (sad_fn)
+        return sad_fn(data_cur + x_mb, linesize, data_ref + x_mv, linesize);
+
     for (j = 0; j < me_ctx->mb_size; j++)
         for (i = 0; i < me_ctx->mb_size; i++)
             sad += FFABS(data_ref[x_mv + i + j * linesize] - data_cur[x_mb + i + j * linesize]);
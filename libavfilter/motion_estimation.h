@@ -22,6 +22,7 @@
 #define AVFILTER_MOTION_ESTIMATION_H
 
 #include "libavutil/avutil.h"
+#include "libavutil/pixelutils.h"
 
 #define AV_ME_METHOD_ESA        1
 #define AV_ME_METHOD_TSS        2
@@ -57,6 +58,8 @@ typedef struct AVMotionEstContext {
     int pred_y;     ///< median predictor y
     AVMotionEstPredictor preds[2];
 
+    av_pixelutils_sad_fn sad[6]; ///< SAD of (1 << n)x(1 << n) blocks, NULL if unavailable
+
     uint64_t (*get_cost)(struct AVMotionEstContext *me_ctx, int x_mb, int y_mb,
                          int mv_x, int mv_y);
 } AVMotionEstContext;
@@ -64,6 +67,20 @@ typedef struct AVMotionEstContext {
 void ff_me_init_context(AVMotionEstContext *me_ctx, int mb_size, int search_param,
                         int width, int height, int x_min, int x_max, int y_min, int y_max);
 
+/**
+ * Get the optimized SAD function for a square block of the given size.
+ *
+ * @return the SAD function, or NULL if size is not a supported power of two
+ */
+static inline av_pixelutils_sad_fn ff_me_get_sad_fn(const AVMotionEstContext *me_ctx, int size)
+{
+    int n = av_log2(size);
+
+    if (size != 1 << n || n >= FF_ARRAY_ELEMS(me_ctx->sad))
+        return NULL;
+    return me_ctx->sad[n];
+}
+
 uint64_t ff_me_cmp_sad(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int x_mv, int y_mv);
 
 uint64_t ff_me_search_esa(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int *mv);
@@ -0,0 +1,276 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+
+#include "audio.h"
+#include "internal.h"
+#include "partconv.h"
+
+/* the SIMD multiply-accumulate works on multiples of 8 complex values */
+#define BIN_STEP 8
+
+typedef struct ThreadData {
+    FFPartConv *pc;
+    const float *const *src;
+    ptrdiff_t src_stride;
+    float *const *dst;
+    ptrdiff_t dst_stride;
+    int nb_samples;
+} ThreadData;
+
+int ff_partconv_init(FFPartConv *pc, int nb_inputs, int nb_outputs,
+                     int block_size, int ir_len, int nb_jobs)
+{
+    int half = 1 << av_log2(FFMAX(block_size, BIN_STEP));
+
+    if (half < block_size)
+        half <<= 1;
+
+    pc->nb_inputs     = nb_inputs;
+    pc->nb_outputs    = nb_outputs;
+    pc->block_size    = block_size;
+    pc->fft_len       = 2 * half;
+    pc->spec_size     = FFALIGN(pc->fft_len + 1, 16);
+    pc->nb_partitions = FFMAX((ir_len + block_size - 1) / block_size, 1);
+    pc->fdl_pos       = 0;
+    pc->nb_jobs       = av_clip(nb_jobs, 1, half / BIN_STEP);
+
+    pc->fdl        = av_calloc(nb_inputs * pc->nb_partitions, pc->spec_size * sizeof(*pc->fdl));
+    pc->coeffs     = av_calloc(nb_outputs * nb_inputs * pc->nb_partitions,
+                               pc->spec_size * sizeof(*pc->coeffs));
+    pc->has_ir     = av_calloc(nb_outputs * nb_inputs, sizeof(*pc->has_ir));
+    pc->input_used = av_calloc(nb_inputs, sizeof(*pc->input_used));
+    pc->sum        = av_calloc(nb_outputs, pc->spec_size * sizeof(*pc->sum));
+    pc->acc        = av_calloc(pc->nb_jobs, pc->spec_size * sizeof(*pc->acc));
+    pc->overlap    = av_calloc(nb_outputs, block_size * sizeof(*pc->overlap));
+    pc->rdft       = av_calloc(nb_inputs, sizeof(*pc->rdft));
+    pc->irdft      = av_calloc(nb_outputs, sizeof(*pc->irdft));
+    if (!pc->fdl || !pc->coeffs || !pc->has_ir || !pc->input_used ||
+        !pc->sum || !pc->acc || !pc->overlap || !pc->rdft || !pc->irdft)
+        return AVERROR(ENOMEM);
+
+    for (int i = 0; i < nb_inputs; i++) {
+        pc->rdft[i] = av_rdft_init(av_log2(pc->fft_len), DFT_R2C);
+        if (!pc->rdft[i])
+            return AVERROR(ENOMEM);
+    }
+
+    for (int o = 0; o < nb_outputs; o++) {
+        pc->irdft[o] = av_rdft_init(av_log2(pc->fft_len), IDFT_C2R);
+        if (!pc->irdft[o])
+            return AVERROR(ENOMEM);
+    }
+
+    ff_afir_init(&pc->dsp);
+
+    return 0;
+}
+
+int ff_partconv_set_ir(FFPartConv *pc, int input, int output,
+                       const float *ir, int len)
+{
+    const int block_size = pc->block_size;
+    const int fft_len = pc->fft_len;
+    const float scale = 2.f / fft_len;
+    float *coeffs = pc->coeffs + (output * pc->nb_inputs + input) *
+                                 pc->nb_partitions * pc->spec_size;
+    float *block;
+
+    if (len > pc->nb_partitions * block_size)
+        return AVERROR(EINVAL);
+
+    block = av_malloc_array(fft_len, sizeof(*block));
+    if (!block)
+        return AVERROR(ENOMEM);
+
+    for (int p = 0; p < pc->nb_partitions; p++) {
+        float *coeff = coeffs + p * pc->spec_size;
+        const int size = av_clip(len - p * block_size, 0, block_size);
+
+        memset(block, 0, fft_len * sizeof(*block));
+        memcpy(block, ir + p * block_size, size * sizeof(*block));
+        av_rdft_calc(pc->rdft[input], block);
+
+        for (int n = 0; n < fft_len; n++)
+            coeff[n] = block[n] * scale;
+        coeff[fft_len] = block[1] * scale;
+        coeff[1] = 0.f;
+    }
+
+    av_free(block);
+
+    pc->has_ir[output * pc->nb_inputs + input] = 1;
+    pc->input_used[input] = 1;
+
+    return 0;
+}
+
+static int transform_inputs(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    FFPartConv *pc = td->pc;
+    const int start = ff_audio_channels_start(pc->nb_inputs, jobnr, nb_jobs);
+    const int end = ff_audio_channels_start(pc->nb_inputs, jobnr + 1, nb_jobs);
+    const int fft_len = pc->fft_len;
+    const int nb_samples = td->nb_samples;
+
+    for (int i = start; i < end; i++) {
+        float *block = pc->fdl + (i * pc->nb_partitions + pc->fdl_pos) * pc->spec_size;
+        const float *src = td->src[i];
+
+        if (!pc->input_used[i])
+            continue;
+
+        if (!src) {
+            memset(block, 0, (fft_len + 1) * sizeof(*block));
+            continue;
+        }
+
+        for (int n = 0; n < nb_samples; n++)
+            block[n] = src[n * td->src_stride];
+        memset(block + nb_samples, 0, (fft_len - nb_samples) * sizeof(*block));
+
+        av_rdft_calc(pc->rdft[i], block);
+        block[fft_len] = block[1];
+        block[1] = 0.f;
+    }
+
+    return 0;
+}
+
+static int accumulate_bins(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    FFPartConv *pc = td->pc;
+    const int nb_steps = pc->fft_len / 2 / BIN_STEP;
+    const int start = (nb_steps * jobnr) / nb_jobs * BIN_STEP;
+    const int end = (nb_steps * (jobnr + 1)) / nb_jobs * BIN_STEP;
+    const int last = jobnr == nb_jobs - 1;
+    const int nb_partitions = pc->nb_partitions;
+    float *acc = pc->acc + jobnr * pc->spec_size;
+
+    if (start >= end)
+        return 0;
+
+    for (int o = 0; o < pc->nb_outputs; o++) {
+        float *sum = pc->sum + o * pc->spec_size;
+
+        /* accumulate in a private buffer: fcmul_add also writes the real
+         * value following the range, which belongs to the next job */
+        memset(acc, 0, (2 * (end - start) + 1) * sizeof(*acc));
+
+        for (int i = 0; i < pc->nb_inputs; i++) {
+            const float *coeffs = pc->coeffs + (o * pc->nb_inputs + i) *
+                                               nb_partitions * pc->spec_size;
+            const float *fdl = pc->fdl + i * nb_partitions * pc->spec_size;
+            int j = pc->fdl_pos;
+
+            if (!pc->has_ir[o * pc->nb_inputs + i])
+                continue;
+
+            for (int p = 0; p < nb_partitions; p++) {
+                pc->dsp.fcmul_add(acc, fdl + j * pc->spec_size + 2 * start,
+                                  coeffs + p * pc->spec_size + 2 * start,
+                                  end - start);
+
+                if (j == 0)
+                    j = nb_partitions;
+                j--;
+            }
+        }
+
+        memcpy(sum + 2 * start, acc, (2 * (end - start) + last) * sizeof(*acc));
+    }
+
+    return 0;
+}
+
+static int transform_outputs(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    FFPartConv *pc = td->pc;
+    const int start = ff_audio_channels_start(pc->nb_outputs, jobnr, nb_jobs);
+    const int end = ff_audio_channels_start(pc->nb_outputs, jobnr + 1, nb_jobs);
+    const int block_size = pc->block_size;
+    const int nb_samples = td->nb_samples;
+
+    for (int o = start; o < end; o++) {
+        float *sum = pc->sum + o * pc->spec_size;
+        float *overlap = pc->overlap + o * block_size;
+        float *dst = td->dst[o];
+
+        sum[1] = sum[pc->fft_len];
+        av_rdft_calc(pc->irdft[o], sum);
+
+        for (int n = 0; n < nb_samples; n++)
+            dst[n * td->dst_stride] = sum[n] + overlap[n];
+
+        memcpy(overlap, sum + block_size, block_size * sizeof(*overlap));
+    }
+
+    return 0;
+}
+
+void ff_partconv_process(AVFilterContext *ctx, FFPartConv *pc,
+                         const float *const *src, ptrdiff_t src_stride,
+                         float *const *dst, ptrdiff_t dst_stride,
+                         int nb_samples)
+{
+    ThreadData td;
+
+    td.pc         = pc;
+    td.src        = src;
+    td.src_stride = src_stride;
+    td.dst        = dst;
+    td.dst_stride = dst_stride;
+    td.nb_samples = FFMIN(nb_samples, pc->block_size);
+
+    ff_filter_execute_channels(ctx, transform_inputs, &td, pc->nb_inputs);
+    ctx->internal->execute(ctx, accumulate_bins, &td, NULL,
+                           FFMIN(pc->nb_jobs, ff_filter_get_nb_threads(ctx)));
+    ff_filter_execute_channels(ctx, transform_outputs, &td, pc->nb_outputs);
+    emms_c();
+
+    pc->fdl_pos = (pc->fdl_pos + 1) % pc->nb_partitions;
+}
+
+void ff_partconv_uninit(FFPartConv *pc)
+{
+    if (pc->rdft) {
+        for (int i = 0; i < pc->nb_inputs; i++)
+            av_rdft_end(pc->rdft[i]);
+    }
+    if (pc->irdft) {
+        for (int o = 0; o < pc->nb_outputs; o++)
+            av_rdft_end(pc->irdft[o]);
+    }
+    av_freep(&pc->rdft);
+    av_freep(&pc->irdft);
+
+    av_freep(&pc->fdl);
+    av_freep(&pc->coeffs);
+    av_freep(&pc->has_ir);
+    av_freep(&pc->input_used);
+    av_freep(&pc->sum);
+    av_freep(&pc->acc);
+    av_freep(&pc->overlap);
+}
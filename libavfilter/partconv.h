@@ -0,0 +1,101 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Uniformly partitioned frequency-domain convolution
+ *
+ * Every output is the sum of all inputs, each convolved with its own
+ * impulse response. The impulse responses are split into partitions of
+ * one block, and the spectra of the last input blocks are kept in a
+ * frequency-domain delay line shared by all outputs, so that the cost per
+ * block does not depend on the transform size of the whole response and
+ * no latency is added.
+ */
+
+#ifndef AVFILTER_PARTCONV_H
+#define AVFILTER_PARTCONV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libavcodec/avfft.h"
+
+#include "af_afirdsp.h"
+#include "avfilter.h"
+
+typedef struct FFPartConv {
+    int nb_inputs;
+    int nb_outputs;
+    int block_size;         ///< number of samples processed per call
+    int fft_len;            ///< real transform length, at least 2 * block_size
+    int spec_size;          ///< number of floats of one packed spectrum
+    int nb_partitions;      ///< number of block_size partitions of the responses
+    int fdl_pos;            ///< delay line slot of the current block
+    int nb_jobs;
+
+    float *fdl;             ///< input spectra, nb_inputs x nb_partitions
+    float *coeffs;          ///< response spectra, nb_outputs x nb_inputs x nb_partitions
+    uint8_t *has_ir;        ///< nb_outputs x nb_inputs, set when a response was loaded
+    uint8_t *input_used;    ///< nb_inputs, set when any output uses the input
+    float *sum;             ///< output spectra, nb_outputs
+    float *acc;             ///< per job accumulators, nb_jobs
+    float *overlap;         ///< output tails, nb_outputs x block_size
+
+    RDFTContext **rdft;     ///< one per input
+    RDFTContext **irdft;    ///< one per output
+
+    AudioFIRDSPContext dsp;
+} FFPartConv;
+
+/**
+ * Allocate the convolution state.
+ *
+ * @param block_size number of samples per ff_partconv_process() call
+ * @param ir_len     maximum length of the impulse responses
+ * @param nb_jobs    maximum number of slice jobs that will be used
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_partconv_init(FFPartConv *pc, int nb_inputs, int nb_outputs,
+                     int block_size, int ir_len, int nb_jobs);
+
+/**
+ * Set the impulse response convolving input into output.
+ * Input/output pairs without a response do not contribute.
+ *
+ * @param ir  len samples, at most the ir_len given to ff_partconv_init()
+ */
+int ff_partconv_set_ir(FFPartConv *pc, int input, int output,
+                       const float *ir, int len);
+
+/**
+ * Convolve one block. Input i is read from src[i][n * src_stride] and
+ * output o is written to dst[o][n * dst_stride], for n < nb_samples.
+ * A NULL src[i] is treated as silence. nb_samples may only be lower than
+ * block_size for the last block of a stream.
+ *
+ * The work is split over slice threads of ctx.
+ */
+void ff_partconv_process(AVFilterContext *ctx, FFPartConv *pc,
+                         const float *const *src, ptrdiff_t src_stride,
+                         float *const *dst, ptrdiff_t dst_stride,
+                         int nb_samples);
+
+void ff_partconv_uninit(FFPartConv *pc);
+
+#endif /* AVFILTER_PARTCONV_H */
@@ -21,8 +21,21 @@
  * Scene SAD functions
  */
 
+#include "internal.h"
 #include "scene_sad.h"
 
+#define MAX_JOBS 64
+
+typedef struct ThreadData {
+    ff_scene_sad_fn sad;
+    const AVFrame *frame1, *frame2;
+    int nb_planes;
+    const ptrdiff_t *width;
+    const ptrdiff_t *height;
+    int step;
+    uint64_t sum[MAX_JOBS];
+} ThreadData;
+
 void ff_scene_sad16_c(SCENE_SAD_PARAMS)
 {
     uint64_t sad = 0;
@@ -70,3 +83,61 @@ ff_scene_sad_fn ff_scene_sad_get_fn(int depth)
     return sad;
 }
 
+
+static int scene_sad_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    uint64_t sum = 0;
+
+    for (int plane = 0; plane < td->nb_planes; plane++) {
+        const int nb_lines = (td->height[plane] + td->step - 1) / td->step;
+        const int slice_start = (nb_lines * jobnr) / nb_jobs;
+        const int slice_end = (nb_lines * (jobnr+1)) / nb_jobs;
+        const ptrdiff_t linesize1 = td->frame1->linesize[plane];
+        const ptrdiff_t linesize2 = td->frame2->linesize[plane];
+        uint64_t plane_sad;
+
+        if (slice_end <= slice_start)
+            continue;
+
+        td->sad(td->frame1->data[plane] + slice_start * td->step * linesize1,
+                linesize1 * td->step,
+                td->frame2->data[plane] + slice_start * td->step * linesize2,
+                linesize2 * td->step,
+                td->width[plane], slice_end - slice_start, &plane_sad);
+        sum += plane_sad;
+    }
+    td->sum[jobnr] = sum;
+
+    return 0;
+}
+
+uint64_t ff_scene_sad_frames(AVFilterContext *ctx, ff_scene_sad_fn sad,
+                             const AVFrame *frame1, const AVFrame *frame2,
+                             int nb_planes, const ptrdiff_t width[4],
+                             const ptrdiff_t height[4], int step,
+                             uint64_t *count)
+{
+    const int nb_jobs = FFMIN(ff_filter_get_nb_threads(ctx), MAX_JOBS);
+    ThreadData td = {
+        .sad       = sad,
+        .frame1    = frame1,
+        .frame2    = frame2,
+        .nb_planes = nb_planes,
+        .width     = width,
+        .height    = height,
+        .step      = step,
+    };
+    uint64_t sum = 0;
+
+    *count = 0;
+    for (int plane = 0; plane < nb_planes; plane++)
+        *count += width[plane] * ((height[plane] + step - 1) / step);
+
+    ctx->internal->execute(ctx, scene_sad_slice, &td, NULL, nb_jobs);
+
+    for (int i = 0; i < nb_jobs; i++)
+        sum += td.sum[i];
+
+    return sum;
+}
@@ -41,4 +41,20 @@ ff_scene_sad_fn ff_scene_sad_get_fn_x86(int depth);
 
 ff_scene_sad_fn ff_scene_sad_get_fn(int depth);
 
+/**
+ * Compute the SAD between the first nb_planes planes of two frames using
+ * the filter slice threads.
+ *
+ * @param width  width of each plane, in samples
+ * @param height height of each plane
+ * @param step   only every step-th line is compared
+ * @param count  set to the number of compared samples
+ * @return the sum of absolute differences
+ */
+uint64_t ff_scene_sad_frames(AVFilterContext *ctx, ff_scene_sad_fn sad,
+                             const AVFrame *frame1, const AVFrame *frame2,
+                             int nb_planes, const ptrdiff_t width[4],
+                             const ptrdiff_t height[4], int step,
+                             uint64_t *count);
+
 #endif /* AVFILTER_SCENE_SAD_H */
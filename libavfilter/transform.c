@@ -143,32 +143,19 @@ void avfilter_mul_matrix(const float *m1, float scalar, float *result)
         result[i] = m1[i] * scalar;
 }
 
-int avfilter_transform(const uint8_t *src, uint8_t *dst,
-                        int src_stride, int dst_stride,
-                        int width, int height, const float *matrix,
-                        enum InterpolateMethod interpolate,
-                        enum FillMethod fill)
+static av_always_inline void transform_rows(const uint8_t *src, uint8_t *dst,
+                                           int src_stride, int dst_stride,
+                                           int width, int height,
+                                           int slice_start, int slice_end,
+                                           const float *matrix, enum FillMethod fill,
+                                           uint8_t (*func)(float, float, const uint8_t *,
+                                                           int, int, int, uint8_t))
 {
     int x, y;
     float x_s, y_s;
     uint8_t def = 0;
-    uint8_t (*func)(float, float, const uint8_t *, int, int, int, uint8_t) = NULL;
 
-    switch(interpolate) {
-        case INTERPOLATE_NEAREST:
-            func = interpolate_nearest;
-            break;
-        case INTERPOLATE_BILINEAR:
-            func = interpolate_bilinear;
-            break;
-        case INTERPOLATE_BIQUADRATIC:
-            func = interpolate_biquadratic;
-            break;
-        default:
-            return AVERROR(EINVAL);
-    }
-
-    for (y = 0; y < height; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for(x = 0; x < width; x++) {
             x_s = x * matrix[0] + y * matrix[1] + matrix[2];
             y_s = x * matrix[3] + y * matrix[4] + matrix[5];
@@ -194,5 +181,41 @@ int avfilter_transform(const uint8_t *src, uint8_t *dst,
             dst[y * dst_stride + x] = func(x_s, y_s, src, width, height, src_stride, def);
         }
     }
+}
+
+int ff_transform_slice(const uint8_t *src, uint8_t *dst,
+                       int src_stride, int dst_stride,
+                       int width, int height, int slice_start, int slice_end,
+                       const float *matrix,
+                       enum InterpolateMethod interpolate,
+                       enum FillMethod fill)
+{
+    /* the interpolation is inlined in the row loop of each method */
+    switch(interpolate) {
+        case INTERPOLATE_NEAREST:
+            transform_rows(src, dst, src_stride, dst_stride, width, height,
+                           slice_start, slice_end, matrix, fill, interpolate_nearest);
+            break;
+        case INTERPOLATE_BILINEAR:
+            transform_rows(src, dst, src_stride, dst_stride, width, height,
+                           slice_start, slice_end, matrix, fill, interpolate_bilinear);
+            break;
+        case INTERPOLATE_BIQUADRATIC:
+            transform_rows(src, dst, src_stride, dst_stride, width, height,
+                           slice_start, slice_end, matrix, fill, interpolate_biquadratic);
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
     return 0;
 }
+
+int avfilter_transform(const uint8_t *src, uint8_t *dst,
+                        int src_stride, int dst_stride,
+                        int width, int height, const float *matrix,
+                        enum InterpolateMethod interpolate,
+                        enum FillMethod fill)
+{
+    return ff_transform_slice(src, dst, src_stride, dst_stride, width, height,
+                              0, height, matrix, interpolate, fill);
+}
@@ -42,8 +42,28 @@ typedef struct CropDetectContext {
     int frame_nb;
     int max_pixsteps[4];
     int max_outliers;
+    int interval;
+    int interval_count;
+    int stable;
+    int stable_count;
+    int converged;
+
+    int nb_threads;
+    int *col_acc;       ///< per job column sums, nb_threads * MAX_BLOCK
 } CropDetectContext;
 
+/* Edges are scanned in blocks of lines whose size doubles from MIN_BLOCK up
+ * to MAX_BLOCK, so the early exit stays cheap while long black borders
+ * are analyzed in parallel. */
+#define MIN_BLOCK 8
+#define MAX_BLOCK 256
+
+typedef struct ThreadData {
+    AVFrame *frame;
+    int lo, n;
+    int *totals;
+} ThreadData;
+
 static int query_formats(AVFilterContext *ctx)
 {
     static const enum AVPixelFormat pix_fmts[] = {
@@ -124,18 +144,139 @@ static int checkline(void *ctx, const unsigned char *src, int stride, int len, i
     return total;
 }
 
+static int row_totals(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    CropDetectContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *frame = td->frame;
+    const int bpp = s->max_pixsteps[0];
+    const int start = (td->n *  jobnr     ) / nb_jobs;
+    const int end   = (td->n * (jobnr + 1)) / nb_jobs;
+
+    for (int i = start; i < end; i++)
+        td->totals[i] = checkline(ctx, frame->data[0] + (td->lo + i) * frame->linesize[0],
+                                  bpp, frame->width, bpp);
+
+    return 0;
+}
+
+/* Column sums are accumulated row by row over a slice of the frame, which
+ * reads memory linearly instead of walking down each column. */
+static int col_sums(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    CropDetectContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *frame = td->frame;
+    const int bpp = s->max_pixsteps[0];
+    const int start = (frame->height *  jobnr     ) / nb_jobs;
+    const int end   = (frame->height * (jobnr + 1)) / nb_jobs;
+    const int n = td->n;
+    int *acc = s->col_acc + MAX_BLOCK * jobnr;
+
+    memset(acc, 0, n * sizeof(*acc));
+
+    for (int y = start; y < end; y++) {
+        const uint8_t *src = frame->data[0] + y * frame->linesize[0] + td->lo * bpp;
+        const uint16_t *src16 = (const uint16_t *)src;
+
+        switch (bpp) {
+        case 1:
+            for (int i = 0; i < n; i++)
+                acc[i] += src[i];
+            break;
+        case 2:
+            for (int i = 0; i < n; i++)
+                acc[i] += src16[i];
+            break;
+        case 3:
+        case 4:
+            for (int i = 0; i < n; i++)
+                acc[i] += src[i * bpp] + src[i * bpp + 1] + src[i * bpp + 2];
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static void line_totals(AVFilterContext *ctx, AVFrame *frame, int vertical,
+                        int lo, int n, int *totals)
+{
+    CropDetectContext *s = ctx->priv;
+    ThreadData td = { .frame = frame, .lo = lo, .n = n, .totals = totals };
+
+    if (!vertical) {
+        ctx->internal->execute(ctx, row_totals, &td, NULL, FFMIN(n, s->nb_threads));
+    } else {
+        const int nb_jobs = FFMIN(frame->height, s->nb_threads);
+        const int div = frame->height * (s->max_pixsteps[0] >= 3 ? 3 : 1);
+
+        ctx->internal->execute(ctx, col_sums, &td, NULL, nb_jobs);
+
+        for (int i = 0; i < n; i++) {
+            int total = 0;
+
+            for (int j = 0; j < nb_jobs; j++)
+                total += s->col_acc[MAX_BLOCK * j + i];
+            totals[i] = total / div;
+            av_log(ctx, AV_LOG_DEBUG, "total:%d\n", totals[i]);
+        }
+    }
+}
+
+/**
+ * Scan lines from 'from' towards 'bound' (exclusive) in direction 'inc' and
+ * move the edge *dst to the last black line before more than max_outliers
+ * non-black lines were found.
+ */
+static void find_edge(AVFilterContext *ctx, AVFrame *frame, int *dst,
+                      int from, int bound, int inc, int vertical, int limit)
+{
+    CropDetectContext *s = ctx->priv;
+    int totals[MAX_BLOCK];
+    int block = MIN_BLOCK;
+    int outliers = 0, last_y = from;
+    int y = from;
+
+    while (inc > 0 ? y < bound : y > bound) {
+        const int n  = FFMIN(block, inc > 0 ? bound - y : y - bound);
+        const int lo = inc > 0 ? y : y - n + 1;
+
+        line_totals(ctx, frame, vertical, lo, n, totals);
+
+        for (int i = 0; i < n; i++, y += inc) {
+            if (totals[y - lo] > limit) {
+                if (++outliers > s->max_outliers) {
+                    *dst = last_y;
+                    return;
+                }
+            } else
+                last_y = y + inc;
+        }
+
+        block = FFMIN(block * 2, MAX_BLOCK);
+    }
+}
+
 static av_cold int init(AVFilterContext *ctx)
 {
     CropDetectContext *s = ctx->priv;
 
     s->frame_nb = -1 * s->skip;
 
-    av_log(ctx, AV_LOG_VERBOSE, "limit:%f round:%d skip:%d reset_count:%d\n",
-           s->limit, s->round, s->skip, s->reset_count);
+    av_log(ctx, AV_LOG_VERBOSE, "limit:%f round:%d skip:%d reset_count:%d interval:%d stable:%d\n",
+           s->limit, s->round, s->skip, s->reset_count, s->interval, s->stable);
 
     return 0;
 }
 
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    CropDetectContext *s = ctx->priv;
+
+    av_freep(&s->col_acc);
+}
+
 static int config_input(AVFilterLink *inlink)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -152,6 +293,12 @@ static int config_input(AVFilterLink *inlink)
     s->x2 = 0;
     s->y2 = 0;
 
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    av_freep(&s->col_acc);
+    s->col_acc = av_calloc(s->nb_threads, MAX_BLOCK * sizeof(*s->col_acc));
+    if (!s->col_acc)
+        return AVERROR(ENOMEM);
+
     return 0;
 }
 
@@ -162,43 +309,46 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
 {
     AVFilterContext *ctx = inlink->dst;
     CropDetectContext *s = ctx->priv;
-    int bpp = s->max_pixsteps[0];
     int w, h, x, y, shrink_by;
     AVDictionary **metadata;
-    int outliers, last_y;
     int limit = lrint(s->limit);
+    int analyze;
 
     // ignore first s->skip frames
     if (++s->frame_nb > 0) {
         metadata = &frame->metadata;
 
         // Reset the crop area every reset_count frames, if reset_count is > 0
-        if (s->reset_count > 0 && s->frame_nb > s->reset_count) {
+        if (s->reset_count > 0 && s->frame_nb > s->reset_count && !s->converged) {
             s->x1 = frame->width  - 1;
             s->y1 = frame->height - 1;
             s->x2 = 0;
             s->y2 = 0;
             s->frame_nb = 1;
+            s->stable_count = 0;
         }
 
-#define FIND(DST, FROM, NOEND, INC, STEP0, STEP1, LEN) \
-        outliers = 0;\
-        for (last_y = y = FROM; NOEND; y = y INC) {\
-            if (checkline(ctx, frame->data[0] + STEP0 * y, STEP1, LEN, bpp) > limit) {\
-                if (++outliers > s->max_outliers) { \
-                    DST = last_y;\
-                    break;\
-                }\
-            } else\
-                last_y = y INC;\
+        // only analyze every interval-th frame, and stop once converged
+        analyze = !s->converged && s->interval_count++ % s->interval == 0;
+        if (analyze) {
+            int x1 = s->x1, y1 = s->y1, x2 = s->x2, y2 = s->y2;
+
+            find_edge(ctx, frame, &s->y1,                 0,                  s->y1,  1, 0, limit);
+            find_edge(ctx, frame, &s->y2, frame->height - 1, FFMAX(s->y2, s->y1), -1, 0, limit);
+            find_edge(ctx, frame, &s->x1,                 0,                  s->x1,  1, 1, limit);
+            find_edge(ctx, frame, &s->x2,  frame->width - 1, FFMAX(s->x2, s->x1), -1, 1, limit);
+
+            if (x1 == s->x1 && y1 == s->y1 && x2 == s->x2 && y2 == s->y2)
+                s->stable_count++;
+            else
+                s->stable_count = 0;
+            if (s->stable > 0 && s->stable_count >= s->stable) {
+                s->converged = 1;
+                av_log(ctx, AV_LOG_VERBOSE, "crop area converged after %d stable samples\n",
+                       s->stable_count);
+            }
         }
 
-        FIND(s->y1,                 0,               y < s->y1, +1, frame->linesize[0], bpp, frame->width);
-        FIND(s->y2, frame->height - 1, y > FFMAX(s->y2, s->y1), -1, frame->linesize[0], bpp, frame->width);
-        FIND(s->x1,                 0,               y < s->x1, +1, bpp, frame->linesize[0], frame->height);
-        FIND(s->x2,  frame->width - 1, y > FFMAX(s->x2, s->x1), -1, bpp, frame->linesize[0], frame->height);
-
-
         // round x and y (up), important for yuv colorspaces
         // make sure they stay rounded!
         x = (s->x1+1) & ~1;
@@ -230,12 +380,15 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
         SET_META("lavfi.cropdetect.h",  h);
         SET_META("lavfi.cropdetect.x",  x);
         SET_META("lavfi.cropdetect.y",  y);
-
-        av_log(ctx, AV_LOG_INFO,
-               "x1:%d x2:%d y1:%d y2:%d w:%d h:%d x:%d y:%d pts:%"PRId64" t:%f crop=%d:%d:%d:%d\n",
-               s->x1, s->x2, s->y1, s->y2, w, h, x, y, frame->pts,
-               frame->pts == AV_NOPTS_VALUE ? -1 : frame->pts * av_q2d(inlink->time_base),
-               w, h, x, y);
+        if (s->converged)
+            SET_META("lavfi.cropdetect.converged", 1);
+
+        if (analyze)
+            av_log(ctx, AV_LOG_INFO,
+                   "x1:%d x2:%d y1:%d y2:%d w:%d h:%d x:%d y:%d pts:%"PRId64" t:%f crop=%d:%d:%d:%d\n",
+                   s->x1, s->x2, s->y1, s->y2, w, h, x, y, frame->pts,
+                   frame->pts == AV_NOPTS_VALUE ? -1 : frame->pts * av_q2d(inlink->time_base),
+                   w, h, x, y);
     }
 
     return ff_filter_frame(inlink->dst->outputs[0], frame);
@@ -251,6 +404,8 @@ static const AVOption cropdetect_options[] = {
     { "skip",  "Number of initial frames to skip",                    OFFSET(skip),        AV_OPT_TYPE_INT, { .i64 = 2 },  0, INT_MAX, FLAGS },
     { "reset_count", "Recalculate the crop area after this many frames",OFFSET(reset_count),AV_OPT_TYPE_INT,{ .i64 = 0 },  0, INT_MAX, FLAGS },
     { "max_outliers", "Threshold count of outliers",                  OFFSET(max_outliers),AV_OPT_TYPE_INT, { .i64 = 0 },  0, INT_MAX, FLAGS },
+    { "interval", "Analyze only every Nth frame",                     OFFSET(interval),    AV_OPT_TYPE_INT, { .i64 = 1 },  1, INT_MAX, FLAGS },
+    { "stable", "Stop analyzing once the area is unchanged for this many samples", OFFSET(stable), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, FLAGS },
     { NULL }
 };
 
@@ -280,8 +435,9 @@ AVFilter ff_vf_cropdetect = {
     .priv_size     = sizeof(CropDetectContext),
     .priv_class    = &cropdetect_class,
     .init          = init,
+    .uninit        = uninit,
     .query_formats = query_formats,
     .inputs        = avfilter_vf_cropdetect_inputs,
     .outputs       = avfilter_vf_cropdetect_outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
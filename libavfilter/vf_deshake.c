@@ -61,6 +61,22 @@
 
 #include "deshake.h"
 
+#define MAX_THREADS 64
+
+typedef struct MotionThreadData {
+    uint8_t *src1, *src2;
+    int stride;
+    int nb_blocks_x, nb_blocks_y;
+} MotionThreadData;
+
+typedef struct TransformThreadData {
+    AVFrame *in, *out;
+    const float *matrix;
+    int plane, width, height;
+    enum InterpolateMethod interpolate;
+    enum FillMethod fill;
+} TransformThreadData;
+
 #define OFFSET(x) offsetof(DeshakeContext, x)
 #define FLAGS AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM
 
@@ -225,6 +241,38 @@ static double block_angle(int x, int y, int cx, int cy, IntMotionVector *shift)
            diff;
 }
 
+static int find_motion_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    DeshakeContext *deshake = ctx->priv;
+    MotionThreadData *td = arg;
+    const int slice_start = (td->nb_blocks_y *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->nb_blocks_y * (jobnr+1)) / nb_jobs;
+    int bx, by;
+
+    for (by = slice_start; by < slice_end; by++) {
+        const int y = deshake->ry + by * deshake->blocksize * 2;
+        IntMotionVector *mv = deshake->mvs + by * td->nb_blocks_x;
+
+        // We use a width of 16 here to match the sad function
+        for (bx = 0; bx < td->nb_blocks_x; bx++) {
+            const int x = deshake->rx + bx * 16;
+
+            // If the contrast is too low, just skip this block as it probably
+            // won't be very useful to us.
+            if (block_contrast(td->src2, x, y, td->stride, deshake->blocksize) > deshake->contrast) {
+                // The search may leave the vector untouched, e.g. the smart
+                // search with rx and ry of 0, so it must start from zero
+                mv[bx] = (IntMotionVector){0, 0};
+                find_block_motion(deshake, td->src1, td->src2, x, y, td->stride, &mv[bx]);
+            } else {
+                mv[bx].x = -1;
+                mv[bx].y = -1;
+            }
+        }
+    }
+    return 0;
+}
+
 /**
  * Find the estimated global motion for a scene given the most likely shift
  * for each block in the frame. The global motion is estimated to be the
@@ -232,19 +280,29 @@ static double block_angle(int x, int y, int cx, int cy, IntMotionVector *shift)
  * move one pixel to the right and two pixels down, this would yield a
  * motion vector (1, -2).
  */
-static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
-                        int width, int height, int stride, Transform *t)
+static int find_motion(AVFilterContext *ctx, uint8_t *src1, uint8_t *src2,
+                       int width, int height, int stride, Transform *t)
 {
-    int x, y;
-    IntMotionVector mv = {0, 0};
+    DeshakeContext *deshake = ctx->priv;
+    MotionThreadData td;
+    int x, y, bx, by;
     int count_max_value = 0;
-    int contrast;
 
     int pos;
     int center_x = 0, center_y = 0;
     double p_x, p_y;
 
+    td.src1   = src1;
+    td.src2   = src2;
+    td.stride = stride;
+    td.nb_blocks_x = FFMAX(0, (width  - 2 * deshake->rx - 16 + 15) / 16);
+    td.nb_blocks_y = FFMAX(0, (height - 2 * deshake->ry - deshake->blocksize * 2 + deshake->blocksize * 2 - 1) /
+                              (deshake->blocksize * 2));
+
     av_fast_malloc(&deshake->angles, &deshake->angles_size, width * height / (16 * deshake->blocksize) * sizeof(*deshake->angles));
+    av_fast_malloc(&deshake->mvs, &deshake->mvs_size, td.nb_blocks_x * td.nb_blocks_y * sizeof(*deshake->mvs));
+    if (td.nb_blocks_x > 0 && td.nb_blocks_y > 0 && !deshake->mvs)
+        return AVERROR(ENOMEM);
 
     // Reset counts to zero
     for (x = 0; x < deshake->rx * 2 + 1; x++) {
@@ -253,25 +311,26 @@ static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
         }
     }
 
+    // Find motion for every block, the rows of blocks are searched in parallel
+    if (td.nb_blocks_x > 0 && td.nb_blocks_y > 0)
+        ctx->internal->execute(ctx, find_motion_slice, &td, NULL,
+                               FFMIN(td.nb_blocks_y, ff_filter_get_nb_threads(ctx)));
+
+    // Store the motion vectors in the counts, in the same order as the search
     pos = 0;
-    // Find motion for every block and store the motion vector in the counts
-    for (y = deshake->ry; y < height - deshake->ry - (deshake->blocksize * 2); y += deshake->blocksize * 2) {
-        // We use a width of 16 here to match the sad function
-        for (x = deshake->rx; x < width - deshake->rx - 16; x += 16) {
-            // If the contrast is too low, just skip this block as it probably
-            // won't be very useful to us.
-            contrast = block_contrast(src2, x, y, stride, deshake->blocksize);
-            if (contrast > deshake->contrast) {
-                //av_log(NULL, AV_LOG_ERROR, "%d\n", contrast);
-                find_block_motion(deshake, src1, src2, x, y, stride, &mv);
-                if (mv.x != -1 && mv.y != -1) {
-                    deshake->counts[mv.x + deshake->rx][mv.y + deshake->ry] += 1;
-                    if (x > deshake->rx && y > deshake->ry)
-                        deshake->angles[pos++] = block_angle(x, y, 0, 0, &mv);
-
-                    center_x += mv.x;
-                    center_y += mv.y;
-                }
+    for (by = 0; by < td.nb_blocks_y; by++) {
+        y = deshake->ry + by * deshake->blocksize * 2;
+        for (bx = 0; bx < td.nb_blocks_x; bx++) {
+            IntMotionVector *mv = &deshake->mvs[by * td.nb_blocks_x + bx];
+
+            x = deshake->rx + bx * 16;
+            if (mv->x != -1 && mv->y != -1) {
+                deshake->counts[mv->x + deshake->rx][mv->y + deshake->ry] += 1;
+                if (x > deshake->rx && y > deshake->ry)
+                    deshake->angles[pos++] = block_angle(x, y, 0, 0, mv);
+
+                center_x += mv->x;
+                center_y += mv->y;
             }
         }
     }
@@ -310,6 +369,19 @@ static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
     t->angle = av_clipf(t->angle, -0.1, 0.1);
 
     //av_log(NULL, AV_LOG_ERROR, "%d x %d\n", avg->x, avg->y);
+    return 0;
+}
+
+static int transform_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    TransformThreadData *td = arg;
+    const int slice_start = (td->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->height * (jobnr+1)) / nb_jobs;
+
+    return ff_transform_slice(td->in->data[td->plane], td->out->data[td->plane],
+                              td->in->linesize[td->plane], td->out->linesize[td->plane],
+                              td->width, td->height, slice_start, slice_end,
+                              td->matrix, td->interpolate, td->fill);
 }
 
 static int deshake_transform_c(AVFilterContext *ctx,
@@ -318,6 +390,7 @@ static int deshake_transform_c(AVFilterContext *ctx,
                                     enum InterpolateMethod interpolate,
                                     enum FillMethod fill, AVFrame *in, AVFrame *out)
 {
+    TransformThreadData td;
     int i = 0, ret = 0;
     const float *matrixs[3];
     int plane_w[3], plane_h[3];
@@ -328,12 +401,24 @@ static int deshake_transform_c(AVFilterContext *ctx,
     plane_h[0] = height;
     plane_h[1] = plane_h[2] = ch;
 
+    td.in          = in;
+    td.out         = out;
+    td.interpolate = interpolate;
+    td.fill        = fill;
     for (i = 0; i < 3; i++) {
-        // Transform the luma and chroma planes
-        ret = avfilter_transform(in->data[i], out->data[i], in->linesize[i], out->linesize[i],
-                                 plane_w[i], plane_h[i], matrixs[i], interpolate, fill);
-        if (ret < 0)
-            return ret;
+        // Transform the luma and chroma planes, the rows are split between the threads
+        int rets[MAX_THREADS], nb_jobs, j;
+
+        td.plane  = i;
+        td.matrix = matrixs[i];
+        td.width  = plane_w[i];
+        td.height = plane_h[i];
+        nb_jobs = FFMAX(1, FFMIN3(td.height, ff_filter_get_nb_threads(ctx), MAX_THREADS));
+        ctx->internal->execute(ctx, transform_slice, &td, rets, nb_jobs);
+        for (j = 0; j < nb_jobs; j++) {
+            if (rets[j] < 0)
+                return rets[j];
+        }
     }
     return ret;
 }
@@ -403,6 +488,8 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_frame_free(&deshake->ref);
     av_freep(&deshake->angles);
     deshake->angles_size = 0;
+    av_freep(&deshake->mvs);
+    deshake->mvs_size = 0;
     if (deshake->fp)
         fclose(deshake->fp);
 }
@@ -437,7 +524,7 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
 
     if (deshake->cx < 0 || deshake->cy < 0 || deshake->cw < 0 || deshake->ch < 0) {
         // Find the most likely global motion for the current frame
-        find_motion(deshake, (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0], in->data[0], link->w, link->h, in->linesize[0], &t);
+        ret = find_motion(link->dst, (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0], in->data[0], link->w, link->h, in->linesize[0], &t);
     } else {
         uint8_t *src1 = (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0];
         uint8_t *src2 = in->data[0];
@@ -454,7 +541,12 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
         src1 += deshake->cy * in->linesize[0] + deshake->cx;
         src2 += deshake->cy * in->linesize[0] + deshake->cx;
 
-        find_motion(deshake, src1, src2, deshake->cw, deshake->ch, in->linesize[0], &t);
+        ret = find_motion(link->dst, src1, src2, deshake->cw, deshake->ch, in->linesize[0], &t);
+    }
+    if (ret < 0) {
+        av_frame_free(&in);
+        av_frame_free(&out);
+        return ret;
     }
 
 
@@ -560,4 +652,5 @@ AVFilter ff_vf_deshake = {
     .inputs        = deshake_inputs,
     .outputs       = deshake_outputs,
     .priv_class    = &deshake_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
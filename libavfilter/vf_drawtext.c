@@ -140,6 +140,39 @@ enum expansion_mode {
     EXP_STRFTIME,
 };
 
+/**
+ * Coverage of all the glyphs of a text, composed into a single 8-bit mask
+ * so that it can be blended in one pass.
+ */
+typedef struct TextMask {
+    uint8_t *buf;
+    int linesize;
+    int x, y;                       ///< offset of the mask relative to the text position
+    int w, h;
+} TextMask;
+
+/**
+ * Layout and masks of an already rendered text, for a given font size.
+ */
+typedef struct TextCacheEntry {
+    char *text;
+    unsigned int fontsize;
+    int text_w, text_h;
+    int max_glyph_w, max_glyph_h;
+    int y_min, y_max;
+    TextMask mask;
+    TextMask border_mask;
+} TextCacheEntry;
+
+#define TEXT_CACHE_SIZE 8
+
+typedef struct ThreadData {
+    AVFrame *frame;
+    FFDrawColor *color;
+    const TextMask *mask;
+    int x, y;
+} ThreadData;
+
 typedef struct DrawTextContext {
     const AVClass *class;
     int exp_mode;                   ///< expansion mode to use for the text
@@ -203,6 +236,8 @@ typedef struct DrawTextContext {
     int text_shaping;               ///< 1 to shape the text before drawing it
 #endif
     AVDictionary *metadata;
+    TextCacheEntry text_cache[TEXT_CACHE_SIZE]; ///< recently rendered texts
+    int text_cache_next;            ///< next entry of text_cache to replace
 } DrawTextContext;
 
 #define OFFSET(x) offsetof(DrawTextContext, x)
@@ -801,9 +836,18 @@ static int glyph_enu_free(void *opaque, void *elem)
     return 0;
 }
 
+static void text_cache_entry_free(TextCacheEntry *e)
+{
+    av_freep(&e->text);
+    av_freep(&e->mask.buf);
+    av_freep(&e->border_mask.buf);
+    memset(e, 0, sizeof(*e));
+}
+
 static av_cold void uninit(AVFilterContext *ctx)
 {
     DrawTextContext *s = ctx->priv;
+    int i;
 
     av_expr_free(s->x_pexpr);
     av_expr_free(s->y_pexpr);
@@ -815,6 +859,9 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->positions);
     s->nb_positions = 0;
 
+    for (i = 0; i < TEXT_CACHE_SIZE; i++)
+        text_cache_entry_free(&s->text_cache[i]);
+
     av_tree_enumerate(s->glyphs, NULL, NULL, glyph_enu_free);
     av_tree_destroy(s->glyphs);
     s->glyphs = NULL;
@@ -1215,51 +1262,119 @@ static int expand_text(AVFilterContext *ctx, char *text, AVBPrint *bp)
     return 0;
 }
 
-static int draw_glyphs(DrawTextContext *s, AVFrame *frame,
-                       int width, int height,
-                       FFDrawColor *color,
-                       int x, int y, int borderw)
+static int render_text_mask(DrawTextContext *s, const char *text,
+                            TextMask *mask, int borderw)
 {
-    char *text = s->expanded_text.str;
+    int x_min = INT_MAX, y_min = INT_MAX, x_max = INT_MIN, y_max = INT_MIN;
     uint32_t code = 0;
-    int i, x1, y1;
-    uint8_t *p;
-    Glyph *glyph = NULL;
+    int i, pass, x, y;
+    const uint8_t *p;
+    Glyph *glyph;
 
-    for (i = 0, p = text; *p; i++) {
-        FT_Bitmap bitmap;
-        Glyph dummy = { 0 };
-        GET_UTF8(code, *p ? *p++ : 0, code = 0xfffd; goto continue_on_invalid;);
+    /* first pass computes the bounding box, second one composes the glyphs */
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0, p = text; *p; i++) {
+            FT_Bitmap bitmap;
+            Glyph dummy = { 0 };
+            int x1, y1;
+            GET_UTF8(code, *p ? *p++ : 0, code = 0xfffd; goto continue_on_invalid;);
 continue_on_invalid:
 
-        /* skip new line chars, just go to new line */
-        if (code == '\n' || code == '\r' || code == '\t')
-            continue;
+            /* skip new line chars, just go to new line */
+            if (code == '\n' || code == '\r' || code == '\t')
+                continue;
 
-        dummy.code = code;
-        dummy.fontsize = s->fontsize;
-        glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
+            dummy.code = code;
+            dummy.fontsize = s->fontsize;
+            glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
 
-        bitmap = borderw ? glyph->border_bitmap : glyph->bitmap;
+            bitmap = borderw ? glyph->border_bitmap : glyph->bitmap;
 
-        if (glyph->bitmap.pixel_mode != FT_PIXEL_MODE_MONO &&
-            glyph->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)
-            return AVERROR(EINVAL);
+            if (glyph->bitmap.pixel_mode != FT_PIXEL_MODE_MONO &&
+                glyph->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)
+                return AVERROR(EINVAL);
+            if (!bitmap.width || !bitmap.rows)
+                continue;
+
+            x1 = s->positions[i].x - borderw;
+            y1 = s->positions[i].y - borderw;
+
+            if (!pass) {
+                x_min = FFMIN(x_min, x1);
+                y_min = FFMIN(y_min, y1);
+                x_max = FFMAX(x_max, x1 + (int)bitmap.width);
+                y_max = FFMAX(y_max, y1 + (int)bitmap.rows);
+                continue;
+            }
 
-        x1 = s->positions[i].x+s->x+x - borderw;
-        y1 = s->positions[i].y+s->y+y - borderw;
+            for (y = 0; y < bitmap.rows; y++) {
+                const uint8_t *src = bitmap.buffer + y * bitmap.pitch;
+                uint8_t *dst = mask->buf + (y1 - mask->y + y) * mask->linesize + x1 - mask->x;
 
-        ff_blend_mask(&s->dc, color,
-                      frame->data, frame->linesize, width, height,
-                      bitmap.buffer, bitmap.pitch,
-                      bitmap.width, bitmap.rows,
-                      bitmap.pixel_mode == FT_PIXEL_MODE_MONO ? 0 : 3,
-                      0, x1, y1);
+                for (x = 0; x < bitmap.width; x++) {
+                    const unsigned v = bitmap.pixel_mode == FT_PIXEL_MODE_MONO ?
+                                       (src[x >> 3] >> (~x & 7) & 1) * 255 : src[x];
+                    /* glyphs overlapping each other are composed with "over" */
+                    dst[x] = dst[x] + v - (dst[x] * v + 127) / 255;
+                }
+            }
+        }
+
+        if (!pass) {
+            if (x_min >= x_max)
+                return 0;
+            mask->x = x_min;
+            mask->y = y_min;
+            mask->w = mask->linesize = x_max - x_min;
+            mask->h = y_max - y_min;
+            mask->buf = av_mallocz_array(mask->h, mask->linesize);
+            if (!mask->buf)
+                return AVERROR(ENOMEM);
+        }
     }
 
     return 0;
 }
 
+static int blend_mask_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    DrawTextContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const TextMask *mask = td->mask;
+    /* subsampled chroma rows must not be split between jobs */
+    const int align = 1 << s->dc.vsub_max;
+    int slice_start = td->y + (mask->h *  jobnr   ) / nb_jobs;
+    int slice_end   = td->y + (mask->h * (jobnr+1)) / nb_jobs;
+
+    slice_start = jobnr ? FFMAX(slice_start & ~(align - 1), td->y) : td->y;
+    slice_end   = jobnr < nb_jobs - 1 ? FFMAX(slice_end & ~(align - 1), td->y) : td->y + mask->h;
+
+    ff_blend_mask(&s->dc, td->color,
+                  td->frame->data, td->frame->linesize,
+                  td->frame->width, td->frame->height,
+                  mask->buf + (slice_start - td->y) * mask->linesize, mask->linesize,
+                  mask->w, slice_end - slice_start, 3, 0, td->x, slice_start);
+    return 0;
+}
+
+static void draw_glyphs(AVFilterContext *ctx, AVFrame *frame,
+                        FFDrawColor *color, const TextMask *mask,
+                        int x, int y)
+{
+    DrawTextContext *s = ctx->priv;
+    ThreadData td;
+
+    if (!mask->buf)
+        return;
+
+    td.frame = frame;
+    td.color = color;
+    td.mask  = mask;
+    td.x     = s->x + x + mask->x;
+    td.y     = s->y + y + mask->y;
+    ctx->internal->execute(ctx, blend_mask_slice, &td, NULL,
+                           FFMAX(1, FFMIN(mask->h / 16, ff_filter_get_nb_threads(ctx))));
+}
 
 static void update_color_with_alpha(DrawTextContext *s, FFDrawColor *color, const FFDrawColor incolor)
 {
@@ -1309,6 +1424,7 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame,
     FFDrawColor shadowcolor;
     FFDrawColor bordercolor;
     FFDrawColor boxcolor;
+    TextCacheEntry *entry = NULL;
 
     av_bprint_clear(bp);
 
@@ -1339,12 +1455,6 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame,
     if (!av_bprint_is_complete(bp))
         return AVERROR(ENOMEM);
     text = s->expanded_text.str;
-    if ((len = s->expanded_text.len) > s->nb_positions) {
-        if (!(s->positions =
-              av_realloc(s->positions, len*sizeof(*s->positions))))
-            return AVERROR(ENOMEM);
-        s->nb_positions = len;
-    }
 
     if (s->fontcolor_expr[0]) {
         /* If expression is set, evaluate and replace the static value */
@@ -1366,6 +1476,23 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame,
     if ((ret = update_fontsize(ctx)) < 0)
         return ret;
 
+    for (i = 0; i < TEXT_CACHE_SIZE; i++) {
+        TextCacheEntry *e = &s->text_cache[i];
+        if (e->text && e->fontsize == s->fontsize && !strcmp(e->text, text)) {
+            entry = e;
+            break;
+        }
+    }
+    if (entry)
+        goto text_ready;
+
+    if ((len = s->expanded_text.len) > s->nb_positions) {
+        if (!(s->positions =
+              av_realloc(s->positions, len*sizeof(*s->positions))))
+            return AVERROR(ENOMEM);
+        s->nb_positions = len;
+    }
+
     /* load and cache glyphs */
     for (i = 0, p = text; *p; i++) {
         GET_UTF8(code, *p ? *p++ : 0, code = 0xfffd; goto continue_on_invalid;);
@@ -1430,8 +1557,35 @@ continue_on_invalid2:
 
     max_text_line_w = FFMAX(x, max_text_line_w);
 
+    /* render the masks of the text and keep them for the next frames */
+    entry = &s->text_cache[s->text_cache_next];
+    s->text_cache_next = (s->text_cache_next + 1) % TEXT_CACHE_SIZE;
+    text_cache_entry_free(entry);
+    if (!(entry->text = av_strdup(text)))
+        return AVERROR(ENOMEM);
+    entry->fontsize    = s->fontsize;
+    entry->text_w      = max_text_line_w;
+    entry->text_h      = y + s->max_glyph_h;
+    entry->max_glyph_w = s->max_glyph_w;
+    entry->max_glyph_h = s->max_glyph_h;
+    entry->y_min       = y_min;
+    entry->y_max       = y_max;
+    if ((ret = render_text_mask(s, text, &entry->mask, 0)) < 0 ||
+        (s->borderw &&
+         (ret = render_text_mask(s, text, &entry->border_mask, s->borderw)) < 0)) {
+        text_cache_entry_free(entry);
+        return ret;
+    }
+
+text_ready:
+    max_text_line_w = entry->text_w;
+    s->max_glyph_w  = entry->max_glyph_w;
+    s->max_glyph_h  = entry->max_glyph_h;
+    y_min           = entry->y_min;
+    y_max           = entry->y_max;
+
     s->var_values[VAR_TW] = s->var_values[VAR_TEXT_W] = max_text_line_w;
-    s->var_values[VAR_TH] = s->var_values[VAR_TEXT_H] = y + s->max_glyph_h;
+    s->var_values[VAR_TH] = s->var_values[VAR_TEXT_H] = entry->text_h;
 
     s->var_values[VAR_MAX_GLYPH_W] = s->max_glyph_w;
     s->var_values[VAR_MAX_GLYPH_H] = s->max_glyph_h;
@@ -1452,7 +1606,7 @@ continue_on_invalid2:
     update_color_with_alpha(s, &boxcolor   , s->boxcolor   );
 
     box_w = max_text_line_w;
-    box_h = y + s->max_glyph_h;
+    box_h = entry->text_h;
 
     if (s->fix_bounds) {
 
@@ -1487,20 +1641,13 @@ continue_on_invalid2:
                            s->x - s->boxborderw, s->y - s->boxborderw,
                            box_w + s->boxborderw * 2, box_h + s->boxborderw * 2);
 
-    if (s->shadowx || s->shadowy) {
-        if ((ret = draw_glyphs(s, frame, width, height,
-                               &shadowcolor, s->shadowx, s->shadowy, 0)) < 0)
-            return ret;
-    }
+    if (s->shadowx || s->shadowy)
+        draw_glyphs(ctx, frame, &shadowcolor, &entry->mask, s->shadowx, s->shadowy);
 
-    if (s->borderw) {
-        if ((ret = draw_glyphs(s, frame, width, height,
-                               &bordercolor, 0, 0, s->borderw)) < 0)
-            return ret;
-    }
-    if ((ret = draw_glyphs(s, frame, width, height,
-                           &fontcolor, 0, 0, 0)) < 0)
-        return ret;
+    if (s->borderw)
+        draw_glyphs(ctx, frame, &bordercolor, &entry->border_mask, 0, 0);
+
+    draw_glyphs(ctx, frame, &fontcolor, &entry->mask, 0, 0);
 
     return 0;
 }
@@ -1576,5 +1723,5 @@ AVFilter ff_vf_drawtext = {
     .inputs        = avfilter_vf_drawtext_inputs,
     .outputs       = avfilter_vf_drawtext_outputs,
     .process_command = command,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -41,11 +41,9 @@ typedef struct PlaneContext {
     float n;
 
     float *buffer[BSIZE];
-    FFTComplex *hdata, *vdata;
+    FFTComplex **hdata, **vdata; ///< per thread scratch blocks
     int data_linesize;
     int buffer_linesize;
-
-    FFTContext *fft, *ifft;
 } PlaneContext;
 
 typedef struct FFTdnoizContext {
@@ -63,8 +61,11 @@ typedef struct FFTdnoizContext {
 
     int depth;
     int nb_planes;
+    int nb_threads;
     PlaneContext planes[4];
 
+    FFTContext **fft, **ifft;  ///< per thread FFT contexts
+
     void (*import_row)(FFTComplex *dst, uint8_t *src, int rw);
     void (*export_row)(FFTComplex *src, uint8_t *dst, int rw, float scale, int depth);
 } FFTdnoizContext;
@@ -91,23 +92,6 @@ static const AVOption fftdnoiz_options[] = {
 
 AVFILTER_DEFINE_CLASS(fftdnoiz);
 
-static av_cold int init(AVFilterContext *ctx)
-{
-    FFTdnoizContext *s = ctx->priv;
-    int i;
-
-    for (i = 0; i < 4; i++) {
-        PlaneContext *p = &s->planes[i];
-
-        p->fft  = av_fft_init(s->block_bits, 0);
-        p->ifft = av_fft_init(s->block_bits, 1);
-        if (!p->fft || !p->ifft)
-            return AVERROR(ENOMEM);
-    }
-
-    return 0;
-}
-
 static int query_formats(AVFilterContext *ctx)
 {
     static const enum AVPixelFormat pix_fmts[] = {
@@ -143,7 +127,8 @@ static int query_formats(AVFilterContext *ctx)
 }
 
 typedef struct ThreadData {
-    float *src, *dst;
+    AVFrame *out;
+    int plane;
 } ThreadData;
 
 static void import_row8(FFTComplex *dst, uint8_t *src, int rw)
@@ -238,18 +223,53 @@ static int config_input(AVFilterLink *inlink)
                 return AVERROR(ENOMEM);
         }
         p->data_linesize = 2 * p->b * sizeof(float);
-        p->hdata = av_calloc(p->b, p->data_linesize);
-        p->vdata = av_calloc(p->b, p->data_linesize);
+    }
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->fft  = av_calloc(s->nb_threads, sizeof(*s->fft));
+    s->ifft = av_calloc(s->nb_threads, sizeof(*s->ifft));
+    if (!s->fft || !s->ifft)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < s->nb_threads; i++) {
+        s->fft[i]  = av_fft_init(s->block_bits, 0);
+        s->ifft[i] = av_fft_init(s->block_bits, 1);
+        if (!s->fft[i] || !s->ifft[i])
+            return AVERROR(ENOMEM);
+    }
+
+    for (i = 0; i < s->nb_planes; i++) {
+        PlaneContext *p = &s->planes[i];
+
+        p->hdata = av_calloc(s->nb_threads, sizeof(*p->hdata));
+        p->vdata = av_calloc(s->nb_threads, sizeof(*p->vdata));
         if (!p->hdata || !p->vdata)
             return AVERROR(ENOMEM);
+
+        for (int j = 0; j < s->nb_threads; j++) {
+            p->hdata[j] = av_calloc(p->b, p->data_linesize);
+            p->vdata[j] = av_calloc(p->b, p->data_linesize);
+            if (!p->hdata[j] || !p->vdata[j])
+                return AVERROR(ENOMEM);
+        }
     }
 
     return 0;
 }
 
+/**
+ * Index of the sample to use for the position i >= n of a block
+ * which has only n valid samples.
+ */
+static int mirror(int i, int n, int block)
+{
+    return block - i - 1 < n ? block - i - 1 : FFMAX(2 * n - 1 - i, 0);
+}
+
 static void import_plane(FFTdnoizContext *s,
                          uint8_t *srcp, int src_linesize,
-                         float *buffer, int buffer_linesize, int plane)
+                         float *buffer, int buffer_linesize, int plane,
+                         int jobnr, int y_start, int y_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int width = p->planewidth;
@@ -258,15 +278,15 @@ static void import_plane(FFTdnoizContext *s,
     const int overlap = p->o;
     const int size = block - overlap;
     const int nox = p->nox;
-    const int noy = p->noy;
     const int bpp = (s->depth + 7) / 8;
     const int data_linesize = p->data_linesize / sizeof(FFTComplex);
-    FFTComplex *hdata = p->hdata;
-    FFTComplex *vdata = p->vdata;
+    FFTComplex *hdata = p->hdata[jobnr];
+    FFTComplex *vdata = p->vdata[jobnr];
+    FFTContext *fft = s->fft[jobnr];
     int x, y, i, j;
 
     buffer_linesize /= sizeof(float);
-    for (y = 0; y < noy; y++) {
+    for (y = y_start; y < y_end; y++) {
         for (x = 0; x < nox; x++) {
             const int rh = FFMIN(block, height - y * size);
             const int rw = FFMIN(block, width  - x * size);
@@ -277,31 +297,28 @@ static void import_plane(FFTdnoizContext *s,
             for (i = 0; i < rh; i++) {
                 s->import_row(dst, src, rw);
                 for (j = rw; j < block; j++) {
-                    dst[j].re = dst[block - j - 1].re;
+                    dst[j].re = dst[mirror(j, rw, block)].re;
                     dst[j].im = 0;
                 }
-                av_fft_permute(p->fft, dst);
-                av_fft_calc(p->fft, dst);
+                av_fft_permute(fft, dst);
+                av_fft_calc(fft, dst);
 
                 src += src_linesize;
                 dst += data_linesize;
             }
 
-            dst = hdata;
-            for (; i < block; i++) {
-                for (j = 0; j < block; j++) {
-                    dst[j].re = dst[(block - i - 1) * data_linesize + j].re;
-                    dst[j].im = dst[(block - i - 1) * data_linesize + j].im;
-                }
-            }
+            for (; i < block; i++)
+                memcpy(hdata + i * data_linesize,
+                       hdata + mirror(i, rh, block) * data_linesize,
+                       block * sizeof(FFTComplex));
 
             ssrc = hdata;
             dst = vdata;
             for (i = 0; i < block; i++) {
                 for (j = 0; j < block; j++)
                     dst[j] = ssrc[j * data_linesize + i];
-                av_fft_permute(p->fft, dst);
-                av_fft_calc(p->fft, dst);
+                av_fft_permute(fft, dst);
+                av_fft_calc(fft, dst);
                 memcpy(bdst, dst, block * sizeof(FFTComplex));
 
                 dst += data_linesize;
@@ -313,7 +330,8 @@ static void import_plane(FFTdnoizContext *s,
 
 static void export_plane(FFTdnoizContext *s,
                          uint8_t *dstp, int dst_linesize,
-                         float *buffer, int buffer_linesize, int plane)
+                         float *buffer, int buffer_linesize, int plane,
+                         int jobnr, int y_start, int y_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int depth = s->depth;
@@ -328,17 +346,21 @@ static void export_plane(FFTdnoizContext *s,
     const int noy = p->noy;
     const int data_linesize = p->data_linesize / sizeof(FFTComplex);
     const float scale = 1.f / (block * block);
-    FFTComplex *hdata = p->hdata;
-    FFTComplex *vdata = p->vdata;
+    /* the rows of the first block row below size + hoverlap are written
+     * by the next block rows, leave them to these */
+    const int rh0 = FFMIN(noy > 1 ? FFMIN(block, size + hoverlap) : block, height);
+    FFTComplex *hdata = p->hdata[jobnr];
+    FFTComplex *vdata = p->vdata[jobnr];
+    FFTContext *ifft = s->ifft[jobnr];
     int x, y, i, j;
 
     buffer_linesize /= sizeof(float);
-    for (y = 0; y < noy; y++) {
+    for (y = y_start; y < y_end; y++) {
         for (x = 0; x < nox; x++) {
             const int woff = x == 0 ? 0 : hoverlap;
             const int hoff = y == 0 ? 0 : hoverlap;
             const int rw = x == 0 ? block : FFMIN(size, width  - x * size - woff);
-            const int rh = y == 0 ? block : FFMIN(size, height - y * size - hoff);
+            const int rh = y == 0 ? rh0   : FFMIN(size, height - y * size - hoff);
             float *bsrc = buffer + buffer_linesize * y * block + x * block * 2;
             uint8_t *dst = dstp + dst_linesize * (y * size + hoff) + (x * size + woff) * bpp;
             FFTComplex *hdst, *ddst = vdata;
@@ -346,8 +368,8 @@ static void export_plane(FFTdnoizContext *s,
             hdst = hdata;
             for (i = 0; i < block; i++) {
                 memcpy(ddst, bsrc, block * sizeof(FFTComplex));
-                av_fft_permute(p->ifft, ddst);
-                av_fft_calc(p->ifft, ddst);
+                av_fft_permute(ifft, ddst);
+                av_fft_calc(ifft, ddst);
                 for (j = 0; j < block; j++) {
                     hdst[j * data_linesize + i] = ddst[j];
                 }
@@ -358,8 +380,8 @@ static void export_plane(FFTdnoizContext *s,
 
             hdst = hdata + hoff * data_linesize;
             for (i = 0; i < rh; i++) {
-                av_fft_permute(p->ifft, hdst);
-                av_fft_calc(p->ifft, hdst);
+                av_fft_permute(ifft, hdst);
+                av_fft_calc(ifft, hdst);
                 s->export_row(hdst + woff, dst, rw, scale, depth);
 
                 hdst += data_linesize;
@@ -369,12 +391,12 @@ static void export_plane(FFTdnoizContext *s,
     }
 }
 
-static void filter_plane3d2(FFTdnoizContext *s, int plane, float *pbuffer, float *nbuffer)
+static void filter_plane3d2(FFTdnoizContext *s, int plane, float *pbuffer, float *nbuffer,
+                            int y_start, int y_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int block = p->b;
     const int nox = p->nox;
-    const int noy = p->noy;
     const int buffer_linesize = p->buffer_linesize / sizeof(float);
     const float sigma = s->sigma * s->sigma * block * block;
     const float limit = 1.f - s->amount;
@@ -383,7 +405,7 @@ static void filter_plane3d2(FFTdnoizContext *s, int plane, float *pbuffer, float
     const float scale = 1.f / 3.f;
     int y, x, i, j;
 
-    for (y = 0; y < noy; y++) {
+    for (y = y_start; y < y_end; y++) {
         for (x = 0; x < nox; x++) {
             float *cbuff = cbuffer + buffer_linesize * y * block + x * block * 2;
             float *pbuff = pbuffer + buffer_linesize * y * block + x * block * 2;
@@ -429,19 +451,19 @@ static void filter_plane3d2(FFTdnoizContext *s, int plane, float *pbuffer, float
     }
 }
 
-static void filter_plane3d1(FFTdnoizContext *s, int plane, float *pbuffer)
+static void filter_plane3d1(FFTdnoizContext *s, int plane, float *pbuffer,
+                            int y_start, int y_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int block = p->b;
     const int nox = p->nox;
-    const int noy = p->noy;
     const int buffer_linesize = p->buffer_linesize / sizeof(float);
     const float sigma = s->sigma * s->sigma * block * block;
     const float limit = 1.f - s->amount;
     float *cbuffer = p->buffer[CURRENT];
     int y, x, i, j;
 
-    for (y = 0; y < noy; y++) {
+    for (y = y_start; y < y_end; y++) {
         for (x = 0; x < nox; x++) {
             float *cbuff = cbuffer + buffer_linesize * y * block + x * block * 2;
             float *pbuff = pbuffer + buffer_linesize * y * block + x * block * 2;
@@ -481,19 +503,19 @@ static void filter_plane3d1(FFTdnoizContext *s, int plane, float *pbuffer)
     }
 }
 
-static void filter_plane2d(FFTdnoizContext *s, int plane)
+static void filter_plane2d(FFTdnoizContext *s, int plane,
+                           int y_start, int y_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int block = p->b;
     const int nox = p->nox;
-    const int noy = p->noy;
     const int buffer_linesize = p->buffer_linesize / 4;
     const float sigma = s->sigma * s->sigma * block * block;
     const float limit = 1.f - s->amount;
     float *buffer = p->buffer[CURRENT];
     int y, x, i, j;
 
-    for (y = 0; y < noy; y++) {
+    for (y = y_start; y < y_end; y++) {
         for (x = 0; x < nox; x++) {
             float *buff = buffer + buffer_linesize * y * block + x * block * 2;
 
@@ -515,6 +537,60 @@ static void filter_plane2d(FFTdnoizContext *s, int plane)
     }
 }
 
+static int denoise_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    FFTdnoizContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int plane = td->plane;
+    PlaneContext *p = &s->planes[plane];
+    const int y_start = (p->noy *  jobnr   ) / nb_jobs;
+    const int y_end   = (p->noy * (jobnr+1)) / nb_jobs;
+
+    if (s->next) {
+        import_plane(s, s->next->data[plane], s->next->linesize[plane],
+                     p->buffer[NEXT], p->buffer_linesize, plane,
+                     jobnr, y_start, y_end);
+    }
+
+    if (s->prev) {
+        import_plane(s, s->prev->data[plane], s->prev->linesize[plane],
+                     p->buffer[PREV], p->buffer_linesize, plane,
+                     jobnr, y_start, y_end);
+    }
+
+    import_plane(s, s->cur->data[plane], s->cur->linesize[plane],
+                 p->buffer[CURRENT], p->buffer_linesize, plane,
+                 jobnr, y_start, y_end);
+
+    if (s->next && s->prev) {
+        filter_plane3d2(s, plane, p->buffer[PREV], p->buffer[NEXT], y_start, y_end);
+    } else if (s->next) {
+        filter_plane3d1(s, plane, p->buffer[NEXT], y_start, y_end);
+    } else  if (s->prev) {
+        filter_plane3d1(s, plane, p->buffer[PREV], y_start, y_end);
+    } else {
+        filter_plane2d(s, plane, y_start, y_end);
+    }
+
+    return 0;
+}
+
+static int export_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    FFTdnoizContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int plane = td->plane;
+    PlaneContext *p = &s->planes[plane];
+    const int y_start = (p->noy *  jobnr   ) / nb_jobs;
+    const int y_end   = (p->noy * (jobnr+1)) / nb_jobs;
+
+    export_plane(s, td->out->data[plane], td->out->linesize[plane],
+                 p->buffer[CURRENT], p->buffer_linesize, plane,
+                 jobnr, y_start, y_end);
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -569,6 +645,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 
     for (plane = 0; plane < s->nb_planes; plane++) {
         PlaneContext *p = &s->planes[plane];
+        ThreadData td;
 
         if (!((1 << plane) & s->planesf) || ctx->is_disabled) {
             if (!direct)
@@ -578,31 +655,15 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
             continue;
         }
 
-        if (s->next) {
-            import_plane(s, s->next->data[plane], s->next->linesize[plane],
-                         p->buffer[NEXT], p->buffer_linesize, plane);
-        }
-
-        if (s->prev) {
-            import_plane(s, s->prev->data[plane], s->prev->linesize[plane],
-                         p->buffer[PREV], p->buffer_linesize, plane);
-        }
-
-        import_plane(s, s->cur->data[plane], s->cur->linesize[plane],
-                     p->buffer[CURRENT], p->buffer_linesize, plane);
-
-        if (s->next && s->prev) {
-            filter_plane3d2(s, plane, p->buffer[PREV], p->buffer[NEXT]);
-        } else if (s->next) {
-            filter_plane3d1(s, plane, p->buffer[NEXT]);
-        } else  if (s->prev) {
-            filter_plane3d1(s, plane, p->buffer[PREV]);
-        } else {
-            filter_plane2d(s, plane);
-        }
-
-        export_plane(s, out->data[plane], out->linesize[plane],
-                     p->buffer[CURRENT], p->buffer_linesize, plane);
+        /* each job denoises a range of block rows, the blocks overlap so
+         * the whole plane is read before any output is written, as out
+         * may be the current frame */
+        td.out   = out;
+        td.plane = plane;
+        ctx->internal->execute(ctx, denoise_slice, &td, NULL,
+                               FFMIN(p->noy, s->nb_threads));
+        ctx->internal->execute(ctx, export_slice, &td, NULL,
+                               FFMIN(p->noy, s->nb_threads));
     }
 
     if (s->nb_next == 0 && s->nb_prev == 0) {
@@ -652,15 +713,28 @@ static av_cold void uninit(AVFilterContext *ctx)
     for (i = 0; i < 4; i++) {
         PlaneContext *p = &s->planes[i];
 
+        for (int j = 0; j < s->nb_threads; j++) {
+            if (p->hdata)
+                av_freep(&p->hdata[j]);
+            if (p->vdata)
+                av_freep(&p->vdata[j]);
+        }
         av_freep(&p->hdata);
         av_freep(&p->vdata);
         av_freep(&p->buffer[PREV]);
         av_freep(&p->buffer[CURRENT]);
         av_freep(&p->buffer[NEXT]);
-        av_fft_end(p->fft);
-        av_fft_end(p->ifft);
     }
 
+    for (i = 0; i < s->nb_threads; i++) {
+        if (s->fft)
+            av_fft_end(s->fft[i]);
+        if (s->ifft)
+            av_fft_end(s->ifft[i]);
+    }
+    av_freep(&s->fft);
+    av_freep(&s->ifft);
+
     av_frame_free(&s->prev);
     av_frame_free(&s->cur);
     av_frame_free(&s->next);
@@ -689,11 +763,11 @@ AVFilter ff_vf_fftdnoiz = {
     .name          = "fftdnoiz",
     .description   = NULL_IF_CONFIG_SMALL("Denoise frames using 3D FFT."),
     .priv_size     = sizeof(FFTdnoizContext),
-    .init          = init,
     .uninit        = uninit,
     .query_formats = query_formats,
     .inputs        = fftdnoiz_inputs,
     .outputs       = fftdnoiz_outputs,
     .priv_class    = &fftdnoiz_class,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL |
+                     AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -50,6 +50,7 @@ typedef struct FPSContext {
     AVRational framerate;   ///< target framerate
     int rounding;           ///< AVRounding method for timestamps
     int eof_action;         ///< action performed for last frame in FIFO
+    int light_dup;          ///< output duplicates without side data and metadata
 
     /* Set during outlink configuration */
     int64_t  in_pts_off;    ///< input frame pts offset for start_time handling
@@ -87,6 +88,7 @@ static const AVOption fps_options[] = {
     { "eof_action", "action performed for last frame", OFFSET(eof_action), AV_OPT_TYPE_INT, { .i64 = EOF_ACTION_ROUND }, 0, EOF_ACTION_NB-1, V|F, "eof_action" },
         { "round", "round similar to other frames",  0, AV_OPT_TYPE_CONST, { .i64 = EOF_ACTION_ROUND }, 0, 0, V|F, "eof_action" },
         { "pass",  "pass through last frame",        0, AV_OPT_TYPE_CONST, { .i64 = EOF_ACTION_PASS  }, 0, 0, V|F, "eof_action" },
+    { "light_dup", "output duplicated frames without side data and metadata", OFFSET(light_dup), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, V|F },
     { NULL }
 };
 
@@ -209,6 +211,25 @@ static int read_frame(AVFilterContext *ctx, FPSContext *s, AVFilterLink *inlink,
     return 1;
 }
 
+/* Reference the data of a frame without its side data and metadata */
+static AVFrame *clone_frame_light(AVFrame *src)
+{
+    AVFrameSideData **side_data = src->side_data;
+    int nb_side_data            = src->nb_side_data;
+    AVDictionary *metadata      = src->metadata;
+    AVFrame *frame;
+
+    src->side_data    = NULL;
+    src->nb_side_data = 0;
+    src->metadata     = NULL;
+    frame = av_frame_clone(src);
+    src->side_data    = side_data;
+    src->nb_side_data = nb_side_data;
+    src->metadata     = metadata;
+
+    return frame;
+}
+
 /* Write a frame to the output */
 static int write_frame(AVFilterContext *ctx, FPSContext *s, AVFilterLink *outlink, int *again)
 {
@@ -246,11 +267,16 @@ static int write_frame(AVFilterContext *ctx, FPSContext *s, AVFilterLink *outlin
 
     /* Output a copy of the first buffered frame */
     } else {
-        frame = av_frame_clone(s->frames[0]);
+        if (s->light_dup && s->cur_frame_out > 0) {
+            frame = clone_frame_light(s->frames[0]);
+        } else {
+            frame = av_frame_clone(s->frames[0]);
+            // Make sure Closed Captions will not be duplicated
+            if (frame)
+                av_frame_remove_side_data(s->frames[0], AV_FRAME_DATA_A53_CC);
+        }
         if (!frame)
             return AVERROR(ENOMEM);
-        // Make sure Closed Captions will not be duplicated
-        av_frame_remove_side_data(s->frames[0], AV_FRAME_DATA_A53_CC);
         frame->pts = s->next_pts++;
 
         av_log(ctx, AV_LOG_DEBUG, "Writing frame with pts %"PRId64" to pts %"PRId64"\n",
@@ -62,6 +62,25 @@ static const AVOption framerate_options[] = {
 
 AVFILTER_DEFINE_CLASS(framerate);
 
+static double scene_sad_float(const uint8_t *src1, ptrdiff_t stride1,
+                              const uint8_t *src2, ptrdiff_t stride2,
+                              int width, int height)
+{
+    double sad = 0;
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        const float *s1 = (const float *)(src1 + y * stride1);
+        const float *s2 = (const float *)(src2 + y * stride2);
+        float line_sad = 0;
+
+        for (x = 0; x < width; x++)
+            line_sad += fabsf(s1[x] - s2[x]);
+        sad += line_sad;
+    }
+    return sad;
+}
+
 static double get_scene_score(AVFilterContext *ctx, AVFrame *crnt, AVFrame *next)
 {
     FrameRateContext *s = ctx->priv;
@@ -75,9 +94,15 @@ static double get_scene_score(AVFilterContext *ctx, AVFrame *crnt, AVFrame *next
         double mafd, diff;
 
         ff_dlog(ctx, "get_scene_score() process\n");
-        s->sad(crnt->data[0], crnt->linesize[0], next->data[0], next->linesize[0], crnt->width, crnt->height, &sad);
-        emms_c();
-        mafd = (double)sad * 100.0 / (crnt->width * crnt->height) / (1 << s->bitdepth);
+        if (s->bitdepth == 32) {
+            /* float samples are normalized to [0, 1] */
+            mafd = scene_sad_float(crnt->data[0], crnt->linesize[0], next->data[0], next->linesize[0],
+                                   crnt->width, crnt->height) * 100.0 / (crnt->width * crnt->height);
+        } else {
+            s->sad(crnt->data[0], crnt->linesize[0], next->data[0], next->linesize[0], crnt->width, crnt->height, &sad);
+            emms_c();
+            mafd = (double)sad * 100.0 / (crnt->width * crnt->height) / (1 << s->bitdepth);
+        }
         diff = fabs(mafd - s->prev_mafd);
         ret  = av_clipf(FFMIN(mafd, diff), 0, 100.0);
         s->prev_mafd = mafd;
@@ -228,6 +253,7 @@ static int query_formats(AVFilterContext *ctx)
         AV_PIX_FMT_YUV420P9, AV_PIX_FMT_YUV420P10, AV_PIX_FMT_YUV420P12,
         AV_PIX_FMT_YUV422P9, AV_PIX_FMT_YUV422P10, AV_PIX_FMT_YUV422P12,
         AV_PIX_FMT_YUV444P9, AV_PIX_FMT_YUV444P10, AV_PIX_FMT_YUV444P12,
+        AV_PIX_FMT_GRAYF32, AV_PIX_FMT_GBRPF32,
         AV_PIX_FMT_NONE
     };
 
@@ -262,11 +288,39 @@ static void blend_frames##nbits##_c(BLEND_FUNC_PARAMS)  \
 BLEND_FRAME_FUNC(8)
 BLEND_FRAME_FUNC(16)
 
+static void blend_frames_float_c(BLEND_FUNC_PARAMS)
+{
+    const float w1 = factor1 / (float)(factor1 + factor2);
+    const float w2 = factor2 / (float)(factor1 + factor2);
+    const float *src1f = (const float *)src1;
+    const float *src2f = (const float *)src2;
+    float *dstf = (float *)dst;
+    int line, pixel;
+
+    width /= 4;
+    src1_linesize /= 4;
+    src2_linesize /= 4;
+    dst_linesize /= 4;
+    for (line = 0; line < height; line++) {
+        for (pixel = 0; pixel < width; pixel++) {
+            const float a = src1f[pixel] * w1;
+            const float b = src2f[pixel] * w2;
+            dstf[pixel] = a + b;
+        }
+        src1f += src1_linesize;
+        src2f += src2_linesize;
+        dstf  += dst_linesize;
+    }
+}
+
 void ff_framerate_init(FrameRateContext *s)
 {
     if (s->bitdepth == 8) {
         s->blend_factor_max = 1 << BLEND_FACTOR_DEPTH(8);
         s->blend = blend_frames8_c;
+    } else if (s->bitdepth == 32) {
+        s->blend_factor_max = 1 << BLEND_FACTOR_DEPTH(16);
+        s->blend = blend_frames_float_c;
     } else {
         s->blend_factor_max = 1 << BLEND_FACTOR_DEPTH(16);
         s->blend = blend_frames16_c;
@@ -290,9 +344,11 @@ static int config_input(AVFilterLink *inlink)
 
     s->bitdepth = pix_desc->comp[0].depth;
 
-    s->sad = ff_scene_sad_get_fn(s->bitdepth == 8 ? 8 : 16);
-    if (!s->sad)
-        return AVERROR(EINVAL);
+    if (s->bitdepth != 32) {
+        s->sad = ff_scene_sad_get_fn(s->bitdepth == 8 ? 8 : 16);
+        if (!s->sad)
+            return AVERROR(EINVAL);
+    }
 
     s->srce_time_base = inlink->time_base;
 
@@ -27,6 +27,7 @@
 #include <libvmaf.h>
 
 #include "libavutil/avstring.h"
+#include "libavutil/imgutils.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 #include "avfilter.h"
@@ -114,15 +115,10 @@ static int copy_picture_data(AVFrame *src, VmafPicture *dst, unsigned bpc)
     if (err)
         return AVERROR(ENOMEM);
 
-    for (unsigned i = 0; i < 3; i++) {
-        uint8_t *src_data = src->data[i];
-        uint8_t *dst_data = dst->data[i];
-        for (unsigned j = 0; j < dst->h[i]; j++) {
-            memcpy(dst_data, src_data, bytes_per_value * dst->w[i]);
-            src_data += src->linesize[i];
-            dst_data += dst->stride[i];
-        }
-    }
+    for (unsigned i = 0; i < 3; i++)
+        av_image_copy_plane(dst->data[i], dst->stride[i],
+                            src->data[i], src->linesize[i],
+                            bytes_per_value * dst->w[i], dst->h[i]);
 
     return 0;
 }
@@ -141,6 +137,14 @@ static int do_vmaf(FFFrameSync *fs)
     if (ctx->is_disabled || !ref)
         return ff_filter_frame(ctx->outputs[0], dist);
 
+    /* libvmaf drops pictures whose index is not a multiple of n_subsample
+     * right away, so do not bother copying them. The index still advances
+     * to keep the pooling in libvmaf aligned with the frames it scored. */
+    if (s->frame_cnt % s->n_subsample) {
+        s->frame_cnt++;
+        return ff_filter_frame(ctx->outputs[0], dist);
+    }
+
     err = copy_picture_data(ref, &pic_ref, s->bpc);
     if (err) {
         av_log(s, AV_LOG_ERROR, "problem during vmaf_picture_alloc.\n");
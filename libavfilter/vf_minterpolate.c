@@ -42,6 +42,7 @@
 #define SCD_METHOD_FDIFF 1
 
 #define NB_FRAMES 4
+#define NB_LEVELS_MAX 3
 #define NB_PIXEL_MVS 32
 #define NB_CLUSTERS 128
 
@@ -161,8 +162,21 @@ typedef struct PixelRefs {
 typedef struct Frame {
     AVFrame *avf;
     Block *blocks;
+    uint8_t *pyr[NB_LEVELS_MAX];    ///< luma downscaled by 2^(n + 1)
 } Frame;
 
+typedef struct SearchThreadData {
+    Block *blocks;
+    Frame *cur, *ref;
+    int dir;
+    int wave;
+} SearchThreadData;
+
+typedef struct ThreadData {
+    AVFrame *out;
+    int alpha;
+} ThreadData;
+
 typedef struct MIContext {
     const AVClass *class;
     AVMotionEstContext me_ctx;
@@ -174,6 +188,7 @@ typedef struct MIContext {
     int mb_size;
     int search_param;
     int vsbmc;
+    int me_levels;
 
     Frame frames[NB_FRAMES];
     Cluster clusters[NB_CLUSTERS];
@@ -196,6 +211,10 @@ typedef struct MIContext {
     int log2_chroma_w;
     int log2_chroma_h;
     int nb_planes;
+
+    int pyr_linesize[NB_LEVELS_MAX];
+    int nb_threads;
+    AVMotionEstContext *me_ctx_slice;
 } MIContext;
 
 #define OFFSET(x) offsetof(MIContext, x)
@@ -227,6 +246,7 @@ static const AVOption minterpolate_options[] = {
     { "mb_size", "macroblock size", OFFSET(mb_size), AV_OPT_TYPE_INT, {.i64 = 16}, 4, 16, FLAGS },
     { "search_param", "search parameter", OFFSET(search_param), AV_OPT_TYPE_INT, {.i64 = 32}, 4, INT_MAX, FLAGS },
     { "vsbmc", "variable-size block motion compensation", OFFSET(vsbmc), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, FLAGS },
+    { "me_levels", "hierarchical motion estimation levels", OFFSET(me_levels), AV_OPT_TYPE_INT, {.i64 = 0}, 0, NB_LEVELS_MAX, FLAGS },
     { "scd", "scene change detection method", OFFSET(scd_method), AV_OPT_TYPE_INT, {.i64 = SCD_METHOD_FDIFF}, SCD_METHOD_NONE, SCD_METHOD_FDIFF, FLAGS, "scene" },
         CONST("none",   "disable detection",                    SCD_METHOD_NONE,        "scene"),
         CONST("fdiff",  "frame difference",                     SCD_METHOD_FDIFF,       "scene"),
@@ -258,6 +278,7 @@ static int query_formats(AVFilterContext *ctx)
 
 static uint64_t get_sbad(AVMotionEstContext *me_ctx, int x, int y, int x_mv, int y_mv)
 {
+    av_pixelutils_sad_fn sad_fn = ff_me_get_sad_fn(me_ctx, me_ctx->mb_size);
     uint8_t *data_cur = me_ctx->data_cur;
     uint8_t *data_next = me_ctx->data_ref;
     int linesize = me_ctx->linesize;
@@ -274,15 +295,19 @@ static uint64_t get_sbad(AVMotionEstContext *me_ctx, int x, int y, int x_mv, int
     data_cur += (y + mv_y) * linesize;
     data_next += (y - mv_y) * linesize;
 
-    for (j = 0; j < me_ctx->mb_size; j++)
-        for (i = 0; i < me_ctx->mb_size; i++)
-            sbad += FFABS(data_cur[x + mv_x + i + j * linesize] - data_next[x - mv_x + i + j * linesize]);
+    if (sad_fn)
+        sbad = sad_fn(data_cur + x + mv_x, linesize, data_next + x - mv_x, linesize);
+    else
+        for (j = 0; j < me_ctx->mb_size; j++)
+            for (i = 0; i < me_ctx->mb_size; i++)
+                sbad += FFABS(data_cur[x + mv_x + i + j * linesize] - data_next[x - mv_x + i + j * linesize]);
 
     return sbad + (FFABS(mv_x1 - me_ctx->pred_x) + FFABS(mv_y1 - me_ctx->pred_y)) * COST_PRED_SCALE;
 }
 
 static uint64_t get_sbad_ob(AVMotionEstContext *me_ctx, int x, int y, int x_mv, int y_mv)
 {
+    av_pixelutils_sad_fn sad_fn = me_ctx->mb_size > 1 ? ff_me_get_sad_fn(me_ctx, me_ctx->mb_size * 2) : NULL;
     uint8_t *data_cur = me_ctx->data_cur;
     uint8_t *data_next = me_ctx->data_ref;
     int linesize = me_ctx->linesize;
@@ -300,15 +325,21 @@ static uint64_t get_sbad_ob(AVMotionEstContext *me_ctx, int x, int y, int x_mv,
     mv_x = av_clip(x_mv - x, -FFMIN(x - x_min, x_max - x), FFMIN(x - x_min, x_max - x));
     mv_y = av_clip(y_mv - y, -FFMIN(y - y_min, y_max - y), FFMIN(y - y_min, y_max - y));
 
-    for (j = -me_ctx->mb_size / 2; j < me_ctx->mb_size * 3 / 2; j++)
-        for (i = -me_ctx->mb_size / 2; i < me_ctx->mb_size * 3 / 2; i++)
-            sbad += FFABS(data_cur[x + mv_x + i + (y + mv_y + j) * linesize] - data_next[x - mv_x + i + (y - mv_y + j) * linesize]);
+    if (sad_fn) {
+        const int off = me_ctx->mb_size / 2;
+        sbad = sad_fn(data_cur  + x + mv_x - off + (y + mv_y - off) * linesize, linesize,
+                      data_next + x - mv_x - off + (y - mv_y - off) * linesize, linesize);
+    } else
+        for (j = -me_ctx->mb_size / 2; j < me_ctx->mb_size * 3 / 2; j++)
+            for (i = -me_ctx->mb_size / 2; i < me_ctx->mb_size * 3 / 2; i++)
+                sbad += FFABS(data_cur[x + mv_x + i + (y + mv_y + j) * linesize] - data_next[x - mv_x + i + (y - mv_y + j) * linesize]);
 
     return sbad + (FFABS(mv_x1 - me_ctx->pred_x) + FFABS(mv_y1 - me_ctx->pred_y)) * COST_PRED_SCALE;
 }
 
 static uint64_t get_sad_ob(AVMotionEstContext *me_ctx, int x, int y, int x_mv, int y_mv)
 {
+    av_pixelutils_sad_fn sad_fn = me_ctx->mb_size > 1 ? ff_me_get_sad_fn(me_ctx, me_ctx->mb_size * 2) : NULL;
     uint8_t *data_ref = me_ctx->data_ref;
     uint8_t *data_cur = me_ctx->data_cur;
     int linesize = me_ctx->linesize;
@@ -326,21 +357,27 @@ static uint64_t get_sad_ob(AVMotionEstContext *me_ctx, int x, int y, int x_mv, i
     x_mv = av_clip(x_mv, x_min, x_max);
     y_mv = av_clip(y_mv, y_min, y_max);
 
-    for (j = -me_ctx->mb_size / 2; j < me_ctx->mb_size * 3 / 2; j++)
-        for (i = -me_ctx->mb_size / 2; i < me_ctx->mb_size * 3 / 2; i++)
-            sad += FFABS(data_ref[x_mv + i + (y_mv + j) * linesize] - data_cur[x + i + (y + j) * linesize]);
+    if (sad_fn) {
+        const int off = me_ctx->mb_size / 2;
+        sad = sad_fn(data_ref + x_mv - off + (y_mv - off) * linesize, linesize,
+                     data_cur + x    - off + (y    - off) * linesize, linesize);
+    } else
+        for (j = -me_ctx->mb_size / 2; j < me_ctx->mb_size * 3 / 2; j++)
+            for (i = -me_ctx->mb_size / 2; i < me_ctx->mb_size * 3 / 2; i++)
+                sad += FFABS(data_ref[x_mv + i + (y_mv + j) * linesize] - data_cur[x + i + (y + j) * linesize]);
 
     return sad + (FFABS(mv_x - me_ctx->pred_x) + FFABS(mv_y - me_ctx->pred_y)) * COST_PRED_SCALE;
 }
 
 static int config_input(AVFilterLink *inlink)
 {
-    MIContext *mi_ctx = inlink->dst->priv;
+    AVFilterContext *ctx = inlink->dst;
+    MIContext *mi_ctx = ctx->priv;
     AVMotionEstContext *me_ctx = &mi_ctx->me_ctx;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
     const int height = inlink->h;
     const int width  = inlink->w;
-    int i;
+    int i, n;
 
     mi_ctx->log2_chroma_h = desc->log2_chroma_h;
     mi_ctx->log2_chroma_w = desc->log2_chroma_w;
@@ -355,6 +392,8 @@ static int config_input(AVFilterLink *inlink)
     mi_ctx->b_height = height >> mi_ctx->log2_mb_size;
     mi_ctx->b_count = mi_ctx->b_width * mi_ctx->b_height;
 
+    mi_ctx->nb_threads = ff_filter_get_nb_threads(ctx);
+
     for (i = 0; i < NB_FRAMES; i++) {
         Frame *frame = &mi_ctx->frames[i];
         frame->blocks = av_mallocz_array(mi_ctx->b_count, sizeof(Block));
@@ -394,6 +433,26 @@ static int config_input(AVFilterLink *inlink)
                     return AVERROR(ENOMEM);
             }
         }
+
+        mi_ctx->me_ctx_slice = av_calloc(mi_ctx->nb_threads, sizeof(*mi_ctx->me_ctx_slice));
+        if (!mi_ctx->me_ctx_slice)
+            return AVERROR(ENOMEM);
+
+        if (mi_ctx->me_levels > mi_ctx->log2_mb_size - 1) {
+            av_log(ctx, AV_LOG_WARNING, "Limiting me_levels to %d for mb_size %d\n",
+                   mi_ctx->log2_mb_size - 1, mi_ctx->mb_size);
+            mi_ctx->me_levels = mi_ctx->log2_mb_size - 1;
+        }
+
+        for (n = 0; n < mi_ctx->me_levels; n++) {
+            mi_ctx->pyr_linesize[n] = width >> (n + 1);
+            for (i = 0; i < NB_FRAMES; i++) {
+                Frame *frame = &mi_ctx->frames[i];
+                frame->pyr[n] = av_malloc_array(mi_ctx->pyr_linesize[n], height >> (n + 1));
+                if (!frame->pyr[n])
+                    return AVERROR(ENOMEM);
+            }
+        }
     }
 
     if (mi_ctx->scd_method == SCD_METHOD_FDIFF) {
@@ -422,17 +481,88 @@ static int config_output(AVFilterLink *outlink)
         preds.nb++;\
     } while(0)
 
-static void search_mv(MIContext *mi_ctx, Block *blocks, int mb_x, int mb_y, int dir)
+static uint64_t search_mv_refine(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int *mv)
+{
+    int x, y;
+    int x_min = FFMAX(me_ctx->x_min, mv[0] - me_ctx->search_param);
+    int y_min = FFMAX(me_ctx->y_min, mv[1] - me_ctx->search_param);
+    int x_max = FFMIN(mv[0] + me_ctx->search_param, me_ctx->x_max);
+    int y_max = FFMIN(mv[1] + me_ctx->search_param, me_ctx->y_max);
+    uint64_t cost, cost_min = UINT64_MAX;
+
+    for (y = y_min; y <= y_max; y++)
+        for (x = x_min; x <= x_max; x++) {
+            cost = me_ctx->get_cost(me_ctx, x_mb, y_mb, x, y);
+            if (cost < cost_min) {
+                cost_min = cost;
+                mv[0] = x;
+                mv[1] = y;
+            }
+        }
+
+    return cost_min;
+}
+
+/**
+ * Exhaustive search on the coarsest level of the pyramid, followed by a
+ * small refinement around the upscaled vector on each finer level.
+ */
+static void search_mv_hier(MIContext *mi_ctx, AVMotionEstContext *me_ctx,
+                           Frame *cur, Frame *ref, int x_mb, int y_mb, int *mv)
+{
+    AVMotionEstContext lvl_ctx = *me_ctx;
+    int mv_x = 0, mv_y = 0;
+    int n;
+
+    for (n = mi_ctx->me_levels; n >= 0; n--) {
+        const int x = x_mb >> n;
+        const int y = y_mb >> n;
+
+        lvl_ctx.mb_size = me_ctx->mb_size >> n;
+        lvl_ctx.x_max = me_ctx->x_max >> n;
+        lvl_ctx.y_max = me_ctx->y_max >> n;
+        lvl_ctx.data_cur = n ? cur->pyr[n - 1] : me_ctx->data_cur;
+        lvl_ctx.data_ref = n ? ref->pyr[n - 1] : me_ctx->data_ref;
+        lvl_ctx.linesize = n ? mi_ctx->pyr_linesize[n - 1] : me_ctx->linesize;
+        lvl_ctx.pred_x = mv_x;
+        lvl_ctx.pred_y = mv_y;
+
+        mv[0] = av_clip(x + mv_x, lvl_ctx.x_min, lvl_ctx.x_max);
+        mv[1] = av_clip(y + mv_y, lvl_ctx.y_min, lvl_ctx.y_max);
+
+        if (n == mi_ctx->me_levels) {
+            lvl_ctx.search_param = FFMAX(me_ctx->search_param >> n, 2);
+            ff_me_search_esa(&lvl_ctx, x, y, mv);
+        } else {
+            lvl_ctx.search_param = 2;
+            search_mv_refine(&lvl_ctx, x, y, mv);
+        }
+
+        mv_x = (mv[0] - x) * (n ? 2 : 1);
+        mv_y = (mv[1] - y) * (n ? 2 : 1);
+    }
+}
+
+static void search_mv(MIContext *mi_ctx, AVMotionEstContext *me_ctx, SearchThreadData *td,
+                      int mb_x, int mb_y)
 {
-    AVMotionEstContext *me_ctx = &mi_ctx->me_ctx;
     AVMotionEstPredictor *preds = me_ctx->preds;
+    Block *blocks = td->blocks;
     Block *block = &blocks[mb_x + mb_y * mi_ctx->b_width];
 
     const int x_mb = mb_x << mi_ctx->log2_mb_size;
     const int y_mb = mb_y << mi_ctx->log2_mb_size;
     const int mb_i = mb_x + mb_y * mi_ctx->b_width;
+    const int dir = td->dir;
     int mv[2] = {x_mb, y_mb};
 
+    if (mi_ctx->me_levels) {
+        search_mv_hier(mi_ctx, me_ctx, td->cur, td->ref, x_mb, y_mb, mv);
+        block->mvs[dir][0] = mv[0] - x_mb;
+        block->mvs[dir][1] = mv[1] - y_mb;
+        return;
+    }
+
     switch (mi_ctx->me_method) {
         case AV_ME_METHOD_ESA:
             ff_me_search_esa(me_ctx, x_mb, y_mb, mv);
@@ -562,10 +692,78 @@ static void search_mv(MIContext *mi_ctx, Block *blocks, int mb_x, int mb_y, int
 
     block->mvs[dir][0] = mv[0] - x_mb;
     block->mvs[dir][1] = mv[1] - y_mb;
+
+    /* keep the predictor state a sequential search would leave behind */
+    if (mb_i == mi_ctx->b_count - 1) {
+        mi_ctx->me_ctx.pred_x = me_ctx->pred_x;
+        mi_ctx->me_ctx.pred_y = me_ctx->pred_y;
+    }
 }
 
-static void bilateral_me(MIContext *mi_ctx)
+static int search_mv_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    MIContext *mi_ctx = ctx->priv;
+    AVMotionEstContext *me_ctx = &mi_ctx->me_ctx_slice[jobnr];
+    SearchThreadData *td = arg;
+    const int slice_start = (mi_ctx->b_height *  jobnr     ) / nb_jobs;
+    const int slice_end   = (mi_ctx->b_height * (jobnr + 1)) / nb_jobs;
+    int mb_x, mb_y;
+
+    for (mb_y = slice_start; mb_y < slice_end; mb_y++)
+        for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++)
+            search_mv(mi_ctx, me_ctx, td, mb_x, mb_y);
+
+    emms_c();
+    return 0;
+}
+
+static int search_mv_wave(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    MIContext *mi_ctx = ctx->priv;
+    AVMotionEstContext *me_ctx = &mi_ctx->me_ctx_slice[jobnr];
+    SearchThreadData *td = arg;
+    const int y_start = FFMAX(0, (td->wave - mi_ctx->b_width + 2) / 2);
+    const int y_end = FFMIN(mi_ctx->b_height - 1, td->wave / 2) + 1;
+    const int slice_start = y_start + ((y_end - y_start) *  jobnr     ) / nb_jobs;
+    const int slice_end   = y_start + ((y_end - y_start) * (jobnr + 1)) / nb_jobs;
+    int mb_y;
+
+    for (mb_y = slice_start; mb_y < slice_end; mb_y++)
+        search_mv(mi_ctx, me_ctx, td, td->wave - 2 * mb_y, mb_y);
+
+    emms_c();
+    return 0;
+}
+
+static void search_mvs(AVFilterContext *ctx, Block *blocks, Frame *cur, Frame *ref, int dir)
+{
+    MIContext *mi_ctx = ctx->priv;
+    SearchThreadData td = { .blocks = blocks, .cur = cur, .ref = ref, .dir = dir };
+    int i;
+
+    for (i = 0; i < mi_ctx->nb_threads; i++)
+        mi_ctx->me_ctx_slice[i] = mi_ctx->me_ctx;
+
+    if (mi_ctx->nb_threads > 1 && !mi_ctx->me_levels &&
+        (mi_ctx->me_method == AV_ME_METHOD_EPZS || mi_ctx->me_method == AV_ME_METHOD_UMH)) {
+        /* the spatial predictors use the left, top and top-right blocks, so
+         * search along anti-diagonals, which only depend on previous ones */
+        for (td.wave = 0; td.wave < mi_ctx->b_width + 2 * (mi_ctx->b_height - 1); td.wave++) {
+            const int y_start = FFMAX(0, (td.wave - mi_ctx->b_width + 2) / 2);
+            const int y_end = FFMIN(mi_ctx->b_height - 1, td.wave / 2) + 1;
+
+            ctx->internal->execute(ctx, search_mv_wave, &td, NULL,
+                                   FFMIN(y_end - y_start, mi_ctx->nb_threads));
+        }
+    } else {
+        ctx->internal->execute(ctx, search_mv_slice, &td, NULL,
+                               FFMIN(mi_ctx->b_height, mi_ctx->nb_threads));
+    }
+}
+
+static void bilateral_me(AVFilterContext *ctx)
+{
+    MIContext *mi_ctx = ctx->priv;
     Block *block;
     int mb_x, mb_y;
 
@@ -580,9 +778,7 @@ static void bilateral_me(MIContext *mi_ctx)
             block->mvs[0][1] = 0;
         }
 
-    for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
-        for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++)
-            search_mv(mi_ctx, mi_ctx->int_blocks, mb_x, mb_y, 0);
+    search_mvs(ctx, mi_ctx->int_blocks, &mi_ctx->frames[1], &mi_ctx->frames[2], 0);
 }
 
 static int var_size_bme(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, int n)
@@ -737,6 +933,30 @@ static int cluster_mvs(MIContext *mi_ctx)
     return 0;
 }
 
+static void build_pyramid(MIContext *mi_ctx, Frame *frame)
+{
+    const uint8_t *src = frame->avf->data[0];
+    int src_linesize = frame->avf->linesize[0];
+    int x, y, n;
+
+    for (n = 0; n < mi_ctx->me_levels; n++) {
+        uint8_t *dst = frame->pyr[n];
+        const int dst_linesize = mi_ctx->pyr_linesize[n];
+        const int height = frame->avf->height >> (n + 1);
+
+        for (y = 0; y < height; y++) {
+            for (x = 0; x < dst_linesize; x++)
+                dst[x] = (src[2 * x] + src[2 * x + 1] +
+                          src[2 * x + src_linesize] + src[2 * x + 1 + src_linesize] + 2) >> 2;
+            src += 2 * src_linesize;
+            dst += dst_linesize;
+        }
+
+        src = frame->pyr[n];
+        src_linesize = dst_linesize;
+    }
+}
+
 static int inject_frame(AVFilterLink *inlink, AVFrame *avf_in)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -752,6 +972,9 @@ static int inject_frame(AVFilterLink *inlink, AVFrame *avf_in)
 
     if (mi_ctx->mi_mode == MI_MODE_MCI) {
 
+        if (mi_ctx->me_levels)
+            build_pyramid(mi_ctx, &mi_ctx->frames[NB_FRAMES - 1]);
+
         if (mi_ctx->me_method == AV_ME_METHOD_EPZS) {
             mi_ctx->mv_table[2] = memcpy(mi_ctx->mv_table[2], mi_ctx->mv_table[1], sizeof(*mi_ctx->mv_table[1]) * mi_ctx->b_count);
             mi_ctx->mv_table[1] = memcpy(mi_ctx->mv_table[1], mi_ctx->mv_table[0], sizeof(*mi_ctx->mv_table[0]) * mi_ctx->b_count);
@@ -765,9 +988,8 @@ static int inject_frame(AVFilterLink *inlink, AVFrame *avf_in)
                     mi_ctx->me_ctx.data_cur = mi_ctx->frames[2].avf->data[0];
                     mi_ctx->me_ctx.data_ref = mi_ctx->frames[dir ? 3 : 1].avf->data[0];
 
-                    for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
-                        for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++)
-                            search_mv(mi_ctx, mi_ctx->frames[2].blocks, mb_x, mb_y, dir);
+                    search_mvs(ctx, mi_ctx->frames[2].blocks, &mi_ctx->frames[2],
+                               &mi_ctx->frames[dir ? 3 : 1], dir);
                 }
             }
 
@@ -782,7 +1004,7 @@ static int inject_frame(AVFilterLink *inlink, AVFrame *avf_in)
             mi_ctx->me_ctx.data_cur = mi_ctx->frames[1].avf->data[0];
             mi_ctx->me_ctx.data_ref = mi_ctx->frames[2].avf->data[0];
 
-            bilateral_me(mi_ctx);
+            bilateral_me(ctx);
 
             if (mi_ctx->mc_mode == MC_MODE_AOBMC) {
 
@@ -864,14 +1086,14 @@ static int detect_scene_change(AVFilterContext *ctx)
         pixel_refs->nb++;\
     } while(0)
 
-static void bidirectional_obmc(MIContext *mi_ctx, int alpha)
+static void bidirectional_obmc(MIContext *mi_ctx, int alpha, int slice_start, int slice_end)
 {
     int x, y;
     int width = mi_ctx->frames[0].avf->width;
     int height = mi_ctx->frames[0].avf->height;
     int mb_y, mb_x, dir;
 
-    for (y = 0; y < height; y++)
+    for (y = slice_start; y < slice_end; y++)
         for (x = 0; x < width; x++)
             mi_ctx->pixel_refs[x + y * width].nb = 0;
 
@@ -892,6 +1114,9 @@ static void bidirectional_obmc(MIContext *mi_ctx, int alpha)
                 endc_x = av_clip(start_x + (2 << mi_ctx->log2_mb_size), 0, width - 1);
                 endc_y = av_clip(start_y + (2 << mi_ctx->log2_mb_size), 0, height - 1);
 
+                startc_y = FFMAX(startc_y, slice_start);
+                endc_y = FFMIN(endc_y, slice_end);
+
                 if (dir) {
                     mv_x = -mv_x;
                     mv_y = -mv_y;
@@ -914,16 +1139,16 @@ static void bidirectional_obmc(MIContext *mi_ctx, int alpha)
             }
 }
 
-static void set_frame_data(MIContext *mi_ctx, int alpha, AVFrame *avf_out)
+static void set_frame_data(MIContext *mi_ctx, int alpha, AVFrame *avf_out,
+                           int slice_start, int slice_end)
 {
     int x, y, plane;
 
     for (plane = 0; plane < mi_ctx->nb_planes; plane++) {
         int width = avf_out->width;
-        int height = avf_out->height;
         int chroma = plane == 1 || plane == 2;
 
-        for (y = 0; y < height; y++)
+        for (y = slice_start; y < slice_end; y++)
             for (x = 0; x < width; x++) {
                 int x_mv, y_mv;
                 int weight_sum = 0;
@@ -972,7 +1197,8 @@ static void set_frame_data(MIContext *mi_ctx, int alpha, AVFrame *avf_out)
     }
 }
 
-static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, int n, int alpha)
+static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, int n, int alpha,
+                         int slice_start, int slice_end)
 {
     int sb_x, sb_y;
     int width = mi_ctx->frames[0].avf->width;
@@ -983,7 +1209,8 @@ static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, in
             Block *sb = &block->subs[sb_x + sb_y * 2];
 
             if (sb->sb)
-                var_size_bmc(mi_ctx, sb, x_mb + (sb_x << (n - 1)), y_mb + (sb_y << (n - 1)), n - 1, alpha);
+                var_size_bmc(mi_ctx, sb, x_mb + (sb_x << (n - 1)), y_mb + (sb_y << (n - 1)), n - 1, alpha,
+                             slice_start, slice_end);
             else {
                 int x, y;
                 int mv_x = sb->mvs[0][0] * 2;
@@ -994,7 +1221,7 @@ static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, in
                 int end_x = start_x + (1 << (n - 1));
                 int end_y = start_y + (1 << (n - 1));
 
-                for (y = start_y; y < end_y; y++)  {
+                for (y = FFMAX(start_y, slice_start); y < FFMIN(end_y, slice_end); y++)  {
                     int y_min = -y;
                     int y_max = height - y - 1;
                     for (x = start_x; x < end_x; x++) {
@@ -1011,7 +1238,8 @@ static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, in
         }
 }
 
-static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y, int alpha)
+static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y, int alpha,
+                           int slice_start, int slice_end)
 {
     int x, y;
     int width = mi_ctx->frames[0].avf->width;
@@ -1026,6 +1254,19 @@ static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y,
     int start_x, start_y;
     int startc_x, startc_y, endc_x, endc_y;
 
+    start_x = (mb_x << mi_ctx->log2_mb_size) - mi_ctx->mb_size / 2;
+    start_y = (mb_y << mi_ctx->log2_mb_size) - mi_ctx->mb_size / 2;
+
+    startc_x = av_clip(start_x, 0, width - 1);
+    startc_y = av_clip(start_y, 0, height - 1);
+    endc_x = av_clip(start_x + (2 << mi_ctx->log2_mb_size), 0, width - 1);
+    endc_y = av_clip(start_y + (2 << mi_ctx->log2_mb_size), 0, height - 1);
+
+    startc_y = FFMAX(startc_y, slice_start);
+    endc_y = FFMIN(endc_y, slice_end);
+    if (startc_y >= endc_y)
+        return;
+
     if (mi_ctx->mc_mode == MC_MODE_AOBMC)
         for (nb_y = FFMAX(0, mb_y - 1); nb_y < FFMIN(mb_y + 2, mi_ctx->b_height); nb_y++)
             for (nb_x = FFMAX(0, mb_x - 1); nb_x < FFMIN(mb_x + 2, mi_ctx->b_width); nb_x++) {
@@ -1036,14 +1277,6 @@ static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y,
                     sbads[nb_x - mb_x + 1 + (nb_y - mb_y + 1) * 3] = get_sbad(&mi_ctx->me_ctx, x_nb, y_nb, x_nb + block->mvs[0][0], y_nb + block->mvs[0][1]);
             }
 
-    start_x = (mb_x << mi_ctx->log2_mb_size) - mi_ctx->mb_size / 2;
-    start_y = (mb_y << mi_ctx->log2_mb_size) - mi_ctx->mb_size / 2;
-
-    startc_x = av_clip(start_x, 0, width - 1);
-    startc_y = av_clip(start_y, 0, height - 1);
-    endc_x = av_clip(start_x + (2 << mi_ctx->log2_mb_size), 0, width - 1);
-    endc_y = av_clip(start_y + (2 << mi_ctx->log2_mb_size), 0, height - 1);
-
     for (y = startc_y; y < endc_y; y++) {
         int y_min = -y;
         int y_max = height - y - 1;
@@ -1075,49 +1308,34 @@ static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y,
     }
 }
 
-static void interpolate(AVFilterLink *inlink, AVFrame *avf_out)
+static int interpolate_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    AVFilterContext *ctx = inlink->dst;
-    AVFilterLink *outlink = ctx->outputs[0];
     MIContext *mi_ctx = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *avf_out = td->out;
+    const int alpha = td->alpha;
+    const int height = avf_out->height;
+    const int height_c = AV_CEIL_RSHIFT(height, mi_ctx->log2_chroma_h);
+    /* slices start on chroma rows so subsampled chroma samples are not shared */
+    const int slice_start = (height_c *  jobnr     ) / nb_jobs << mi_ctx->log2_chroma_h;
+    const int slice_end   = FFMIN((height_c * (jobnr + 1)) / nb_jobs << mi_ctx->log2_chroma_h, height);
     int x, y;
-    int plane, alpha;
-    int64_t pts;
-
-    pts = av_rescale(avf_out->pts, (int64_t) ALPHA_MAX * outlink->time_base.num * inlink->time_base.den,
-                                   (int64_t)             outlink->time_base.den * inlink->time_base.num);
-
-    alpha = (pts - mi_ctx->frames[1].avf->pts * ALPHA_MAX) / (mi_ctx->frames[2].avf->pts - mi_ctx->frames[1].avf->pts);
-    alpha = av_clip(alpha, 0, ALPHA_MAX);
-
-    if (alpha == 0 || alpha == ALPHA_MAX) {
-        av_frame_copy(avf_out, alpha ? mi_ctx->frames[2].avf : mi_ctx->frames[1].avf);
-        return;
-    }
-
-    if (mi_ctx->scene_changed) {
-        av_log(ctx, AV_LOG_DEBUG, "scene changed, input pts %"PRId64"\n", mi_ctx->frames[1].avf->pts);
-        /* duplicate frame */
-        av_frame_copy(avf_out, alpha > ALPHA_MAX / 2 ? mi_ctx->frames[2].avf : mi_ctx->frames[1].avf);
-        return;
-    }
+    int plane;
 
     switch(mi_ctx->mi_mode) {
-        case MI_MODE_DUP:
-            av_frame_copy(avf_out, alpha > ALPHA_MAX / 2 ? mi_ctx->frames[2].avf : mi_ctx->frames[1].avf);
-
-            break;
         case MI_MODE_BLEND:
             for (plane = 0; plane < mi_ctx->nb_planes; plane++) {
                 int width = avf_out->width;
-                int height = avf_out->height;
+                int start = slice_start;
+                int end = slice_end;
 
                 if (plane == 1 || plane == 2) {
                     width = AV_CEIL_RSHIFT(width, mi_ctx->log2_chroma_w);
-                    height = AV_CEIL_RSHIFT(height, mi_ctx->log2_chroma_h);
+                    start = AV_CEIL_RSHIFT(start, mi_ctx->log2_chroma_h);
+                    end = AV_CEIL_RSHIFT(end, mi_ctx->log2_chroma_h);
                 }
 
-                for (y = 0; y < height; y++) {
+                for (y = start; y < end; y++) {
                     for (x = 0; x < width; x++) {
                         avf_out->data[plane][x + y * avf_out->linesize[plane]] =
                             (alpha  * mi_ctx->frames[2].avf->data[plane][x + y * mi_ctx->frames[2].avf->linesize[plane]] +
@@ -1129,33 +1347,76 @@ static void interpolate(AVFilterLink *inlink, AVFrame *avf_out)
             break;
         case MI_MODE_MCI:
             if (mi_ctx->me_mode == ME_MODE_BIDIR) {
-                bidirectional_obmc(mi_ctx, alpha);
-                set_frame_data(mi_ctx, alpha, avf_out);
+                bidirectional_obmc(mi_ctx, alpha, slice_start, slice_end);
+                set_frame_data(mi_ctx, alpha, avf_out, slice_start, slice_end);
 
             } else if (mi_ctx->me_mode == ME_MODE_BILAT) {
+                int width = mi_ctx->frames[0].avf->width;
                 int mb_x, mb_y;
                 Block *block;
 
-                for (y = 0; y < mi_ctx->frames[0].avf->height; y++)
-                    for (x = 0; x < mi_ctx->frames[0].avf->width; x++)
-                        mi_ctx->pixel_refs[x + y * mi_ctx->frames[0].avf->width].nb = 0;
+                for (y = slice_start; y < slice_end; y++)
+                    for (x = 0; x < width; x++)
+                        mi_ctx->pixel_refs[x + y * width].nb = 0;
 
                 for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
                     for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++) {
                         block = &mi_ctx->int_blocks[mb_x + mb_y * mi_ctx->b_width];
 
                         if (block->sb)
-                            var_size_bmc(mi_ctx, block, mb_x << mi_ctx->log2_mb_size, mb_y << mi_ctx->log2_mb_size, mi_ctx->log2_mb_size, alpha);
+                            var_size_bmc(mi_ctx, block, mb_x << mi_ctx->log2_mb_size, mb_y << mi_ctx->log2_mb_size, mi_ctx->log2_mb_size, alpha,
+                                         slice_start, slice_end);
 
-                        bilateral_obmc(mi_ctx, block, mb_x, mb_y, alpha);
+                        bilateral_obmc(mi_ctx, block, mb_x, mb_y, alpha, slice_start, slice_end);
 
                     }
 
-                set_frame_data(mi_ctx, alpha, avf_out);
+                set_frame_data(mi_ctx, alpha, avf_out, slice_start, slice_end);
             }
 
             break;
     }
+
+    emms_c();
+    return 0;
+}
+
+static void interpolate(AVFilterLink *inlink, AVFrame *avf_out)
+{
+    AVFilterContext *ctx = inlink->dst;
+    AVFilterLink *outlink = ctx->outputs[0];
+    MIContext *mi_ctx = ctx->priv;
+    ThreadData td;
+    int alpha;
+    int64_t pts;
+
+    pts = av_rescale(avf_out->pts, (int64_t) ALPHA_MAX * outlink->time_base.num * inlink->time_base.den,
+                                   (int64_t)             outlink->time_base.den * inlink->time_base.num);
+
+    alpha = (pts - mi_ctx->frames[1].avf->pts * ALPHA_MAX) / (mi_ctx->frames[2].avf->pts - mi_ctx->frames[1].avf->pts);
+    alpha = av_clip(alpha, 0, ALPHA_MAX);
+
+    if (alpha == 0 || alpha == ALPHA_MAX) {
+        av_frame_copy(avf_out, alpha ? mi_ctx->frames[2].avf : mi_ctx->frames[1].avf);
+        return;
+    }
+
+    if (mi_ctx->scene_changed) {
+        av_log(ctx, AV_LOG_DEBUG, "scene changed, input pts %"PRId64"\n", mi_ctx->frames[1].avf->pts);
+        /* duplicate frame */
+        av_frame_copy(avf_out, alpha > ALPHA_MAX / 2 ? mi_ctx->frames[2].avf : mi_ctx->frames[1].avf);
+        return;
+    }
+
+    if (mi_ctx->mi_mode == MI_MODE_DUP) {
+        av_frame_copy(avf_out, alpha > ALPHA_MAX / 2 ? mi_ctx->frames[2].avf : mi_ctx->frames[1].avf);
+        return;
+    }
+
+    td.out = avf_out;
+    td.alpha = alpha;
+    ctx->internal->execute(ctx, interpolate_slice, &td, NULL,
+                           FFMIN(AV_CEIL_RSHIFT(avf_out->height, mi_ctx->log2_chroma_h), mi_ctx->nb_threads));
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *avf_in)
@@ -1224,6 +1485,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&mi_ctx->pixel_mvs);
     av_freep(&mi_ctx->pixel_weights);
     av_freep(&mi_ctx->pixel_refs);
+    av_freep(&mi_ctx->me_ctx_slice);
     if (mi_ctx->int_blocks)
         for (m = 0; m < mi_ctx->b_count; m++)
             free_blocks(&mi_ctx->int_blocks[m], 0);
@@ -1233,6 +1495,8 @@ static av_cold void uninit(AVFilterContext *ctx)
         Frame *frame = &mi_ctx->frames[i];
         av_freep(&frame->blocks);
         av_frame_free(&frame->avf);
+        for (m = 0; m < NB_LEVELS_MAX; m++)
+            av_freep(&frame->pyr[m]);
     }
 
     for (i = 0; i < 3; i++)
@@ -1267,4 +1531,5 @@ AVFilter ff_vf_minterpolate = {
     .query_formats = query_formats,
     .inputs        = minterpolate_inputs,
     .outputs       = minterpolate_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -60,6 +60,13 @@ enum {
 
 #define NBITS 5
 #define HIST_SIZE (1<<(3*NBITS))
+#define MAX_THREADS 64
+
+typedef struct ThreadData {
+    const AVFrame *in, *prev;
+    int nb_slices;           // number of per slice histograms to merge
+    int nb_new[MAX_THREADS]; // number of new colors found by each merge job
+} ThreadData;
 
 typedef struct PaletteGenContext {
     const AVClass *class;
@@ -70,6 +77,8 @@ typedef struct PaletteGenContext {
 
     AVFrame *prev_frame;                    // previous frame used for the diff stats_mode
     struct hist_node histogram[HIST_SIZE];  // histogram/hashtable of the colors
+    struct hist_node *slice_hist;           // per slice histograms, merged into histogram for each frame
+    int nb_slice_hists;                     // number of per slice histograms
     struct color_ref **refs;                // references of all the colors used in the stream
     int nb_refs;                            // number of color references (or number of different colors)
     struct range_box boxes[256];            // define the segmentation of the colorspace (the final palette)
@@ -403,19 +412,17 @@ static inline unsigned color_hash(uint32_t color)
 }
 
 /**
- * Locate the color in the hash table and increment its counter.
+ * Locate the color in the hash table node and add count to its counter.
  */
-static int color_inc(struct hist_node *hist, uint32_t color)
+static av_always_inline int color_add(struct hist_node *node, uint32_t color, uint64_t count)
 {
     int i;
-    const unsigned hash = color_hash(color);
-    struct hist_node *node = &hist[hash];
     struct color_ref *e;
 
     for (i = 0; i < node->nb_entries; i++) {
         e = &node->entries[i];
         if (e->color == color) {
-            e->count++;
+            e->count += count;
             return 0;
         }
     }
@@ -425,19 +432,28 @@ static int color_inc(struct hist_node *hist, uint32_t color)
     if (!e)
         return AVERROR(ENOMEM);
     e->color = color;
-    e->count = 1;
+    e->count = count;
     return 1;
 }
 
+/**
+ * Locate the color in the hash table and increment its counter.
+ */
+static int color_inc(struct hist_node *hist, uint32_t color)
+{
+    return color_add(&hist[color_hash(color)], color, 1);
+}
+
 /**
  * Update histogram when pixels differ from previous frame.
  */
 static int update_histogram_diff(struct hist_node *hist,
-                                 const AVFrame *f1, const AVFrame *f2)
+                                 const AVFrame *f1, const AVFrame *f2,
+                                 int slice_start, int slice_end)
 {
     int x, y, ret, nb_diff_colors = 0;
 
-    for (y = 0; y < f1->height; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         const uint32_t *p = (const uint32_t *)(f1->data[0] + y*f1->linesize[0]);
         const uint32_t *q = (const uint32_t *)(f2->data[0] + y*f2->linesize[0]);
 
@@ -456,11 +472,12 @@ static int update_histogram_diff(struct hist_node *hist,
 /**
  * Simple histogram of the frame.
  */
-static int update_histogram_frame(struct hist_node *hist, const AVFrame *f)
+static int update_histogram_frame(struct hist_node *hist, const AVFrame *f,
+                                  int slice_start, int slice_end)
 {
     int x, y, ret, nb_diff_colors = 0;
 
-    for (y = 0; y < f->height; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         const uint32_t *p = (const uint32_t *)(f->data[0] + y*f->linesize[0]);
 
         for (x = 0; x < f->width; x++) {
@@ -473,6 +490,86 @@ static int update_histogram_frame(struct hist_node *hist, const AVFrame *f)
     return nb_diff_colors;
 }
 
+/**
+ * Build the histogram of a horizontal slice of the frame in its own table.
+ */
+static int update_histogram_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteGenContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int height = td->in->height;
+    const int slice_start = (height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (height * (jobnr+1)) / nb_jobs;
+    struct hist_node *hist = s->slice_hist + jobnr * HIST_SIZE;
+    const int ret = td->prev ? update_histogram_diff(hist, td->prev, td->in, slice_start, slice_end)
+                             : update_histogram_frame(hist, td->in, slice_start, slice_end);
+
+    return FFMIN(ret, 0);
+}
+
+/**
+ * Merge the slice histograms into the main one, for a range of hash entries.
+ * Slices are merged in order so the colors end up in the main table in the
+ * same order as with a single pass over the frame.
+ */
+static int merge_histograms(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteGenContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int start = (HIST_SIZE *  jobnr   ) / nb_jobs;
+    const int end   = (HIST_SIZE * (jobnr+1)) / nb_jobs;
+    int i, j, k, ret, nb_new = 0;
+
+    for (i = start; i < end; i++) {
+        struct hist_node *node = &s->histogram[i];
+
+        for (j = 0; j < td->nb_slices; j++) {
+            struct hist_node *slice_node = &s->slice_hist[j * HIST_SIZE + i];
+
+            for (k = 0; k < slice_node->nb_entries; k++) {
+                const struct color_ref *e = &slice_node->entries[k];
+
+                ret = color_add(node, e->color, e->count);
+                if (ret < 0)
+                    return ret;
+                nb_new += ret;
+            }
+            slice_node->nb_entries = 0;
+        }
+    }
+    td->nb_new[jobnr] = nb_new;
+    return 0;
+}
+
+static int update_histogram_threaded(AVFilterContext *ctx, AVFrame *prev, AVFrame *in)
+{
+    PaletteGenContext *s = ctx->priv;
+    ThreadData td = { .in = in, .prev = prev };
+    int i, nb_jobs, rets[MAX_THREADS], nb_diff_colors = 0;
+
+    if (!s->slice_hist) {
+        const int nb_threads = FFMIN(ff_filter_get_nb_threads(ctx), MAX_THREADS);
+        s->slice_hist = av_calloc(nb_threads * HIST_SIZE, sizeof(*s->slice_hist));
+        if (!s->slice_hist)
+            return AVERROR(ENOMEM);
+        s->nb_slice_hists = nb_threads;
+    }
+    nb_jobs = td.nb_slices = FFMIN(s->nb_slice_hists, in->height);
+
+    ctx->internal->execute(ctx, update_histogram_slice, &td, rets, nb_jobs);
+    for (i = 0; i < nb_jobs; i++)
+        if (rets[i] < 0)
+            return rets[i];
+
+    ctx->internal->execute(ctx, merge_histograms, &td, rets, nb_jobs);
+    for (i = 0; i < nb_jobs; i++) {
+        if (rets[i] < 0)
+            return rets[i];
+        nb_diff_colors += td.nb_new[i];
+    }
+    return nb_diff_colors;
+}
+
 /**
  * Update the histogram for each passing frame. No frame will be pushed here.
  */
@@ -480,8 +577,14 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx = inlink->dst;
     PaletteGenContext *s = ctx->priv;
-    int ret = s->prev_frame ? update_histogram_diff(s->histogram, s->prev_frame, in)
-                            : update_histogram_frame(s->histogram, in);
+    int ret;
+
+    if (ff_filter_get_nb_threads(ctx) > 1 && in->height > 1)
+        ret = update_histogram_threaded(ctx, s->prev_frame, in);
+    else if (s->prev_frame)
+        ret = update_histogram_diff(s->histogram, s->prev_frame, in, 0, in->height);
+    else
+        ret = update_histogram_frame(s->histogram, in, 0, in->height);
 
     if (ret > 0)
         s->nb_refs += ret;
@@ -547,6 +650,9 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     for (i = 0; i < HIST_SIZE; i++)
         av_freep(&s->histogram[i].entries);
+    for (i = 0; i < s->nb_slice_hists * HIST_SIZE; i++)
+        av_freep(&s->slice_hist[i].entries);
+    av_freep(&s->slice_hist);
     av_freep(&s->refs);
     av_frame_free(&s->prev_frame);
 }
@@ -579,4 +685,5 @@ AVFilter ff_vf_palettegen = {
     .inputs        = palettegen_inputs,
     .outputs       = palettegen_outputs,
     .priv_class    = &palettegen_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
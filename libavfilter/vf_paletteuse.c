@@ -64,6 +64,7 @@ struct color_node {
 
 #define NBITS 5
 #define CACHE_SIZE (1<<(3*NBITS))
+#define MAX_THREADS 64
 
 struct cached_color {
     uint32_t color;
@@ -77,13 +78,20 @@ struct cache_node {
 
 struct PaletteUseContext;
 
-typedef int (*set_frame_func)(struct PaletteUseContext *s, AVFrame *out, AVFrame *in,
+typedef int (*set_frame_func)(struct PaletteUseContext *s, struct cache_node *cache,
+                              AVFrame *out, AVFrame *in,
                               int x_start, int y_start, int width, int height);
 
+typedef struct ThreadData {
+    AVFrame *out, *in;
+    int x, y, w, h;
+} ThreadData;
+
 typedef struct PaletteUseContext {
     const AVClass *class;
     FFFrameSync fs;
-    struct cache_node cache[CACHE_SIZE];    /* lookup cache */
+    struct cache_node *cache;               /* lookup caches, one per slice job */
+    int nb_caches;
     struct color_node map[AVPALETTE_COUNT]; /* 3D-Tree (KD-Tree with K=3) for reverse colormap */
     uint32_t palette[AVPALETTE_COUNT];
     int transparency_index; /* index in the palette of transparency. -1 if there is no transparency in the palette. */
@@ -333,7 +341,7 @@ end:
  * Note: a, r, g, and b are the components of color, but are passed as well to avoid
  * recomputing them (they are generally computed by the caller for other uses).
  */
-static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
+static av_always_inline int color_get(PaletteUseContext *s, struct cache_node *cache, uint32_t color,
                                       uint8_t a, uint8_t r, uint8_t g, uint8_t b,
                                       const enum color_search_method search_method)
 {
@@ -343,7 +351,7 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
     const uint8_t ghash = g & ((1<<NBITS)-1);
     const uint8_t bhash = b & ((1<<NBITS)-1);
     const unsigned hash = rhash<<(NBITS*2) | ghash<<NBITS | bhash;
-    struct cache_node *node = &s->cache[hash];
+    struct cache_node *node = &cache[hash];
     struct cached_color *e;
 
     // first, check for transparency
@@ -367,7 +375,7 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
     return e->pal_entry;
 }
 
-static av_always_inline int get_dst_color_err(PaletteUseContext *s,
+static av_always_inline int get_dst_color_err(PaletteUseContext *s, struct cache_node *cache,
                                               uint32_t c, int *er, int *eg, int *eb,
                                               const enum color_search_method search_method)
 {
@@ -376,7 +384,7 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     const uint8_t g = c >>  8 & 0xff;
     const uint8_t b = c       & 0xff;
     uint32_t dstc;
-    const int dstx = color_get(s, c, a, r, g, b, search_method);
+    const int dstx = color_get(s, cache, c, a, r, g, b, search_method);
     if (dstx < 0)
         return dstx;
     dstc = s->palette[dstx];
@@ -386,7 +394,8 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     return dstx;
 }
 
-static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFrame *in,
+static av_always_inline int set_frame(PaletteUseContext *s, struct cache_node *cache,
+                                      AVFrame *out, AVFrame *in,
                                       int x_start, int y_start, int w, int h,
                                       enum dithering_mode dither,
                                       const enum color_search_method search_method)
@@ -413,7 +422,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t r = av_clip_uint8(r8 + d);
                 const uint8_t g = av_clip_uint8(g8 + d);
                 const uint8_t b = av_clip_uint8(b8 + d);
-                const int color = color_get(s, src[x], a8, r, g, b, search_method);
+                const int color = color_get(s, cache, src[x], a8, r, g, b, search_method);
 
                 if (color < 0)
                     return color;
@@ -421,7 +430,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_HECKBERT) {
                 const int right = x < w - 1, down = y < h - 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -433,7 +442,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_FLOYD_STEINBERG) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -447,7 +456,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
             } else if (dither == DITHERING_SIERRA2) {
                 const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
                 const int right2 = x < w - 2,                    left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -466,7 +475,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_SIERRA2_4A) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -481,7 +490,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t r = src[x] >> 16 & 0xff;
                 const uint8_t g = src[x] >>  8 & 0xff;
                 const uint8_t b = src[x]       & 0xff;
-                const int color = color_get(s, src[x], a, r, g, b, search_method);
+                const int color = color_get(s, cache, src[x], a, r, g, b, search_method);
 
                 if (color < 0)
                     return color;
@@ -549,9 +558,11 @@ static int disp_tree(const struct color_node *node, const char *fname)
     return 0;
 }
 
-static int debug_accuracy(const struct color_node *node, const uint32_t *palette, const int trans_thresh,
-                          const enum color_search_method search_method)
+static int debug_accuracy(const PaletteUseContext *s, const enum color_search_method search_method)
 {
+    const struct color_node *node = s->map;
+    const uint32_t *palette = s->palette;
+    const int trans_thresh = s->trans_thresh;
     int r, g, b, ret = 0;
 
     for (r = 0; r < 256; r++) {
@@ -765,7 +776,7 @@ static void load_colormap(PaletteUseContext *s)
         disp_tree(s->map, s->dot_filename);
 
     if (s->debug_accuracy) {
-        if (!debug_accuracy(s->map, s->palette, s->trans_thresh, s->color_search_method))
+        if (!debug_accuracy(s, s->color_search_method))
             av_log(NULL, AV_LOG_INFO, "Accuracy check passed\n");
     }
 }
@@ -889,6 +900,17 @@ static void set_processing_window(enum diff_mode diff_mode,
     *hp = height;
 }
 
+static int set_frame_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int slice_start = td->y + (td->h *  jobnr   ) / nb_jobs;
+    const int slice_end   = td->y + (td->h * (jobnr+1)) / nb_jobs;
+
+    return s->set_frame(s, s->cache + jobnr * CACHE_SIZE, td->out, td->in,
+                        td->x, slice_start, td->w, slice_end - slice_start);
+}
+
 static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
 {
     int x, y, w, h, ret;
@@ -918,7 +940,18 @@ static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
     ff_dlog(ctx, "%dx%d rect: (%d;%d) -> (%d,%d) [area:%dx%d]\n",
             w, h, x, y, x+w, y+h, in->width, in->height);
 
-    ret = s->set_frame(s, out, in, x, y, w, h);
+    if (s->dither <= DITHERING_BAYER && s->nb_caches > 1 && h > 1) {
+        /* no error diffusion: the rows are independent */
+        ThreadData td = { .out = out, .in = in, .x = x, .y = y, .w = w, .h = h };
+        const int nb_jobs = FFMIN(s->nb_caches, h);
+        int i, rets[MAX_THREADS];
+
+        ctx->internal->execute(ctx, set_frame_slice, &td, rets, nb_jobs);
+        for (ret = 0, i = 0; i < nb_jobs; i++)
+            ret = FFMIN(ret, rets[i]);
+    } else {
+        ret = s->set_frame(s, s->cache, out, in, x, y, w, h);
+    }
     if (ret < 0) {
         av_frame_free(&out);
         *outf = NULL;
@@ -947,6 +980,13 @@ static int config_output(AVFilterLink *outlink)
     outlink->w = ctx->inputs[0]->w;
     outlink->h = ctx->inputs[0]->h;
 
+    if (!s->cache) {
+        s->nb_caches = FFMIN(ff_filter_get_nb_threads(ctx), MAX_THREADS);
+        s->cache = av_calloc(s->nb_caches * CACHE_SIZE, sizeof(*s->cache));
+        if (!s->cache)
+            return AVERROR(ENOMEM);
+    }
+
     outlink->time_base = ctx->inputs[0]->time_base;
     if ((ret = ff_framesync_configure(&s->fs)) < 0)
         return ret;
@@ -979,9 +1019,9 @@ static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
     if (s->new) {
         memset(s->palette, 0, sizeof(s->palette));
         memset(s->map, 0, sizeof(s->map));
-        for (i = 0; i < CACHE_SIZE; i++)
+        for (i = 0; i < s->nb_caches * CACHE_SIZE; i++)
             av_freep(&s->cache[i].entries);
-        memset(s->cache, 0, sizeof(s->cache));
+        memset(s->cache, 0, s->nb_caches * CACHE_SIZE * sizeof(*s->cache));
     }
 
     i = 0;
@@ -1029,10 +1069,12 @@ static int load_apply_palette(FFFrameSync *fs)
 }
 
 #define DEFINE_SET_FRAME(color_search, name, value)                             \
-static int set_frame_##name(PaletteUseContext *s, AVFrame *out, AVFrame *in,    \
+static int set_frame_##name(PaletteUseContext *s, struct cache_node *cache,     \
+                            AVFrame *out, AVFrame *in,                          \
                             int x_start, int y_start, int w, int h)             \
 {                                                                               \
-    return set_frame(s, out, in, x_start, y_start, w, h, value, color_search);  \
+    return set_frame(s, cache, out, in, x_start, y_start, w, h,                 \
+                     value, color_search);                                      \
 }
 
 #define DEFINE_SET_FRAME_COLOR_SEARCH(color_search, color_search_macro)                                 \
@@ -1107,8 +1149,9 @@ static av_cold void uninit(AVFilterContext *ctx)
     PaletteUseContext *s = ctx->priv;
 
     ff_framesync_uninit(&s->fs);
-    for (i = 0; i < CACHE_SIZE; i++)
+    for (i = 0; i < s->nb_caches * CACHE_SIZE; i++)
         av_freep(&s->cache[i].entries);
+    av_freep(&s->cache);
     av_frame_free(&s->last_in);
     av_frame_free(&s->last_out);
 }
@@ -1145,4 +1188,5 @@ AVFilter ff_vf_paletteuse = {
     .inputs        = paletteuse_inputs,
     .outputs       = paletteuse_outputs,
     .priv_class    = &paletteuse_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -0,0 +1,1170 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Calculate PSNR, SSIM and VIF between one reference and several
+ * distorted videos.
+ *
+ * The reference-only terms (SSIM block sums, VIF pyramid, local means and
+ * variances) are computed once per frame and shared by all distorted
+ * inputs. The per-input terms run as (input, slice) jobs.
+ */
+
+#include <float.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "avfilter.h"
+#include "drawutils.h"
+#include "formats.h"
+#include "framesync.h"
+#include "internal.h"
+#include "psnr.h"
+#include "video.h"
+
+#define METRIC_PSNR (1 << 0)
+#define METRIC_SSIM (1 << 1)
+#define METRIC_VIF  (1 << 2)
+
+#define VIF_SCALES 4
+
+typedef struct JobScores {
+    uint64_t sse[4];
+    double ssim[4];
+    double vif_num[VIF_SCALES];
+    double vif_den[VIF_SCALES];
+} JobScores;
+
+typedef struct InputStats {
+    uint64_t nb_frames;
+    double mse, min_mse, max_mse, mse_comp[4];
+    double ssim[4], ssim_total;
+    double vif_sum[VIF_SCALES], vif_min[VIF_SCALES], vif_max[VIF_SCALES];
+} InputStats;
+
+typedef struct QualityMetricsContext {
+    const AVClass *class;
+    FFFrameSync fs;
+
+    int nb_dists;
+    int metrics;
+    char *summary_file_str;
+
+    int depth;
+    int max[4], average_max;
+    int is_rgb;
+    uint8_t rgba_map[4];
+    char comps[4];
+    int nb_components;
+    int planewidth[4];
+    int planeheight[4];
+    double planeweight[4];
+
+    int nb_threads;
+    int nb_slices;
+    int nb_jobs;
+    int nb_temps;
+    JobScores *scores;
+    float **temp;
+    int64_t **ssim_temp;
+
+    PSNRDSPContext psnr_dsp;
+
+    /* SSIM: per 4x4 block sum and sum of squares of the reference */
+    int64_t (*ref_sums[4])[2];
+
+    /* VIF: luma pyramid of every input and the reference statistics */
+    int vif_w[VIF_SCALES];
+    int vif_h[VIF_SCALES];
+    float vif_factor;
+    float *ref_pyr[VIF_SCALES];
+    float *ref_mu[VIF_SCALES];
+    float *ref_sq_filt[VIF_SCALES];
+    float **dist_pyr;
+
+    InputStats *stats;
+    AVFrame **dists;
+    uint64_t nb_frames;
+} QualityMetricsContext;
+
+#define OFFSET(x) offsetof(QualityMetricsContext, x)
+#define FLAGS AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_VIDEO_PARAM
+
+static const AVOption qualitymetrics_options[] = {
+    { "inputs",  "set number of distorted inputs", OFFSET(nb_dists), AV_OPT_TYPE_INT, {.i64=1}, 1, INT16_MAX, FLAGS },
+    { "metrics", "set metrics to compute", OFFSET(metrics), AV_OPT_TYPE_FLAGS, {.i64=METRIC_PSNR|METRIC_SSIM}, 0, INT_MAX, FLAGS, "metrics" },
+        { "psnr", "peak signal to noise ratio",        0, AV_OPT_TYPE_CONST, {.i64=METRIC_PSNR}, 0, 0, FLAGS, "metrics" },
+        { "ssim", "structural similarity",             0, AV_OPT_TYPE_CONST, {.i64=METRIC_SSIM}, 0, 0, FLAGS, "metrics" },
+        { "vif",  "visual information fidelity",       0, AV_OPT_TYPE_CONST, {.i64=METRIC_VIF},  0, 0, FLAGS, "metrics" },
+    { "summary", "set file where to write the JSON summary", OFFSET(summary_file_str), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS },
+    { NULL }
+};
+
+FRAMESYNC_DEFINE_CLASS(qualitymetrics, QualityMetricsContext, fs);
+
+/* Same kernels as vf_vif. */
+static const uint8_t vif_filter1d_width[VIF_SCALES] = { 17, 9, 5, 3 };
+
+static const float vif_filter1d_table[VIF_SCALES][17] =
+{
+    {
+        0.00745626912, 0.0142655009, 0.0250313189, 0.0402820669, 0.0594526194,
+        0.0804751068, 0.0999041125, 0.113746084, 0.118773937, 0.113746084,
+        0.0999041125, 0.0804751068, 0.0594526194, 0.0402820669, 0.0250313189,
+        0.0142655009, 0.00745626912
+    },
+    {
+        0.0189780835, 0.0558981746, 0.120920904, 0.192116052, 0.224173605,
+        0.192116052, 0.120920904, 0.0558981746, 0.0189780835
+    },
+    {
+        0.054488685, 0.244201347, 0.402619958, 0.244201347, 0.054488685
+    },
+    {
+        0.166378498, 0.667243004, 0.166378498
+    }
+};
+
+typedef struct ThreadData {
+    AVFrame *ref;
+    AVFrame **dists;
+    int scale;
+} ThreadData;
+
+static inline unsigned pow_2(unsigned base)
+{
+    return base*base;
+}
+
+static inline double get_psnr(double mse, uint64_t nb_frames, int max)
+{
+    return 10.0 * log10(pow_2(max) / (mse / nb_frames));
+}
+
+static uint64_t sse_line_8bit(const uint8_t *main_line,  const uint8_t *ref_line, int outw)
+{
+    unsigned m2 = 0;
+
+    for (int j = 0; j < outw; j++)
+        m2 += pow_2(main_line[j] - ref_line[j]);
+
+    return m2;
+}
+
+static uint64_t sse_line_16bit(const uint8_t *_main_line, const uint8_t *_ref_line, int outw)
+{
+    const uint16_t *main_line = (const uint16_t *) _main_line;
+    const uint16_t *ref_line = (const uint16_t *) _ref_line;
+    uint64_t m2 = 0;
+
+    for (int j = 0; j < outw; j++)
+        m2 += pow_2(main_line[j] - ref_line[j]);
+
+    return m2;
+}
+
+static double ssim_db(double ssim, double weight)
+{
+    return (fabs(weight - ssim) > 1e-9) ? 10.0 * log10(weight / (weight - ssim)) : INFINITY;
+}
+
+static float ssim_end1x(int64_t s1, int64_t s2, int64_t ss, int64_t s12, int max)
+{
+    int64_t ssim_c1 = (int64_t)(.01*.01*max*max*64 + .5);
+    int64_t ssim_c2 = (int64_t)(.03*.03*max*max*64*63 + .5);
+
+    int64_t vars = ss * 64 - s1 * s1 - s2 * s2;
+    int64_t covar = s12 * 64 - s1 * s2;
+
+    return (float)(2 * s1 * s2 + ssim_c1) * (float)(2 * covar + ssim_c2)
+         / ((float)(s1 * s1 + s2 * s2 + ssim_c1) * (float)(vars + ssim_c2));
+}
+
+#define PIXEL(data, x, hbd) ((hbd) ? ((const uint16_t *)(data))[x] : (data)[x])
+
+static av_always_inline void ssim_ref_sums(const uint8_t *ref, ptrdiff_t ref_stride,
+                                           int64_t (*sums)[2], int width, int hbd)
+{
+    for (int z = 0; z < width; z++) {
+        uint64_t s2 = 0, ss = 0;
+
+        for (int y = 0; y < 4; y++) {
+            for (int x = 0; x < 4; x++) {
+                unsigned b = PIXEL(ref + y * ref_stride, 4 * z + x, hbd);
+
+                s2 += b;
+                ss += (uint64_t)b * b;
+            }
+        }
+
+        sums[z][0] = s2;
+        sums[z][1] = ss;
+    }
+}
+
+static av_always_inline void ssim_dist_sums(const uint8_t *main, ptrdiff_t main_stride,
+                                            const uint8_t *ref, ptrdiff_t ref_stride,
+                                            int64_t (*sums)[3], int width, int hbd)
+{
+    for (int z = 0; z < width; z++) {
+        uint64_t s1 = 0, ss = 0, s12 = 0;
+
+        for (int y = 0; y < 4; y++) {
+            for (int x = 0; x < 4; x++) {
+                unsigned a = PIXEL(main + y * main_stride, 4 * z + x, hbd);
+                unsigned b = PIXEL(ref + y * ref_stride, 4 * z + x, hbd);
+
+                s1  += a;
+                ss  += (uint64_t)a * a;
+                s12 += (uint64_t)a * b;
+            }
+        }
+
+        sums[z][0] = s1;
+        sums[z][1] = ss;
+        sums[z][2] = s12;
+    }
+}
+
+static double ssim_end_line(const int64_t (*sum0)[3], const int64_t (*sum1)[3],
+                            const int64_t (*ref0)[2], const int64_t (*ref1)[2],
+                            int width, int max)
+{
+    double ssim = 0.0;
+
+    for (int i = 0; i < width; i++)
+        ssim += ssim_end1x(sum0[i][0] + sum0[i + 1][0] + sum1[i][0] + sum1[i + 1][0],
+                           ref0[i][0] + ref0[i + 1][0] + ref1[i][0] + ref1[i + 1][0],
+                           sum0[i][1] + sum0[i + 1][1] + sum1[i][1] + sum1[i + 1][1] +
+                           ref0[i][1] + ref0[i + 1][1] + ref1[i][1] + ref1[i + 1][1],
+                           sum0[i][2] + sum0[i + 1][2] + sum1[i][2] + sum1[i + 1][2],
+                           max);
+    return ssim;
+}
+
+#define SUM_LEN(w) (((w) >> 2) + 3)
+
+static void ssim_plane(QualityMetricsContext *s, const AVFrame *main, const AVFrame *ref,
+                       int c, int64_t *temp, double *score, int jobnr, int nb_jobs)
+{
+    const int hbd = s->depth > 8;
+    const uint8_t *main_data = main->data[c];
+    const uint8_t *ref_data = ref->data[c];
+    const int main_stride = main->linesize[c];
+    const int ref_stride = ref->linesize[c];
+    const int width = s->planewidth[c] >> 2;
+    const int height = s->planeheight[c] >> 2;
+    const int slice_start = (height * jobnr) / nb_jobs;
+    const int slice_end = (height * (jobnr+1)) / nb_jobs;
+    const int ystart = FFMAX(1, slice_start);
+    const int64_t (*ref_sums)[2] = (const int64_t (*)[2])s->ref_sums[c];
+    int64_t (*sum0)[3] = (int64_t (*)[3])temp;
+    int64_t (*sum1)[3] = sum0 + SUM_LEN(s->planewidth[c]);
+    double ssim = 0.0;
+    int z = ystart - 1;
+
+    for (int y = ystart; y < slice_end; y++) {
+        for (; z <= y; z++) {
+            FFSWAP(void*, sum0, sum1);
+            if (hbd)
+                ssim_dist_sums(&main_data[4 * z * main_stride], main_stride,
+                               &ref_data[4 * z * ref_stride], ref_stride,
+                               sum0, width, 1);
+            else
+                ssim_dist_sums(&main_data[4 * z * main_stride], main_stride,
+                               &ref_data[4 * z * ref_stride], ref_stride,
+                               sum0, width, 0);
+        }
+
+        ssim += ssim_end_line((const int64_t (*)[3])sum0, (const int64_t (*)[3])sum1,
+                              ref_sums + y * width, ref_sums + (y - 1) * width,
+                              width - 1, s->max[c]);
+    }
+
+    *score = ssim;
+}
+
+static void vif_set_rows(const float **rows, const float *src, int stride,
+                         int h, int i, int filt_w)
+{
+    for (int k = 0; k < filt_w; k++) {
+        int ii = i - filt_w / 2 + k;
+
+        ii = ii < 0 ? -ii : (ii >= h ? 2 * h - ii - 1 : ii);
+        rows[k] = src + ii * stride;
+    }
+}
+
+static av_always_inline float vif_hfilter_px(const float *filter, int filt_w,
+                                             const float *src, int w, int j)
+{
+    float sum = 0.f;
+
+    if (j >= filt_w / 2 && j < w - filt_w / 2 - 1) {
+        src += j - filt_w / 2;
+        for (int k = 0; k < filt_w; k++)
+            sum += filter[k] * src[k];
+    } else {
+        for (int k = 0; k < filt_w; k++) {
+            int jj = j - filt_w / 2 + k;
+
+            jj = jj < 0 ? -jj : (jj >= w ? 2 * w - jj - 1 : jj);
+            sum += filter[k] * src[jj];
+        }
+    }
+
+    return sum;
+}
+
+static void vif_hfilter(const float *filter, int filt_w,
+                        const float *src, float *dst, int w)
+{
+    for (int j = 0; j < w; j++)
+        dst[j] = vif_hfilter_px(filter, filt_w, src, w, j);
+}
+
+/**
+ * Low-pass row 2 * k of a pyramid level and keep its even columns,
+ * giving row k of the next level.
+ */
+static void vif_dec_row(const float *filter, int filt_w,
+                        const float *src, int w, int h, int k,
+                        float *dst, float *temp)
+{
+    const float *rows[17];
+
+    vif_set_rows(rows, src, w, h, 2 * k, filt_w);
+    for (int j = 0; j < w; j++) {
+        float sum = 0.f;
+
+        for (int t = 0; t < filt_w; t++)
+            sum += filter[t] * rows[t][j];
+        temp[j] = sum;
+    }
+
+    for (int j = 0; j < w / 2; j++)
+        dst[j] = vif_hfilter_px(filter, filt_w, temp, w, 2 * j);
+}
+
+static void vif_ref_row(const float *filter, int filt_w,
+                        const float *ref, int w, int h, int i,
+                        float *mu, float *sq_filt, float *temp)
+{
+    const float *rows[17];
+    float *t_mu = temp;
+    float *t_sq = temp + w;
+
+    vif_set_rows(rows, ref, w, h, i, filt_w);
+    for (int j = 0; j < w; j++) {
+        float sum = 0.f, sum_sq = 0.f;
+
+        for (int t = 0; t < filt_w; t++) {
+            const float val = rows[t][j];
+
+            sum    += filter[t] * val;
+            sum_sq += filter[t] * (val * val);
+        }
+        t_mu[j] = sum;
+        t_sq[j] = sum_sq;
+    }
+
+    vif_hfilter(filter, filt_w, t_mu, mu, w);
+    vif_hfilter(filter, filt_w, t_sq, sq_filt, w);
+}
+
+static void vif_dist_row(const float *filter, int filt_w,
+                         const float *ref, const float *main,
+                         const float *mu1, const float *ref_sq_filt,
+                         int w, int h, int i, float *temp,
+                         double *num, double *den)
+{
+    static const float sigma_nsq = 2;
+    const float eps = 1.0e-10f;
+    const float gain_limit = 100.f;
+    const float *ref_rows[17], *main_rows[17];
+    float *t_mu = temp, *t_sq = temp + w, *t_rm = temp + 2 * w;
+    float *mu2 = temp + 3 * w, *main_sq_filt = temp + 4 * w, *ref_main_filt = temp + 5 * w;
+    float accum_num = 0.f, accum_den = 0.f;
+
+    vif_set_rows(ref_rows, ref, w, h, i, filt_w);
+    vif_set_rows(main_rows, main, w, h, i, filt_w);
+    for (int j = 0; j < w; j++) {
+        float sum = 0.f, sum_sq = 0.f, sum_rm = 0.f;
+
+        for (int t = 0; t < filt_w; t++) {
+            const float mval = main_rows[t][j];
+            const float rval = ref_rows[t][j];
+
+            sum    += filter[t] * mval;
+            sum_sq += filter[t] * (mval * mval);
+            sum_rm += filter[t] * (rval * mval);
+        }
+        t_mu[j] = sum;
+        t_sq[j] = sum_sq;
+        t_rm[j] = sum_rm;
+    }
+
+    vif_hfilter(filter, filt_w, t_mu, mu2, w);
+    vif_hfilter(filter, filt_w, t_sq, main_sq_filt, w);
+    vif_hfilter(filter, filt_w, t_rm, ref_main_filt, w);
+
+    for (int j = 0; j < w; j++) {
+        float sigma1_sq = ref_sq_filt[j]   - mu1[j] * mu1[j];
+        float sigma2_sq = main_sq_filt[j]  - mu2[j] * mu2[j];
+        float sigma12   = ref_main_filt[j] - mu1[j] * mu2[j];
+        float g, sv_sq, num_val, den_val;
+
+        sigma1_sq = FFMAX(sigma1_sq, 0.0f);
+        sigma2_sq = FFMAX(sigma2_sq, 0.0f);
+        sigma12   = FFMAX(sigma12,   0.0f);
+
+        g = sigma12 / (sigma1_sq + eps);
+        sv_sq = sigma2_sq - g * sigma12;
+
+        if (sigma1_sq < eps) {
+            g = 0.0f;
+            sv_sq = sigma2_sq;
+            sigma1_sq = 0.0f;
+        }
+
+        if (sigma2_sq < eps) {
+            g = 0.0f;
+            sv_sq = 0.0f;
+        }
+
+        if (g < 0.0f) {
+            sv_sq = sigma2_sq;
+            g = 0.0f;
+        }
+        sv_sq = FFMAX(sv_sq, eps);
+
+        g = FFMIN(g, gain_limit);
+
+        num_val = log2f(1.0f + g * g * sigma1_sq / (sv_sq + sigma_nsq));
+        den_val = log2f(1.0f + sigma1_sq / sigma_nsq);
+
+        if (isnan(den_val))
+            num_val = den_val = 1.f;
+
+        accum_num += num_val;
+        accum_den += den_val;
+    }
+
+    *num += accum_num;
+    *den += accum_den;
+}
+
+static void vif_convert(const QualityMetricsContext *s, const AVFrame *in,
+                        float *dst, int slice_start, int slice_end)
+{
+    const float factor = s->vif_factor;
+    const int w = s->vif_w[0];
+
+    for (int i = slice_start; i < slice_end; i++) {
+        const uint8_t *src = in->data[0] + i * in->linesize[0];
+        float *dst_row = dst + i * w;
+
+        if (s->depth > 8) {
+            const uint16_t *src16 = (const uint16_t *)src;
+
+            for (int j = 0; j < w; j++)
+                dst_row[j] = src16[j] * factor - 128.f;
+        } else {
+            for (int j = 0; j < w; j++)
+                dst_row[j] = src[j] * factor - 128.f;
+        }
+    }
+}
+
+static void vif_dec_slice(const QualityMetricsContext *s, const float *src, float *dst,
+                          int scale, float *temp, int jobnr, int nb_jobs)
+{
+    const int h = s->vif_h[scale];
+    const int slice_start = (h * jobnr) / nb_jobs;
+    const int slice_end = (h * (jobnr+1)) / nb_jobs;
+
+    for (int k = slice_start; k < slice_end; k++)
+        vif_dec_row(vif_filter1d_table[scale], vif_filter1d_width[scale],
+                    src, s->vif_w[scale - 1], s->vif_h[scale - 1], k,
+                    dst + k * s->vif_w[scale], temp);
+}
+
+static int ref_stats(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    QualityMetricsContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const AVFrame *ref = td->ref;
+
+    if (s->metrics & METRIC_SSIM) {
+        for (int c = 0; c < s->nb_components; c++) {
+            const int width = s->planewidth[c] >> 2;
+            const int height = s->planeheight[c] >> 2;
+            const int slice_start = (height * jobnr) / nb_jobs;
+            const int slice_end = (height * (jobnr+1)) / nb_jobs;
+            const int stride = ref->linesize[c];
+
+            for (int y = slice_start; y < slice_end; y++) {
+                const uint8_t *src = ref->data[c] + 4 * y * stride;
+
+                if (s->depth > 8)
+                    ssim_ref_sums(src, stride, s->ref_sums[c] + y * width, width, 1);
+                else
+                    ssim_ref_sums(src, stride, s->ref_sums[c] + y * width, width, 0);
+            }
+        }
+    }
+
+    if (s->metrics & METRIC_VIF)
+        vif_convert(s, ref, s->ref_pyr[0],
+                    (s->vif_h[0] * jobnr) / nb_jobs,
+                    (s->vif_h[0] * (jobnr+1)) / nb_jobs);
+
+    return 0;
+}
+
+static int dist_stats(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    QualityMetricsContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int d = jobnr / s->nb_slices;
+    const int slice = jobnr % s->nb_slices;
+    const AVFrame *ref = td->ref;
+    const AVFrame *main = td->dists[d];
+    JobScores *score = &s->scores[jobnr];
+
+    if (!main)
+        return 0;
+
+    if (s->metrics & METRIC_PSNR) {
+        for (int c = 0; c < s->nb_components; c++) {
+            const int outw = s->planewidth[c];
+            const int outh = s->planeheight[c];
+            const int slice_start = (outh * slice) / s->nb_slices;
+            const int slice_end = (outh * (slice+1)) / s->nb_slices;
+            const int ref_linesize = ref->linesize[c];
+            const int main_linesize = main->linesize[c];
+            const uint8_t *main_line = main->data[c] + main_linesize * slice_start;
+            const uint8_t *ref_line = ref->data[c] + ref_linesize * slice_start;
+            uint64_t m = 0;
+
+            for (int i = slice_start; i < slice_end; i++) {
+                m += s->psnr_dsp.sse_line(main_line, ref_line, outw);
+                ref_line += ref_linesize;
+                main_line += main_linesize;
+            }
+            score->sse[c] = m;
+        }
+    }
+
+    if (s->metrics & METRIC_SSIM) {
+        for (int c = 0; c < s->nb_components; c++)
+            ssim_plane(s, main, ref, c, s->ssim_temp[jobnr],
+                       &score->ssim[c], slice, s->nb_slices);
+    }
+
+    if (s->metrics & METRIC_VIF)
+        vif_convert(s, main, s->dist_pyr[d],
+                    (s->vif_h[0] * slice) / s->nb_slices,
+                    (s->vif_h[0] * (slice+1)) / s->nb_slices);
+
+    return 0;
+}
+
+static float *dist_level(QualityMetricsContext *s, int d, int scale)
+{
+    float *pyr = s->dist_pyr[d];
+
+    for (int i = 0; i < scale; i++)
+        pyr += s->vif_w[i] * s->vif_h[i];
+    return pyr;
+}
+
+static int vif_ref_scale(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    QualityMetricsContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int scale = td->scale;
+    const int w = s->vif_w[scale];
+    const int h = s->vif_h[scale];
+    const int slice_start = (h * jobnr) / nb_jobs;
+    const int slice_end = (h * (jobnr+1)) / nb_jobs;
+    float *temp = s->temp[jobnr];
+
+    for (int i = slice_start; i < slice_end; i++)
+        vif_ref_row(vif_filter1d_table[scale], vif_filter1d_width[scale],
+                    s->ref_pyr[scale], w, h, i,
+                    s->ref_mu[scale] + i * w, s->ref_sq_filt[scale] + i * w, temp);
+
+    if (scale + 1 < VIF_SCALES)
+        vif_dec_slice(s, s->ref_pyr[scale], s->ref_pyr[scale + 1],
+                      scale + 1, temp, jobnr, nb_jobs);
+
+    return 0;
+}
+
+static int vif_dist_scale(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    QualityMetricsContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int scale = td->scale;
+    const int d = jobnr / s->nb_slices;
+    const int slice = jobnr % s->nb_slices;
+    const int w = s->vif_w[scale];
+    const int h = s->vif_h[scale];
+    const int slice_start = (h * slice) / s->nb_slices;
+    const int slice_end = (h * (slice+1)) / s->nb_slices;
+    const float *main = dist_level(s, d, scale);
+    JobScores *score = &s->scores[jobnr];
+    float *temp = s->temp[jobnr];
+    double num = 0., den = 0.;
+
+    if (!td->dists[d])
+        return 0;
+
+    for (int i = slice_start; i < slice_end; i++)
+        vif_dist_row(vif_filter1d_table[scale], vif_filter1d_width[scale],
+                     s->ref_pyr[scale], main,
+                     s->ref_mu[scale] + i * w, s->ref_sq_filt[scale] + i * w,
+                     w, h, i, temp, &num, &den);
+    score->vif_num[scale] = num;
+    score->vif_den[scale] = den;
+
+    if (scale + 1 < VIF_SCALES)
+        vif_dec_slice(s, main, dist_level(s, d, scale + 1),
+                      scale + 1, temp, slice, s->nb_slices);
+
+    return 0;
+}
+
+static void set_meta(AVDictionary **metadata, int input, const char *key, char comp, double d)
+{
+    char value[128];
+    char key2[128];
+
+    snprintf(value, sizeof(value), "%f", d);
+    if (comp)
+        snprintf(key2, sizeof(key2), "lavfi.qualitymetrics.%d.%s%c", input, key, comp);
+    else
+        snprintf(key2, sizeof(key2), "lavfi.qualitymetrics.%d.%s", input, key);
+    av_dict_set(metadata, key2, value, 0);
+}
+
+static void update_stats(AVFilterContext *ctx, int d, AVDictionary **metadata)
+{
+    QualityMetricsContext *s = ctx->priv;
+    const JobScores *scores = &s->scores[d * s->nb_slices];
+    InputStats *st = &s->stats[d];
+
+    st->nb_frames++;
+
+    if (s->metrics & METRIC_PSNR) {
+        double comp_mse[4], mse = 0.;
+
+        for (int c = 0; c < s->nb_components; c++) {
+            uint64_t sum = 0;
+
+            for (int j = 0; j < s->nb_slices; j++)
+                sum += scores[j].sse[c];
+            comp_mse[c] = sum / ((double)s->planewidth[c] * s->planeheight[c]);
+            mse += comp_mse[c] * s->planeweight[c];
+            st->mse_comp[c] += comp_mse[c];
+        }
+
+        st->min_mse = FFMIN(st->min_mse, mse);
+        st->max_mse = FFMAX(st->max_mse, mse);
+        st->mse += mse;
+
+        for (int j = 0; j < s->nb_components; j++) {
+            int c = s->is_rgb ? s->rgba_map[j] : j;
+            set_meta(metadata, d, "psnr.mse.", s->comps[j], comp_mse[c]);
+            set_meta(metadata, d, "psnr.psnr.", s->comps[j], get_psnr(comp_mse[c], 1, s->max[c]));
+        }
+        set_meta(metadata, d, "psnr.mse_avg", 0, mse);
+        set_meta(metadata, d, "psnr.psnr_avg", 0, get_psnr(mse, 1, s->average_max));
+    }
+
+    if (s->metrics & METRIC_SSIM) {
+        double c[4] = { 0 }, ssimv = 0.0;
+
+        for (int i = 0; i < s->nb_components; i++) {
+            for (int j = 0; j < s->nb_slices; j++)
+                c[i] += scores[j].ssim[i];
+            c[i] = c[i] / (((s->planewidth[i] >> 2) - 1) * ((s->planeheight[i] >> 2) - 1));
+            ssimv += s->planeweight[i] * c[i];
+            st->ssim[i] += c[i];
+        }
+        st->ssim_total += ssimv;
+
+        for (int i = 0; i < s->nb_components; i++) {
+            int cidx = s->is_rgb ? s->rgba_map[i] : i;
+            set_meta(metadata, d, "ssim.", s->comps[i], c[cidx]);
+        }
+        set_meta(metadata, d, "ssim.all", 0, ssimv);
+        set_meta(metadata, d, "ssim.db", 0, ssim_db(ssimv, 1.0));
+    }
+
+    if (s->metrics & METRIC_VIF) {
+        for (int i = 0; i < VIF_SCALES; i++) {
+            double num = 0., den = 0., score;
+            char key[16];
+
+            for (int j = 0; j < s->nb_slices; j++) {
+                num += scores[j].vif_num[i];
+                den += scores[j].vif_den[i];
+            }
+            score = den <= FLT_EPSILON ? 1. : num / den;
+
+            st->vif_min[i]  = FFMIN(st->vif_min[i], score);
+            st->vif_max[i]  = FFMAX(st->vif_max[i], score);
+            st->vif_sum[i] += score;
+
+            snprintf(key, sizeof(key), "vif.scale.%d", i);
+            set_meta(metadata, d, key, 0, score);
+        }
+    }
+}
+
+static int process_frame(FFFrameSync *fs)
+{
+    AVFilterContext *ctx = fs->parent;
+    QualityMetricsContext *s = fs->opaque;
+    AVFilterLink *outlink = ctx->outputs[0];
+    AVFrame *ref, **dists = s->dists;
+    ThreadData td;
+    int ret;
+
+    if ((ret = ff_framesync_get_frame(fs, 0, &ref, 1)) < 0)
+        return ret;
+    ref->pts = av_rescale_q(s->fs.pts, s->fs.time_base, outlink->time_base);
+
+    if (ctx->is_disabled)
+        return ff_filter_frame(outlink, ref);
+
+    for (int i = 0; i < s->nb_dists; i++) {
+        if ((ret = ff_framesync_get_frame(fs, i + 1, &dists[i], 0)) < 0) {
+            av_frame_free(&ref);
+            return ret;
+        }
+    }
+
+    td.ref = ref;
+    td.dists = dists;
+
+    ctx->internal->execute(ctx, ref_stats, &td, NULL, s->nb_threads);
+    ctx->internal->execute(ctx, dist_stats, &td, NULL, s->nb_jobs);
+
+    if (s->metrics & METRIC_VIF) {
+        for (int scale = 0; scale < VIF_SCALES; scale++) {
+            td.scale = scale;
+            ctx->internal->execute(ctx, vif_ref_scale, &td, NULL, s->nb_threads);
+            ctx->internal->execute(ctx, vif_dist_scale, &td, NULL, s->nb_jobs);
+        }
+    }
+
+    for (int i = 0; i < s->nb_dists; i++) {
+        if (dists[i])
+            update_stats(ctx, i, &ref->metadata);
+    }
+    s->nb_frames++;
+
+    return ff_filter_frame(outlink, ref);
+}
+
+static av_cold int init(AVFilterContext *ctx)
+{
+    QualityMetricsContext *s = ctx->priv;
+    AVFilterPad pad = { 0 };
+    int ret;
+
+    if (!s->metrics) {
+        av_log(ctx, AV_LOG_ERROR, "No metrics selected.\n");
+        return AVERROR(EINVAL);
+    }
+
+    pad.type = AVMEDIA_TYPE_VIDEO;
+    pad.name = av_strdup("reference");
+    if (!pad.name)
+        return AVERROR(ENOMEM);
+    if ((ret = ff_insert_inpad(ctx, 0, &pad)) < 0) {
+        av_freep(&pad.name);
+        return ret;
+    }
+
+    for (int i = 0; i < s->nb_dists; i++) {
+        pad.name = av_asprintf("dist%d", i);
+        if (!pad.name)
+            return AVERROR(ENOMEM);
+
+        if ((ret = ff_insert_inpad(ctx, i + 1, &pad)) < 0) {
+            av_freep(&pad.name);
+            return ret;
+        }
+    }
+
+    s->stats = av_calloc(s->nb_dists, sizeof(*s->stats));
+    if (!s->stats)
+        return AVERROR(ENOMEM);
+
+    for (int i = 0; i < s->nb_dists; i++) {
+        InputStats *st = &s->stats[i];
+
+        st->min_mse = +INFINITY;
+        st->max_mse = -INFINITY;
+        for (int j = 0; j < VIF_SCALES; j++) {
+            st->vif_min[j] =  DBL_MAX;
+            st->vif_max[j] = -DBL_MAX;
+        }
+    }
+
+    return 0;
+}
+
+static int query_formats(AVFilterContext *ctx)
+{
+    static const enum AVPixelFormat pix_fmts[] = {
+        AV_PIX_FMT_GRAY8, AV_PIX_FMT_GRAY9, AV_PIX_FMT_GRAY10,
+        AV_PIX_FMT_GRAY12, AV_PIX_FMT_GRAY14, AV_PIX_FMT_GRAY16,
+        AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P, AV_PIX_FMT_YUV444P,
+        AV_PIX_FMT_YUV440P, AV_PIX_FMT_YUV411P, AV_PIX_FMT_YUV410P,
+        AV_PIX_FMT_YUVJ411P, AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_YUVJ422P,
+        AV_PIX_FMT_YUVJ440P, AV_PIX_FMT_YUVJ444P,
+        AV_PIX_FMT_GBRP,
+#define PF(suf) AV_PIX_FMT_YUV420##suf,  AV_PIX_FMT_YUV422##suf,  AV_PIX_FMT_YUV444##suf, AV_PIX_FMT_GBR##suf
+        PF(P9), PF(P10), PF(P12), PF(P14), PF(P16),
+        AV_PIX_FMT_NONE
+    };
+
+    AVFilterFormats *fmts_list = ff_make_format_list(pix_fmts);
+    if (!fmts_list)
+        return AVERROR(ENOMEM);
+    return ff_set_common_formats(ctx, fmts_list);
+}
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    QualityMetricsContext *s = ctx->priv;
+    AVFilterLink *reflink = ctx->inputs[0];
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(reflink->format);
+    FFFrameSyncIn *in;
+    double average_max;
+    unsigned sum;
+    int ret;
+
+    for (int i = 1; i < ctx->nb_inputs; i++) {
+        if (ctx->inputs[i]->w != reflink->w || ctx->inputs[i]->h != reflink->h) {
+            av_log(ctx, AV_LOG_ERROR, "Input %d size (%dx%d) does not match reference size (%dx%d).\n",
+                   i - 1, ctx->inputs[i]->w, ctx->inputs[i]->h, reflink->w, reflink->h);
+            return AVERROR(EINVAL);
+        }
+        if (ctx->inputs[i]->format != reflink->format) {
+            av_log(ctx, AV_LOG_ERROR, "Inputs must be of same pixel format.\n");
+            return AVERROR(EINVAL);
+        }
+    }
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->nb_slices = FFMAX(1, (s->nb_threads + s->nb_dists - 1) / s->nb_dists);
+    s->nb_jobs = s->nb_dists * s->nb_slices;
+    s->nb_temps = FFMAX(s->nb_threads, s->nb_jobs);
+    s->nb_components = desc->nb_components;
+    s->depth = desc->comp[0].depth;
+
+    s->is_rgb = ff_fill_rgba_map(s->rgba_map, reflink->format) >= 0;
+    s->comps[0] = s->is_rgb ? 'r' : 'y';
+    s->comps[1] = s->is_rgb ? 'g' : 'u';
+    s->comps[2] = s->is_rgb ? 'b' : 'v';
+    s->comps[3] = 'a';
+
+    if (s->is_rgb && (s->metrics & METRIC_VIF)) {
+        av_log(ctx, AV_LOG_ERROR, "VIF is only supported for gray and YUV inputs.\n");
+        return AVERROR(EINVAL);
+    }
+
+    s->planeheight[1] = s->planeheight[2] = AV_CEIL_RSHIFT(reflink->h, desc->log2_chroma_h);
+    s->planeheight[0] = s->planeheight[3] = reflink->h;
+    s->planewidth[1]  = s->planewidth[2]  = AV_CEIL_RSHIFT(reflink->w, desc->log2_chroma_w);
+    s->planewidth[0]  = s->planewidth[3]  = reflink->w;
+    sum = 0;
+    for (int j = 0; j < s->nb_components; j++) {
+        s->max[j] = (1 << desc->comp[j].depth) - 1;
+        sum += s->planeheight[j] * s->planewidth[j];
+    }
+    average_max = 0;
+    for (int j = 0; j < s->nb_components; j++) {
+        s->planeweight[j] = (double) s->planeheight[j] * s->planewidth[j] / sum;
+        average_max += s->max[j] * s->planeweight[j];
+    }
+    s->average_max = lrint(average_max);
+
+    s->psnr_dsp.sse_line = s->depth > 8 ? sse_line_16bit : sse_line_8bit;
+    if (ARCH_X86)
+        ff_psnr_init_x86(&s->psnr_dsp, s->depth);
+
+    s->dists = av_calloc(s->nb_dists, sizeof(*s->dists));
+    s->scores = av_calloc(s->nb_jobs, sizeof(*s->scores));
+    s->temp = av_calloc(s->nb_temps, sizeof(*s->temp));
+    s->ssim_temp = av_calloc(s->nb_temps, sizeof(*s->ssim_temp));
+    if (!s->dists || !s->scores || !s->temp || !s->ssim_temp)
+        return AVERROR(ENOMEM);
+
+    for (int t = 0; t < s->nb_temps; t++) {
+        if (!(s->temp[t] = av_calloc(reflink->w, 6 * sizeof(float))))
+            return AVERROR(ENOMEM);
+        if (!(s->ssim_temp[t] = av_calloc(2 * SUM_LEN(reflink->w), sizeof(int64_t[3]))))
+            return AVERROR(ENOMEM);
+    }
+
+    if (s->metrics & METRIC_SSIM) {
+        for (int c = 0; c < s->nb_components; c++) {
+            s->ref_sums[c] = av_calloc((s->planewidth[c] >> 2) * (s->planeheight[c] >> 2) + 1,
+                                       sizeof(*s->ref_sums[c]));
+            if (!s->ref_sums[c])
+                return AVERROR(ENOMEM);
+        }
+    }
+
+    if (s->metrics & METRIC_VIF) {
+        int pyr_size = 0;
+
+        s->vif_factor = 1.f / (1 << (s->depth - 8));
+        s->vif_w[0] = reflink->w;
+        s->vif_h[0] = reflink->h;
+        for (int i = 1; i < VIF_SCALES; i++) {
+            s->vif_w[i] = s->vif_w[i - 1] / 2;
+            s->vif_h[i] = s->vif_h[i - 1] / 2;
+        }
+
+        for (int i = 0; i < VIF_SCALES; i++) {
+            const int size = s->vif_w[i] * s->vif_h[i];
+
+            if (!(s->ref_pyr[i]     = av_calloc(size, sizeof(float))) ||
+                !(s->ref_mu[i]      = av_calloc(size, sizeof(float))) ||
+                !(s->ref_sq_filt[i] = av_calloc(size, sizeof(float))))
+                return AVERROR(ENOMEM);
+            pyr_size += size;
+        }
+
+        s->dist_pyr = av_calloc(s->nb_dists, sizeof(*s->dist_pyr));
+        if (!s->dist_pyr)
+            return AVERROR(ENOMEM);
+        for (int i = 0; i < s->nb_dists; i++) {
+            if (!(s->dist_pyr[i] = av_calloc(pyr_size, sizeof(float))))
+                return AVERROR(ENOMEM);
+        }
+    }
+
+    if ((ret = ff_framesync_init(&s->fs, ctx, ctx->nb_inputs)) < 0)
+        return ret;
+
+    in = s->fs.in;
+    in[0].time_base = reflink->time_base;
+    in[0].sync   = 2;
+    in[0].before = EXT_STOP;
+    in[0].after  = EXT_INFINITY;
+    for (int i = 1; i < ctx->nb_inputs; i++) {
+        in[i].time_base = ctx->inputs[i]->time_base;
+        in[i].sync   = 1;
+        in[i].before = EXT_NULL;
+        in[i].after  = EXT_INFINITY;
+    }
+    s->fs.opaque   = s;
+    s->fs.on_event = process_frame;
+
+    outlink->w = reflink->w;
+    outlink->h = reflink->h;
+    outlink->sample_aspect_ratio = reflink->sample_aspect_ratio;
+    outlink->frame_rate = reflink->frame_rate;
+
+    if ((ret = ff_framesync_configure(&s->fs)) < 0)
+        return ret;
+
+    outlink->time_base = s->fs.time_base;
+
+    return 0;
+}
+
+static int activate(AVFilterContext *ctx)
+{
+    QualityMetricsContext *s = ctx->priv;
+    return ff_framesync_activate(&s->fs);
+}
+
+static void write_summary(AVFilterContext *ctx, FILE *f)
+{
+    QualityMetricsContext *s = ctx->priv;
+
+    fprintf(f, "{\n");
+    fprintf(f, "    \"frames\": %"PRIu64",\n", s->nb_frames);
+    fprintf(f, "    \"inputs\": [\n");
+    for (int i = 0; i < s->nb_dists; i++) {
+        const InputStats *st = &s->stats[i];
+        const uint64_t n = st->nb_frames;
+
+        fprintf(f, "        {\n");
+        fprintf(f, "            \"input\": %d,\n", i);
+        fprintf(f, "            \"frames\": %"PRIu64, n);
+        if (n && (s->metrics & METRIC_PSNR)) {
+            fprintf(f, ",\n            \"psnr\": {");
+            for (int j = 0; j < s->nb_components; j++) {
+                int c = s->is_rgb ? s->rgba_map[j] : j;
+                fprintf(f, " \"%c\": %f,", s->comps[j],
+                        get_psnr(st->mse_comp[c], n, s->max[c]));
+            }
+            fprintf(f, " \"average\": %f, \"min\": %f, \"max\": %f }",
+                    get_psnr(st->mse, n, s->average_max),
+                    get_psnr(st->max_mse, 1, s->average_max),
+                    get_psnr(st->min_mse, 1, s->average_max));
+        }
+        if (n && (s->metrics & METRIC_SSIM)) {
+            fprintf(f, ",\n            \"ssim\": {");
+            for (int j = 0; j < s->nb_components; j++) {
+                int c = s->is_rgb ? s->rgba_map[j] : j;
+                fprintf(f, " \"%c\": %f,", s->comps[j], st->ssim[c] / n);
+            }
+            fprintf(f, " \"all\": %f, \"db\": %f }",
+                    st->ssim_total / n, ssim_db(st->ssim_total, n));
+        }
+        if (n && (s->metrics & METRIC_VIF)) {
+            fprintf(f, ",\n            \"vif\": [");
+            for (int j = 0; j < VIF_SCALES; j++)
+                fprintf(f, "%s { \"average\": %f, \"min\": %f, \"max\": %f }",
+                        j ? "," : "", st->vif_sum[j] / n, st->vif_min[j], st->vif_max[j]);
+            fprintf(f, " ]");
+        }
+        fprintf(f, "\n        }%s\n", i + 1 < s->nb_dists ? "," : "");
+    }
+    fprintf(f, "    ]\n");
+    fprintf(f, "}\n");
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    QualityMetricsContext *s = ctx->priv;
+
+    for (int i = 0; i < s->nb_dists && s->stats; i++) {
+        const InputStats *st = &s->stats[i];
+        char buf[256];
+
+        if (!st->nb_frames)
+            continue;
+
+        if (s->metrics & METRIC_PSNR) {
+            buf[0] = 0;
+            for (int j = 0; j < s->nb_components; j++) {
+                int c = s->is_rgb ? s->rgba_map[j] : j;
+                av_strlcatf(buf, sizeof(buf), " %c:%f", s->comps[j],
+                            get_psnr(st->mse_comp[c], st->nb_frames, s->max[c]));
+            }
+            av_log(ctx, AV_LOG_INFO, "Input %d PSNR%s average:%f min:%f max:%f\n",
+                   i, buf,
+                   get_psnr(st->mse, st->nb_frames, s->average_max),
+                   get_psnr(st->max_mse, 1, s->average_max),
+                   get_psnr(st->min_mse, 1, s->average_max));
+        }
+
+        if (s->metrics & METRIC_SSIM) {
+            buf[0] = 0;
+            for (int j = 0; j < s->nb_components; j++) {
+                int c = s->is_rgb ? s->rgba_map[j] : j;
+                av_strlcatf(buf, sizeof(buf), " %c:%f (%f)", s->comps[j],
+                            st->ssim[c] / st->nb_frames, ssim_db(st->ssim[c], st->nb_frames));
+            }
+            av_log(ctx, AV_LOG_INFO, "Input %d SSIM%s All:%f (%f)\n", i, buf,
+                   st->ssim_total / st->nb_frames, ssim_db(st->ssim_total, st->nb_frames));
+        }
+
+        if (s->metrics & METRIC_VIF) {
+            for (int j = 0; j < VIF_SCALES; j++)
+                av_log(ctx, AV_LOG_INFO, "Input %d VIF scale=%d average:%f min:%f: max:%f\n",
+                       i, j, st->vif_sum[j] / st->nb_frames, st->vif_min[j], st->vif_max[j]);
+        }
+    }
+
+    if (s->summary_file_str && s->nb_frames) {
+        FILE *f = stdout;
+
+        if (strcmp(s->summary_file_str, "-"))
+            f = fopen(s->summary_file_str, "w");
+        if (f) {
+            write_summary(ctx, f);
+            if (f != stdout)
+                fclose(f);
+        } else {
+            int err = AVERROR(errno);
+            char buf[128];
+            av_strerror(err, buf, sizeof(buf));
+            av_log(ctx, AV_LOG_ERROR, "Could not open summary file %s: %s\n",
+                   s->summary_file_str, buf);
+        }
+    }
+
+    ff_framesync_uninit(&s->fs);
+
+    for (int t = 0; t < s->nb_temps && s->temp; t++)
+        av_freep(&s->temp[t]);
+    for (int t = 0; t < s->nb_temps && s->ssim_temp; t++)
+        av_freep(&s->ssim_temp[t]);
+    av_freep(&s->temp);
+    av_freep(&s->ssim_temp);
+    av_freep(&s->scores);
+    av_freep(&s->dists);
+
+    for (int c = 0; c < 4; c++)
+        av_freep(&s->ref_sums[c]);
+
+    for (int i = 0; i < VIF_SCALES; i++) {
+        av_freep(&s->ref_pyr[i]);
+        av_freep(&s->ref_mu[i]);
+        av_freep(&s->ref_sq_filt[i]);
+    }
+    for (int i = 0; i < s->nb_dists && s->dist_pyr; i++)
+        av_freep(&s->dist_pyr[i]);
+    av_freep(&s->dist_pyr);
+
+    av_freep(&s->stats);
+
+    for (int i = 0; i < ctx->nb_inputs; i++)
+        av_freep(&ctx->input_pads[i].name);
+}
+
+static const AVFilterPad qualitymetrics_outputs[] = {
+    {
+        .name          = "default",
+        .type          = AVMEDIA_TYPE_VIDEO,
+        .config_props  = config_output,
+    },
+    { NULL }
+};
+
+AVFilter ff_vf_qualitymetrics = {
+    .name          = "qualitymetrics",
+    .description   = NULL_IF_CONFIG_SMALL("Calculate PSNR, SSIM and VIF between a reference and several distorted video streams."),
+    .preinit       = qualitymetrics_framesync_preinit,
+    .init          = init,
+    .uninit        = uninit,
+    .query_formats = query_formats,
+    .activate      = activate,
+    .priv_size     = sizeof(QualityMetricsContext),
+    .priv_class    = &qualitymetrics_class,
+    .outputs       = qualitymetrics_outputs,
+    .flags         = AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL |
+                     AVFILTER_FLAG_SLICE_THREADS,
+};
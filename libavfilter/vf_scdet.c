@@ -44,6 +44,7 @@ typedef struct SCDetContext {
     AVFrame *prev_picref;
     double threshold;
     int sc_pass;
+    int step;
 } SCDetContext;
 
 #define OFFSET(x) offsetof(SCDetContext, x)
@@ -55,6 +56,7 @@ static const AVOption scdet_options[] = {
     { "t",           "set scene change detect threshold",        OFFSET(threshold),  AV_OPT_TYPE_DOUBLE,   {.dbl = 10.},     0,  100., V|F },
     { "sc_pass",     "Set the flag to pass scene change frames", OFFSET(sc_pass),    AV_OPT_TYPE_BOOL,     {.dbl =  0  },    0,    1,  V|F },
     { "s",           "Set the flag to pass scene change frames", OFFSET(sc_pass),    AV_OPT_TYPE_BOOL,     {.dbl =  0  },    0,    1,  V|F },
+    { "step",        "set the line step used for detection",     OFFSET(step),       AV_OPT_TYPE_INT,      {.i64 =  1  },    1,   64,  V|F },
     {NULL}
 };
 
@@ -121,18 +123,11 @@ static double get_scene_score(AVFilterContext *ctx, AVFrame *frame)
 
     if (prev_picref && frame->height == prev_picref->height
                     && frame->width  == prev_picref->width) {
-        uint64_t sad = 0;
+        uint64_t sad, count;
         double mafd, diff;
-        uint64_t count = 0;
-
-        for (int plane = 0; plane < s->nb_planes; plane++) {
-            uint64_t plane_sad;
-            s->sad(prev_picref->data[plane], prev_picref->linesize[plane],
-                    frame->data[plane], frame->linesize[plane],
-                    s->width[plane], s->height[plane], &plane_sad);
-            sad += plane_sad;
-            count += s->width[plane] * s->height[plane];
-        }
+
+        sad = ff_scene_sad_frames(ctx, s->sad, prev_picref, frame, s->nb_planes,
+                                  s->width, s->height, s->step, &count);
 
         emms_c();
         mafd = (double)sad * 100. / count / (1ULL << s->bitdepth);
@@ -221,4 +216,5 @@ AVFilter ff_vf_scdet = {
     .inputs        = scdet_inputs,
     .outputs       = scdet_outputs,
     .activate      = activate,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
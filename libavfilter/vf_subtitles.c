@@ -36,6 +36,7 @@
 #endif
 #include "libavutil/avstring.h"
 #include "libavutil/imgutils.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
 #include "libavutil/parseutils.h"
 #include "drawutils.h"
@@ -60,6 +61,18 @@ typedef struct AssContext {
     int original_w, original_h;
     int shaping;
     FFDrawContext draw;
+
+    /**
+     * The images of the last rendered frame composited into one layer, in
+     * the format of the output and premultiplied by their alpha. A pixel
+     * is blended as dst * trans + value, for each component of a plane.
+     */
+    float *layer_value[4];     ///< premultiplied components, pixelstep per pixel
+    float *layer_trans[4];     ///< transparency left by the images
+    unsigned int layer_value_size[4], layer_trans_size[4];
+    int layer_x, layer_y;      ///< position of the layer, aligned to the subsampling
+    int layer_w, layer_h;      ///< size of the layer, 0 if it is empty
+    int layer_valid;           ///< set if the layer matches the last rendered frame
 } AssContext;
 
 #define OFFSET(x) offsetof(AssContext, x)
@@ -131,6 +144,10 @@ static av_cold void uninit(AVFilterContext *ctx)
         ass_renderer_done(ass->renderer);
     if (ass->library)
         ass_library_done(ass->library);
+    for (int i = 0; i < 4; i++) {
+        av_freep(&ass->layer_value[i]);
+        av_freep(&ass->layer_trans[i]);
+    }
 }
 
 static int query_formats(AVFilterContext *ctx)
@@ -151,6 +168,8 @@ static int config_input(AVFilterLink *inlink)
     if (ass->shaping != -1)
         ass_set_shaper(ass->renderer, ass->shaping);
 
+    ass->layer_valid = 0;
+
     return 0;
 }
 
@@ -160,19 +179,199 @@ static int config_input(AVFilterLink *inlink)
 #define AB(c)  (((c)>>8) &0xFF)
 #define AA(c)  ((0xFF-(c)) &0xFF)
 
-static void overlay_ass_image(AssContext *ass, AVFrame *picref,
-                              const ASS_Image *image)
+static int get_nb_planes(const FFDrawContext *draw)
+{
+    int nb_planes = draw->nb_planes - !!(draw->desc->flags & AV_PIX_FMT_FLAG_ALPHA &&
+                                         !(draw->flags & FF_DRAW_PROCESS_ALPHA));
+    return FFMAX(nb_planes, 1);
+}
+
+/**
+ * Composite an image over the layer, with the same coverage of the
+ * subsampled planes as ff_blend_mask().
+ */
+static void composite_image(AssContext *ass, const ASS_Image *image, int w, int h)
+{
+    const FFDrawContext *draw = &ass->draw;
+    const int x0 = FFMAX(image->dst_x, 0), x1 = FFMIN(image->dst_x + image->w, w);
+    const int y0 = FFMAX(image->dst_y, 0), y1 = FFMIN(image->dst_y + image->h, h);
+    uint8_t rgba_color[] = {AR(image->color), AG(image->color), AB(image->color), AA(image->color)};
+    FFDrawColor color;
+
+    if (x0 >= x1 || y0 >= y1 || !rgba_color[3])
+        return;
+    ff_draw_color(&ass->draw, &color, rgba_color);
+
+    for (int plane = 0; plane < get_nb_planes(draw); plane++) {
+        const int hsub = draw->hsub[plane], vsub = draw->vsub[plane];
+        const int step = draw->pixelstep[plane];
+        const int depth = draw->desc->comp[0].depth;
+        const int layer_w = AV_CEIL_RSHIFT(ass->layer_x + ass->layer_w, hsub) - (ass->layer_x >> hsub);
+        const float scale = rgba_color[3] / (255.f * 255.f * (1 << (hsub + vsub)));
+        float comp_value[8];
+
+        for (int comp = 0; comp < step; comp++)
+            comp_value[comp] = depth <= 8 ? color.comp[plane].u8[comp] : color.comp[plane].u16[comp];
+
+        for (int ys = y0 >> vsub; ys <= (y1 - 1) >> vsub; ys++) {
+            const int my0 = FFMAX(ys << vsub, y0), my1 = FFMIN((ys + 1) << vsub, y1);
+            float *trans = ass->layer_trans[plane] + (ys - (ass->layer_y >> vsub)) * layer_w;
+            float *value = ass->layer_value[plane] + (ys - (ass->layer_y >> vsub)) * layer_w * step;
+
+            for (int xs = x0 >> hsub; xs <= (x1 - 1) >> hsub; xs++) {
+                const int mx0 = FFMAX(xs << hsub, x0), mx1 = FFMIN((xs + 1) << hsub, x1);
+                const int i = xs - (ass->layer_x >> hsub);
+                unsigned sum = 0;
+                float a;
+
+                for (int my = my0; my < my1; my++)
+                    for (int mx = mx0; mx < mx1; mx++)
+                        sum += image->bitmap[(my - image->dst_y) * image->stride + mx - image->dst_x];
+                if (!sum)
+                    continue;
+
+                a = sum * scale;
+                trans[i] *= 1.f - a;
+                for (int comp = 0; comp < step; comp++) {
+                    if (draw->comp_mask[plane] >> comp & 1)
+                        value[i * step + comp] = value[i * step + comp] * (1.f - a) + comp_value[comp] * a;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Composite the images into the layer, over the bounding box of the images.
+ */
+static int build_layer(AssContext *ass, const ASS_Image *image, int w, int h)
+{
+    const FFDrawContext *draw = &ass->draw;
+    const int halign = 1 << draw->hsub_max, valign = 1 << draw->vsub_max;
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    const ASS_Image *img;
+
+    ass->layer_valid = 0;
+    for (img = image; img; img = img->next) {
+        if (img->w <= 0 || img->h <= 0)
+            continue;
+        x0 = FFMIN(x0, img->dst_x);
+        y0 = FFMIN(y0, img->dst_y);
+        x1 = FFMAX(x1, img->dst_x + img->w);
+        y1 = FFMAX(y1, img->dst_y + img->h);
+    }
+    x0 = FFMAX(x0, 0) & ~(halign - 1);
+    y0 = FFMAX(y0, 0) & ~(valign - 1);
+    x1 = FFMIN(FFALIGN(x1, halign), w);
+    y1 = FFMIN(FFALIGN(y1, valign), h);
+
+    ass->layer_x = x0;
+    ass->layer_y = y0;
+    ass->layer_w = FFMAX(x1 - x0, 0);
+    ass->layer_h = FFMAX(y1 - y0, 0);
+    if (!ass->layer_w || !ass->layer_h) {
+        ass->layer_w = ass->layer_h = 0;
+        ass->layer_valid = 1;
+        return 0;
+    }
+
+    for (int plane = 0; plane < get_nb_planes(draw); plane++) {
+        const int layer_w = AV_CEIL_RSHIFT(x1, draw->hsub[plane]) - (x0 >> draw->hsub[plane]);
+        const int layer_h = AV_CEIL_RSHIFT(y1, draw->vsub[plane]) - (y0 >> draw->vsub[plane]);
+        const size_t size = (size_t)layer_w * layer_h;
+
+        av_fast_malloc(&ass->layer_value[plane], &ass->layer_value_size[plane],
+                       size * draw->pixelstep[plane] * sizeof(*ass->layer_value[plane]));
+        av_fast_malloc(&ass->layer_trans[plane], &ass->layer_trans_size[plane],
+                       size * sizeof(*ass->layer_trans[plane]));
+        if (!ass->layer_value[plane] || !ass->layer_trans[plane])
+            return AVERROR(ENOMEM);
+
+        memset(ass->layer_value[plane], 0, size * draw->pixelstep[plane] * sizeof(*ass->layer_value[plane]));
+        for (size_t i = 0; i < size; i++)
+            ass->layer_trans[plane][i] = 1.f;
+    }
+
+    for (img = image; img; img = img->next)
+        composite_image(ass, img, w, h);
+
+    ass->layer_valid = 1;
+    return 0;
+}
+
+static int blend_layer_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    for (; image; image = image->next) {
-        uint8_t rgba_color[] = {AR(image->color), AG(image->color), AB(image->color), AA(image->color)};
-        FFDrawColor color;
-        ff_draw_color(&ass->draw, &color, rgba_color);
-        ff_blend_mask(&ass->draw, &color,
-                      picref->data, picref->linesize,
-                      picref->width, picref->height,
-                      image->bitmap, image->stride, image->w, image->h,
-                      3, 0, image->dst_x, image->dst_y);
+    AssContext *ass = ctx->priv;
+    const FFDrawContext *draw = &ass->draw;
+    AVFrame *picref = arg;
+    /* subsampled chroma rows must not be split between jobs */
+    const int align = 1 << draw->vsub_max;
+    const int y_start = ass->layer_y, y_end = ass->layer_y + ass->layer_h;
+    int slice_start = y_start + (ass->layer_h *  jobnr   ) / nb_jobs;
+    int slice_end   = y_start + (ass->layer_h * (jobnr+1)) / nb_jobs;
+
+    slice_start = jobnr ? FFMAX(slice_start & ~(align - 1), y_start) : y_start;
+    slice_end   = jobnr < nb_jobs - 1 ? FFMAX(slice_end & ~(align - 1), y_start) : y_end;
+
+    for (int plane = 0; plane < get_nb_planes(draw); plane++) {
+        const int hsub = draw->hsub[plane], vsub = draw->vsub[plane];
+        const int step = draw->pixelstep[plane];
+        const int depth = draw->desc->comp[0].depth;
+        const int layer_x = ass->layer_x >> hsub, layer_y = ass->layer_y >> vsub;
+        const int layer_w = AV_CEIL_RSHIFT(ass->layer_x + ass->layer_w, hsub) - layer_x;
+        const int ys_end = AV_CEIL_RSHIFT(slice_end, vsub);
+
+        for (int ys = slice_start >> vsub; ys < ys_end; ys++) {
+            const float *trans = ass->layer_trans[plane] + (ys - layer_y) * layer_w;
+            const float *value = ass->layer_value[plane] + (ys - layer_y) * layer_w * step;
+            uint8_t *dst = picref->data[plane] + ys * picref->linesize[plane] + layer_x * step;
+
+            if (depth > 8) {
+                /* components are addressed by their byte offset, as in drawutils */
+                for (int x = 0; x < layer_w; x++) {
+                    for (int comp = 0; comp < step; comp++) {
+                        uint8_t *p = dst + x * step + comp;
+                        if (draw->comp_mask[plane] >> comp & 1)
+                            AV_WL16(p, AV_RL16(p) * trans[x] + value[x * step + comp] + 0.5f);
+                    }
+                }
+            } else if (step == 1) {
+                for (int x = 0; x < layer_w; x++)
+                    dst[x] = dst[x] * trans[x] + value[x] + 0.5f;
+            } else {
+                for (int x = 0; x < layer_w; x++) {
+                    for (int comp = 0; comp < step; comp++) {
+                        if (draw->comp_mask[plane] >> comp & 1)
+                            dst[x * step + comp] = dst[x * step + comp] * trans[x] + value[x * step + comp] + 0.5f;
+                    }
+                }
+            }
+        }
     }
+    return 0;
+}
+
+static int overlay_ass_image(AVFilterContext *ctx, AVFrame *picref,
+                             const ASS_Image *image, int detect_change)
+{
+    AssContext *ass = ctx->priv;
+    int ret;
+
+    if (!image) {
+        ass->layer_valid = 0;
+        return 0;
+    }
+
+    if (detect_change || !ass->layer_valid) {
+        if ((ret = build_layer(ass, image, picref->width, picref->height)) < 0)
+            return ret;
+    }
+    if (!ass->layer_h)
+        return 0;
+
+    ctx->internal->execute(ctx, blend_layer_slice, picref, NULL,
+                           FFMAX(1, FFMIN(ass->layer_h / 16, ff_filter_get_nb_threads(ctx))));
+    return 0;
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *picref)
@@ -184,11 +383,16 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *picref)
     double time_ms = picref->pts * av_q2d(inlink->time_base) * 1000;
     ASS_Image *image = ass_render_frame(ass->renderer, ass->track,
                                         time_ms, &detect_change);
+    int ret;
 
     if (detect_change)
         av_log(ctx, AV_LOG_DEBUG, "Change happened at time ms:%f\n", time_ms);
 
-    overlay_ass_image(ass, picref, image);
+    ret = overlay_ass_image(ctx, picref, image, detect_change);
+    if (ret < 0) {
+        av_frame_free(&picref);
+        return ret;
+    }
 
     return ff_filter_frame(outlink, picref);
 }
@@ -256,6 +460,7 @@ AVFilter ff_vf_ass = {
     .inputs        = ass_inputs,
     .outputs       = ass_outputs,
     .priv_class    = &ass_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
 #endif
 
@@ -490,5 +695,6 @@ AVFilter ff_vf_subtitles = {
     .inputs        = ass_inputs,
     .outputs       = ass_outputs,
     .priv_class    = &subtitles_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
 #endif
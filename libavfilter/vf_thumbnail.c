@@ -34,6 +34,12 @@
 
 #define HIST_SIZE (3*256)
 
+enum ThumbMode {
+    MODE_BATCH,
+    MODE_STREAM,
+    NB_MODES
+};
+
 struct thumb_frame {
     AVFrame *buf;               ///< cached frame
     int histogram[HIST_SIZE];   ///< RGB color distribution histogram of the frame
@@ -45,6 +51,15 @@ typedef struct ThumbContext {
     int n_frames;               ///< number of frames for analysis
     struct thumb_frame *frames; ///< the n_frames frames
     AVRational tb;              ///< copy of the input timebase to ease access
+    int step;                   ///< pixel sampling step, horizontally and vertically
+    int mode;                   ///< ThumbMode
+
+    int64_t hist_sum[HIST_SIZE];///< running histogram sum (stream mode)
+    int cur_hist[HIST_SIZE];    ///< histogram of the current frame (stream mode)
+    int best_idx;               ///< index of the candidate in the batch (stream mode)
+
+    int nb_threads;
+    int *thread_histogram;      ///< per job histograms, nb_threads * HIST_SIZE
 
     int planewidth[4];
     int planeheight[4];
@@ -55,6 +70,10 @@ typedef struct ThumbContext {
 
 static const AVOption thumbnail_options[] = {
     { "n", "set the frames batch size", OFFSET(n_frames), AV_OPT_TYPE_INT, {.i64=100}, 2, INT_MAX, FLAGS },
+    { "step", "set the pixel sampling step", OFFSET(step), AV_OPT_TYPE_INT, {.i64=1}, 1, 64, FLAGS },
+    { "mode", "set the selection mode", OFFSET(mode), AV_OPT_TYPE_INT, {.i64=MODE_BATCH}, 0, NB_MODES-1, FLAGS, "mode" },
+        { "batch",  "keep the whole batch and pick the frame closest to its average", 0, AV_OPT_TYPE_CONST, {.i64=MODE_BATCH},  0, 0, FLAGS, "mode" },
+        { "stream", "keep only the best candidate so far",                            0, AV_OPT_TYPE_CONST, {.i64=MODE_STREAM}, 0, 0, FLAGS, "mode" },
     { NULL }
 };
 
@@ -64,7 +83,8 @@ static av_cold int init(AVFilterContext *ctx)
 {
     ThumbContext *s = ctx->priv;
 
-    s->frames = av_calloc(s->n_frames, sizeof(*s->frames));
+    // the stream mode only ever holds one candidate
+    s->frames = av_calloc(s->mode == MODE_STREAM ? 1 : s->n_frames, sizeof(*s->frames));
     if (!s->frames) {
         av_log(ctx, AV_LOG_ERROR,
                "Allocation failure, try to lower the number of frames\n");
@@ -100,6 +120,19 @@ static AVFrame *get_best_frame(AVFilterContext *ctx)
     int nb_frames = s->n;
     double avg_hist[HIST_SIZE] = {0}, sq_err, min_sq_err = -1;
 
+    if (s->mode == MODE_STREAM) {
+        memset(s->hist_sum, 0, sizeof(s->hist_sum));
+        s->n = 0;
+
+        picref = s->frames[0].buf;
+        av_log(ctx, AV_LOG_INFO, "frame id #%d (pts_time=%f) selected "
+               "from a set of %d images\n", s->best_idx,
+               picref->pts * av_q2d(s->tb), nb_frames);
+        s->frames[0].buf = NULL;
+
+        return picref;
+    }
+
     // average histogram of the N frames
     for (j = 0; j < FF_ARRAY_ELEMS(avg_hist); j++) {
         for (i = 0; i < nb_frames; i++)
@@ -132,69 +165,151 @@ static AVFrame *get_best_frame(AVFilterContext *ctx)
     return picref;
 }
 
-static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
+static int do_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    ThumbContext *s = ctx->priv;
+    AVFrame *frame = arg;
+    int *hist = s->thread_histogram + HIST_SIZE * jobnr;
+    const int step = s->step;
+    const int h = ctx->inputs[0]->h;
+    const int w = ctx->inputs[0]->w;
+    const int nb_rows = (h + step - 1) / step;
+    const int slice_start = (nb_rows *  jobnr     ) / nb_jobs * step;
+    const int slice_end   = FFMIN((nb_rows * (jobnr+1)) / nb_jobs * step, h);
+    const uint8_t *p = frame->data[0] + slice_start * frame->linesize[0];
+    const ptrdiff_t linesize = frame->linesize[0] * step;
     int i, j;
-    AVFilterContext *ctx  = inlink->dst;
-    ThumbContext *s   = ctx->priv;
-    AVFilterLink *outlink = ctx->outputs[0];
-    int *hist = s->frames[s->n].histogram;
-    const uint8_t *p = frame->data[0];
 
-    // keep a reference of each frame
-    s->frames[s->n].buf = frame;
+    memset(hist, 0, sizeof(*hist) * HIST_SIZE);
 
-    // update current frame histogram
-    switch (inlink->format) {
+    switch (frame->format) {
     case AV_PIX_FMT_RGB24:
     case AV_PIX_FMT_BGR24:
-        for (j = 0; j < inlink->h; j++) {
-            for (i = 0; i < inlink->w; i++) {
+        for (j = slice_start; j < slice_end; j += step) {
+            for (i = 0; i < w; i += step) {
                 hist[0*256 + p[i*3    ]]++;
                 hist[1*256 + p[i*3 + 1]]++;
                 hist[2*256 + p[i*3 + 2]]++;
             }
-            p += frame->linesize[0];
+            p += linesize;
         }
         break;
     case AV_PIX_FMT_RGB0:
     case AV_PIX_FMT_BGR0:
     case AV_PIX_FMT_RGBA:
     case AV_PIX_FMT_BGRA:
-        for (j = 0; j < inlink->h; j++) {
-            for (i = 0; i < inlink->w; i++) {
+        for (j = slice_start; j < slice_end; j += step) {
+            for (i = 0; i < w; i += step) {
                 hist[0*256 + p[i*4    ]]++;
                 hist[1*256 + p[i*4 + 1]]++;
                 hist[2*256 + p[i*4 + 2]]++;
             }
-            p += frame->linesize[0];
+            p += linesize;
         }
         break;
     case AV_PIX_FMT_0RGB:
     case AV_PIX_FMT_0BGR:
     case AV_PIX_FMT_ARGB:
     case AV_PIX_FMT_ABGR:
-        for (j = 0; j < inlink->h; j++) {
-            for (i = 0; i < inlink->w; i++) {
+        for (j = slice_start; j < slice_end; j += step) {
+            for (i = 0; i < w; i += step) {
                 hist[0*256 + p[i*4 + 1]]++;
                 hist[1*256 + p[i*4 + 2]]++;
                 hist[2*256 + p[i*4 + 3]]++;
             }
-            p += frame->linesize[0];
+            p += linesize;
         }
         break;
     default:
         for (int plane = 0; plane < 3; plane++) {
-            const uint8_t *p = frame->data[plane];
-            for (j = 0; j < s->planeheight[plane]; j++) {
-                for (i = 0; i < s->planewidth[plane]; i++)
+            const int ph = s->planeheight[plane];
+            const int pw = s->planewidth[plane];
+            const int plane_rows = (ph + step - 1) / step;
+            const int start = (plane_rows *  jobnr     ) / nb_jobs * step;
+            const int end   = FFMIN((plane_rows * (jobnr+1)) / nb_jobs * step, ph);
+            const ptrdiff_t plinesize = frame->linesize[plane] * step;
+            const uint8_t *p = frame->data[plane] + start * frame->linesize[plane];
+
+            for (j = start; j < end; j += step) {
+                for (i = 0; i < pw; i += step)
                     hist[256*plane + p[i]]++;
-                p += frame->linesize[plane];
+                p += plinesize;
             }
         }
         break;
     }
 
+    return 0;
+}
+
+static void compute_histogram(AVFilterContext *ctx, AVFrame *frame, int *hist)
+{
+    ThumbContext *s = ctx->priv;
+    const int nb_jobs = FFMIN(s->nb_threads, ctx->inputs[0]->h);
+
+    ctx->internal->execute(ctx, do_slice, frame, NULL, nb_jobs);
+
+    memcpy(hist, s->thread_histogram, sizeof(*hist) * HIST_SIZE);
+    for (int n = 1; n < nb_jobs; n++) {
+        const int *thist = s->thread_histogram + HIST_SIZE * n;
+
+        for (int i = 0; i < HIST_SIZE; i++)
+            hist[i] += thist[i];
+    }
+}
+
+/**
+ * Stream mode: compare the new frame and the current candidate against the
+ * average histogram of the frames seen so far and keep the closest one.
+ */
+static int filter_frame_stream(AVFilterContext *ctx, AVFrame *frame)
+{
+    ThumbContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+    struct thumb_frame *best = &s->frames[0];
+    double avg_hist[HIST_SIZE];
+    int i;
+
+    compute_histogram(ctx, frame, s->cur_hist);
+
+    for (i = 0; i < HIST_SIZE; i++) {
+        s->hist_sum[i] += s->cur_hist[i];
+        avg_hist[i] = (double)s->hist_sum[i] / (s->n + 1);
+    }
+
+    if (!best->buf ||
+        frame_sum_square_err(s->cur_hist, avg_hist) <
+        frame_sum_square_err(best->histogram, avg_hist)) {
+        av_frame_free(&best->buf);
+        best->buf = frame;
+        memcpy(best->histogram, s->cur_hist, sizeof(best->histogram));
+        s->best_idx = s->n;
+    } else {
+        av_frame_free(&frame);
+    }
+
+    s->n++;
+    if (s->n < s->n_frames)
+        return 0;
+
+    return ff_filter_frame(outlink, get_best_frame(ctx));
+}
+
+static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
+{
+    AVFilterContext *ctx  = inlink->dst;
+    ThumbContext *s   = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+
+    if (s->mode == MODE_STREAM)
+        return filter_frame_stream(ctx, frame);
+
+    // keep a reference of each frame
+    s->frames[s->n].buf = frame;
+
+    // update current frame histogram
+    compute_histogram(ctx, frame, s->frames[s->n].histogram);
+
     // no selection until the buffer of N frames is filled up
     s->n++;
     if (s->n < s->n_frames)
@@ -207,9 +322,11 @@ static av_cold void uninit(AVFilterContext *ctx)
 {
     int i;
     ThumbContext *s = ctx->priv;
-    for (i = 0; i < s->n_frames && s->frames && s->frames[i].buf; i++)
+    const int nb_frames = s->mode == MODE_STREAM ? 1 : s->n_frames;
+    for (i = 0; i < nb_frames && s->frames && s->frames[i].buf; i++)
         av_frame_free(&s->frames[i].buf);
     av_freep(&s->frames);
+    av_freep(&s->thread_histogram);
 }
 
 static int request_frame(AVFilterLink *link)
@@ -241,6 +358,12 @@ static int config_props(AVFilterLink *inlink)
     s->planeheight[1] = s->planeheight[2] = AV_CEIL_RSHIFT(inlink->h, desc->log2_chroma_h);
     s->planeheight[0] = s->planeheight[3] = inlink->h;
 
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    av_freep(&s->thread_histogram);
+    s->thread_histogram = av_calloc(HIST_SIZE, s->nb_threads * sizeof(*s->thread_histogram));
+    if (!s->thread_histogram)
+        return AVERROR(ENOMEM);
+
     return 0;
 }
 
@@ -297,5 +420,5 @@ AVFilter ff_vf_thumbnail = {
     .inputs        = thumbnail_inputs,
     .outputs       = thumbnail_outputs,
     .priv_class    = &thumbnail_class,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
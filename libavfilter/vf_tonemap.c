@@ -28,6 +28,7 @@
 #include <string.h>
 
 #include "libavutil/imgutils.h"
+#include "libavutil/intfloat.h"
 #include "libavutil/internal.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
@@ -60,6 +61,51 @@ static const struct LumaCoefficients luma_coefficients[AVCOL_SPC_NB] = {
     [AVCOL_SPC_BT2020_CL]  = { 0.2627, 0.6780, 0.0593 },
 };
 
+static const struct PrimaryCoefficients primaries_table[AVCOL_PRI_NB] = {
+    [AVCOL_PRI_BT709]  = { 0.640, 0.330, 0.300, 0.600, 0.150, 0.060 },
+    [AVCOL_PRI_BT2020] = { 0.708, 0.292, 0.170, 0.797, 0.131, 0.046 },
+};
+
+static const struct WhitepointCoefficients whitepoint_table[AVCOL_PRI_NB] = {
+    [AVCOL_PRI_BT709]  = { 0.3127, 0.3290 },
+    [AVCOL_PRI_BT2020] = { 0.3127, 0.3290 },
+};
+
+#define ST2084_MAX_LUMINANCE 10000.0
+#define ST2084_M1 0.1593017578125
+#define ST2084_M2 78.84375
+#define ST2084_C1 0.8359375
+#define ST2084_C2 18.8515625
+#define ST2084_C3 18.6875
+
+#define HLG_A 0.17883277
+#define HLG_B 0.28466892
+#define HLG_C 0.55991073
+
+/* number of intervals of the transfer function tables */
+#define LIN_LUT_SIZE 4096
+
+// below this signal, the gamma curve is continued linearly to black
+#define GAMMA_KNEE 0.05
+
+/* log2 of the number of intervals of the tone curve table per octave */
+#define TONEMAP_LUT_LOG2_STEPS 8
+/* number of octaves covered by the tone curve table */
+#define TONEMAP_LUT_OCTAVES 32
+/* number of intervals of the tone curve table */
+#define TONEMAP_LUT_SIZE (TONEMAP_LUT_OCTAVES << TONEMAP_LUT_LOG2_STEPS)
+/* float bits of the start of the table, shifted down to the interval index */
+#define TONEMAP_LUT_BASE ((127 - TONEMAP_LUT_OCTAVES) << TONEMAP_LUT_LOG2_STEPS)
+
+enum TonemapRowCoeffs {
+    TONEMAP_COEFF_CR,
+    TONEMAP_COEFF_CG,
+    TONEMAP_COEFF_CB,
+    TONEMAP_COEFF_DESAT,
+    TONEMAP_COEFF_LUT_SCALE,    ///< scale of the signal to the table domain
+    TONEMAP_COEFF_NB,
+};
+
 typedef struct TonemapContext {
     const AVClass *class;
 
@@ -67,8 +113,23 @@ typedef struct TonemapContext {
     double param;
     double desat;
     double peak;
+    int fused;
 
     const struct LumaCoefficients *coeffs;
+
+    float lut[2 * TONEMAP_LUT_SIZE];    ///< value and slope of the tone curve per interval
+    double lut_peak;                    ///< peak the tone curve was built for
+    double lut_scale;                   ///< see TONEMAP_COEFF_LUT_SCALE
+
+    /* fused processing */
+    float lin_lut[LIN_LUT_SIZE + 1];    ///< nonlinear to linear light
+    enum AVColorTransferCharacteristic lin_trc;
+    float ootf_lut[LIN_LUT_SIZE + 1];   ///< HLG OOTF gain, indexed by sqrt(luma / 12)
+    double ootf_peak;
+    float delin_lut[LIN_LUT_SIZE + 1];  ///< linear light to BT.709, indexed by sqrt(signal)
+    float *rgb_buf;                     ///< scratch rows of linear RGB, 6 per job
+    int rgb_stride;
+    int nb_rgb_bufs;
 } TonemapContext;
 
 static const enum AVPixelFormat pix_fmts[] = {
@@ -79,7 +140,84 @@ static const enum AVPixelFormat pix_fmts[] = {
 
 static int query_formats(AVFilterContext *ctx)
 {
-    return ff_set_common_formats(ctx, ff_make_format_list(pix_fmts));
+    static const enum AVPixelFormat fused_in_fmts[]  = { AV_PIX_FMT_YUV420P10, AV_PIX_FMT_NONE };
+    static const enum AVPixelFormat fused_out_fmts[] = { AV_PIX_FMT_YUV420P,   AV_PIX_FMT_NONE };
+    TonemapContext *s = ctx->priv;
+    int ret;
+
+    if (!s->fused)
+        return ff_set_common_formats(ctx, ff_make_format_list(pix_fmts));
+
+    if ((ret = ff_formats_ref(ff_make_format_list(fused_in_fmts),
+                              &ctx->inputs[0]->outcfg.formats)) < 0)
+        return ret;
+    return ff_formats_ref(ff_make_format_list(fused_out_fmts),
+                          &ctx->outputs[0]->incfg.formats);
+}
+
+/**
+ * Start of the interval i of the tone curve table, in the table domain.
+ * The scaled signal covers the table in [2^-TONEMAP_LUT_OCTAVES, 1), each
+ * octave divided into 1 << TONEMAP_LUT_LOG2_STEPS equal intervals.
+ */
+static inline float lut_start(int i)
+{
+    return av_int2float((unsigned)(i + TONEMAP_LUT_BASE) << (23 - TONEMAP_LUT_LOG2_STEPS));
+}
+
+#define MIX(x,y,a) (x) * (1 - (a)) + (y) * (a)
+static av_always_inline void tonemap_row_c(float *dst_r, float *dst_g, float *dst_b,
+                          const float *src_r, const float *src_g, const float *src_b,
+                          const float *lut, const float *coeffs, ptrdiff_t width,
+                          int desat)
+{
+    for (int x = 0; x < width; x++) {
+        float r = src_r[x], g = src_g[x], b = src_b[x];
+        float sig, f, t, gain;
+        int i;
+
+        /* desaturate to prevent unnatural colors */
+        if (desat) {
+            const float luma = coeffs[TONEMAP_COEFF_CR] * r + coeffs[TONEMAP_COEFF_CG] * g +
+                               coeffs[TONEMAP_COEFF_CB] * b;
+            const float overbright = FFMAX(luma - coeffs[TONEMAP_COEFF_DESAT], 1e-6f) /
+                                     FFMAX(luma, 1e-6f);
+            r = MIX(r, luma, overbright);
+            g = MIX(g, luma, overbright);
+            b = MIX(b, luma, overbright);
+        }
+
+        /* pick the brightest component, reducing the value range as necessary
+         * to keep the entire signal in range and preventing discoloration due to
+         * out-of-bounds clipping */
+        sig = FFMAX(FFMAX3(r, g, b), 1e-6f);
+
+        /* interpolate the tone curve, the interval is given by the exponent
+         * and the top mantissa bits of the scaled signal */
+        f = sig * coeffs[TONEMAP_COEFF_LUT_SCALE];
+        i = av_clip((int)(av_float2int(f) >> (23 - TONEMAP_LUT_LOG2_STEPS)) - TONEMAP_LUT_BASE,
+                    0, TONEMAP_LUT_SIZE - 1);
+        t = f - lut_start(i);
+        gain = (lut[2 * i] + t * lut[2 * i + 1]) / sig;
+
+        /* apply the computed scale factor to the color,
+         * linearly to prevent discoloration */
+        dst_r[x] = r * gain;
+        dst_g[x] = g * gain;
+        dst_b[x] = b * gain;
+    }
+}
+
+/* Tone map a row of linear RGB samples, the source and destination may be the same. */
+static void tonemap_row(const TonemapContext *s,
+                        float *dst_r, float *dst_g, float *dst_b,
+                        const float *src_r, const float *src_g, const float *src_b,
+                        const float *coeffs, ptrdiff_t width)
+{
+    if (s->desat > 0)
+        tonemap_row_c(dst_r, dst_g, dst_b, src_r, src_g, src_b, s->lut, coeffs, width, 1);
+    else
+        tonemap_row_c(dst_r, dst_g, dst_b, src_r, src_g, src_b, s->lut, coeffs, width, 0);
 }
 
 static av_cold int init(AVFilterContext *ctx)
@@ -104,60 +242,41 @@ static av_cold int init(AVFilterContext *ctx)
     if (isnan(s->param))
         s->param = 1.0f;
 
+    s->lin_trc = AVCOL_TRC_UNSPECIFIED;
+
     return 0;
 }
 
-static float hable(float in)
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    TonemapContext *s = ctx->priv;
+
+    av_freep(&s->rgb_buf);
+}
+
+static double hable(double in)
 {
-    float a = 0.15f, b = 0.50f, c = 0.10f, d = 0.20f, e = 0.02f, f = 0.30f;
+    double a = 0.15, b = 0.50, c = 0.10, d = 0.20, e = 0.02, f = 0.30;
     return (in * (in * a + b * c) + d * e) / (in * (in * a + b) + d * f) - e / f;
 }
 
-static float mobius(float in, float j, double peak)
+static double mobius(double in, double j, double peak)
 {
-    float a, b;
+    double a, b;
 
     if (in <= j)
         return in;
 
-    a = -j * j * (peak - 1.0f) / (j * j - 2.0f * j + peak);
-    b = (j * j - 2.0f * j * peak + peak) / FFMAX(peak - 1.0f, 1e-6);
+    a = -j * j * (peak - 1.0) / (j * j - 2.0 * j + peak);
+    b = (j * j - 2.0 * j * peak + peak) / FFMAX(peak - 1.0, 1e-6);
 
-    return (b * b + 2.0f * b * j + j * j) / (b - a) * (in + a) / (in + b);
+    return (b * b + 2.0 * b * j + j * j) / (b - a) * (in + a) / (in + b);
 }
 
-#define MIX(x,y,a) (x) * (1 - (a)) + (y) * (a)
-static void tonemap(TonemapContext *s, AVFrame *out, const AVFrame *in,
-                    const AVPixFmtDescriptor *desc, int x, int y, double peak)
+/* The curves are only evaluated to build the table, in double precision
+ * as hable() subtracts nearly equal terms near black. */
+static double tonemap_curve(const TonemapContext *s, double sig, double peak)
 {
-    const float *r_in = (const float *)(in->data[0] + x * desc->comp[0].step + y * in->linesize[0]);
-    const float *b_in = (const float *)(in->data[1] + x * desc->comp[1].step + y * in->linesize[1]);
-    const float *g_in = (const float *)(in->data[2] + x * desc->comp[2].step + y * in->linesize[2]);
-    float *r_out = (float *)(out->data[0] + x * desc->comp[0].step + y * out->linesize[0]);
-    float *b_out = (float *)(out->data[1] + x * desc->comp[1].step + y * out->linesize[1]);
-    float *g_out = (float *)(out->data[2] + x * desc->comp[2].step + y * out->linesize[2]);
-    float sig, sig_orig;
-
-    /* load values */
-    *r_out = *r_in;
-    *b_out = *b_in;
-    *g_out = *g_in;
-
-    /* desaturate to prevent unnatural colors */
-    if (s->desat > 0) {
-        float luma = s->coeffs->cr * *r_in + s->coeffs->cg * *g_in + s->coeffs->cb * *b_in;
-        float overbright = FFMAX(luma - s->desat, 1e-6) / FFMAX(luma, 1e-6);
-        *r_out = MIX(*r_in, luma, overbright);
-        *g_out = MIX(*g_in, luma, overbright);
-        *b_out = MIX(*b_in, luma, overbright);
-    }
-
-    /* pick the brightest component, reducing the value range as necessary
-     * to keep the entire signal in range and preventing discoloration due to
-     * out-of-bounds clipping */
-    sig = FFMAX(FFMAX3(*r_out, *g_out, *b_out), 1e-6);
-    sig_orig = sig;
-
     switch(s->tonemap) {
     default:
     case TONEMAP_NONE:
@@ -167,11 +286,11 @@ static void tonemap(TonemapContext *s, AVFrame *out, const AVFrame *in,
         sig = sig * s->param / peak;
         break;
     case TONEMAP_GAMMA:
-        sig = sig > 0.05f ? pow(sig / peak, 1.0f / s->param)
-                          : sig * pow(0.05f / peak, 1.0f / s->param) / 0.05f;
+        sig = sig > GAMMA_KNEE ? pow(sig / peak, 1.0 / s->param)
+                               : sig * pow(GAMMA_KNEE / peak, 1.0 / s->param) / GAMMA_KNEE;
         break;
     case TONEMAP_CLIP:
-        sig = av_clipf(sig * s->param, 0, 1.0f);
+        sig = av_clipd(sig * s->param, 0, 1.0);
         break;
     case TONEMAP_HABLE:
         sig = hable(sig) / hable(peak);
@@ -183,18 +302,92 @@ static void tonemap(TonemapContext *s, AVFrame *out, const AVFrame *in,
         sig = mobius(sig, s->param, peak);
         break;
     }
+    return sig;
+}
+
+/* Sample the tone curve, so that it is not evaluated per pixel. The table
+ * has the same number of intervals in each octave of the signal, so the
+ * relative error of the interpolation does not depend on the peak. */
+static void build_lut(TonemapContext *s, double peak)
+{
+    /* cover at least four times the peak, with the knee of the gamma curve
+     * at the start of an octave */
+    const double unit = s->tonemap == TONEMAP_GAMMA ? GAMMA_KNEE : 1.0;
+    const double scale = exp2(floor(log2(unit / (4 * peak)))) / unit;
+    double prev = tonemap_curve(s, lut_start(0) / scale, peak);
+
+    for (int i = 0; i < TONEMAP_LUT_SIZE; i++) {
+        const double start = lut_start(i), end = lut_start(i + 1);
+        const double next = tonemap_curve(s, end / scale, peak);
+        s->lut[2 * i    ] = prev;
+        s->lut[2 * i + 1] = (next - prev) / (end - start);
+        prev = next;
+    }
+    s->lut_scale = scale;
+    s->lut_peak = peak;
+}
+
+static av_always_inline float lut_lookup(const float *lut, float x)
+{
+    const float f = av_clipf(x, 0.0f, 1.0f) * LIN_LUT_SIZE;
+    const int i = FFMIN((int)f, LIN_LUT_SIZE - 1);
+
+    return lut[i] + (f - i) * (lut[i + 1] - lut[i]);
+}
 
-    /* apply the computed scale factor to the color,
-     * linearly to prevent discoloration */
-    *r_out *= sig / sig_orig;
-    *g_out *= sig / sig_orig;
-    *b_out *= sig / sig_orig;
+static double eotf_st2084(double x)
+{
+    const double p = pow(x, 1.0 / ST2084_M2);
+    const double a = FFMAX(p - ST2084_C1, 0.0);
+    const double b = FFMAX(ST2084_C2 - ST2084_C3 * p, 1e-6);
+
+    return x > 0.0 ? pow(a / b, 1.0 / ST2084_M1) * ST2084_MAX_LUMINANCE / REFERENCE_WHITE : 0.0;
+}
+
+static double inverse_oetf_hlg(double x)
+{
+    return x < 0.5 ? 4.0 * x * x : exp((x - HLG_C) / HLG_A) + HLG_B;
+}
+
+static double oetf_bt709(double x)
+{
+    return x < 0.018 ? 4.5 * x : 1.099 * pow(x, 0.45) - 0.099;
+}
+
+static void build_fused_luts(TonemapContext *s, enum AVColorTransferCharacteristic trc,
+                             double peak)
+{
+    int i;
+
+    if (trc != s->lin_trc) {
+        for (i = 0; i <= LIN_LUT_SIZE; i++) {
+            const double x = (double)i / LIN_LUT_SIZE;
+            s->lin_lut[i] = trc == AVCOL_TRC_ARIB_STD_B67 ? inverse_oetf_hlg(x) : eotf_st2084(x);
+        }
+        s->lin_trc   = trc;
+        s->ootf_peak = 0;
+    }
+
+    if (trc == AVCOL_TRC_ARIB_STD_B67 && peak != s->ootf_peak) {
+        const double gamma = FFMAX(1.0, 1.2 + 0.42 * log10(peak * REFERENCE_WHITE / 1000.0));
+
+        for (i = 0; i <= LIN_LUT_SIZE; i++) {
+            const double x = (double)i / LIN_LUT_SIZE;
+            s->ootf_lut[i] = peak * pow(12.0 * x * x, gamma - 1.0) / pow(12.0, gamma);
+        }
+        s->ootf_peak = peak;
+    }
 }
 
 typedef struct ThreadData {
     AVFrame *in, *out;
-    const AVPixFmtDescriptor *desc;
-    double peak;
+    float coeffs[TONEMAP_COEFF_NB];
+    /* fused processing */
+    float yuv2rgb[3][3], rgb2rgb[3][3], rgb2yuv[3][3];
+    float src_luma[3];
+    int y_off;
+    float y_scale, uv_scale;
+    int hlg;
 } ThreadData;
 
 static int tonemap_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
@@ -203,14 +396,207 @@ static int tonemap_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs
     ThreadData *td = arg;
     AVFrame *in = td->in;
     AVFrame *out = td->out;
-    const AVPixFmtDescriptor *desc = td->desc;
     const int slice_start = (in->height * jobnr) / nb_jobs;
     const int slice_end = (in->height * (jobnr+1)) / nb_jobs;
-    double peak = td->peak;
 
+#define ROW(frame, plane) (float *)(frame->data[plane] + y * frame->linesize[plane])
     for (int y = slice_start; y < slice_end; y++)
-        for (int x = 0; x < out->width; x++)
-            tonemap(s, out, in, desc, x, y, peak);
+        tonemap_row(s, ROW(out, 0), ROW(out, 2), ROW(out, 1),
+                       ROW(in,  0), ROW(in,  2), ROW(in,  1),
+                       td->coeffs, out->width);
+#undef ROW
+
+    return 0;
+}
+
+/**
+ * Linearize, tone map and convert to 8-bit BT.709 a slice of 10-bit 4:2:0
+ * PQ or HLG input, two rows at a time.
+ */
+static int tonemap_fused_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    TonemapContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const AVFrame *in = td->in;
+    AVFrame *out = td->out;
+    const int w = in->width, h = in->height;
+    const int cw = AV_CEIL_RSHIFT(w, 1), ch = AV_CEIL_RSHIFT(h, 1);
+    const int slice_start = (ch * jobnr) / nb_jobs;
+    const int slice_end = (ch * (jobnr+1)) / nb_jobs;
+    float (*m)[3] = td->yuv2rgb, (*p)[3] = td->rgb2rgb, (*c)[3] = td->rgb2yuv;
+    float *rgb[2][3];
+    int i, x, cy;
+
+    for (i = 0; i < 6; i++)
+        rgb[i / 3][i % 3] = s->rgb_buf + (jobnr * 6 + i) * s->rgb_stride;
+
+    for (cy = slice_start; cy < slice_end; cy++) {
+        const uint16_t *src_u = (const uint16_t *)(in->data[1] + cy * in->linesize[1]);
+        const uint16_t *src_v = (const uint16_t *)(in->data[2] + cy * in->linesize[2]);
+        uint8_t *dst_u = out->data[1] + cy * out->linesize[1];
+        uint8_t *dst_v = out->data[2] + cy * out->linesize[2];
+
+        for (i = 0; i < 2; i++) {
+            const int y = FFMIN(2 * cy + i, h - 1);
+            const uint16_t *src_y = (const uint16_t *)(in->data[0] + y * in->linesize[0]);
+            uint8_t *dst_y = out->data[0] + y * out->linesize[0];
+            float *r = rgb[i][0], *g = rgb[i][1], *b = rgb[i][2];
+
+            for (x = 0; x < w; x++) {
+                const float yy = (src_y[x] - td->y_off) * td->y_scale;
+                const float u  = (src_u[x >> 1] - 512) * td->uv_scale;
+                const float v  = (src_v[x >> 1] - 512) * td->uv_scale;
+                float lr = lut_lookup(s->lin_lut, m[0][0] * yy + m[0][1] * u + m[0][2] * v);
+                float lg = lut_lookup(s->lin_lut, m[1][0] * yy + m[1][1] * u + m[1][2] * v);
+                float lb = lut_lookup(s->lin_lut, m[2][0] * yy + m[2][1] * u + m[2][2] * v);
+
+                if (td->hlg) {
+                    const float luma = td->src_luma[0] * lr + td->src_luma[1] * lg +
+                                       td->src_luma[2] * lb;
+                    const float gain = lut_lookup(s->ootf_lut, sqrtf(FFMAX(luma, 0.0f) / 12.0f));
+                    lr *= gain;
+                    lg *= gain;
+                    lb *= gain;
+                }
+
+                /* convert to the BT.709 primaries */
+                r[x] = p[0][0] * lr + p[0][1] * lg + p[0][2] * lb;
+                g[x] = p[1][0] * lr + p[1][1] * lg + p[1][2] * lb;
+                b[x] = p[2][0] * lr + p[2][1] * lg + p[2][2] * lb;
+            }
+
+            tonemap_row(s, r, g, b, r, g, b, td->coeffs, w);
+
+            for (x = 0; x < w; x++) {
+                r[x] = lut_lookup(s->delin_lut, sqrtf(FFMAX(r[x], 0.0f)));
+                g[x] = lut_lookup(s->delin_lut, sqrtf(FFMAX(g[x], 0.0f)));
+                b[x] = lut_lookup(s->delin_lut, sqrtf(FFMAX(b[x], 0.0f)));
+                dst_y[x] = av_clip_uint8(lrintf(16.0f + 219.0f * (c[0][0] * r[x] + c[0][1] * g[x] +
+                                                                 c[0][2] * b[x])));
+            }
+            if (w & 1) {
+                r[w] = r[w - 1];
+                g[w] = g[w - 1];
+                b[w] = b[w - 1];
+            }
+        }
+
+        for (x = 0; x < cw; x++) {
+            const float r = (rgb[0][0][2 * x] + rgb[0][0][2 * x + 1] + rgb[1][0][2 * x] + rgb[1][0][2 * x + 1]) * 0.25f;
+            const float g = (rgb[0][1][2 * x] + rgb[0][1][2 * x + 1] + rgb[1][1][2 * x] + rgb[1][1][2 * x + 1]) * 0.25f;
+            const float b = (rgb[0][2][2 * x] + rgb[0][2][2 * x + 1] + rgb[1][2][2 * x] + rgb[1][2][2 * x + 1]) * 0.25f;
+
+            dst_u[x] = av_clip_uint8(lrintf(128.0f + 224.0f * (c[1][0] * r + c[1][1] * g + c[1][2] * b)));
+            dst_v[x] = av_clip_uint8(lrintf(128.0f + 224.0f * (c[2][0] * r + c[2][1] * g + c[2][2] * b)));
+        }
+    }
+
+    return 0;
+}
+
+static void get_rgb2rgb_matrix(enum AVColorPrimaries in, enum AVColorPrimaries out,
+                               double rgb2rgb[3][3])
+{
+    double rgb2xyz[3][3], xyz2rgb[3][3];
+
+    ff_fill_rgb2xyz_table(&primaries_table[out], &whitepoint_table[out], rgb2xyz);
+    ff_matrix_invert_3x3(rgb2xyz, xyz2rgb);
+    ff_fill_rgb2xyz_table(&primaries_table[in], &whitepoint_table[in], rgb2xyz);
+    ff_matrix_mul_3x3(rgb2rgb, rgb2xyz, xyz2rgb);
+}
+
+static int setup_fused(AVFilterContext *ctx, ThreadData *td, AVFrame *in, AVFrame *out,
+                       double peak)
+{
+    TonemapContext *s = ctx->priv;
+    const struct LumaCoefficients *in_coeffs, *out_coeffs = &luma_coefficients[AVCOL_SPC_BT709];
+    enum AVColorTransferCharacteristic trc = in->color_trc;
+    double rgb2yuv[3][3], yuv2rgb[3][3], rgb2rgb[3][3];
+    int i, j;
+
+    if (trc == AVCOL_TRC_UNSPECIFIED) {
+        av_log(s, AV_LOG_WARNING, "Untagged transfer, assuming SMPTE ST 2084\n");
+        trc = AVCOL_TRC_SMPTE2084;
+    } else if (trc != AVCOL_TRC_SMPTE2084 && trc != AVCOL_TRC_ARIB_STD_B67) {
+        av_log(s, AV_LOG_ERROR, "Unsupported transfer '%s', fused processing "
+               "needs SMPTE ST 2084 or ARIB STD-B67 input\n", av_color_transfer_name(trc));
+        return AVERROR(EINVAL);
+    }
+
+    in_coeffs = in->colorspace == AVCOL_SPC_UNSPECIFIED ? NULL : &luma_coefficients[in->colorspace];
+    if (!in_coeffs || !in_coeffs->cr)
+        in_coeffs = &luma_coefficients[AVCOL_SPC_BT2020_NCL];
+
+    build_fused_luts(s, trc, peak);
+
+    ff_fill_rgb2yuv_table(in_coeffs, rgb2yuv);
+    ff_matrix_invert_3x3(rgb2yuv, yuv2rgb);
+    if (in->color_primaries == AVCOL_PRI_BT709) {
+        memset(rgb2rgb, 0, sizeof(rgb2rgb));
+        rgb2rgb[0][0] = rgb2rgb[1][1] = rgb2rgb[2][2] = 1.0;
+    } else {
+        get_rgb2rgb_matrix(AVCOL_PRI_BT2020, AVCOL_PRI_BT709, rgb2rgb);
+    }
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            td->yuv2rgb[i][j] = yuv2rgb[i][j];
+            td->rgb2rgb[i][j] = rgb2rgb[i][j];
+        }
+    }
+    ff_fill_rgb2yuv_table(out_coeffs, rgb2yuv);
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            td->rgb2yuv[i][j] = rgb2yuv[i][j];
+
+    td->src_luma[0] = in_coeffs->cr;
+    td->src_luma[1] = in_coeffs->cg;
+    td->src_luma[2] = in_coeffs->cb;
+    td->hlg = trc == AVCOL_TRC_ARIB_STD_B67;
+    if (in->color_range == AVCOL_RANGE_JPEG) {
+        td->y_off    = 0;
+        td->y_scale  = 1.0f / 1023;
+        td->uv_scale = 1.0f / 1023;
+    } else {
+        td->y_off    = 64;
+        td->y_scale  = 1.0f / 876;
+        td->uv_scale = 1.0f / 896;
+    }
+
+    /* the tone mapping is done in the output primaries */
+    td->coeffs[TONEMAP_COEFF_CR] = out_coeffs->cr;
+    td->coeffs[TONEMAP_COEFF_CG] = out_coeffs->cg;
+    td->coeffs[TONEMAP_COEFF_CB] = out_coeffs->cb;
+
+    out->color_trc       = AVCOL_TRC_BT709;
+    out->color_primaries = AVCOL_PRI_BT709;
+    out->colorspace      = AVCOL_SPC_BT709;
+    out->color_range     = AVCOL_RANGE_MPEG;
+    av_frame_remove_side_data(out, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL);
+    av_frame_remove_side_data(out, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA);
+
+    return 0;
+}
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    TonemapContext *s = ctx->priv;
+
+    if (!s->fused)
+        return 0;
+
+    for (int i = 0; i <= LIN_LUT_SIZE; i++) {
+        const double x = (double)i / LIN_LUT_SIZE;
+        s->delin_lut[i] = oetf_bt709(x * x);
+    }
+
+    s->nb_rgb_bufs = ff_filter_get_nb_threads(ctx);
+    /* one more sample for the chroma of odd widths */
+    s->rgb_stride  = FFALIGN(ctx->inputs[0]->w + 1, 16);
+    av_freep(&s->rgb_buf);
+    s->rgb_buf = av_malloc_array(6 * s->nb_rgb_bufs, s->rgb_stride * sizeof(*s->rgb_buf));
+    if (!s->rgb_buf)
+        return AVERROR(ENOMEM);
 
     return 0;
 }
@@ -246,10 +632,10 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
     }
 
     /* input and output transfer will be linear */
-    if (in->color_trc == AVCOL_TRC_UNSPECIFIED) {
+    if (!s->fused && in->color_trc == AVCOL_TRC_UNSPECIFIED) {
         av_log(s, AV_LOG_WARNING, "Untagged transfer, assuming linear light\n");
         out->color_trc = AVCOL_TRC_LINEAR;
-    } else if (in->color_trc != AVCOL_TRC_LINEAR)
+    } else if (!s->fused && in->color_trc != AVCOL_TRC_LINEAR)
         av_log(s, AV_LOG_WARNING, "Tonemapping works on linear light only\n");
 
     /* read peak from side data if not passed in */
@@ -260,7 +646,7 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
 
     /* load original color space even if pixel format is RGB to compute overbrights */
     s->coeffs = &luma_coefficients[in->colorspace];
-    if (s->desat > 0 && (in->colorspace == AVCOL_SPC_UNSPECIFIED || !s->coeffs)) {
+    if (!s->fused && s->desat > 0 && (in->colorspace == AVCOL_SPC_UNSPECIFIED || !s->coeffs)) {
         if (in->colorspace == AVCOL_SPC_UNSPECIFIED)
             av_log(s, AV_LOG_WARNING, "Missing color space information, ");
         else if (!s->coeffs)
@@ -270,11 +656,30 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
         s->desat = 0;
     }
 
+    if (peak != s->lut_peak)
+        build_lut(s, peak);
+
     /* do the tone map */
     td.out = out;
     td.in = in;
-    td.desc = desc;
-    td.peak = peak;
+    td.coeffs[TONEMAP_COEFF_CR]        = s->coeffs->cr;
+    td.coeffs[TONEMAP_COEFF_CG]        = s->coeffs->cg;
+    td.coeffs[TONEMAP_COEFF_CB]        = s->coeffs->cb;
+    td.coeffs[TONEMAP_COEFF_DESAT]     = s->desat;
+    td.coeffs[TONEMAP_COEFF_LUT_SCALE] = s->lut_scale;
+    if (s->fused) {
+        ret = setup_fused(ctx, &td, in, out, peak);
+        if (ret < 0) {
+            av_frame_free(&in);
+            av_frame_free(&out);
+            return ret;
+        }
+        ctx->internal->execute(ctx, tonemap_fused_slice, &td, NULL,
+                               FFMIN3(AV_CEIL_RSHIFT(in->height, 1), s->nb_rgb_bufs,
+                                      ff_filter_get_nb_threads(ctx)));
+        av_frame_free(&in);
+        return ff_filter_frame(outlink, out);
+    }
     ctx->internal->execute(ctx, tonemap_slice, &td, NULL, FFMIN(in->height, ff_filter_get_nb_threads(ctx)));
 
     /* copy/generate alpha if needed */
@@ -312,6 +717,7 @@ static const AVOption tonemap_options[] = {
     { "param",        "tonemap parameter", OFFSET(param), AV_OPT_TYPE_DOUBLE, {.dbl = NAN}, DBL_MIN, DBL_MAX, FLAGS },
     { "desat",        "desaturation strength", OFFSET(desat), AV_OPT_TYPE_DOUBLE, {.dbl = 2}, 0, DBL_MAX, FLAGS },
     { "peak",         "signal peak override", OFFSET(peak), AV_OPT_TYPE_DOUBLE, {.dbl = 0}, 0, DBL_MAX, FLAGS },
+    { "fused",        "linearize, tonemap and convert 10-bit PQ/HLG YUV to BT.709 in one pass", OFFSET(fused), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, FLAGS },
     { NULL }
 };
 
@@ -330,6 +736,7 @@ static const AVFilterPad tonemap_outputs[] = {
     {
         .name         = "default",
         .type         = AVMEDIA_TYPE_VIDEO,
+        .config_props = config_output,
     },
     { NULL }
 };
@@ -338,6 +745,7 @@ AVFilter ff_vf_tonemap = {
     .name            = "tonemap",
     .description     = NULL_IF_CONFIG_SMALL("Conversion to/from different dynamic ranges."),
     .init            = init,
+    .uninit          = uninit,
     .query_formats   = query_formats,
     .priv_size       = sizeof(TonemapContext),
     .priv_class      = &tonemap_class,
@@ -114,13 +114,21 @@ typedef struct ZScaleContext {
 
     int force_original_aspect_ratio;
 
-    void *tmp;
-    size_t tmp_size;
+    int max_threads;            ///< size of the per-thread arrays
+    int nb_threads;
+    int *jobs_ret;
+    double *in_slice_start;
+    double *in_slice_end;
+    int *out_slice_start;
+    int *out_slice_end;
+
+    void **tmp;
+    size_t *tmp_size;
 
     zimg_image_format src_format, dst_format;
     zimg_image_format alpha_src_format, alpha_dst_format;
     zimg_graph_builder_params alpha_params, params;
-    zimg_filter_graph *alpha_graph, *graph;
+    zimg_filter_graph **alpha_graph, **graph;
 
     enum AVColorSpace in_colorspace, out_colorspace;
     enum AVColorTransferCharacteristic in_trc, out_trc;
@@ -308,6 +316,24 @@ static int config_props(AVFilterLink *outlink)
            inlink->sample_aspect_ratio.num, inlink->sample_aspect_ratio.den,
            outlink->w, outlink->h, av_get_pix_fmt_name(outlink->format),
            outlink->sample_aspect_ratio.num, outlink->sample_aspect_ratio.den);
+
+    if (!s->graph) {
+        s->max_threads     = ff_filter_get_nb_threads(ctx);
+        s->jobs_ret        = av_calloc(s->max_threads, sizeof(*s->jobs_ret));
+        s->in_slice_start  = av_calloc(s->max_threads, sizeof(*s->in_slice_start));
+        s->in_slice_end    = av_calloc(s->max_threads, sizeof(*s->in_slice_end));
+        s->out_slice_start = av_calloc(s->max_threads, sizeof(*s->out_slice_start));
+        s->out_slice_end   = av_calloc(s->max_threads, sizeof(*s->out_slice_end));
+        s->tmp             = av_calloc(s->max_threads, sizeof(*s->tmp));
+        s->tmp_size        = av_calloc(s->max_threads, sizeof(*s->tmp_size));
+        s->alpha_graph     = av_calloc(s->max_threads, sizeof(*s->alpha_graph));
+        s->graph           = av_calloc(s->max_threads, sizeof(*s->graph));
+        if (!s->jobs_ret || !s->in_slice_start || !s->in_slice_end ||
+            !s->out_slice_start || !s->out_slice_end || !s->tmp ||
+            !s->tmp_size || !s->alpha_graph || !s->graph)
+            return AVERROR(ENOMEM);
+    }
+
     return 0;
 
 fail:
@@ -478,29 +504,78 @@ static void format_init(zimg_image_format *format, AVFrame *frame, const AVPixFm
     format->chroma_location = location == -1 ? convert_chroma_location(frame->chroma_location) : location;
 }
 
-static int graph_build(zimg_filter_graph **graph, zimg_graph_builder_params *params,
-                       zimg_image_format *src_format, zimg_image_format *dst_format,
-                       void **tmp, size_t *tmp_size)
+static void slice_params(ZScaleContext *s, const AVPixFmtDescriptor *odesc, int out_h, int in_h)
 {
+    /* zimg needs every output slice to cover whole chroma rows */
+    const int align = 1 << FFMAX(odesc->log2_chroma_h, 1);
+    int i;
+
+    s->out_slice_start[0] = 0;
+    for (i = 1; i < s->nb_threads; i++) {
+        int slice_end = out_h * i / s->nb_threads;
+        s->out_slice_end[i - 1] = s->out_slice_start[i] = FFALIGN(slice_end, align);
+    }
+    s->out_slice_end[s->nb_threads - 1] = out_h;
+
+    for (i = 0; i < s->nb_threads; i++) {
+        s->in_slice_start[i] = s->out_slice_start[i] * in_h / (double)out_h;
+        s->in_slice_end[i]   = s->out_slice_end[i]   * in_h / (double)out_h;
+    }
+}
+
+static int graph_build(ZScaleContext *s, int job_nr, int alpha)
+{
+    zimg_image_format src_format = s->src_format;
+    zimg_image_format dst_format = s->dst_format;
+    size_t size, alpha_size = 0;
     int ret;
-    size_t size;
 
-    zimg_filter_graph_free(*graph);
-    *graph = zimg_filter_graph_build(src_format, dst_format, params);
-    if (!*graph)
+    /* The input slice is selected through the active region, the output
+     * slice is a standalone image written at the right offset. */
+    src_format.active_region.left   = 0;
+    src_format.active_region.top    = s->in_slice_start[job_nr];
+    src_format.active_region.width  = src_format.width;
+    src_format.active_region.height = s->in_slice_end[job_nr] - s->in_slice_start[job_nr];
+    dst_format.height = s->out_slice_end[job_nr] - s->out_slice_start[job_nr];
+
+    zimg_filter_graph_free(s->graph[job_nr]);
+    s->graph[job_nr] = zimg_filter_graph_build(&src_format, &dst_format, &s->params);
+    if (!s->graph[job_nr])
         return print_zimg_error(NULL);
 
-    ret = zimg_filter_graph_get_tmp_size(*graph, &size);
+    ret = zimg_filter_graph_get_tmp_size(s->graph[job_nr], &size);
     if (ret)
         return print_zimg_error(NULL);
 
-    if (size > *tmp_size) {
-        av_freep(tmp);
-        *tmp = av_malloc(size);
-        if (!*tmp)
+    zimg_filter_graph_free(s->alpha_graph[job_nr]);
+    s->alpha_graph[job_nr] = NULL;
+    if (alpha) {
+        zimg_image_format alpha_src_format = s->alpha_src_format;
+        zimg_image_format alpha_dst_format = s->alpha_dst_format;
+
+        alpha_src_format.active_region = src_format.active_region;
+        alpha_dst_format.height = dst_format.height;
+
+        s->alpha_graph[job_nr] = zimg_filter_graph_build(&alpha_src_format, &alpha_dst_format, &s->alpha_params);
+        if (!s->alpha_graph[job_nr])
+            return print_zimg_error(NULL);
+
+        ret = zimg_filter_graph_get_tmp_size(s->alpha_graph[job_nr], &alpha_size);
+        if (ret)
+            return print_zimg_error(NULL);
+    }
+
+    /* the scratch buffer is shared by both graphs and only ever grows */
+    size = FFMAX(size, alpha_size);
+    if (size > s->tmp_size[job_nr]) {
+        av_freep(&s->tmp[job_nr]);
+        s->tmp[job_nr] = av_malloc(size);
+        if (!s->tmp[job_nr]) {
+            s->tmp_size[job_nr] = 0;
             return AVERROR(ENOMEM);
+        }
 
-        *tmp_size = size;
+        s->tmp_size[job_nr] = size;
     }
 
     return 0;
@@ -544,16 +619,64 @@ fail:
     return ret;
 }
 
+typedef struct ThreadData {
+    const AVPixFmtDescriptor *desc, *odesc;
+    AVFrame *in, *out;
+} ThreadData;
+
+static int filter_slice(AVFilterContext *ctx, void *arg, int job_nr, int n_jobs)
+{
+    ZScaleContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const AVPixFmtDescriptor *desc = td->desc;
+    const AVPixFmtDescriptor *odesc = td->odesc;
+    const int out_slice_start = s->out_slice_start[job_nr];
+    zimg_image_buffer_const src_buf = { ZIMG_API_VERSION };
+    zimg_image_buffer dst_buf = { ZIMG_API_VERSION };
+    int plane;
+
+    for (plane = 0; plane < 3; plane++) {
+        const int vsub = plane ? odesc->log2_chroma_h : 0;
+        int p = desc->comp[plane].plane;
+        src_buf.plane[plane].data   = td->in->data[p];
+        src_buf.plane[plane].stride = td->in->linesize[p];
+        src_buf.plane[plane].mask   = -1;
+
+        p = odesc->comp[plane].plane;
+        dst_buf.plane[plane].data   = td->out->data[p] + (out_slice_start >> vsub) * td->out->linesize[p];
+        dst_buf.plane[plane].stride = td->out->linesize[p];
+        dst_buf.plane[plane].mask   = -1;
+    }
+
+    if (zimg_filter_graph_process(s->graph[job_nr], &src_buf, &dst_buf, s->tmp[job_nr], 0, 0, 0, 0))
+        return print_zimg_error(ctx);
+
+    if (s->alpha_graph[job_nr]) {
+        src_buf.plane[0].data   = td->in->data[3];
+        src_buf.plane[0].stride = td->in->linesize[3];
+        src_buf.plane[0].mask   = -1;
+
+        dst_buf.plane[0].data   = td->out->data[3] + out_slice_start * td->out->linesize[3];
+        dst_buf.plane[0].stride = td->out->linesize[3];
+        dst_buf.plane[0].mask   = -1;
+
+        if (zimg_filter_graph_process(s->alpha_graph[job_nr], &src_buf, &dst_buf, s->tmp[job_nr], 0, 0, 0, 0))
+            return print_zimg_error(ctx);
+    }
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *link, AVFrame *in)
 {
-    ZScaleContext *s = link->dst->priv;
-    AVFilterLink *outlink = link->dst->outputs[0];
+    AVFilterContext *ctx = link->dst;
+    ZScaleContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(link->format);
     const AVPixFmtDescriptor *odesc = av_pix_fmt_desc_get(outlink->format);
-    zimg_image_buffer_const src_buf = { ZIMG_API_VERSION };
-    zimg_image_buffer dst_buf = { ZIMG_API_VERSION };
+    ThreadData td;
     char buf[32];
-    int ret = 0, plane;
+    int ret = 0, i;
     AVFrame *out = NULL;
 
     if ((ret = realign_frame(desc, &in)) < 0)
@@ -568,8 +691,11 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
     out->width  = outlink->w;
     out->height = outlink->h;
 
-    if(   in->width  != link->w
+    if(   !s->graph[0]
+       || in->width  != link->w
        || in->height != link->h
+       || s->dst_format.width  != out->width
+       || s->dst_format.height != out->height
        || in->format != link->format
        || s->in_colorspace != in->colorspace
        || s->in_trc  != in->color_trc
@@ -626,11 +752,6 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
         if (s->chromal != -1)
             out->chroma_location = (int)s->dst_format.chroma_location - 1;
 
-        ret = graph_build(&s->graph, &s->params, &s->src_format, &s->dst_format,
-                          &s->tmp, &s->tmp_size);
-        if (ret < 0)
-            goto fail;
-
         s->in_colorspace  = in->colorspace;
         s->in_trc         = in->color_trc;
         s->in_primaries   = in->color_primaries;
@@ -660,11 +781,20 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
             s->alpha_dst_format.depth = odesc->comp[0].depth;
             s->alpha_dst_format.pixel_type = (odesc->flags & AV_PIX_FMT_FLAG_FLOAT) ? ZIMG_PIXEL_FLOAT : odesc->comp[0].depth > 8 ? ZIMG_PIXEL_WORD : ZIMG_PIXEL_BYTE;
             s->alpha_dst_format.color_family = ZIMG_COLOR_GREY;
+        }
 
-            zimg_filter_graph_free(s->alpha_graph);
-            s->alpha_graph = zimg_filter_graph_build(&s->alpha_src_format, &s->alpha_dst_format, &s->alpha_params);
-            if (!s->alpha_graph) {
-                ret = print_zimg_error(link->dst);
+        s->nb_threads = av_clip(out->height / 16, 1, s->max_threads);
+        /* Every slice graph restarts the dither pattern and the error
+         * diffusion state, so dithered output is only stable single-threaded. */
+        if (s->dither != ZIMG_DITHER_NONE)
+            s->nb_threads = 1;
+        slice_params(s, odesc, out->height, in->height);
+
+        for (i = 0; i < s->nb_threads; i++) {
+            ret = graph_build(s, i, desc->flags & AV_PIX_FMT_FLAG_ALPHA && odesc->flags & AV_PIX_FMT_FLAG_ALPHA);
+            if (ret < 0) {
+                zimg_filter_graph_free(s->graph[0]);
+                s->graph[0] = NULL;
                 goto fail;
             }
         }
@@ -687,39 +817,21 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
               (int64_t)in->sample_aspect_ratio.den * outlink->w * link->h,
               INT_MAX);
 
-    for (plane = 0; plane < 3; plane++) {
-        int p = desc->comp[plane].plane;
-        src_buf.plane[plane].data   = in->data[p];
-        src_buf.plane[plane].stride = in->linesize[p];
-        src_buf.plane[plane].mask   = -1;
-
-        p = odesc->comp[plane].plane;
-        dst_buf.plane[plane].data   = out->data[p];
-        dst_buf.plane[plane].stride = out->linesize[p];
-        dst_buf.plane[plane].mask   = -1;
-    }
-
-    ret = zimg_filter_graph_process(s->graph, &src_buf, &dst_buf, s->tmp, 0, 0, 0, 0);
-    if (ret) {
-        ret = print_zimg_error(link->dst);
-        goto fail;
-    }
-
-    if (desc->flags & AV_PIX_FMT_FLAG_ALPHA && odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
-        src_buf.plane[0].data   = in->data[3];
-        src_buf.plane[0].stride = in->linesize[3];
-        src_buf.plane[0].mask   = -1;
+    td.desc = desc;
+    td.odesc = odesc;
+    td.in = in;
+    td.out = out;
 
-        dst_buf.plane[0].data   = out->data[3];
-        dst_buf.plane[0].stride = out->linesize[3];
-        dst_buf.plane[0].mask   = -1;
+    ctx->internal->execute(ctx, filter_slice, &td, s->jobs_ret, s->nb_threads);
 
-        ret = zimg_filter_graph_process(s->alpha_graph, &src_buf, &dst_buf, s->tmp, 0, 0, 0, 0);
-        if (ret) {
-            ret = print_zimg_error(link->dst);
+    for (i = 0; i < s->nb_threads; i++) {
+        if (s->jobs_ret[i] < 0) {
+            ret = s->jobs_ret[i];
             goto fail;
         }
-    } else if (odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
+    }
+
+    if (!(desc->flags & AV_PIX_FMT_FLAG_ALPHA) && odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
         int x, y;
 
         if (odesc->flags & AV_PIX_FMT_FLAG_FLOAT) {
@@ -748,11 +860,25 @@ fail:
 static av_cold void uninit(AVFilterContext *ctx)
 {
     ZScaleContext *s = ctx->priv;
-
-    zimg_filter_graph_free(s->graph);
-    zimg_filter_graph_free(s->alpha_graph);
+    int i;
+
+    for (i = 0; i < s->max_threads; i++) {
+        if (s->graph)
+            zimg_filter_graph_free(s->graph[i]);
+        if (s->alpha_graph)
+            zimg_filter_graph_free(s->alpha_graph[i]);
+        if (s->tmp)
+            av_freep(&s->tmp[i]);
+    }
+    av_freep(&s->jobs_ret);
+    av_freep(&s->in_slice_start);
+    av_freep(&s->in_slice_end);
+    av_freep(&s->out_slice_start);
+    av_freep(&s->out_slice_end);
     av_freep(&s->tmp);
-    s->tmp_size = 0;
+    av_freep(&s->tmp_size);
+    av_freep(&s->alpha_graph);
+    av_freep(&s->graph);
 }
 
 static int process_command(AVFilterContext *ctx, const char *cmd, const char *args,
@@ -938,4 +1064,5 @@ AVFilter ff_vf_zscale = {
     .inputs          = avfilter_vf_zscale_inputs,
     .outputs         = avfilter_vf_zscale_outputs,
     .process_command = process_command,
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -0,0 +1,75 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <string.h>
+#include "checkasm.h"
+#include "libavfilter/framerate.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem_internal.h"
+
+#define WIDTH  256 /* bytes */
+#define HEIGHT 4
+#define BUF_SIZE (WIDTH * HEIGHT)
+
+static void randomize_buffers(uint8_t *buf, int bitdepth)
+{
+    int i;
+
+    for (i = 0; i < BUF_SIZE; i += 4)
+        AV_WN32A(buf + i, rnd() & (bitdepth == 8 ? 0xffffffff : 0x0fff0fff));
+}
+
+static void check_blend_frames(int bitdepth)
+{
+    LOCAL_ALIGNED_32(uint8_t, src1,    [BUF_SIZE]);
+    LOCAL_ALIGNED_32(uint8_t, src2,    [BUF_SIZE]);
+    LOCAL_ALIGNED_32(uint8_t, dst_ref, [BUF_SIZE]);
+    LOCAL_ALIGNED_32(uint8_t, dst_new, [BUF_SIZE]);
+    FrameRateContext s = { .bitdepth = bitdepth };
+    int factor1, factor2;
+
+    declare_func(void, BLEND_FUNC_PARAMS);
+
+    ff_framerate_init(&s);
+
+    if (check_func(s.blend, "blend_frames%d", bitdepth)) {
+        randomize_buffers(src1, bitdepth);
+        randomize_buffers(src2, bitdepth);
+        factor2 = 1 + rnd() % (s.blend_factor_max - 1);
+        factor1 = s.blend_factor_max - factor2;
+
+        memset(dst_ref, 0, BUF_SIZE);
+        memset(dst_new, 0, BUF_SIZE);
+        call_ref(src1, WIDTH, src2, WIDTH, dst_ref, WIDTH, WIDTH, HEIGHT,
+                 factor1, factor2, s.blend_factor_max >> 1);
+        call_new(src1, WIDTH, src2, WIDTH, dst_new, WIDTH, WIDTH, HEIGHT,
+                 factor1, factor2, s.blend_factor_max >> 1);
+        if (memcmp(dst_ref, dst_new, BUF_SIZE))
+            fail();
+        bench_new(src1, WIDTH, src2, WIDTH, dst_new, WIDTH, WIDTH, HEIGHT,
+                  factor1, factor2, s.blend_factor_max >> 1);
+    }
+}
+
+void checkasm_check_vf_framerate(void)
+{
+    check_blend_frames(8);
+    report("blend_frames8");
+
+    check_blend_frames(16);
+    report("blend_frames16");
+}
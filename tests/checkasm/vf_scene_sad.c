@@ -0,0 +1,61 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "checkasm.h"
+#include "libavfilter/scene_sad.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem_internal.h"
+
+#define WIDTH  (256 + 13) /* not a multiple of any SIMD width */
+#define STRIDE 1024       /* bytes */
+#define HEIGHT 8
+#define BUF_SIZE (STRIDE * HEIGHT)
+
+static void randomize_buffers(uint8_t *buf)
+{
+    for (int i = 0; i < BUF_SIZE; i += 4)
+        AV_WN32A(buf + i, rnd());
+}
+
+static void check_scene_sad(void)
+{
+    LOCAL_ALIGNED_32(uint8_t, src1, [BUF_SIZE]);
+    LOCAL_ALIGNED_32(uint8_t, src2, [BUF_SIZE]);
+    uint64_t sum_ref, sum_new;
+
+    declare_func(void, SCENE_SAD_PARAMS);
+
+    if (check_func(ff_scene_sad_get_fn(8), "scene_sad")) {
+        for (int width = 13; width <= WIDTH; width += WIDTH - 13) {
+            randomize_buffers(src1);
+            randomize_buffers(src2);
+
+            call_ref(src1, STRIDE, src2, STRIDE, width, HEIGHT, &sum_ref);
+            call_new(src1, STRIDE, src2, STRIDE, width, HEIGHT, &sum_new);
+            if (sum_ref != sum_new)
+                fail();
+        }
+        bench_new(src1, STRIDE, src2, STRIDE, WIDTH, HEIGHT, &sum_new);
+    }
+}
+
+void checkasm_check_vf_scene_sad(void)
+{
+    check_scene_sad();
+    report("scene_sad");
+}
@@ -22,8 +22,72 @@
 #include <string.h>
 #include <math.h>
 #include "libavfilter/dnn/dnn_backend_native_layer_conv2d.h"
+#include "libavutil/time.h"
 
 #define EPSON 0.00001
+// bound of the error of one product of the int8 path on rand_float() data
+#define INT8_EPSON 0.004
+
+#define CLAMP_TO_EDGE(x, w) ((x) < 0 ? 0 : ((x) >= (w) ? (w - 1) : (x)))
+
+// the direct convolution the layer used before it was lowered to a matrix product
+static void conv2d_direct(float *output, const float *input, int height, int width,
+                          const ConvolutionalParams *conv_params)
+{
+    int radius = conv_params->kernel_size >> 1;
+    int src_linesize = width * conv_params->input_num;
+    int filter_linesize = conv_params->kernel_size * conv_params->input_num;
+    int filter_size = conv_params->kernel_size * filter_linesize;
+    int pad_size = (conv_params->padding_method == VALID) ? (conv_params->kernel_size - 1) / 2 * conv_params->dilation : 0;
+
+    for (int y = pad_size; y < height - pad_size; ++y) {
+        for (int x = pad_size; x < width - pad_size; ++x) {
+            for (int n_filter = 0; n_filter < conv_params->output_num; ++n_filter) {
+                if (conv_params->has_bias)
+                    output[n_filter] = conv_params->biases[n_filter];
+                else
+                    output[n_filter] = 0.f;
+
+                for (int ch = 0; ch < conv_params->input_num; ++ch) {
+                    for (int kernel_y = 0; kernel_y < conv_params->kernel_size; ++kernel_y) {
+                        for (int kernel_x = 0; kernel_x < conv_params->kernel_size; ++kernel_x) {
+                            float input_pel;
+                            if (conv_params->padding_method == SAME_CLAMP_TO_EDGE) {
+                                int y_pos = CLAMP_TO_EDGE(y + (kernel_y - radius) * conv_params->dilation, height);
+                                int x_pos = CLAMP_TO_EDGE(x + (kernel_x - radius) * conv_params->dilation, width);
+                                input_pel = input[y_pos * src_linesize + x_pos * conv_params->input_num + ch];
+                            } else {
+                                int y_pos = y + (kernel_y - radius) * conv_params->dilation;
+                                int x_pos = x + (kernel_x - radius) * conv_params->dilation;
+                                input_pel = (x_pos < 0 || x_pos >= width || y_pos < 0 || y_pos >= height) ? 0.0 :
+                                                   input[y_pos * src_linesize + x_pos * conv_params->input_num + ch];
+                            }
+
+                            output[n_filter] += input_pel * conv_params->kernel[n_filter * filter_size + kernel_y * filter_linesize +
+                                                                                kernel_x * conv_params->input_num + ch];
+                        }
+                    }
+                }
+                switch (conv_params->activation){
+                case RELU:
+                    output[n_filter] = FFMAX(output[n_filter], 0.0);
+                    break;
+                case TANH:
+                    output[n_filter] = 2.0f  / (1.0f + exp(-2.0f * output[n_filter])) - 1.0f;
+                    break;
+                case SIGMOID:
+                    output[n_filter] = 1.0f / (1.0f + exp(-output[n_filter]));
+                    break;
+                case NONE:
+                    break;
+                case LEAKY_RELU:
+                    output[n_filter] = FFMAX(output[n_filter], 0.0) + 0.2 * FFMIN(output[n_filter], 0.0);
+                }
+            }
+            output += conv_params->output_num;
+        }
+    }
+}
 
 static int test_with_same_dilate(void)
 {
@@ -59,7 +123,7 @@ static int test_with_same_dilate(void)
     print(list(output.flatten()))
     */
 
-    ConvolutionalParams params;
+    ConvolutionalParams params = { 0 };
     DnnOperand operands[2];
     int32_t input_indexes[1];
     float input[1*5*6*3] = {
@@ -96,9 +160,8 @@ static int test_with_same_dilate(void)
     };
     float bias[2] = { -1.6574852, -0.72915393 };
 
-    NativeContext ctx;
-    ctx.class = NULL;
-    ctx.options.conv2d_threads = 1;
+    NativeContext ctx = { 0 };
+    ctx.options.threads = 1;
 
     params.activation = TANH;
     params.has_bias = 1;
@@ -109,6 +172,8 @@ static int test_with_same_dilate(void)
     params.kernel_size = 3;
     params.output_num = 2;
     params.padding_method = SAME;
+    if (ff_dnn_pack_layer_conv2d(&params) < 0)
+        return 1;
 
     operands[0].data = input;
     operands[0].dims[0] = 1;
@@ -119,6 +184,8 @@ static int test_with_same_dilate(void)
 
     input_indexes[0] = 0;
     ff_dnn_execute_layer_conv2d(operands, input_indexes, 1, &params, &ctx);
+    av_freep(&params.packed_kernel);
+    av_freep(&params.packed_biases);
 
     output = operands[1].data;
     for (int i = 0; i < sizeof(expected_output) / sizeof(float); i++) {
@@ -167,7 +234,7 @@ static int test_with_valid(void)
     print(list(output.flatten()))
     */
 
-    ConvolutionalParams params;
+    ConvolutionalParams params = { 0 };
     DnnOperand operands[2];
     int32_t input_indexes[1];
     float input[1*5*6*3] = {
@@ -200,9 +267,8 @@ static int test_with_valid(void)
     };
     float bias[2] = { -0.4773722, -0.19620377 };
 
-    NativeContext ctx;
-    ctx.class = NULL;
-    ctx.options.conv2d_threads = 1;
+    NativeContext ctx = { 0 };
+    ctx.options.threads = 1;
 
     params.activation = TANH;
     params.has_bias = 1;
@@ -213,6 +279,8 @@ static int test_with_valid(void)
     params.kernel_size = 3;
     params.output_num = 2;
     params.padding_method = VALID;
+    if (ff_dnn_pack_layer_conv2d(&params) < 0)
+        return 1;
 
     operands[0].data = input;
     operands[0].dims[0] = 1;
@@ -223,6 +291,8 @@ static int test_with_valid(void)
 
     input_indexes[0] = 0;
     ff_dnn_execute_layer_conv2d(operands, input_indexes, 1, &params, &ctx);
+    av_freep(&params.packed_kernel);
+    av_freep(&params.packed_biases);
 
     output = operands[1].data;
     for (int i = 0; i < sizeof(expected_output) / sizeof(float); i++) {
@@ -237,12 +307,152 @@ static int test_with_valid(void)
     return 0;
 }
 
+static unsigned int rand_state = 1;
+
+static float rand_float(void)
+{
+    rand_state = rand_state * 1664525 + 1013904223;
+    return (rand_state >> 8) / (float)(1 << 24) - 0.5f;
+}
+
+/**
+ * Compare the layer against the direct convolution on random data,
+ * and report the time of both when bench is set.
+ */
+static int test_against_direct(int height, int width, int input_num, int output_num,
+                               int kernel_size, int dilation, DNNPaddingParam padding_method,
+                               DNNActivationFunc activation, int bench)
+{
+    ConvolutionalParams params = { 0 };
+    DnnOperand operands[2] = { 0 };
+    int32_t input_indexes[1] = { 0 };
+    NativeContext ctx = { 0 };
+    int filter_size = kernel_size * kernel_size * input_num;
+    int nb_runs = bench ? FFMAX(1, 20000000 / (height * width * filter_size * output_num)) : 1;
+    int64_t direct_time, layer_time, int8_time;
+    float *input, *expected, *output;
+    int nb_outputs, ret = 1;
+
+    params.activation = activation;
+    params.has_bias = 1;
+    params.dilation = dilation;
+    params.input_num = input_num;
+    params.kernel_size = kernel_size;
+    params.output_num = output_num;
+    params.padding_method = padding_method;
+    params.kernel = av_malloc_array(filter_size * output_num, sizeof(*params.kernel));
+    params.biases = av_malloc_array(output_num, sizeof(*params.biases));
+    input = av_malloc_array(height * width * input_num, sizeof(*input));
+    expected = av_malloc_array(height * width * output_num, sizeof(*expected));
+    if (!params.kernel || !params.biases || !input || !expected ||
+        ff_dnn_pack_layer_conv2d(&params) < 0)
+        goto end;
+
+    for (int i = 0; i < filter_size * output_num; i++)
+        params.kernel[i] = rand_float();
+    for (int i = 0; i < output_num; i++)
+        params.biases[i] = rand_float();
+    for (int i = 0; i < height * width * input_num; i++)
+        input[i] = rand_float();
+    if (ff_dnn_pack_layer_conv2d(&params) < 0)
+        goto end;
+
+    ctx.options.threads = 1;
+    operands[0].data = input;
+    operands[0].dims[0] = 1;
+    operands[0].dims[1] = height;
+    operands[0].dims[2] = width;
+    operands[0].dims[3] = input_num;
+
+    direct_time = av_gettime_relative();
+    for (int i = 0; i < nb_runs; i++)
+        conv2d_direct(expected, input, height, width, &params);
+    direct_time = av_gettime_relative() - direct_time;
+
+    layer_time = av_gettime_relative();
+    for (int i = 0; i < nb_runs; i++)
+        ff_dnn_execute_layer_conv2d(operands, input_indexes, 1, &params, &ctx);
+    layer_time = av_gettime_relative() - layer_time;
+
+    output = operands[1].data;
+    if (!output)
+        goto end;
+    nb_outputs = ff_calculate_operand_dims_count(&operands[1]);
+    for (int i = 0; i < nb_outputs; i++) {
+        if (fabs(output[i] - expected[i]) > EPSON * filter_size) {
+            printf("%dx%dx%d -> %d, kernel %d: at index %d, output: %f, expected_output: %f\n",
+                   width, height, input_num, output_num, kernel_size, i, output[i], expected[i]);
+            goto end;
+        }
+    }
+
+    if (ff_dnn_quantize_layer_conv2d(&params, 0.f) < 0)
+        goto end;
+
+    int8_time = av_gettime_relative();
+    for (int i = 0; i < nb_runs; i++)
+        ff_dnn_execute_layer_conv2d(operands, input_indexes, 1, &params, &ctx);
+    int8_time = av_gettime_relative() - int8_time;
+
+    output = operands[1].data;
+    for (int i = 0; i < nb_outputs; i++) {
+        if (fabs(output[i] - expected[i]) > INT8_EPSON * filter_size) {
+            printf("%dx%dx%d -> %d, kernel %d, int8: at index %d, output: %f, expected_output: %f\n",
+                   width, height, input_num, output_num, kernel_size, i, output[i], expected[i]);
+            goto end;
+        }
+    }
+
+    if (bench)
+        printf("%4dx%-4d %3d -> %-3d kernel %d: direct %9.3f ms, layer %9.3f ms, %5.1fx, int8 %9.3f ms, %5.1fx\n",
+               width, height, input_num, output_num, kernel_size,
+               direct_time / 1000.0 / nb_runs, layer_time / 1000.0 / nb_runs,
+               (double)direct_time / FFMAX(layer_time, 1), int8_time / 1000.0 / nb_runs,
+               (double)direct_time / FFMAX(int8_time, 1));
+    ret = 0;
+
+end:
+    av_freep(&operands[1].data);
+    av_freep(&params.kernel);
+    av_freep(&params.biases);
+    av_freep(&params.packed_kernel);
+    av_freep(&params.packed_biases);
+    if (params.int8)
+        ff_dnn_int8_uninit_params(params.int8);
+    av_freep(&params.int8);
+    av_freep(&input);
+    av_freep(&expected);
+    return ret;
+}
+
 int main(int argc, char **argv)
 {
+    // run with "bench" to compare the time of the layer with the direct convolution
+    int bench = argc > 1 && !strcmp(argv[1], "bench");
+
     if (test_with_valid())
         return 1;
     if (test_with_same_dilate())
         return 1;
 
+    // the shapes of the two tests above
+    if (test_against_direct(5, 6, 3, 2, 3, 1, VALID, TANH, bench))
+        return 1;
+    if (test_against_direct(5, 6, 3, 2, 3, 2, SAME, TANH, bench))
+        return 1;
+    // layers of the srcnn and espcn models used by the sr filter
+    if (test_against_direct(37, 29, 1, 64, 9, 1, SAME_CLAMP_TO_EDGE, RELU, bench))
+        return 1;
+    if (test_against_direct(37, 29, 64, 32, 1, 1, SAME_CLAMP_TO_EDGE, RELU, bench))
+        return 1;
+    if (test_against_direct(37, 29, 32, 1, 5, 1, SAME_CLAMP_TO_EDGE, NONE, bench))
+        return 1;
+    if (test_against_direct(41, 23, 32, 32, 3, 1, VALID, TANH, bench))
+        return 1;
+    if (test_against_direct(41, 23, 32, 4, 3, 2, SAME, SIGMOID, bench))
+        return 1;
+    if (test_against_direct(17, 9, 5, 7, 3, 1, SAME, LEAKY_RELU, bench))
+        return 1;
+
     return 0;
 }
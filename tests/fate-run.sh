@@ -366,8 +366,9 @@ refcmp_metadata(){
     refcmp=$1
     pixfmt=$2
     fuzz=${3:-0.001}
+    filter=${4:-avgblur=4}
     ffmpeg $FLAGS $ENC_OPTS \
-        -lavfi "testsrc2=size=300x200:rate=1:duration=5,format=${pixfmt},split[ref][tmp];[tmp]avgblur=4[enc];[enc][ref]${refcmp},metadata=print:file=-" \
+        -lavfi "testsrc2=size=300x200:rate=1:duration=5,format=${pixfmt},split[ref][tmp];[tmp]${filter}[enc];[enc][ref]${refcmp},metadata=print:file=-" \
         -f null /dev/null | awk -v ref=${ref} -v fuzz=${fuzz} -f ${base}/refcmp-metadata.awk -
 }
 
@@ -491,6 +492,20 @@ concat(){
     fi
 }
 
+filter_threads_match(){
+    src=$1
+    filters=$2
+    shift 2
+
+    outfile1="${outdir}/${test}.t1"
+    outfileN="${outdir}/${test}.tN"
+    cleanfiles="$cleanfiles $outfile1 $outfileN"
+
+    ffmpeg -f lavfi -i "$src" -filter_threads 1 -vf "$filters" "$@" -bitexact -f framemd5 -y $(target_path $outfile1)
+    ffmpeg -f lavfi -i "$src" -filter_threads 4 -vf "$filters" "$@" -bitexact -f framemd5 -y $(target_path $outfileN)
+    cmp -s $outfile1 $outfileN && echo match || echo mismatch
+}
+
 venc_data(){
     file=$1
     stream=$2
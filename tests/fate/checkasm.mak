@@ -30,8 +30,10 @@ FATE_CHECKASM = fate-checkasm-aacpsdsp                                  \
                 fate-checkasm-vf_blend                                  \
                 fate-checkasm-vf_colorspace                             \
                 fate-checkasm-vf_eq                                     \
+                fate-checkasm-vf_framerate                              \
                 fate-checkasm-vf_gblur                                  \
                 fate-checkasm-vf_hflip                                  \
+                fate-checkasm-vf_scene_sad                              \
                 fate-checkasm-vf_threshold                              \
                 fate-checkasm-videodsp                                  \
                 fate-checkasm-vp8dsp                                    \
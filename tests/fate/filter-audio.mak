@@ -178,6 +178,16 @@ fate-filter-pan-downmix2: tests/data/asynth-44100-11.wav
 fate-filter-pan-downmix2: SRC = $(TARGET_PATH)/tests/data/asynth-44100-11.wav
 fate-filter-pan-downmix2: CMD = framecrc -ss 3.14 -i $(SRC) -frames:a 20 -filter:a "pan=5C|c0=0.7*c0+0.7*c10|c1=c9|c2=c8|c3=c7|c4=c6"
 
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, LOUDNORM ARESAMPLE, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-loudnorm-native
+fate-filter-loudnorm-native: tests/data/asynth-44100-2.wav
+fate-filter-loudnorm-native: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-loudnorm-native: CMD = framecrc -i $(SRC) -frames:a 20 -af aresample,loudnorm=upsample=0,aresample
+
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, LOUDNORM ARESAMPLE, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-loudnorm-lookahead
+fate-filter-loudnorm-lookahead: tests/data/asynth-44100-2.wav
+fate-filter-loudnorm-lookahead: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-loudnorm-lookahead: CMD = framecrc -i $(SRC) -frames:a 20 -af aresample,loudnorm=upsample=0:lookahead=300,aresample
+
 FATE_AFILTER_SAMPLES-$(call FILTERDEMDECENCMUX, SILENCEREMOVE, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-silenceremove
 fate-filter-silenceremove: SRC = $(TARGET_SAMPLES)/audio-reference/divertimenti_2ch_96kHz_s24.wav
 fate-filter-silenceremove: CMD = framecrc -i $(SRC) -frames:a 30 -af aresample,silenceremove=start_periods=0:start_duration=0:start_threshold=0:stop_periods=-1:stop_duration=0:stop_threshold=-90dB,aresample
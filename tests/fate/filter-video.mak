@@ -122,6 +122,10 @@ FATE_FILTER-$(call ALLYES, FRAMERATE_FILTER TESTSRC2_FILTER FORMAT_FILTER) += fa
 fate-filter-framerate-12bit-up: CMD = framecrc -lavfi testsrc2=r=50:d=1,format=pix_fmts=yuv422p12le,scale,framerate=fps=60,scale -t 1 -pix_fmt yuv422p12le
 fate-filter-framerate-12bit-down: CMD = framecrc -lavfi testsrc2=r=60:d=1,format=pix_fmts=yuv422p12le,scale,framerate=fps=50,scale -t 1 -pix_fmt yuv422p12le
 
+FATE_FILTER-$(call ALLYES, FRAMERATE_FILTER TESTSRC2_FILTER FORMAT_FILTER SCALE_FILTER) += fate-filter-framerate-gbrpf32 fate-filter-framerate-grayf32
+fate-filter-framerate-gbrpf32: CMD = framecrc -lavfi testsrc2=r=2:d=10,scale,format=gbrpf32le,framerate=fps=10,scale,format=gbrp -t 1 -sws_flags +accurate_rnd+bitexact
+fate-filter-framerate-grayf32: CMD = framecrc -lavfi testsrc2=r=2:d=10,scale,format=grayf32le,framerate=fps=10,scale,format=gray -t 1 -sws_flags +accurate_rnd+bitexact
+
 FATE_FILTER-$(call ALLYES, MINTERPOLATE_FILTER TESTSRC2_FILTER) += fate-filter-minterpolate-up fate-filter-minterpolate-down
 fate-filter-minterpolate-up: CMD = framecrc -lavfi testsrc2=r=2:d=10,minterpolate=fps=10 -t 1
 fate-filter-minterpolate-down: CMD = framecrc -lavfi testsrc2=r=2:d=10,minterpolate=fps=1 -t 1
@@ -407,6 +411,13 @@ FATE_FILTER_VSYNTH-$(CONFIG_TRIM_FILTER) += $(FATE_TRIM)
 FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER UNTILE_FILTER) += fate-filter-untile
 fate-filter-untile: CMD = framecrc -lavfi testsrc2=d=1:r=2,untile=2x2
 
+FATE_FILTER-$(call ALLYES, LAVFI_INDEV TESTSRC2_FILTER FORMAT_FILTER ZSCALE_FILTER FRAMEMD5_MUXER) += fate-filter-zscale-dither-threads
+fate-filter-zscale-dither-threads: CMD = filter_threads_match testsrc2=s=320x240:r=5:d=1 format=yuv420p10,zscale=w=640:h=480:d=error_diffusion,format=yuv420p
+
+FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER FORMAT_FILTER SETPARAMS_FILTER TONEMAP_FILTER) += fate-filter-tonemap-fused-pq fate-filter-tonemap-fused-hlg
+fate-filter-tonemap-fused-pq: CMD = framecrc -lavfi testsrc2=s=320x240:r=5:d=1,format=yuv420p10,setparams=color_primaries=bt2020:color_trc=smpte2084:colorspace=bt2020nc:range=tv,tonemap=hable:fused=1
+fate-filter-tonemap-fused-hlg: CMD = framecrc -lavfi testsrc2=s=320x240:r=5:d=1,format=yuv420p10,setparams=color_primaries=bt2020:color_trc=arib-std-b67:colorspace=bt2020nc:range=tv,tonemap=mobius:fused=1
+
 FATE_FILTER_VSYNTH-$(CONFIG_UNSHARP_FILTER) += fate-filter-unsharp
 fate-filter-unsharp: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf unsharp=11:11:-1.5:11:11:-1.5
 
@@ -462,6 +473,13 @@ fate-filter-fps-down-eof-pass: CMD = framecrc -lavfi testsrc2=r=7:d=3.5,fps=3:eo
 fate-filter-fps-start-drop: CMD = framecrc -lavfi testsrc2=r=7:d=3.5,fps=3:start_time=1.5
 fate-filter-fps-start-fill: CMD = framecrc -lavfi testsrc2=r=7:d=1.5,setpts=PTS+14,fps=3:start_time=1.5
 
+FATE_FILTER-$(call ALLYES, FPS_FILTER TESTSRC2_FILTER) += fate-filter-fps-light-dup
+fate-filter-fps-light-dup: CMD = framecrc -lavfi testsrc2=r=3:d=2,fps=7:light_dup=1
+
+# only the first copy of each input frame carries its metadata
+FATE_FILTER-$(call ALLYES, FPS_FILTER TESTSRC2_FILTER METADATA_FILTER NULL_MUXER) += fate-filter-fps-light-dup-metadata
+fate-filter-fps-light-dup-metadata: CMD = ffmpeg -lavfi testsrc2=r=3:d=1,metadata=add:key=src:value=1,fps=7:light_dup=1,metadata=print:file=- -f null -
+
 FATE_FILTER_SAMPLES-$(call ALLYES, MOV_DEMUXER FPS_FILTER QTRLE_DECODER) += fate-filter-fps-cfr fate-filter-fps fate-filter-fps-r
 fate-filter-fps-cfr: CMD = framecrc -auto_conversion_filters -i $(TARGET_SAMPLES)/qtrle/apple-animation-variable-fps-bug.mov -r 30 -vsync cfr -pix_fmt yuv420p
 fate-filter-fps-r:   CMD = framecrc -auto_conversion_filters -i $(TARGET_SAMPLES)/qtrle/apple-animation-variable-fps-bug.mov -r 30 -vf fps -pix_fmt yuv420p
@@ -670,6 +688,12 @@ FATE_FILTER_VSYNTH-$(CONFIG_STEREO3D_FILTER) += $(FATE_STEREO3D)
 FATE_FILTER_VSYNTH-$(CONFIG_THUMBNAIL_FILTER) += fate-filter-thumbnail
 fate-filter-thumbnail: CMD = video_filter "scale,thumbnail=10"
 
+FATE_FILTER_VSYNTH-$(CONFIG_THUMBNAIL_FILTER) += fate-filter-thumbnail-stream
+fate-filter-thumbnail-stream: CMD = video_filter "scale,thumbnail=10:mode=stream"
+
+FATE_FILTER_VSYNTH-$(CONFIG_THUMBNAIL_FILTER) += fate-filter-thumbnail-step
+fate-filter-thumbnail-step: CMD = video_filter "scale,thumbnail=10:step=4"
+
 FATE_FILTER_VSYNTH-$(CONFIG_TILE_FILTER) += fate-filter-tile
 fate-filter-tile: CMD = video_filter "tile=3x3:nb_frames=5:padding=7:margin=2"
 
@@ -799,6 +823,15 @@ FATE_METADATA_FILTER-$(call ALLYES, $(CROPDETECT_DEPS)) += fate-filter-metadata-
 fate-filter-metadata-cropdetect: SRC = $(TARGET_SAMPLES)/filter/cropdetect.mp4
 fate-filter-metadata-cropdetect: CMD = run $(FILTER_METADATA_COMMAND) "sws_flags=+accurate_rnd+bitexact;movie='$(SRC)',cropdetect=max_outliers=3"
 
+CROPDETECT_SRC = color=black:s=400x300:r=5:d=3,format=yuv420p[bg];testsrc2=s=160x120:r=5:d=3,format=yuva420p[fg];[bg][fg]overlay=x=40+80*min(t\\,1)+40*gte(t\\,2):y=30
+CROPDETECT_LAVFI_DEPS = FFMPEG COLOR_FILTER TESTSRC2_FILTER FORMAT_FILTER OVERLAY_FILTER CROPDETECT_FILTER METADATA_FILTER NULL_MUXER
+
+FATE_FILTER-$(call ALLYES, $(CROPDETECT_LAVFI_DEPS)) += fate-filter-cropdetect-interval
+fate-filter-cropdetect-interval: CMD = ffmpeg -lavfi "$(CROPDETECT_SRC),cropdetect=round=2:interval=3,metadata=print:file=-" -f null -
+
+FATE_FILTER-$(call ALLYES, $(CROPDETECT_LAVFI_DEPS)) += fate-filter-cropdetect-stable
+fate-filter-cropdetect-stable: CMD = ffmpeg -lavfi "$(CROPDETECT_SRC),cropdetect=round=2:stable=2,metadata=print:file=-" -f null -
+
 FREEZEDETECT_DEPS = FFPROBE AVDEVICE LAVFI_INDEV MPTESTSRC_FILTER SCALE_FILTER FREEZEDETECT_FILTER
 FATE_METADATA_FILTER-$(call ALLYES, $(FREEZEDETECT_DEPS)) += fate-filter-metadata-freezedetect
 fate-filter-metadata-freezedetect: CMD = run $(FILTER_METADATA_COMMAND) "sws_flags=+accurate_rnd+bitexact;mptestsrc=r=25:d=10:m=51,freezedetect"
@@ -859,6 +892,21 @@ fate-filter-refcmp-ssim-rgb: CMD = refcmp_metadata ssim rgb24 0.015
 FATE_FILTER_SAMPLES-$(call ALLYES, $(REFCMP_DEPS) SSIM_FILTER) += fate-filter-refcmp-ssim-yuv
 fate-filter-refcmp-ssim-yuv: CMD = refcmp_metadata ssim yuv422p 0.015
 
+FATE_FILTER-$(call ALLYES, $(REFCMP_DEPS) QUALITYMETRICS_FILTER) += fate-filter-refcmp-qualitymetrics-psnr-yuv
+fate-filter-refcmp-qualitymetrics-psnr-yuv: CMD = refcmp_metadata qualitymetrics=metrics=psnr yuv422p 0.0015
+
+FATE_FILTER-$(call ALLYES, $(REFCMP_DEPS) QUALITYMETRICS_FILTER) += fate-filter-refcmp-qualitymetrics-ssim-yuv
+fate-filter-refcmp-qualitymetrics-ssim-yuv: CMD = refcmp_metadata qualitymetrics=metrics=ssim yuv422p 0.015
+
+FATE_FILTER-$(call ALLYES, $(REFCMP_DEPS) QUALITYMETRICS_FILTER) += fate-filter-refcmp-qualitymetrics-rgb
+fate-filter-refcmp-qualitymetrics-rgb: CMD = refcmp_metadata qualitymetrics=metrics=psnr+ssim gbrp 0.015
+
+FATE_FILTER-$(call ALLYES, $(REFCMP_DEPS) PSNR_FILTER FFTDNOIZ_FILTER) += fate-filter-refcmp-psnr-fftdnoiz
+fate-filter-refcmp-psnr-fftdnoiz: CMD = refcmp_metadata psnr yuv420p 0.001 fftdnoiz=sigma=8
+
+FATE_FILTER-$(call ALLYES, LAVFI_INDEV TESTSRC2_FILTER FORMAT_FILTER FFTDNOIZ_FILTER FRAMEMD5_MUXER) += fate-filter-fftdnoiz-threads
+fate-filter-fftdnoiz-threads: CMD = filter_threads_match testsrc2=s=300x200:r=5:d=1 format=yuv420p,fftdnoiz=sigma=8:prev=1:next=1
+
 FATE_SAMPLES_FFPROBE += $(FATE_METADATA_FILTER-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_FILTER_SAMPLES-yes)
 FATE_FFMPEG += $(FATE_FILTER-yes)
@@ -0,0 +1,193 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Calibrate a native DNN model for int8 inference.
+ *
+ * The model is run on sample frames, and the largest magnitude of the input
+ * of each conv2d and dense layer is appended to a copy of the model as its
+ * calibration table. When its int8 option is enabled, the native backend
+ * then runs these layers with the input scales of the table.
+ *
+ * The frames can be extracted from any video with e.g.
+ * ffmpeg -i clip.mkv -vf format=grayf32 -f rawvideo frames.raw
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/frame.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/intfloat.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
+#include "libavutil/parseutils.h"
+#include "libavutil/pixdesc.h"
+#include "libavfilter/dnn/dnn_backend_native.h"
+
+static int write_calibrated_model(const char *in_filename, const char *out_filename,
+                                  const NativeModel *native_model)
+{
+    uint8_t *data = NULL, tail[8];
+    FILE *in = NULL, *out = NULL;
+    long size, body_size;
+    int ret = 1;
+
+    in = fopen(in_filename, "rb");
+    out = fopen(out_filename, "wb");
+    if (!in || !out) {
+        fprintf(stderr, "Failed to open %s\n", !in ? in_filename : out_filename);
+        goto end;
+    }
+
+    if (fseek(in, 0, SEEK_END) < 0 || (size = ftell(in)) < 8 || fseek(in, 0, SEEK_SET) < 0)
+        goto end;
+    data = av_malloc(size);
+    if (!data || fread(data, 1, size, in) != size)
+        goto end;
+
+    /* replace the table of an already calibrated model */
+    body_size = size - 8;
+    if (native_model->has_calibration_table)
+        body_size -= 4 + 4 * native_model->layers_num;
+
+    fwrite(data, 1, body_size, out);
+    AV_WL32(tail, DNN_NATIVE_CALIBRATION_TAG);
+    fwrite(tail, 1, 4, out);
+    for (int i = 0; i < native_model->layers_num; i++) {
+        AV_WL32(tail, av_float2int(native_model->input_range[i]));
+        fwrite(tail, 1, 4, out);
+    }
+    fwrite(data + size - 8, 1, 8, out);
+
+    ret = ferror(out) ? 1 : 0;
+
+end:
+    if (in)
+        fclose(in);
+    if (out && fclose(out))
+        ret = 1;
+    av_free(data);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    const char *input_name, *output_name;
+    enum AVPixelFormat pix_fmt;
+    int width, height, output_width, output_height, frame_size;
+    DNNModel *model = NULL;
+    NativeModel *native_model;
+    AVFrame *in_frame = NULL, *out_frame = NULL;
+    uint8_t *buf = NULL;
+    char *options = NULL;
+    FILE *frames = NULL;
+    int nb_frames = 0, ret = 1;
+
+    if (argc < 8) {
+        fprintf(stderr, "usage: %s input.model output.model input_name output_name "
+                "WxH pix_fmt frames.raw [backend_options]\n"
+                "Run the native model on the raw frames (- for stdin), and write a copy\n"
+                "with the input ranges of its layers for int8 inference.\n", argv[0]);
+        return 1;
+    }
+    input_name  = argv[3];
+    output_name = argv[4];
+
+    if (av_parse_video_size(&width, &height, argv[5]) < 0) {
+        fprintf(stderr, "Invalid frame size %s\n", argv[5]);
+        return 1;
+    }
+    pix_fmt = av_get_pix_fmt(argv[6]);
+    if (pix_fmt == AV_PIX_FMT_NONE) {
+        fprintf(stderr, "Invalid pixel format %s\n", argv[6]);
+        return 1;
+    }
+
+    options = av_asprintf("calibrate=1%s%s", argc > 8 ? "&" : "", argc > 8 ? argv[8] : "");
+    if (!options)
+        return 1;
+
+    model = ff_dnn_load_model_native(argv[1], DFT_PROCESS_FRAME, options, NULL);
+    if (!model) {
+        fprintf(stderr, "Failed to load model %s\n", argv[1]);
+        goto end;
+    }
+    native_model = model->model;
+
+    if (model->get_output(model->model, input_name, width, height, output_name,
+                          &output_width, &output_height) != DNN_SUCCESS)
+        goto end;
+
+    frame_size = av_image_get_buffer_size(pix_fmt, width, height, 1);
+    in_frame  = av_frame_alloc();
+    out_frame = av_frame_alloc();
+    buf = av_malloc(frame_size);
+    if (frame_size < 0 || !in_frame || !out_frame || !buf)
+        goto end;
+
+    in_frame->format   = pix_fmt;
+    in_frame->width    = width;
+    in_frame->height   = height;
+    av_image_fill_arrays(in_frame->data, in_frame->linesize, buf, pix_fmt, width, height, 1);
+    out_frame->format  = pix_fmt;
+    out_frame->width   = output_width;
+    out_frame->height  = output_height;
+    if (av_frame_get_buffer(out_frame, 0) < 0)
+        goto end;
+
+    frames = strcmp(argv[7], "-") ? fopen(argv[7], "rb") : stdin;
+    if (!frames) {
+        fprintf(stderr, "Failed to open %s\n", argv[7]);
+        goto end;
+    }
+
+    while (fread(buf, 1, frame_size, frames) == frame_size) {
+        if (ff_dnn_execute_model_native(model, input_name, in_frame,
+                                        &output_name, 1, out_frame) != DNN_SUCCESS) {
+            fprintf(stderr, "Failed to execute the model on frame %d\n", nb_frames);
+            goto end;
+        }
+        nb_frames++;
+    }
+    if (!nb_frames) {
+        fprintf(stderr, "No complete %dx%d %s frame in %s\n",
+                width, height, av_get_pix_fmt_name(pix_fmt), argv[7]);
+        goto end;
+    }
+
+    for (int i = 0; i < native_model->layers_num; i++) {
+        if (native_model->layers[i].type == DLT_CONV2D || native_model->layers[i].type == DLT_DENSE)
+            printf("layer %d: input range %f\n", i, native_model->input_range[i]);
+    }
+    printf("%d frames\n", nb_frames);
+
+    ret = write_calibrated_model(argv[1], argv[2], native_model);
+
+end:
+    if (frames && frames != stdin)
+        fclose(frames);
+    ff_dnn_free_model_native(&model);
+    av_frame_free(&in_frame);
+    av_frame_free(&out_frame);
+    av_free(buf);
+    av_free(options);
+    return ret;
+}